@@ -1,20 +1,54 @@
 #include <cassert>
+#include <cstring>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <thread>
 
 #include "buffer/buffer_manager.h"
 #include "common/macros.h"
+#include "common/trace.h"
+#include "log/write_ahead_log.h"
 #include "storage/file.h"
 #include "storage/slotted_page.h"
 
 /*
-This is a dummy implementation of a buffer manager. It does not do any locking.
+This is a dummy implementation of a buffer manager. The page table is protected
+by a single mutex, pages are not latched: a page is only written out by
+try_flush_page() or evicted while no one has it fixed. Once the buffer is
+full, a clock over the frames picks the page to evict.
  */
 
 namespace buzzdb {
 
+BufferFrame::BufferFrame():
+				frame_id(INVALID_FRAME_ID),
+				page_id(INVALID_PAGE_ID),
+				rec_lsn(INVALID_LSN){
+}
+
 char* BufferFrame::get_data() {
-	return data.data();
+	return data.data() + BufferManager::PAGE_LSN_SIZE;
+}
+
+uint64_t BufferFrame::get_page_lsn() const {
+	std::lock_guard<std::mutex> guard(page_lsn_mutex);
+	uint64_t page_lsn;
+	memcpy(&page_lsn, data.data(), sizeof(uint64_t));
+	return page_lsn;
+}
+
+void BufferFrame::set_page_lsn(uint64_t lsn) {
+	std::lock_guard<std::mutex> guard(page_lsn_mutex);
+	uint64_t page_lsn;
+	memcpy(&page_lsn, data.data(), sizeof(uint64_t));
+	if (page_lsn == INVALID_LSN || page_lsn < lsn) {
+		memcpy(data.data(), &lsn, sizeof(uint64_t));
+	}
+	// the oldest update not yet written out, INVALID_LSN compares greatest
+	if (lsn < rec_lsn) {
+		rec_lsn = lsn;
+	}
 }
 
 
@@ -26,7 +60,7 @@ BufferManager::BufferManager(size_t page_size, size_t page_count) {
 	pool_.resize(capacity_);
 	for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
 		pool_[frame_id].reset(new BufferFrame());
-		pool_[frame_id]->data.resize(page_size_);
+		pool_[frame_id]->data.resize(PAGE_LSN_SIZE + page_size_);
 		pool_[frame_id]->page_id = INVALID_PAGE_ID;
 		pool_[frame_id]->frame_id = frame_id;
 	}
@@ -50,25 +84,34 @@ BufferFrame& BufferManager::fix_page(uint64_t page_id, bool /*exclusive*/) {
 		exit(-1);
 	}
 
+	std::lock_guard<std::mutex> lock(mutex_);
+
 	/// Check if page is in buffer
-	uint64_t page_frame_id = get_frame_id_of_page(page_id);
+	uint64_t page_frame_id = find_frame(page_id);
 	if (page_frame_id != INVALID_FRAME_ID) {
+		pool_[page_frame_id]->fix_count++;
 		return *pool_[page_frame_id];
 	}
 
 //	std::cout << "Create page: " << page_id << "\n";
 
-	// Create a new page
-	uint64_t free_frame_id = page_counter_++;
+	std::optional<TraceScope> miss_scope;
+	miss_scope.emplace(TracePhase::FIX_PAGE_MISS);
 
-	if(page_counter_ >= capacity_){
-		std::cout << "Out of space \n";
-		std::cout << page_counter_ << " " << capacity_ << "\n";
-		exit(-1);
+	// Create a new page
+	uint64_t free_frame_id;
+	if (page_counter_ + 1 < capacity_) {
+		free_frame_id = page_counter_++;
+	} else {
+		free_frame_id = evict_frame();
+		if (free_frame_id == INVALID_FRAME_ID) {
+			throw buffer_full_error();
+		}
 	}
 
 	pool_[free_frame_id]->page_id = page_id;
 	pool_[free_frame_id]->dirty = false;
+	pool_[free_frame_id]->fix_count = 1;
 
 	read_frame(free_frame_id);
 
@@ -79,27 +122,70 @@ void BufferManager::read_frame(uint64_t frame_id) {
 
 	auto segment_id = get_segment_id(pool_[frame_id]->page_id);
 	auto file_handle =
-			File::open_file(std::to_string(segment_id).c_str(), File::WRITE);
-	size_t start = get_segment_page_id(pool_[frame_id]->page_id) * page_size_;
-	
-	file_handle->read_block(start, page_size_, pool_[frame_id]->data.data());
+			File::open_file(get_segment_file_name(segment_id).c_str(), File::WRITE);
+	size_t start = get_segment_page_id(pool_[frame_id]->page_id) * (PAGE_LSN_SIZE + page_size_);
+
+	auto& frame = *pool_[frame_id];
+	frame.rec_lsn = INVALID_LSN;
+	if (start + PAGE_LSN_SIZE + page_size_ > file_handle->size()) {
+		// the page was never written
+		memset(frame.data.data(), 0, frame.data.size());
+		memcpy(frame.data.data(), &INVALID_LSN, sizeof(uint64_t));
+		return;
+	}
+	file_handle->read_block(start, PAGE_LSN_SIZE + page_size_, frame.data.data());
 }
 
 void BufferManager::write_frame(uint64_t frame_id) {
+	TraceScope scope(TracePhase::WRITE_FRAME);
+
+	// WAL: the records of the updates on the page reach the log file first
+	uint64_t page_lsn = pool_[frame_id]->get_page_lsn();
+	if (log_manager_ != nullptr && page_lsn != INVALID_LSN &&
+			page_lsn >= log_manager_->get_durable_lsn()) {
+		log_manager_->flush_log(page_lsn);
+	}
 
 	auto segment_id = get_segment_id(pool_[frame_id]->page_id);
 	auto file_handle =
-			File::open_file(std::to_string(segment_id).c_str(), File::WRITE);
-	size_t start = get_segment_page_id(pool_[frame_id]->page_id) * page_size_;
+			File::open_file(get_segment_file_name(segment_id).c_str(), File::WRITE);
+	size_t start = get_segment_page_id(pool_[frame_id]->page_id) * (PAGE_LSN_SIZE + page_size_);
+
+	file_handle->write_block(pool_[frame_id]->data.data(), start, PAGE_LSN_SIZE + page_size_);
+	pool_[frame_id]->dirty = false;
+	pool_[frame_id]->rec_lsn = INVALID_LSN;
+}
+
+uint64_t BufferManager::evict_frame() {
 
-	file_handle->write_block(pool_[frame_id]->data.data(), start, page_size_);
+	// clock over the frames that are in use
+	for (uint64_t step = 0; step < page_counter_; step++) {
+		uint64_t frame_id = clock_hand_;
+		clock_hand_ = (clock_hand_ + 1) % page_counter_;
+		auto& frame = *pool_[frame_id];
+		if (frame.fix_count > 0) {
+			continue;
+		}
+		if (frame.dirty && !steal_ && uncommitted_pages_.count(frame.page_id) > 0) {
+			continue;
+		}
+		if (frame.dirty) {
+			write_frame(frame_id);
+		}
+		return frame_id;
+	}
+	return INVALID_FRAME_ID;
 }
 
 void BufferManager::unfix_page(BufferFrame& page, bool is_dirty) {
 
+	std::lock_guard<std::mutex> lock(mutex_);
 	if (!page.dirty) {
 		page.dirty = is_dirty;
 	}
+	if (page.fix_count > 0) {
+		page.fix_count--;
+	}
 
 }
 
@@ -107,8 +193,10 @@ void  BufferManager::flush_page(uint64_t page_id){
 
 	// std::cout << "FLUSH: " << page_id << "\n";
 
+	std::lock_guard<std::mutex> lock(mutex_);
+
 	/// Check if page is in buffer
-	uint64_t page_frame_id = get_frame_id_of_page(page_id);
+	uint64_t page_frame_id = find_frame(page_id);
 	if (page_frame_id != INVALID_FRAME_ID) {
 		if (pool_[page_frame_id]->dirty == true) {
 			write_frame(page_frame_id);
@@ -117,15 +205,35 @@ void  BufferManager::flush_page(uint64_t page_id){
 
 }
 
+bool  BufferManager::try_flush_page(uint64_t page_id){
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	uint64_t page_frame_id = find_frame(page_id);
+	if (page_frame_id == INVALID_FRAME_ID) {
+		return true;
+	}
+	if (pool_[page_frame_id]->fix_count > 0) {
+		return false;
+	}
+	if (pool_[page_frame_id]->dirty == true) {
+		write_frame(page_frame_id);
+	}
+	return true;
+
+}
+
 void  BufferManager::discard_page(uint64_t page_id){
 
+	std::lock_guard<std::mutex> lock(mutex_);
+
 	/// Check if page is in buffer
-	uint64_t page_frame_id = get_frame_id_of_page(page_id);
+	uint64_t page_frame_id = find_frame(page_id);
 	if (page_frame_id != INVALID_FRAME_ID) {
 		pool_[page_frame_id].reset(new BufferFrame());
 		pool_[page_frame_id]->page_id = INVALID_PAGE_ID;
 		pool_[page_frame_id]->dirty = false;
-		pool_[page_frame_id]->data.resize(page_size_);
+		pool_[page_frame_id]->data.resize(PAGE_LSN_SIZE + page_size_);
 	}
 
 }
@@ -134,6 +242,8 @@ void  BufferManager::flush_all_pages(){
 
 //	std::cout << "FLUSH ALL PAGES \n";
 
+	std::lock_guard<std::mutex> lock(mutex_);
+
 	for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
 		if (pool_[frame_id]->dirty == true) {
 			write_frame(frame_id);
@@ -146,16 +256,107 @@ void  BufferManager::discard_all_pages(){
 
 //	std::cout << "DISCARD ALL PAGES \n";
 
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	page_counter_ = 0;
+	clock_hand_ = 0;
+	uncommitted_pages_.clear();
 	for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
 		pool_[frame_id].reset(new BufferFrame());
 		pool_[frame_id]->page_id = INVALID_PAGE_ID;
 		pool_[frame_id]->dirty = false;
-		pool_[frame_id]->data.resize(page_size_);
+		pool_[frame_id]->data.resize(PAGE_LSN_SIZE + page_size_);
 	}
 
 }
 
+size_t BufferManager::get_fixable_frame_count() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	// fix_page evicts once page_counter_ reaches the capacity
+	size_t count = page_counter_ + 1 < capacity_ ? capacity_ - page_counter_ - 1 : 0;
+	for (uint64_t frame_id = 0; frame_id < page_counter_; frame_id++) {
+		auto& frame = *pool_[frame_id];
+		if (frame.fix_count == 0 &&
+				(!frame.dirty || steal_ || uncommitted_pages_.count(frame.page_id) == 0)) {
+			count++;
+		}
+	}
+	return count;
+}
+
 uint64_t BufferManager::get_frame_id_of_page(uint64_t page_id){
+	std::lock_guard<std::mutex> lock(mutex_);
+	return find_frame(page_id);
+}
+
+void BufferManager::set_log_manager(WriteAheadLog* log_manager) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	log_manager_ = log_manager;
+}
+
+void BufferManager::set_steal(bool steal) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	steal_ = steal;
+}
+
+void BufferManager::add_uncommitted_page(uint64_t page_id) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	uncommitted_pages_[page_id]++;
+}
+
+void BufferManager::set_segment_directory(const std::string& directory) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	segment_directory_ = directory.empty() || directory.back() == '/' ? directory : directory + "/";
+}
+
+size_t BufferManager::copy_segment(uint16_t segment_id, const std::string& path) {
+	size_t page_count;
+	std::unique_ptr<File> file_handle;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		file_handle = File::open_file(get_segment_file_name(segment_id).c_str(), File::WRITE);
+		page_count = file_handle->size() / (PAGE_LSN_SIZE + page_size_);
+	}
+	auto backup_handle = File::open_file(path.c_str(), File::WRITE);
+	backup_handle->resize(page_count * (PAGE_LSN_SIZE + page_size_));
+
+	std::vector<char> page(PAGE_LSN_SIZE + page_size_);
+	for (uint64_t segment_page_id = 0; segment_page_id < page_count; segment_page_id++) {
+		uint64_t page_id = get_overall_page_id(segment_id, segment_page_id);
+		size_t start = segment_page_id * (PAGE_LSN_SIZE + page_size_);
+		while (true) {
+			std::unique_lock<std::mutex> lock(mutex_);
+			uint64_t frame_id = find_frame(page_id);
+			if (frame_id == INVALID_FRAME_ID) {
+				// pages are only written with the mutex held
+				file_handle->read_block(start, page.size(), page.data());
+				break;
+			}
+			if (pool_[frame_id]->fix_count == 0) {
+				memcpy(page.data(), pool_[frame_id]->data.data(), page.size());
+				break;
+			}
+			lock.unlock();
+			std::this_thread::yield();
+		}
+		backup_handle->write_block(page.data(), start, page.size());
+	}
+	return page_count;
+}
+
+std::string BufferManager::get_segment_file_name(uint16_t segment_id) const {
+	return segment_directory_ + std::to_string(segment_id);
+}
+
+void BufferManager::release_uncommitted_page(uint64_t page_id) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = uncommitted_pages_.find(page_id);
+	if (it != uncommitted_pages_.end() && --it->second == 0) {
+		uncommitted_pages_.erase(it);
+	}
+}
+
+uint64_t BufferManager::find_frame(uint64_t page_id){
 
 	uint64_t page_frame_id = INVALID_FRAME_ID;
 
@@ -180,6 +381,7 @@ std::vector<uint64_t> BufferManager::get_lru_list() const {
 }
 
 std::vector<uint64_t> BufferManager::get_dirty_page_ids() {
+	std::lock_guard<std::mutex> lock(mutex_);
 	std::vector<uint64_t> dirty_page_ids;
 	for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
 		if (pool_[frame_id]->dirty == true) {
@@ -189,4 +391,16 @@ std::vector<uint64_t> BufferManager::get_dirty_page_ids() {
 	return dirty_page_ids;
 }
 
+std::vector<std::pair<uint64_t, uint64_t>> BufferManager::get_dirty_page_table() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::vector<std::pair<uint64_t, uint64_t>> dirty_page_table;
+	for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
+		uint64_t rec_lsn = pool_[frame_id]->rec_lsn;
+		if (rec_lsn != INVALID_LSN) {
+			dirty_page_table.emplace_back(pool_[frame_id]->page_id, rec_lsn);
+		}
+	}
+	return dirty_page_table;
+}
+
 } // namespace buzzdb
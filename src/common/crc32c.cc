@@ -0,0 +1,98 @@
+#include "common/crc32c.h"
+
+#include <string.h>
+
+#include <array>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace buzzdb {
+
+namespace {
+
+/// reflected polynomial of CRC32C
+constexpr uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+
+constexpr std::array<uint32_t, 256> make_crc32c_table() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+constexpr std::array<uint32_t, 256> CRC32C_TABLE = make_crc32c_table();
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2"))) uint32_t crc32c_hardware(uint32_t crc, const char* data, size_t size) {
+    uint64_t state = ~crc;
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), data += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(uint64_t));
+        state = _mm_crc32_u64(state, word);
+    }
+    uint32_t state32 = static_cast<uint32_t>(state);
+    for (; size > 0; size--, data++) {
+        state32 = _mm_crc32_u8(state32, static_cast<unsigned char>(*data));
+    }
+    return ~state32;
+}
+
+bool has_crc_instructions() { return __builtin_cpu_supports("sse4.2"); }
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+
+uint32_t crc32c_hardware(uint32_t crc, const char* data, size_t size) {
+    uint32_t state = ~crc;
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), data += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(uint64_t));
+        state = __crc32cd(state, word);
+    }
+    for (; size > 0; size--, data++) {
+        state = __crc32cb(state, static_cast<unsigned char>(*data));
+    }
+    return ~state;
+}
+
+bool has_crc_instructions() { return true; }
+
+#else
+
+uint32_t crc32c_hardware(uint32_t crc, const char* data, size_t size) { return crc32c_software(crc, data, size); }
+
+bool has_crc_instructions() { return false; }
+
+#endif
+
+using Crc32cFunction = uint32_t (*)(uint32_t, const char*, size_t);
+
+Crc32cFunction select_crc32c() { return has_crc_instructions() ? crc32c_hardware : crc32c_software; }
+
+}  // namespace
+
+uint32_t crc32c_software(uint32_t crc, const char* data, size_t size) {
+    uint32_t state = ~crc;
+    for (; size > 0; size--, data++) {
+        state = CRC32C_TABLE[(state ^ static_cast<unsigned char>(*data)) & 0xFF] ^ (state >> 8);
+    }
+    return ~state;
+}
+
+uint32_t crc32c(uint32_t crc, const char* data, size_t size) {
+    static const Crc32cFunction implementation = select_crc32c();
+    return implementation(crc, data, size);
+}
+
+bool crc32c_is_hardware() { return has_crc_instructions(); }
+
+}  // namespace buzzdb
@@ -0,0 +1,70 @@
+#include "common/histogram.h"
+
+#include <algorithm>
+
+namespace buzzdb {
+
+size_t Histogram::bucket_of(uint64_t value) {
+    size_t bucket = 0;
+    while (value != 0) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+uint64_t Histogram::percentile(double quantile) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(quantile * count + 0.5));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+        seen += buckets[bucket];
+        if (seen >= rank) {
+            uint64_t upper = bucket == 0 ? 0 : bucket >= 64 ? UINT64_MAX : (uint64_t{1} << bucket) - 1;
+            return std::min(upper, max);
+        }
+    }
+    return max;
+}
+
+void AtomicHistogram::add(uint64_t value) {
+    bump(buckets[Histogram::bucket_of(value)], 1);
+    bump(count, 1);
+    bump(sum, value);
+    if (value > max.load(std::memory_order_relaxed)) {
+        max.store(value, std::memory_order_relaxed);
+    }
+}
+
+void AtomicHistogram::merge(const Histogram& histogram) {
+    for (size_t bucket = 0; bucket < Histogram::BUCKET_COUNT; bucket++) {
+        bump(buckets[bucket], histogram.buckets[bucket]);
+    }
+    bump(count, histogram.count);
+    bump(sum, histogram.sum);
+    if (histogram.max > max.load(std::memory_order_relaxed)) {
+        max.store(histogram.max, std::memory_order_relaxed);
+    }
+}
+
+void AtomicHistogram::read(Histogram& histogram) const {
+    for (size_t bucket = 0; bucket < Histogram::BUCKET_COUNT; bucket++) {
+        histogram.buckets[bucket] += buckets[bucket].load(std::memory_order_relaxed);
+    }
+    histogram.count += count.load(std::memory_order_relaxed);
+    histogram.sum += sum.load(std::memory_order_relaxed);
+    histogram.max = std::max(histogram.max, max.load(std::memory_order_relaxed));
+}
+
+void AtomicHistogram::clear() {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+}  // namespace buzzdb
@@ -0,0 +1,220 @@
+#include "common/trace.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace buzzdb {
+
+namespace {
+
+/// A slot of a ring, the fields are atomic as a dump may read a slot that
+/// is being overwritten; such a slot is dropped by the dump
+struct TraceSlot {
+    std::atomic<uint64_t> phase_and_depth{0};
+    std::atomic<uint64_t> txn_id{INVALID_TXN_ID};
+    std::atomic<uint64_t> start_ns{0};
+    std::atomic<uint64_t> duration_ns{0};
+};
+
+/// Spans and histograms of a thread. Rings outlive their threads, a new
+/// thread takes over the ring of a finished one.
+struct alignas(64) TraceRing {
+    std::array<TraceSlot, Tracer::RING_SIZE> slots;
+    /// spans recorded, the last RING_SIZE of them are in the slots
+    std::atomic<uint64_t> head{0};
+    std::array<AtomicHistogram, TRACE_PHASE_COUNT> histograms;
+    bool in_use = false;
+};
+
+/// protects the list of rings and their in_use flags
+std::mutex rings_mutex;
+
+std::vector<std::unique_ptr<TraceRing>> rings;
+
+/// Hands the ring of the calling thread back once the thread ends
+struct LocalRing {
+    TraceRing* ring = nullptr;
+
+    ~LocalRing() {
+        if (ring != nullptr) {
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            ring->in_use = false;
+        }
+    }
+};
+
+thread_local LocalRing local_ring;
+
+/// spans open on the calling thread
+thread_local uint32_t local_depth = 0;
+
+/// transaction of the innermost transaction scope of the calling thread
+thread_local uint64_t local_txn_id = INVALID_TXN_ID;
+
+TraceRing& get_local_ring() {
+    if (local_ring.ring != nullptr) {
+        return *local_ring.ring;
+    }
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (auto& ring : rings) {
+        if (!ring->in_use) {
+            local_ring.ring = ring.get();
+            break;
+        }
+    }
+    if (local_ring.ring == nullptr) {
+        rings.push_back(std::make_unique<TraceRing>());
+        local_ring.ring = rings.back().get();
+    }
+    local_ring.ring->in_use = true;
+    return *local_ring.ring;
+}
+
+bool is_txn_phase(TracePhase phase) {
+    return phase == TracePhase::START_TXN || phase == TracePhase::COMMIT_TXN || phase == TracePhase::ABORT_TXN;
+}
+
+}  // namespace
+
+std::atomic<bool> Tracer::enabled_{false};
+
+const char* get_trace_phase_name(TracePhase phase) {
+    switch (phase) {
+        case TracePhase::START_TXN:
+            return "start_txn";
+        case TracePhase::COMMIT_TXN:
+            return "commit_txn";
+        case TracePhase::ABORT_TXN:
+            return "abort_txn";
+        case TracePhase::LOG_APPEND:
+            return "log_append";
+        case TracePhase::LOG_FLUSH:
+            return "log_flush";
+        case TracePhase::LOG_RESIZE:
+            return "log_resize";
+        case TracePhase::FIX_PAGE_MISS:
+            return "fix_page_miss";
+        case TracePhase::WRITE_FRAME:
+            return "write_frame";
+        default:
+            return "invalid";
+    }
+}
+
+void Tracer::record(const TraceSpan& span) {
+    TraceRing& ring = get_local_ring();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    TraceSlot& slot = ring.slots[head % RING_SIZE];
+    slot.phase_and_depth.store(static_cast<uint64_t>(span.phase) | uint64_t{span.depth} << 8,
+                               std::memory_order_relaxed);
+    slot.txn_id.store(span.txn_id, std::memory_order_relaxed);
+    slot.start_ns.store(span.start_ns, std::memory_order_relaxed);
+    slot.duration_ns.store(span.duration_ns, std::memory_order_relaxed);
+    ring.head.store(head + 1, std::memory_order_release);
+    ring.histograms[static_cast<size_t>(span.phase)].add(span.duration_ns);
+}
+
+std::vector<TraceSpan> Tracer::dump() {
+    std::vector<TraceSpan> spans;
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (auto& ring : rings) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t first = head > RING_SIZE ? head - RING_SIZE : 0;
+        size_t count = spans.size();
+        for (uint64_t position = first; position < head; position++) {
+            TraceSlot& slot = ring->slots[position % RING_SIZE];
+            uint64_t phase_and_depth = slot.phase_and_depth.load(std::memory_order_relaxed);
+            spans.push_back(TraceSpan{static_cast<TracePhase>(phase_and_depth & 0xff),
+                                      static_cast<uint32_t>(phase_and_depth >> 8),
+                                      slot.txn_id.load(std::memory_order_relaxed),
+                                      slot.start_ns.load(std::memory_order_relaxed),
+                                      slot.duration_ns.load(std::memory_order_relaxed)});
+        }
+        // the owner may have overwritten the oldest slots meanwhile and be writing the next one
+        uint64_t end = ring->head.load(std::memory_order_acquire);
+        uint64_t valid_from = end + 1 > RING_SIZE ? end + 1 - RING_SIZE : 0;
+        uint64_t torn = std::min(head - first, valid_from > first ? valid_from - first : 0);
+        spans.erase(spans.begin() + count, spans.begin() + count + torn);
+    }
+    std::sort(spans.begin(), spans.end(),
+              [](const TraceSpan& a, const TraceSpan& b) { return a.start_ns < b.start_ns; });
+    return spans;
+}
+
+TraceHistograms Tracer::histograms() {
+    TraceHistograms histograms;
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (auto& ring : rings) {
+        for (size_t phase = 0; phase < TRACE_PHASE_COUNT; phase++) {
+            ring->histograms[phase].read(histograms[phase]);
+        }
+    }
+    return histograms;
+}
+
+void Tracer::reset() {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (auto& ring : rings) {
+        ring->head.store(0, std::memory_order_relaxed);
+        for (auto& histogram : ring->histograms) {
+            histogram.clear();
+        }
+    }
+}
+
+void Tracer::print_spans(std::ostream& out, const std::vector<TraceSpan>& spans) {
+    for (auto& span : spans) {
+        out << span.start_ns << " " << std::string(2 * span.depth, ' ') << get_trace_phase_name(span.phase);
+        if (span.txn_id != INVALID_TXN_ID) {
+            out << " txn " << span.txn_id;
+        }
+        out << " " << span.duration_ns << " ns\n";
+    }
+}
+
+void Tracer::print_histograms(std::ostream& out, const TraceHistograms& histograms) {
+    out << std::left << std::setw(16) << "phase" << std::right << std::setw(10) << "count" << std::setw(12)
+        << "mean ns" << std::setw(12) << "p50 ns" << std::setw(12) << "p99 ns" << std::setw(12) << "p99.9 ns"
+        << std::setw(12) << "max ns" << "\n";
+    for (size_t phase = 0; phase < TRACE_PHASE_COUNT; phase++) {
+        const Histogram& histogram = histograms[phase];
+        if (histogram.count == 0) {
+            continue;
+        }
+        out << std::left << std::setw(16) << get_trace_phase_name(static_cast<TracePhase>(phase)) << std::right
+            << std::setw(10) << histogram.count << std::setw(12) << static_cast<uint64_t>(histogram.mean())
+            << std::setw(12) << histogram.percentile(0.5) << std::setw(12) << histogram.percentile(0.99)
+            << std::setw(12) << histogram.percentile(0.999) << std::setw(12) << histogram.max << "\n";
+    }
+}
+
+TraceScope::TraceScope(TracePhase phase, uint64_t txn_id) : active_(Tracer::is_enabled()), phase_(phase) {
+    if (!active_) {
+        return;
+    }
+    depth_ = local_depth++;
+    outer_txn_id_ = local_txn_id;
+    txn_id_ = txn_id != INVALID_TXN_ID ? txn_id : local_txn_id;
+    if (is_txn_phase(phase)) {
+        local_txn_id = txn_id_;
+    }
+    start_ = std::chrono::steady_clock::now();
+}
+
+TraceScope::~TraceScope() {
+    if (!active_) {
+        return;
+    }
+    auto end = std::chrono::steady_clock::now();
+    local_depth--;
+    local_txn_id = outer_txn_id_;
+    Tracer::record(TraceSpan{
+        phase_, depth_, txn_id_,
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(start_.time_since_epoch()).count()),
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start_).count())});
+}
+
+}  // namespace buzzdb
@@ -1,5 +1,7 @@
 
 #include <iostream>
+#include <mutex>
+#include <shared_mutex>
 
 #include "heap/heap_file.h"
 #include "common/macros.h"
@@ -140,6 +142,27 @@ TID HeapPage::addSlot(uint32_t size) {
   return new_tid;
 }
 
+namespace {
+
+/// Copy the header and the slot array of the page, with room for one more slot
+std::vector<std::byte> copy_slot_array(BufferFrame &frame) {
+	auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
+	size_t length = sizeof(SlottedPage::Header) +
+			(page->header.slot_count + 1) * sizeof(SlottedPage::Slot);
+	auto* data = reinterpret_cast<std::byte *>(frame.get_data());
+	return std::vector<std::byte>(data, data + length);
+}
+
+/// Read a slot of the page. The header's frame pointer is stale once the
+/// page was written out and read into another frame.
+uint64_t read_slot(BufferFrame &frame, uint16_t slot_id) {
+	auto* slots = reinterpret_cast<SlottedPage::Slot *>(
+			frame.get_data() + sizeof(SlottedPage::Header));
+	return slots[slot_id].value;
+}
+
+}  // namespace
+
 HeapSegment::HeapSegment(uint16_t segment_id, LogManager &log_manager,
 		BufferManager& buffer_manager)
     : segment_id_(segment_id),
@@ -149,6 +172,7 @@ HeapSegment::HeapSegment(uint16_t segment_id, LogManager &log_manager,
 }
 
 TID HeapSegment::allocate(uint32_t record_size) {
+	std::lock_guard<std::mutex> guard(allocate_mutex_);
 
 	// Go over all pages in heap segment
 	// std::cout << "Go over all pages in heap segment \n";
@@ -161,14 +185,22 @@ TID HeapSegment::allocate(uint32_t record_size) {
 				BufferManager::get_overall_page_id(segment_id_, segment_page_itr);
 
 		BufferFrame &frame = buffer_manager_.fix_page(page_id, true);
+		std::unique_lock<std::shared_mutex> latch(frame.get_latch());
 
 		auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
 
 		if(record_size > page->header.free_space){
+			latch.unlock();
+			buffer_manager_.unfix_page(frame, false);
 			continue;
 		}
 
+		// the page may have been read into another frame
+		page->header.buffer_frame = frame.get_data();
+		auto before_img = copy_slot_array(frame);
 		TID tid = page->addSlot(record_size);
+		log_slot_array(frame, page_id, before_img);
+		latch.unlock();
 		buffer_manager_.unfix_page(frame, true);
 		return tid;
 	}
@@ -183,6 +215,10 @@ TID HeapSegment::allocate(uint32_t record_size) {
 	page_count_++;
 
 	BufferFrame& frame = buffer_manager_.fix_page(page_id, true);
+	std::unique_lock<std::shared_mutex> latch(frame.get_latch());
+	// the header of a page that was never written is zeroed
+	std::vector<std::byte> before_img(sizeof(SlottedPage::Header) + sizeof(SlottedPage::Slot));
+	memcpy(before_img.data(), frame.get_data(), before_img.size());
 
 	auto* page = new (frame.get_data())
 			SlottedPage(frame.get_data(), buffer_manager_.get_page_size());
@@ -190,30 +226,65 @@ TID HeapSegment::allocate(uint32_t record_size) {
 	page->header.overall_page_id = page_id;
 
 	TID tid = page->addSlot(record_size);
+	log_slot_array(frame, page_id, before_img);
+	latch.unlock();
 	buffer_manager_.unfix_page(frame, true);
 
 	return tid;
 }
 
-uint32_t HeapSegment::read(TID tid, std::byte* record, uint32_t capacity) const {
+/**
+ * The allocation is not part of the transaction, it is logged as a
+ * redo-only update of the header and the slot array. Redo rebuilds the
+ * slots of the pages that were not flushed at commit, a rollback leaves
+ * the slot allocated.
+ */
+void HeapSegment::log_slot_array(BufferFrame &frame, uint64_t page_id,
+		std::vector<std::byte>& before_img) {
+	uint64_t lsn = log_manager_.log_update(INVALID_TXN_ID, page_id, before_img.size(), 0,
+			before_img.data(), reinterpret_cast<std::byte *>(frame.get_data()));
+	frame.set_page_lsn(lsn);
+}
+
+uint32_t HeapSegment::read(TID tid, std::byte* record, uint32_t capacity, uint64_t txn_id) const {
+  // a snapshot or optimistic read takes no lock
+  bool snapshot_read = version_store_ != nullptr && txn_id != INVALID_TXN_ID;
+  bool occ_read = occ_manager_ != nullptr && txn_id != INVALID_TXN_ID;
+  if (lock_manager_ != nullptr && txn_id != INVALID_TXN_ID && !snapshot_read && !occ_read) {
+    lock_manager_->lock(txn_id, segment_id_, tid, LockMode::SHARED);
+  }
+
   uint64_t page_id = tid.value >> 16;
   uint64_t overall_page_id =
       BufferManager::get_overall_page_id(segment_id_, page_id);
   uint16_t slot_id = tid.value & ((1ull << 16) - 1);
 
   BufferFrame& frame = buffer_manager_.fix_page(overall_page_id, false);
-  auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
-
-//  std::cout << *page;
 
-  buzzdb::SlottedPage::Slot slot = page->getSlot(slot_id);
-
-  uint64_t value = slot.value;
+  uint64_t value;
+  {
+    std::shared_lock<std::shared_mutex> latch(frame.get_latch());
+    value = read_slot(frame, slot_id);
+  }
   uint32_t length = value << 40 >> 40;
   uint32_t offset = value << 16 >> 40;
 
   if (capacity <= length) {
-    memcpy(record, &frame.get_data()[offset], capacity);
+    if (occ_read) {
+      if (!occ_manager_->read_own_write(txn_id, segment_id_, tid, record, capacity)) {
+        uint64_t version;
+        do {
+          version = occ_manager_->begin_read(segment_id_, tid);
+          std::shared_lock<std::shared_mutex> latch(frame.get_latch());
+          memcpy(record, &frame.get_data()[offset], capacity);
+        } while (!occ_manager_->end_read(txn_id, segment_id_, tid, version));
+      }
+    } else if (snapshot_read) {
+      version_store_->read(txn_id, segment_id_, tid,
+          reinterpret_cast<std::byte*>(&frame.get_data()[offset]), record, capacity);
+    } else {
+      memcpy(record, &frame.get_data()[offset], capacity);
+    }
   } else {
     std::cout << "Capacity exceeds length \n";
     std::cout << "Length: " << length << "\n";
@@ -225,7 +296,18 @@ uint32_t HeapSegment::read(TID tid, std::byte* record, uint32_t capacity) const
   return length;
 }
 
-uint32_t HeapSegment::write(TID tid, std::byte* record, uint32_t record_size, UNUSED_ATTRIBUTE uint64_t txn_id) {
+uint32_t HeapSegment::write(TID tid, std::byte* record, uint32_t record_size, uint64_t txn_id) {
+  if (occ_manager_ != nullptr && txn_id != INVALID_TXN_ID) {
+    occ_manager_->buffer_write(txn_id, this, tid, record, record_size);
+    return 0;
+  }
+  if (lock_manager_ != nullptr && txn_id != INVALID_TXN_ID) {
+    lock_manager_->lock(txn_id, segment_id_, tid, LockMode::EXCLUSIVE);
+  }
+  return write_in_place(tid, record, record_size, txn_id);
+}
+
+uint32_t HeapSegment::write_in_place(TID tid, std::byte* record, uint32_t record_size, uint64_t txn_id) {
 
   uint64_t page_id = tid.value >> 16;
   uint64_t overall_page_id =
@@ -233,25 +315,43 @@ uint32_t HeapSegment::write(TID tid, std::byte* record, uint32_t record_size, UN
   uint16_t slot_id = tid.value & ((1ull << 16) - 1);
 
   BufferFrame& frame = buffer_manager_.fix_page(overall_page_id, true);
-  auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
 
-  buzzdb::SlottedPage::Slot slot = page->getSlot(slot_id);
-  uint64_t value = slot.value;
+  uint64_t value;
+  {
+    std::shared_lock<std::shared_mutex> latch(frame.get_latch());
+    value = read_slot(frame, slot_id);
+  }
 
   uint32_t offset = value << 16 >> 40;
-  
+
+  // keep the prior version of the whole record before changing it
+  if (version_store_ != nullptr && txn_id != INVALID_TXN_ID) {
+    uint32_t length = value << 40 >> 40;
+    try {
+      version_store_->install(txn_id, segment_id_, tid,
+          reinterpret_cast<std::byte*>(&frame.get_data()[offset]), length);
+    } catch (...) {
+      buffer_manager_.unfix_page(frame, false);
+      throw;
+    }
+  }
+
   // save before record
   std::vector<char> before_record;
 	before_record.resize(record_size);
   memcpy(before_record.data(), &frame.get_data()[offset], record_size);
 
-  // update
-  memcpy(&frame.get_data()[offset], record, record_size);
+  // Add an update record
+  uint64_t lsn = log_manager_.log_update(txn_id, overall_page_id, record_size, offset, reinterpret_cast<std::byte *> (before_record.data()), record);
 
-  buffer_manager_.unfix_page(frame, true);
+  // update, optimistic readers copy the record without a lock
+  {
+    std::unique_lock<std::shared_mutex> latch(frame.get_latch());
+    memcpy(&frame.get_data()[offset], record, record_size);
+  }
+  frame.set_page_lsn(lsn);
 
-  // Add an update record
-  log_manager_.log_update(txn_id, overall_page_id, record_size, offset, reinterpret_cast<std::byte *> (before_record.data()), record);
+  buffer_manager_.unfix_page(frame, true);
 
   return 0;
 }
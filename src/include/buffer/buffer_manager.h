@@ -6,23 +6,66 @@
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <atomic>
+#include <string>
+#include <utility>
 
 namespace buzzdb {
 
+class WriteAheadLog;
+
 class BufferFrame {
 private:
     friend class BufferManager;
 
     uint64_t frame_id;
     uint64_t page_id;
+    /// page LSN header followed by the page's data
     std::vector<char> data;
 
-	bool dirty;
+	bool dirty = false;
+
+    /// number of fix_page() calls not yet matched by unfix_page()
+    size_t fix_count = 0;
+
+    /// LSN of the first log record that dirtied the page since it was last
+    /// written, INVALID_LSN if the page is clean
+    std::atomic<uint64_t> rec_lsn;
+
+    /// protects the page LSN header, which writers of different records on
+    /// the page update concurrently
+    mutable std::mutex page_lsn_mutex;
+
+    /// latch on the page's header and slot array, see get_latch()
+    std::shared_mutex latch;
 
 public:
+    BufferFrame();
+
     /// Returns a pointer to this page's data.
     char* get_data();
+
+    /// Returns the LSN of the last log record applied to the page,
+    /// INVALID_LSN if no logged update was ever applied.
+    uint64_t get_page_lsn() const;
+
+    /// Sets the page LSN after applying the log record `lsn` to the page.
+    /// The page LSN never moves backwards: an update that got an older LSN
+    /// but finished after a newer one leaves the newer one in place, and
+    /// lowers the recovery LSN to it instead.
+    void set_page_lsn(uint64_t lsn);
+
+    /// Returns the recovery LSN of the page.
+    uint64_t get_rec_lsn() const { return rec_lsn; }
+
+    /// Returns the latch on the page's header and slot array. It is taken
+    /// shared to read a slot and exclusively to change them, and around
+    /// writing a record that optimistic readers copy without a record lock.
+    /// fix_page() does not take it since a thread may fix the same page
+    /// more than once.
+    std::shared_mutex& get_latch() { return latch; }
 };
 
 
@@ -50,17 +93,22 @@ public:
     /// Returns size of a page
     size_t get_page_size() { return page_size_; }
 
+    /// Size of the page LSN header that precedes every page on disk
+    static constexpr size_t PAGE_LSN_SIZE = sizeof(uint64_t);
+
     /// Returns a reference to a `BufferFrame` object for a given page id. When
     /// the page is not loaded into memory, it is read from disk. Otherwise the
     /// loaded page is used.
-    /// When the page cannot be loaded because the buffer is full, throws the
-    /// exception `buffer_full_error`.
+    /// When the buffer is full, an unfixed page is evicted, dirty pages only
+    /// if they hold no uncommitted updates or steal is enabled. When no page
+    /// can be evicted, throws the exception `buffer_full_error`.
     /// Is thread-safe w.r.t. other concurrent calls to `fix_page()` and
     /// `unfix_page()`.
     /// @param[in] page_id   Page id of the page that should be loaded.
-    /// @param[in] exclusive If `exclusive` is true, the page is locked
-    ///                      exclusively. Otherwise it is locked
-    ///                      non-exclusively (shared).
+    /// @param[in] exclusive Whether the caller is going to change the page.
+    ///                      The page is not latched, callers take
+    ///                      `BufferFrame::get_latch()` around reading or
+    ///                      changing its slot array.
     BufferFrame& fix_page(uint64_t page_id, bool exclusive);
 
     /// Takes a `BufferFrame` reference that was returned by an earlier call to
@@ -97,8 +145,16 @@ public:
         return (static_cast<uint64_t>(segment_id) << 48) | segment_page_id;
     }
 
+    /// Writes the page to disk if it is dirty. Like every write of a page,
+    /// it first makes the log durable up to the page LSN.
     void  flush_page(uint64_t page_id);
 
+    /// Writes the page to disk unless it is fixed, as its data may be
+    /// changing. Returns false if the page was fixed.
+    /// Is thread-safe w.r.t. other concurrent calls to `fix_page()` and
+    /// `unfix_page()`.
+    bool  try_flush_page(uint64_t page_id);
+
     void  discard_page(uint64_t page_id);
 
     void  flush_all_pages();
@@ -107,11 +163,47 @@ public:
 
     std::vector<uint64_t> get_dirty_page_ids();
 
+    /// Returns the page id and the recovery LSN of the pages with logged
+    /// updates that were not written yet
+    std::vector<std::pair<uint64_t, uint64_t>> get_dirty_page_table();
+
+    /// Returns the number of pages that can be fixed at the same time on top
+    /// of those fixed now: the free frames and the frames whose pages can be
+    /// evicted
+    size_t get_fixable_frame_count() const;
+
     /// Returns the frame id of the frame containing the page if it is
     /// present in the buffer
     /// Otherwise, returns INVALID_FRAME_ID
     uint64_t get_frame_id_of_page(uint64_t page_id);
 
+    /// Sets the log whose records the written pages must not get ahead of,
+    /// nullptr to write pages without it. The log manager must have flushed
+    /// its buffer whenever it fixes a page with its latch held.
+    void set_log_manager(WriteAheadLog* log_manager);
+
+    /// Allow evicting dirty pages that hold uncommitted updates (steal), the
+    /// default. Without steal, such pages stay in the buffer until their
+    /// transactions end. Explicit flushes are not affected.
+    void set_steal(bool steal);
+
+    /// Marks the page as holding uncommitted updates of a transaction, each
+    /// call is matched by a call to `release_uncommitted_page()` once the
+    /// transaction ended
+    void add_uncommitted_page(uint64_t page_id);
+
+    void release_uncommitted_page(uint64_t page_id);
+
+    /// Keep the segment files in `directory` instead of the working
+    /// directory, e.g. for a standby running next to its primary
+    void set_segment_directory(const std::string& directory);
+
+    /// Copies the pages of the segment file to `path` while they are in use,
+    /// for an online backup. A page that is loaded is copied from its frame
+    /// once no one has it fixed, the others from disk. Pages that were never
+    /// written are not copied. Returns the number of pages copied.
+    size_t copy_segment(uint16_t segment_id, const std::string& path);
+
 private:
     size_t capacity_;
 
@@ -121,6 +213,31 @@ private:
 
     uint64_t page_counter_ = 0;
 
+    /// frame at which the search for a page to evict continues
+    uint64_t clock_hand_ = 0;
+
+    WriteAheadLog* log_manager_ = nullptr;
+
+    bool steal_ = true;
+
+    /// number of active transactions that updated each page
+    std::unordered_map<uint64_t, size_t> uncommitted_pages_;
+
+    /// prefix of the segment file names, empty or ending with a slash
+    std::string segment_directory_;
+
+    std::string get_segment_file_name(uint16_t segment_id) const;
+
+    /// protects the page table and the fix counts, the frames' data is
+    /// protected by fixing the page
+    mutable std::mutex mutex_;
+
+    uint64_t find_frame(uint64_t page_id);
+
+    /// Returns an unfixed frame whose page can be evicted, INVALID_FRAME_ID
+    /// if there is none. Dirty pages are written.
+    uint64_t evict_frame();
+
     void read_frame(uint64_t frame_id);
 
     void write_frame(uint64_t frame_id);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace buzzdb {
+
+/// Extend `crc` with the CRC32C (Castagnoli) of `size` bytes at `data`.
+/// Start with a crc of 0. Uses the SSE4.2 or ARMv8 CRC instructions when the
+/// CPU has them, the table-driven implementation otherwise.
+uint32_t crc32c(uint32_t crc, const char* data, size_t size);
+
+/// Table-driven CRC32C, same results as `crc32c()`
+uint32_t crc32c_software(uint32_t crc, const char* data, size_t size);
+
+/// Returns true if `crc32c()` uses the CRC instructions of the CPU
+bool crc32c_is_hardware();
+
+}  // namespace buzzdb
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace buzzdb {
+
+/// Add to a counter only the calling thread writes, without a read-modify-write
+inline void bump(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+/// Histogram with power of two buckets: bucket 0 counts the zeros, bucket i
+/// the values in [2^(i-1), 2^i)
+struct Histogram {
+    static constexpr size_t BUCKET_COUNT = 65;
+
+    std::array<uint64_t, BUCKET_COUNT> buckets{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    /// Returns the bucket counting `value`
+    static size_t bucket_of(uint64_t value);
+
+    /// Returns the upper bound of the bucket holding the value at `quantile`
+    /// (between 0 and 1), 0 if the histogram is empty
+    uint64_t percentile(double quantile) const;
+
+    double mean() const { return count == 0 ? 0 : static_cast<double>(sum) / count; }
+};
+
+/// A Histogram that one thread adds to while others read it
+struct AtomicHistogram {
+    std::array<std::atomic<uint64_t>, Histogram::BUCKET_COUNT> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+
+    /// Count `value`, only the owning thread adds
+    void add(uint64_t value);
+
+    /// Add the counts of `histogram`, only the owning thread merges
+    void merge(const Histogram& histogram);
+
+    /// Add the counts to `histogram`
+    void read(Histogram& histogram) const;
+
+    void clear();
+};
+
+}  // namespace buzzdb
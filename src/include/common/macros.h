@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <limits>
+#include <string>
 
 namespace buzzdb {
 
@@ -14,6 +16,8 @@ constexpr uint64_t INVALID_NODE_ID = std::numeric_limits<uint64_t>::max();
 
 constexpr uint64_t INVALID_TXN_ID = std::numeric_limits<uint64_t>::max();
 
+constexpr uint64_t INVALID_LSN = std::numeric_limits<uint64_t>::max();
+
 constexpr uint64_t INVALID_FIELD = std::numeric_limits<uint64_t>::max();
 
 constexpr uint64_t REGISTER_SIZE = 16 + 1;  // null delimiter
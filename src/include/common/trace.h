@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "common/histogram.h"
+#include "common/macros.h"
+
+namespace buzzdb {
+
+/// The phases of a transaction that are traced, across the transaction
+/// manager, the log and the buffer manager
+enum class TracePhase : uint8_t {
+    START_TXN,
+    COMMIT_TXN,
+    ABORT_TXN,
+    /// a log_* call appending records, the wait for the log latch included
+    LOG_APPEND,
+    /// a write of the log buffer to the log file
+    LOG_FLUSH,
+    /// a resize of the log file before a write
+    LOG_RESIZE,
+    /// a fix_page of a page that was not in the buffer, eviction and read included
+    FIX_PAGE_MISS,
+    /// a write of a page to its segment file
+    WRITE_FRAME,
+};
+
+constexpr size_t TRACE_PHASE_COUNT = 8;
+
+/// Returns the name of a phase as the dumps print it
+const char* get_trace_phase_name(TracePhase phase);
+
+/// A timed phase, the spans a thread records within another one are nested in it
+struct TraceSpan {
+    TracePhase phase;
+    /// spans open on the thread when it started, 0 for an outermost span
+    uint32_t depth;
+    /// transaction of the innermost enclosing transaction span, INVALID_TXN_ID if none
+    uint64_t txn_id;
+    /// nanoseconds of the steady clock
+    uint64_t start_ns;
+    uint64_t duration_ns;
+};
+
+/// Latencies of the spans per TracePhase, in nanoseconds
+using TraceHistograms = std::array<Histogram, TRACE_PHASE_COUNT>;
+
+/// Collects the spans of all threads. Every thread records into its own ring
+/// of the last RING_SIZE spans and its own histograms, without a shared
+/// cache line; a dump reads all of them. Tracing is off by default, a span
+/// then costs a relaxed load.
+class Tracer {
+   public:
+    /// Spans kept per thread
+    static constexpr size_t RING_SIZE = 4096;
+
+    static void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    static bool is_enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    /// Record a span of the calling thread
+    static void record(const TraceSpan& span);
+
+    /// Returns the spans in the rings ordered by their start. Spans recorded
+    /// while the dump runs may be missing.
+    static std::vector<TraceSpan> dump();
+
+    /// Returns the latency histograms of all spans recorded since the last reset
+    static TraceHistograms histograms();
+
+    /// Empty the rings and the histograms. Spans recorded concurrently may survive.
+    static void reset();
+
+    /// Print a span per line
+    static void print_spans(std::ostream& out, const std::vector<TraceSpan>& spans);
+
+    /// Print the count, mean, p50, p99, p99.9 and max latency of each phase
+    static void print_histograms(std::ostream& out, const TraceHistograms& histograms);
+
+   private:
+    static std::atomic<bool> enabled_;
+};
+
+/// Times the phase from its construction to its destruction if tracing is
+/// enabled. A START_TXN, COMMIT_TXN or ABORT_TXN scope tags the spans nested
+/// in it with its transaction.
+class TraceScope {
+   public:
+    explicit TraceScope(TracePhase phase, uint64_t txn_id = INVALID_TXN_ID);
+
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+   private:
+    bool active_;
+    TracePhase phase_;
+    uint32_t depth_ = 0;
+    uint64_t txn_id_ = INVALID_TXN_ID;
+    /// transaction of the enclosing scope, restored at the end
+    uint64_t outer_txn_id_ = INVALID_TXN_ID;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace buzzdb
@@ -4,10 +4,14 @@
 #include <vector>
 #include <atomic>
 #include <cstddef>
+#include <mutex>
 
 #include "buffer/buffer_manager.h"
 #include "log/log_manager.h"
 #include "storage/slotted_page.h"  // for TID
+#include "transaction/lock_manager.h"
+#include "transaction/occ_manager.h"
+#include "transaction/version_store.h"
 #include "common/macros.h"
 
 namespace buzzdb {
@@ -87,15 +91,28 @@ public:
 	/// @param[in] tid          The TID that identifies the record.
 	/// @param[in] record       The buffer that is read into.
 	/// @param[in] capacity     The capacity of the buffer that is read into.
-	uint32_t read(TID tid, std::byte *record, uint32_t capacity) const;
+	/// @param[in] txn_id       The reading transaction. With an OCC manager,
+	/// it reads its own writes and records the version it read otherwise. With a version store,
+	/// it reads the version of its snapshot without a lock, otherwise it
+	/// takes a shared lock on the record if the segment has a lock manager.
+	uint32_t read(TID tid, std::byte *record, uint32_t capacity,
+			uint64_t txn_id = INVALID_TXN_ID) const;
 
 	/// Write a record.
 	/// @param[in] tid          The TID that identifies the record.
 	/// @param[in] record       The buffer that is written.
 	/// @param[in] record_size  The capacity of the buffer that is written.
-	/// @param[in] txn_id		The txn_id for the transaction
+	/// @param[in] txn_id		The txn_id for the transaction, which takes an
+	/// exclusive lock on the record if the segment has a lock manager and
+	/// keeps its prior version if the segment has a version store. Both
+	/// throw `txn_abort_error` when the transaction must abort. With an
+	/// OCC manager, the write is buffered until the commit instead.
 	uint32_t write(TID tid, std::byte* record, uint32_t record_size, uint64_t txn_id = INVALID_TXN_ID);
 
+	/// Write a record in place and log it, without taking a lock or
+	/// buffering the write. Installs the writes of optimistic transactions.
+	uint32_t write_in_place(TID tid, std::byte* record, uint32_t record_size, uint64_t txn_id);
+
 	/// The segment id
 	uint16_t segment_id_;
 
@@ -107,6 +124,24 @@ public:
 
 	/// Number of pages in segment
 	uint64_t page_count_;
+
+	/// Serializes allocate(), which grows the segment and changes the slot
+	/// arrays of its pages
+	std::mutex allocate_mutex_;
+
+	/// Record locks of the transactions, nullptr if they take none
+	LockManager *lock_manager_ = nullptr;
+
+	/// Prior versions of the records for snapshot reads, nullptr if none are kept
+	VersionStore *version_store_ = nullptr;
+
+	/// Read and write sets of optimistic transactions, nullptr if they are not used
+	OccManager *occ_manager_ = nullptr;
+
+private:
+	/// Log the changes of an allocation to the header and the slot array of the page,
+	/// `before_img` holds them before the allocation
+	void log_slot_array(BufferFrame &frame, uint64_t page_id, std::vector<std::byte>& before_img);
 };
 
 std::ostream &operator<<(std::ostream &os, HeapSegment const &s);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "buffer/buffer_manager.h"
+#include "log/log_manager.h"
+
+namespace buzzdb {
+
+/// An online backup: copies of the segment files taken while transactions
+/// run. A copied page may miss updates logged after the backup began and
+/// hold some logged while it ran, the log in [start_lsn, end_lsn) makes the
+/// copies consistent. A restore can rebuild the state as of any point from
+/// end_lsn on, as long as the log from start_lsn on is kept: archive the
+/// segments of the SegmentedLogFile, see
+/// `SegmentedLogFile::set_archive_directory()`.
+///
+/// The manifest file in the backup directory holds:
+///   start_lsn | end_lsn | count | count * segment_id | crc
+struct BackupManifest {
+    /// redo of the copied pages starts here
+    uint64_t start_lsn = INVALID_LSN;
+    /// durable log once the last page was copied
+    uint64_t end_lsn = INVALID_LSN;
+    std::vector<uint16_t> segment_ids;
+};
+
+/// Outcome of a restore
+struct RestoreResult {
+    /// end of the replayed log, the restored state is as of the record before it
+    uint64_t restored_lsn = 0;
+    /// bytes of log replayed
+    uint64_t log_bytes = 0;
+    /// time spent copying the backup and the log and replaying it
+    double seconds = 0;
+
+    /// Returns the restore throughput in MB/s of replayed log
+    double get_throughput() const { return seconds > 0 ? log_bytes / seconds / 1e6 : 0; }
+};
+
+/// Copy the segment files `segment_ids` to `directory` while transactions
+/// keep running and write the manifest. Returns the manifest.
+BackupManifest create_backup(LogManager& log_manager, BufferManager& buffer_manager,
+                             const std::vector<uint16_t>& segment_ids, const std::string& directory);
+
+/// Read the manifest of the backup in `directory`. Throws std::runtime_error
+/// if it is missing or corrupt.
+BackupManifest read_backup_manifest(const std::string& directory);
+
+/// Where and to which point a backup is restored
+struct RestoreOptions {
+    /// directory of the backup
+    std::string backup_directory;
+    /// segments archived by the log since the backup, may be empty
+    std::string archive_directory;
+    /// directory of the SegmentedLogFile, holds the segments that were not archived yet
+    std::string log_directory;
+    /// size of the log segments
+    size_t segment_size = 0;
+    /// the restored segment files and the restored log in its `log`
+    /// subdirectory are created here
+    std::string target_directory;
+    /// the records up to this LSN are replayed
+    uint64_t target_lsn = INVALID_LSN;
+    /// the replay stops at the first commit after this time, in microseconds since the epoch
+    uint64_t target_time = LogManager::NO_TARGET_TIME;
+};
+
+/// Rebuild the database as of the target of `options` from a backup and the
+/// archived and live log segments. The segment files of the backup are
+/// copied to the target directory, `buffer_manager` is pointed at it and
+/// must not hold pages. The segments holding the log from the begin of the
+/// backup to the target are copied to the restored log, which is replayed
+/// by `LogManager::restore()` and ends with a checkpoint, so the restored
+/// database opens without recovery work.
+/// Throws std::runtime_error if the log does not reach the end of the backup.
+RestoreResult restore_backup(const RestoreOptions& options, BufferManager& buffer_manager);
+
+}  // namespace buzzdb
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "buffer/buffer_manager.h"
+#include "log/log_manager.h"
+
+namespace buzzdb {
+
+/// Runs fuzzy checkpoints in a background thread. A checkpoint starts once
+/// enough log was written since the last one or the interval elapsed (and
+/// some log was written). The pages of a checkpoint are flushed at the rate
+/// allowed by the I/O budget, so foreground transactions don't see a burst
+/// of writes.
+class Checkpointer {
+   public:
+    /// Constructor. The thread starts with `start()`.
+    Checkpointer(LogManager& log_manager, BufferManager& buffer_manager);
+
+    /// Destructor. Stops the thread.
+    ~Checkpointer();
+
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+
+    /// Checkpoint after `bytes` of log, 0 disables the trigger
+    void set_log_volume_trigger(uint64_t bytes) { log_volume_trigger_ = bytes; }
+
+    /// Checkpoint after `interval`, 0 disables the trigger
+    void set_interval(std::chrono::milliseconds interval) { interval_ = interval; }
+
+    /// Limit the page flushes to `bytes_per_second`, 0 means no limit
+    void set_io_budget(uint64_t bytes_per_second) { io_budget_ = bytes_per_second; }
+
+    /// Default log volume between two checkpoints
+    static constexpr uint64_t DEFAULT_LOG_VOLUME_TRIGGER = 16 << 20;
+
+    /// Default interval between two checkpoints
+    static constexpr std::chrono::milliseconds DEFAULT_INTERVAL{30000};
+
+    /// How often the thread looks at the triggers
+    static constexpr std::chrono::milliseconds POLL_INTERVAL{10};
+
+    /// Start the thread
+    void start();
+
+    /// Stop the thread, a running checkpoint is completed without throttling
+    void stop();
+
+    /// Run a checkpoint now and wait for it
+    void request_checkpoint();
+
+    /// Returns the number of completed checkpoints
+    size_t get_checkpoint_count();
+
+   private:
+    void run();
+
+    /// Run a fuzzy checkpoint, flushing its pages within the I/O budget
+    void checkpoint();
+
+    LogManager& log_manager_;
+
+    BufferManager& buffer_manager_;
+
+    uint64_t log_volume_trigger_ = DEFAULT_LOG_VOLUME_TRIGGER;
+
+    std::chrono::milliseconds interval_ = DEFAULT_INTERVAL;
+
+    uint64_t io_budget_ = 0;
+
+    std::thread thread_;
+
+    std::mutex mutex_;
+
+    /// wakes up the thread
+    std::condition_variable wake_up_;
+
+    /// signals a completed checkpoint
+    std::condition_variable checkpoint_done_;
+
+    bool stopping_ = false;
+
+    bool requested_ = false;
+
+    bool running_ = false;
+
+    size_t checkpoint_count_ = 0;
+
+    /// LSN at the begin of the last checkpoint
+    uint64_t last_checkpoint_lsn_ = 0;
+
+    std::chrono::steady_clock::time_point last_checkpoint_time_;
+};
+
+}  // namespace buzzdb
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <zlib.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "storage/file.h"
+
+namespace buzzdb {
+
+/// Compresses the log written through it with zlib. The offsets of the file
+/// stay the LSNs, only the file underneath holds the compressed bytes.
+///
+/// Every write appends a chunk:   raw_size | stored_size | crc | deflated bytes
+/// The chunks of a block form one deflate stream, each one ending with a
+/// sync flush, so later records are compressed against the earlier ones of
+/// the block while every write is complete on its own. A block is decompressed
+/// as a whole, the first chunk of a block has BLOCK_START_FLAG set in its raw
+/// size. crc is the CRC32C of the LSN of the chunk, its sizes and its bytes.
+///
+/// Opening the file scans the chunks and stops at the first torn one. The
+/// appends after that start a new block.
+class CompressedLogFile : public File {
+   public:
+    /// Constructor.
+    /// @param[in] file        The file holding the compressed log.
+    /// @param[in] block_size  Raw size after which a new block is started.
+    /// @param[in] level       zlib compression level.
+    explicit CompressedLogFile(std::unique_ptr<File> file, size_t block_size = DEFAULT_BLOCK_SIZE,
+                               int level = Z_BEST_SPEED);
+
+    /// Destructor.
+    ~CompressedLogFile() override;
+
+    CompressedLogFile(const CompressedLogFile&) = delete;
+    CompressedLogFile& operator=(const CompressedLogFile&) = delete;
+
+    /// Default raw size of a block
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 64 << 10;
+
+    static constexpr uint32_t BLOCK_START_FLAG = 1u << 31;
+
+    /// raw_size | stored_size | crc
+    static constexpr size_t CHUNK_HEADER_SIZE = 3 * sizeof(uint32_t);
+
+    Mode get_mode() const override { return file_->get_mode(); }
+
+    /// Returns the end of the log
+    size_t size() const override;
+
+    /// Moves the end of the log. A block cut by it is compressed again.
+    void resize(size_t new_size) override;
+
+    /// Reads [offset, offset + size), decompressing the blocks it spans
+    void read_block(size_t offset, size_t size, char* block) override;
+
+    /// Appends a chunk, `offset` must not be before the end of the written log
+    void write_block(const char* block, size_t offset, size_t size) override;
+
+    /// Returns the size of the file holding the compressed log
+    size_t get_stored_size() const;
+
+   private:
+    struct Block {
+        uint64_t lsn;
+        uint64_t raw_size;
+        uint64_t physical_offset;
+        uint64_t physical_size;
+    };
+
+    /// Scan the chunks of the file underneath
+    void open();
+
+    /// Start a new deflate stream
+    void start_block();
+
+    /// Compress and append a chunk to the last block
+    void append_chunk(const char* data, size_t size);
+
+    /// Returns the raw bytes of the block at `index`
+    const std::vector<char>& get_block(size_t index);
+
+    std::unique_ptr<File> file_;
+
+    size_t block_size_;
+
+    mutable std::mutex mutex_;
+
+    z_stream deflate_stream_;
+
+    /// blocks in LSN order
+    std::vector<Block> blocks_;
+
+    /// whether the last block is open for appends, it is not after opening the file
+    bool block_open_ = false;
+
+    /// raw bytes of the open block
+    std::vector<char> open_block_;
+
+    /// the last decompressed block
+    size_t cached_block_ = SIZE_MAX;
+    std::vector<char> cached_block_data_;
+
+    /// end of the written chunks
+    uint64_t written_size_ = 0;
+
+    uint64_t physical_size_ = 0;
+
+    /// end of the log, past the written chunks after a resize
+    uint64_t size_ = 0;
+
+    std::vector<char> chunk_buffer_;
+};
+
+}  // namespace buzzdb
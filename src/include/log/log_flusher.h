@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "log/log_manager.h"
+
+namespace buzzdb {
+
+/// Writes the log buffer to the log file in a background thread. The commit
+/// records of asynchronous commits wait in the log buffer, the flusher bounds
+/// the time they may be lost in a crash; LogManager::set_max_unflushed_bytes
+/// bounds their volume.
+class LogFlusher {
+   public:
+    /// Constructor. The thread starts with `start()`.
+    explicit LogFlusher(LogManager& log_manager);
+
+    /// Destructor. Stops the thread.
+    ~LogFlusher();
+
+    LogFlusher(const LogFlusher&) = delete;
+    LogFlusher& operator=(const LogFlusher&) = delete;
+
+    /// Flush the log buffer every `interval`
+    void set_interval(std::chrono::milliseconds interval) { interval_ = interval; }
+
+    /// Default interval between two flushes
+    static constexpr std::chrono::milliseconds DEFAULT_INTERVAL{10};
+
+    /// Start the thread
+    void start();
+
+    /// Stop the thread, the log buffer is flushed a last time
+    void stop();
+
+   private:
+    void run();
+
+    LogManager& log_manager_;
+
+    std::chrono::milliseconds interval_ = DEFAULT_INTERVAL;
+
+    std::thread thread_;
+
+    std::mutex mutex_;
+
+    /// wakes up the thread
+    std::condition_variable wake_up_;
+
+    bool stopping_ = false;
+};
+
+}  // namespace buzzdb
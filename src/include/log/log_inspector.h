@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <ostream>
+
+#include "log/log_manager.h"
+#include "log/log_reader.h"
+#include "log/log_stats.h"
+#include "storage/file.h"
+
+namespace buzzdb {
+
+/// Returns the name of a record type as the log tool prints it
+const char* get_log_record_type_name(LogManager::LogRecordType type);
+
+/// Selects the records a LogInspector looks at, an empty field matches all
+struct LogFilter {
+    std::optional<uint64_t> txn_id;
+    /// only update and compensation records have a page
+    std::optional<uint64_t> page_id;
+
+    bool matches(const LogRecordView& record) const;
+};
+
+/// Records of a transaction found in the log
+struct TxnLogSummary {
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    /// update and compensation records
+    uint64_t page_writes = 0;
+    uint64_t first_lsn = INVALID_LSN;
+    uint64_t last_lsn = INVALID_LSN;
+    /// the log ends with the transaction still running if neither is set
+    bool committed = false;
+    bool aborted = false;
+};
+
+/// Statistics of the records a LogInspector decoded
+struct LogSummary {
+    /// records and bytes of the matching records per LogRecordType
+    std::array<uint64_t, LOG_RECORD_TYPE_COUNT> records{};
+    std::array<uint64_t, LOG_RECORD_TYPE_COUNT> bytes{};
+    /// update records logged with their changed byte ranges only
+    uint64_t delta_updates = 0;
+    /// per transaction, the redo-only records of INVALID_TXN_ID included
+    std::map<uint64_t, TxnLogSummary> txns;
+    uint64_t start_lsn = 0;
+    /// end of the last valid record, a torn or corrupt tail stops the scan
+    uint64_t end_lsn = 0;
+
+    uint64_t total_records() const;
+    uint64_t total_bytes() const;
+};
+
+/// Decode and replay timing of a dry-run redo
+struct RedoTiming {
+    /// bytes of log and records decoded
+    uint64_t bytes = 0;
+    uint64_t records = 0;
+    /// update and compensation records applied to the in-memory pages
+    uint64_t applied = 0;
+    uint64_t pages = 0;
+    /// the log decoded without applying it
+    double decode_seconds = 0;
+    /// the log decoded and applied
+    double redo_seconds = 0;
+
+    /// Returns the decode throughput in MB/s
+    double get_decode_throughput() const { return decode_seconds > 0 ? bytes / decode_seconds / 1e6 : 0; }
+
+    /// Returns the redo throughput in MB/s
+    double get_redo_throughput() const { return redo_seconds > 0 ? bytes / redo_seconds / 1e6 : 0; }
+};
+
+/// Reads a log file for the log tool: prints its records, summarizes them
+/// per type and per transaction and times a redo. The log is decoded by a
+/// LogReader, in chunks that are prefetched while the previous one is decoded.
+class LogInspector {
+   public:
+    /// Constructor.
+    /// @param[in] log_file   The log file, it is only read.
+    /// @param[in] start_lsn  LSN of the first record, e.g. the start of a segmented log.
+    /// @param[in] chunk_size Size of the reads issued to the log file.
+    LogInspector(File* log_file, uint64_t start_lsn = 0,
+                 size_t chunk_size = LogManager::DEFAULT_LOG_READER_CHUNK_SIZE);
+
+    /// Only look at the records `filter` matches
+    void set_filter(const LogFilter& filter) { filter_ = filter; }
+
+    /// Decode the log and summarize the matching records, printing each one
+    /// to `out` unless it is null
+    LogSummary scan(std::ostream* out = nullptr);
+
+    /// Decode the log twice, the second time applying the matching update
+    /// and compensation records to in-memory pages, as the redo pass would
+    /// without the buffer manager and the disk
+    RedoTiming time_redo();
+
+    /// Print a record on one line
+    static void print_record(std::ostream& out, const LogRecordView& record);
+
+    /// Print the per-type statistics and the transaction outcomes, with a
+    /// line per transaction if `per_txn` is set
+    static void print_summary(std::ostream& out, const LogSummary& summary, bool per_txn);
+
+    /// Print the throughput of a dry-run redo
+    static void print_redo_timing(std::ostream& out, const RedoTiming& timing);
+
+   private:
+    File* log_file_;
+
+    uint64_t start_lsn_;
+
+    size_t chunk_size_;
+
+    LogFilter filter_;
+};
+
+}  // namespace buzzdb
@@ -1,15 +1,26 @@
 #pragma once
 
 #include <atomic>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include "buffer/buffer_manager.h"
+#include "common/macros.h"
+#include "log/log_stats.h"
+#include "log/write_ahead_log.h"
 #include "storage/test_file.h"
 
 namespace buzzdb {
 
-class LogManager {
+class SegmentedLogFile;
+
+struct LogRecordView;
+
+class LogManager : public WriteAheadLog {
    public:
     enum class LogRecordType {
         INVALID_RECORD_TYPE,
@@ -20,66 +31,334 @@ class LogManager {
         CHECKPOINT_RECORD,
         BEGIN_FUZZY_CHECKPOINT_RECORD,
         END_FUZZY_CHECKPOINT_RECORD,
+        COMPENSATION_RECORD,
     };
 
-    /// Constructor.
+    /// Constructor. With a SegmentedLogFile, checkpoints update its master
+    /// record and recycle the segments that are no longer needed, and
+    /// recovery starts at the last checkpoint.
+    /// The public functions are thread-safe, the fuzzy checkpoint functions
+    /// may be called by a Checkpointer thread while transactions are running.
     LogManager(File* log_file);
 
     /// Destructor.
-    ~LogManager();
+    ~LogManager() override;
 
     /// Add an abort record
     void log_abort(uint64_t txn_id, BufferManager& buffer_manager);
 
-    /// Add a commit record
-    void log_commit(uint64_t txn_id);
+    /// Add a commit record, returns its LSN. An asynchronous commit returns
+    /// once the record is in the log buffer, it becomes durable with the
+    /// next flush of the log.
+    uint64_t log_commit(uint64_t txn_id, bool async = false);
+
+    /// Write the log buffer to the log file unless the record at `lsn` is
+    /// already durable, by default the whole log buffer is written
+    void flush_log(uint64_t lsn = INVALID_LSN) override;
 
-    /// Add an update record
-    void log_update(uint64_t txn_id, uint64_t page_id, uint64_t length, uint64_t offset,
+    /// Returns the end of the durable log, the records before it survive a crash.
+    /// Does not take the latch.
+    uint64_t get_durable_lsn() override;
+
+    /// Add an update record, returns its LSN
+    uint64_t log_update(uint64_t txn_id, uint64_t page_id, uint64_t length, uint64_t offset,
                     std::byte* before_img, std::byte* after_img);
 
-    /// Add a txn begin record
+    /// Add a txn begin record. With lazy begins, nothing is logged until the
+    /// first update of the transaction.
     void log_txn_begin(uint64_t txn_id);
 
-    /// Add a log checkpoint record
+    /// Add a log checkpoint record with the active transaction table
     void log_checkpoint(BufferManager& buffer_manager);
 
     /// Add a log fuzzy checkpoint begin record, returns the number of pages to be flushed
     size_t log_fuzzy_checkpoint_begin(BufferManager& buffer_manager);
 
     /// Perform a fuzzy checkpoint step by flushing a page (unless it was already flushed). First step is 0.
-    void log_fuzzy_checkpoint_do_step(BufferManager& buffer_manager, size_t step);
+    /// Returns false if the page was skipped because it is fixed, it is then
+    /// part of the dirty page table of the end record.
+    bool log_fuzzy_checkpoint_do_step(BufferManager& buffer_manager, size_t step);
 
-    /// Add a log fuzzy checkpoint end record
+    /// Add a log fuzzy checkpoint end record with the active transaction table
+    /// and the dirty page table
     void log_fuzzy_checkpoint_end();
 
-    /// recovery
+    /// Returns the LSN the next record will get
+    uint64_t get_current_lsn();
+
+    /// ARIES recovery: analysis, redo and undo passes. Throws
+    /// `std::runtime_error` if a record of a loser cannot be read back.
     void recovery(BufferManager& buffer_manager);
 
-    /// rollback a txn
+    /// rollback a txn by following its backward chain, writing compensation records.
+    /// Throws `std::runtime_error` if a record of the chain cannot be read back.
     void rollback_txn(uint64_t txn_id, BufferManager& buffer_manager);
 
+    /// Returns a savepoint of the transaction: the LSN of its last record,
+    /// INVALID_LSN if it logged nothing yet
+    uint64_t create_savepoint(uint64_t txn_id);
+
+    /// Roll back the updates the transaction logged after the savepoint with
+    /// compensation records, newest first. The transaction keeps running, a
+    /// later abort only rolls back what is left. Throws like `rollback_txn()`.
+    void rollback_to_savepoint(uint64_t txn_id, uint64_t savepoint_lsn, BufferManager& buffer_manager);
+
     /// Get log records
     uint64_t get_total_log_records();
 
     /// Get log records of a given type
     uint64_t get_total_log_records_of_type(LogRecordType type);
 
+    /// Returns the record and byte counts per type, the writes to the log
+    /// file with a sample of their latencies and the group commit sizes.
+    /// Does not take the latch.
+    LogStatsSnapshot get_stats() const { return stats_.snapshot(); }
+
     /// reset the state, used to simulate crash
     void reset(File* log_file);
 
+    /// Set the per-transaction memory budget (in bytes) of the in-memory undo buffer.
+    /// Transactions whose before-images exceed it are rolled back from the log file.
+    void set_undo_buffer_budget(size_t budget) { undo_buffer_budget_ = budget; }
+
+    /// Default per-transaction undo buffer budget
+    static constexpr size_t DEFAULT_UNDO_BUFFER_BUDGET = 1 << 20;
+
+    /// Set the number of threads of the redo pass. With more than one thread the
+    /// updates are applied by workers that each own a partition of the page
+    /// ids and keep its pages fixed, while the log is decoded. A dirty page
+    /// table larger than the buffer is redone in waves of pages that fit.
+    void set_redo_threads(size_t redo_threads) { redo_threads_ = redo_threads; }
+
+    /// Number of update records the parallel redo decodes before handing them
+    /// to the workers, it decodes the next batch while they apply one
+    static constexpr size_t REDO_BATCH_SIZE = 4096;
+
+    /// Set the size of the chunks in which recovery and rollbacks read the log file
+    void set_log_reader_chunk_size(size_t chunk_size) { log_reader_chunk_size_ = chunk_size; }
+
+    /// Default size of the chunks read from the log file
+    static constexpr size_t DEFAULT_LOG_READER_CHUNK_SIZE = 1 << 20;
+
+    /// Flush the log buffer once it holds `bytes`, which bounds the commits
+    /// an asynchronous commit may lose
+    void set_max_unflushed_bytes(size_t bytes) { max_unflushed_bytes_ = bytes; }
+
+    /// Default size of the log buffer that triggers a flush
+    static constexpr size_t DEFAULT_MAX_UNFLUSHED_BYTES = 64 << 10;
+
+    /// Enable or disable delta update records. When enabled, an update whose
+    /// images differ in few bytes is logged with the changed byte ranges only.
+    void set_delta_updates(bool delta_updates) { delta_updates_ = delta_updates; }
+
+    /// Enable or disable lazy begins. When enabled, the begin record of a
+    /// transaction is written with its first update record; a transaction
+    /// that commits or aborts without an update logs nothing, and its commit
+    /// returns INVALID_LSN. Set it while no transaction is running.
+    void set_lazy_begin(bool lazy_begin) { lazy_begin_ = lazy_begin; }
+
+    /// Called with the bytes of the log at `lsn` once they were written to the
+    /// log file, with the latch held
+    using FlushListener = std::function<void(uint64_t lsn, const char* data, size_t size)>;
+
+    /// Pass the durable log from `start_lsn` on to `listener`, then every
+    /// write to the log file. Appends wait while the durable log is read.
+    /// An empty listener stops the calls.
+    void set_flush_listener(FlushListener listener, uint64_t start_lsn = 0);
+
+    /// Apply the update and compensation records in [start_lsn, end_lsn) to
+    /// the pages that are behind them, like the redo pass does. Returns the
+    /// end of the last complete record, a hot standby continues from there
+    /// as more log arrives.
+    uint64_t redo_log(uint64_t start_lsn, uint64_t end_lsn, BufferManager& buffer_manager);
+
+    /// Flush the log and return the LSN the redo of an online backup that
+    /// starts copying pages now must start at: no update before it is
+    /// missing on disk, and no transaction that is active began before it.
+    uint64_t log_backup_begin(BufferManager& buffer_manager);
+
+    /// Commit time (microseconds since the epoch) that a restore does not stop at
+    static constexpr uint64_t NO_TARGET_TIME = UINT64_MAX;
+
+    /// Point-in-time restore of the pages of an online backup, started at its
+    /// begin LSN. A single sequential pass over the log from `start_lsn`
+    /// applies the records up to `target_lsn` to the pages that are behind
+    /// them and rebuilds the active transaction table. The pass stops early
+    /// at the first commit after `target_time`. The log is then cut after
+    /// the last replayed record and the transactions that did not commit
+    /// by then are rolled back.
+    /// Returns the end of the replayed log.
+    uint64_t restore(uint64_t start_lsn, uint64_t target_lsn, uint64_t target_time,
+                     BufferManager& buffer_manager);
+
    private:
+    /// A mutex that does not prevent copying the log manager, used to
+    /// simulate crashes. A copy gets its own mutex.
+    struct Latch : std::mutex {
+        Latch() = default;
+        Latch(const Latch&) : std::mutex() {}
+        Latch& operator=(const Latch&) { return *this; }
+    };
+
+    /// An LSN that is read without the latch and copied with the log manager
+    struct AtomicLsn : std::atomic<uint64_t> {
+        AtomicLsn(uint64_t lsn = 0) : std::atomic<uint64_t>(lsn) {}
+        AtomicLsn(const AtomicLsn& other) : std::atomic<uint64_t>(other.load()) {}
+        AtomicLsn& operator=(const AtomicLsn& other) {
+            store(other.load());
+            return *this;
+        }
+        AtomicLsn& operator=(uint64_t lsn) {
+            store(lsn);
+            return *this;
+        }
+    };
+
+    /// Entry of the dirty page table rebuilt by the analysis pass
+    struct DirtyPageEntry {
+        /// LSN of the first record that may not be on disk
+        uint64_t rec_lsn;
+        /// LSN of the first record of the page after the running fuzzy checkpoint began
+        uint64_t first_lsn_since_fuzzy_checkpoint;
+    };
+
+    using DirtyPageTable = std::unordered_map<uint64_t, DirtyPageEntry>;
+
+    /// A before-image captured by log_update, stored in UndoBuffer::images
+    struct UndoEntry {
+        /// undo next LSN of the compensation record
+        uint64_t prev_lsn;
+        uint64_t page_id;
+        uint64_t offset;
+        uint64_t length;
+        size_t image_offset;
+    };
+
+    /// In-memory undo log of a transaction, applied directly on abort
+    struct UndoBuffer {
+        std::vector<UndoEntry> entries;
+        std::vector<std::byte> images;
+        /// set once the budget is exceeded, the log file is then used for the rollback
+        bool spilled = false;
+    };
+
+    /// Apply the before-images of the undo buffer in reverse order
+    void apply_undo_buffer(uint64_t txn_id, const UndoBuffer& undo_buffer, BufferManager& buffer_manager);
+
+    /// Write a compensation record and apply the before image of an update
+    void compensate(uint64_t txn_id, uint64_t page_id, uint64_t length, uint64_t offset,
+                    const char* before_img, uint64_t undo_next_lsn, BufferManager& buffer_manager);
+
+    /// Undo an update record read from the log with a compensation record
+    void undo_update(const LogRecordView& record, BufferManager& buffer_manager);
+
+    /// Start encoding a record into the record buffer, chained to the last record of the txn
+    void begin_record(LogRecordType type, uint64_t txn_id);
+
+    /// Append the record buffer to the log, returns the LSN of the record.
+    /// Unless `flush` is false, the record and the log buffer before it are
+    /// written to the log file.
+    uint64_t end_record(bool flush = true);
+
+    /// Append the begin record of a transaction and create its undo buffer, with the latch held
+    void append_txn_begin(uint64_t txn_id, bool flush);
+
+    /// Write the log buffer to the log file
+    void flush_log_buffer();
+
+    /// Returns the first LSN still in the log file
+    uint64_t get_log_start_lsn() const;
+
+    /// Append the active transaction table to the record buffer
+    void append_active_txn_table();
+
+    /// Add the tables of a checkpoint record to txn_id_to_last_lsn and `dirty_page_table`
+    void load_checkpoint_tables(const LogRecordView& record, DirtyPageTable& dirty_page_table);
+
+    /// Point the master record at the checkpoint starting at `checkpoint_lsn` and recycle the
+    /// segments before it, before `min_rec_lsn` and before the first record of the active transactions
+    void truncate_log(uint64_t checkpoint_lsn, uint64_t min_rec_lsn);
+
+    /// rollback_txn without taking the latch, stopping at the record at
+    /// `savepoint_lsn` unless it is INVALID_LSN
+    void rollback_txn_chain(uint64_t txn_id, BufferManager& buffer_manager,
+                            uint64_t savepoint_lsn = INVALID_LSN);
+
+    /// Rebuild the active transaction table and the dirty page table
+    void recovery_analysis(DirtyPageTable& dirty_page_table);
+
+    /// Repeat history from the minimum recLSN of the dirty page table
+    void recovery_redo(const DirtyPageTable& dirty_page_table, BufferManager& buffer_manager);
+
+    /// Repeat history with redo_threads_ workers partitioned by page id, in
+    /// waves of at most `wave_size` pages of the dirty page table
+    void recovery_parallel_redo(const DirtyPageTable& dirty_page_table, size_t wave_size,
+                                BufferManager& buffer_manager);
+
+    /// Repeat history for the pages of a wave, given with their recLSN
+    void recovery_redo_wave(const std::vector<std::pair<uint64_t, uint64_t>>& pages,
+                            BufferManager& buffer_manager);
+
+    /// Roll back the loser transactions, writing compensation records
+    void recovery_undo(BufferManager& buffer_manager);
+
+    /// protects the state of the log manager and the appends to the log file
+    Latch latch_;
 
     std::vector<uint64_t> fuzzy_checkpoint_page_ids;
 
+    uint64_t fuzzy_checkpoint_begin_lsn_ = INVALID_LSN;
+
+    /// buffer manager of the running fuzzy checkpoint, the end record holds its dirty page table
+    BufferManager* fuzzy_checkpoint_buffer_manager_ = nullptr;
+
     File* log_file_;
 
-    // offset in the file
+    /// log_file_ if it is segmented, nullptr otherwise
+    SegmentedLogFile* segmented_log_file_;
+
+    // offset in the file, the LSN of a record is its offset
     size_t current_offset_ = 0;
 
-    std::map<uint64_t, uint64_t> txn_id_to_first_log_record;
+    /// end of the log file, the log buffer holds [durable_lsn_, current_offset_).
+    /// The buffer manager reads it before writing a page.
+    AtomicLsn durable_lsn_;
+
+    /// records appended without a flush, the commit records of asynchronous commits
+    std::vector<char> log_buffer_;
+
+    size_t max_unflushed_bytes_ = DEFAULT_MAX_UNFLUSHED_BYTES;
+
+    /// active transaction table: LSN of the last record of each active transaction
+    std::map<uint64_t, uint64_t> txn_id_to_last_lsn;
+
+    /// LSN of the first record of each active transaction, bounds the truncation of the log
+    std::map<uint64_t, uint64_t> txn_id_to_first_lsn;
+
+    /// encoding buffer of the record being appended
+    std::vector<char> record_buffer_;
+
+    LogStats stats_;
+
+    /// commit records in the log buffer
+    uint64_t unflushed_commits_ = 0;
+
+    /// writes to the log file, to sample their latency
+    uint64_t flushes_ = 0;
+
+    FlushListener flush_listener_;
+
+    std::unordered_map<uint64_t, UndoBuffer> txn_id_to_undo_buffer;
+
+    size_t undo_buffer_budget_ = DEFAULT_UNDO_BUFFER_BUDGET;
+
+    size_t redo_threads_ = 1;
+
+    size_t log_reader_chunk_size_ = DEFAULT_LOG_READER_CHUNK_SIZE;
+
+    bool delta_updates_ = true;
 
-    std::map<LogRecordType, uint64_t> log_record_type_to_count;
+    bool lazy_begin_ = false;
 };
 
 }  // namespace buzzdb
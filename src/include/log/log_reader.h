@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+#include "common/crc32c.h"
+#include "log/log_manager.h"
+#include "storage/file.h"
+
+namespace buzzdb {
+
+/// Log record layout
+///   Every record starts with:    size | crc | type | txn_id | prev_lsn
+///   Update records follow with:  page_id | length | offset | before_img | after_img
+///   Delta update records:        page_id | length | offset | count | count * (range_offset | range_length | before | after)
+///   Compensation records:        page_id | length | offset | undo_next_lsn | img
+///   (Fuzzy) checkpoint end:      count | count * (txn_id | last_lsn)
+///   Commit records:              commit_time
+/// size is the size of the whole record, crc the CRC32C of the LSN, the size
+/// and the bytes after the crc. prev_lsn chains the records of a transaction
+/// backwards, the LSN of a record is its offset in the log file. The commit
+/// time is the wall clock time in microseconds since the epoch, a restore to
+/// a point in time stops at the first commit after it.
+/// A delta update only holds the byte ranges in which the images differ, it is
+/// an update record with DELTA_RECORD_FLAG set in its type.
+/// The records of a PartitionedLog have GSN_RECORD_FLAG set in their type and
+/// their global sequence number follows the header: size | crc | type | txn_id | prev_lsn | gsn.
+constexpr size_t RECORD_PREFIX_SIZE = 2 * sizeof(uint32_t);
+
+constexpr size_t RECORD_HEADER_SIZE = RECORD_PREFIX_SIZE + sizeof(unsigned char) + 2 * sizeof(uint64_t);
+
+constexpr size_t UPDATE_FIELDS_SIZE = 3 * sizeof(uint64_t);
+
+constexpr size_t COMPENSATION_FIELDS_SIZE = 4 * sizeof(uint64_t);
+
+constexpr unsigned char DELTA_RECORD_FLAG = 0x80;
+
+constexpr unsigned char GSN_RECORD_FLAG = 0x40;
+
+/// range_offset | range_length of a changed byte range of a delta update
+constexpr size_t DELTA_RANGE_HEADER_SIZE = 2 * sizeof(uint16_t);
+
+/// CRC of the record of `size` bytes at `data`. The LSN is part of it, so a
+/// record left in a recycled log segment is not taken for one at another LSN.
+inline uint32_t record_crc(uint64_t lsn, const char* data, uint32_t size) {
+    uint32_t crc = crc32c(0, reinterpret_cast<const char*>(&lsn), sizeof(uint64_t));
+    crc = crc32c(crc, data, sizeof(uint32_t));
+    return crc32c(crc, data + RECORD_PREFIX_SIZE, size - RECORD_PREFIX_SIZE);
+}
+
+/// A log record decoded by the LogReader. The images point into the buffer of
+/// the reader and stay valid until the next call to the reader.
+struct LogRecordView {
+    LogManager::LogRecordType type;
+    uint64_t lsn;
+    uint64_t txn_id;
+    uint64_t prev_lsn;
+    uint64_t page_id;
+    uint64_t length;
+    uint64_t offset;
+    uint64_t undo_next_lsn;
+    /// global sequence number of a record of a PartitionedLog, INVALID_LSN for the others
+    uint64_t gsn;
+    /// before image of an update
+    const char* before_img;
+    /// after image of an update, image written by a compensation record
+    const char* after_img;
+    /// changed byte ranges of a delta update, the images are then null
+    const char* delta;
+    uint64_t delta_size;
+    /// body of the other records, the active transaction table of checkpoint records
+    const char* payload;
+    uint64_t payload_size;
+    /// size of the record in the log file
+    uint64_t size;
+};
+
+/// Append the byte ranges in which the images differ as the body of a delta
+/// update. Returns false, leaving the buffer unchanged, if the delta would not
+/// be smaller than the two images.
+bool append_delta(std::vector<char>& buffer, const std::byte* before_img, const std::byte* after_img, uint64_t length);
+
+/// Apply the changed byte ranges of a delta update to `data`, the bytes at the
+/// offset of the record: their after images to redo it, their before images to undo it.
+void apply_delta(const char* delta, uint64_t delta_size, bool after, char* data);
+
+/// Reads the log file in large chunks. While the records of a chunk are
+/// decoded, the next chunk is read asynchronously into a second buffer.
+/// Records can also be read at arbitrary LSNs, e.g. to follow a backward chain.
+class LogReader {
+   public:
+    /// Constructor.
+    /// @param[in] log_file   The log file.
+    /// @param[in] start_lsn  LSN of the first record returned by `next()`, nothing is read before it.
+    /// @param[in] end_lsn    End of the log, nothing is read past it.
+    /// @param[in] chunk_size Size of the reads issued to the log file.
+    LogReader(File* log_file, uint64_t start_lsn, uint64_t end_lsn, size_t chunk_size);
+
+    /// Destructor. Waits for the pending read.
+    ~LogReader();
+
+    LogReader(const LogReader&) = delete;
+    LogReader& operator=(const LogReader&) = delete;
+
+    /// Decode the record that follows the last one read.
+    /// Returns false at the end of the log or at a torn or corrupt record.
+    bool next(LogRecordView& record);
+
+    /// Decode the record at `lsn`.
+    /// Returns false at the end of the log or at a torn or corrupt record.
+    bool read(uint64_t lsn, LogRecordView& record);
+
+    /// Returns the LSN following the last record read
+    uint64_t get_next_lsn() const { return next_lsn_; }
+
+   private:
+    /// Decode the record at `lsn`
+    bool decode(uint64_t lsn, LogRecordView& record);
+
+    /// Make [lsn, lsn + size) available in the window
+    bool ensure(uint64_t lsn, uint64_t size);
+
+    /// Synchronously read [start, end) into the window
+    void load(uint64_t start, uint64_t end);
+
+    /// Start reading the chunk that follows the window
+    void start_prefetch();
+
+    /// Wait for the pending read, if any
+    void finish_prefetch();
+
+    File* log_file_;
+
+    uint64_t start_lsn_;
+
+    uint64_t end_lsn_;
+
+    size_t chunk_size_;
+
+    uint64_t next_lsn_;
+
+    /// only sequential scans read ahead, random reads may race with appends to the log
+    bool sequential_ = false;
+
+    /// buffer holding the window
+    std::vector<char> buffer_;
+
+    /// buffer the next chunk is read into, after `chunk_size_` bytes of room
+    /// for the tail of the window
+    std::vector<char> prefetch_buffer_;
+
+    /// bytes [window_start_, window_end_) of the log
+    const char* window_ = nullptr;
+    uint64_t window_start_ = 0;
+    uint64_t window_end_ = 0;
+
+    std::future<void> prefetch_;
+    uint64_t prefetch_start_ = 0;
+    uint64_t prefetch_end_ = 0;
+};
+
+}  // namespace buzzdb
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "buffer/buffer_manager.h"
+#include "log/log_manager.h"
+#include "storage/file.h"
+
+namespace buzzdb {
+
+/// Hot standby of a primary that ships its log with a LogShipper. The
+/// received log is written to the standby's own log file at the same LSNs
+/// and replayed right away against its own buffer manager, so taking over
+/// only needs the undo of the transactions that did not commit.
+class LogReplica {
+   public:
+    /// Constructor. The standby listens once it is started.
+    /// @param[in] log_file        The log file of the standby.
+    /// @param[in] buffer_manager  The buffer manager of the standby, with its
+    ///                            own segment files.
+    /// @param[in] socket_path     Path of the Unix socket the primary connects to.
+    LogReplica(File* log_file, BufferManager& buffer_manager, std::string socket_path);
+
+    /// Destructor. Stops the standby.
+    ~LogReplica();
+
+    LogReplica(const LogReplica&) = delete;
+    LogReplica& operator=(const LogReplica&) = delete;
+
+    /// Listen on the socket and replay the log of the primary that connects
+    void start();
+
+    /// Stop receiving and replaying
+    void stop();
+
+    /// Stop and run recovery: the transactions that did not commit are
+    /// rolled back and the standby can take over, writing its log with
+    /// `get_log_manager()`
+    void promote();
+
+    /// Returns the end of the log received from the primary
+    uint64_t get_received_lsn() const { return received_lsn_; }
+
+    /// Returns the end of the replayed log
+    uint64_t get_applied_lsn() const { return applied_lsn_; }
+
+    /// Returns the bytes of log received but not replayed yet
+    uint64_t get_lag_lsn() const;
+
+    /// Returns the time since the oldest log that is not replayed yet was
+    /// written by the primary, 0 if the standby caught up
+    double get_lag_seconds() const;
+
+    /// Wait until the log up to `lsn` was replayed. Returns false on timeout.
+    bool wait_for_lsn(uint64_t lsn, std::chrono::milliseconds timeout);
+
+    LogManager& get_log_manager() { return log_manager_; }
+
+   private:
+    void run();
+
+    /// Receive and replay the frames of a connected primary, returns once
+    /// it disconnects or the standby is stopped
+    void receive(int connection);
+
+    File* log_file_;
+
+    BufferManager& buffer_manager_;
+
+    /// replays the received log
+    LogManager log_manager_;
+
+    std::string socket_path_;
+
+    int listen_socket_ = -1;
+
+    std::thread thread_;
+
+    std::atomic<bool> stopping_{false};
+
+    /// protects the lag entries, wakes up the waiters
+    mutable std::mutex mutex_;
+
+    std::condition_variable replayed_;
+
+    /// end LSN and flush time (microseconds since the epoch) of the received
+    /// blocks that are not fully replayed
+    std::deque<std::pair<uint64_t, uint64_t>> pending_blocks_;
+
+    std::atomic<uint64_t> received_lsn_{0};
+
+    std::atomic<uint64_t> applied_lsn_{0};
+};
+
+}  // namespace buzzdb
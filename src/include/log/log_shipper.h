@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log/log_manager.h"
+
+namespace buzzdb {
+
+/// Streams the log to a LogReplica over a Unix socket. Every write to the
+/// log file is queued by the flush listener of the log manager and sent by
+/// a background thread, so the appends don't wait for the standby.
+///
+/// Each block is sent as a frame:   lsn | size | flush_time | bytes
+/// lsn and flush_time (microseconds since the epoch, when the block became
+/// durable) are 8 bytes, size is 4 bytes. The frames follow each other in LSN
+/// order without gaps.
+class LogShipper {
+   public:
+    /// Constructor. Shipping starts with `start()`.
+    LogShipper(LogManager& log_manager, std::string socket_path);
+
+    /// Destructor. Stops shipping.
+    ~LogShipper();
+
+    LogShipper(const LogShipper&) = delete;
+    LogShipper& operator=(const LogShipper&) = delete;
+
+    /// frame header: lsn | size | flush_time
+    static constexpr size_t FRAME_HEADER_SIZE = 2 * sizeof(uint64_t) + sizeof(uint32_t);
+
+    /// Default time to wait for the standby to listen
+    static constexpr std::chrono::milliseconds DEFAULT_CONNECT_TIMEOUT{5000};
+
+    /// Connect to the standby listening at the socket path and ship the
+    /// durable log from `start_lsn` on, then every write to the log file.
+    /// Throws std::system_error if the standby does not accept the
+    /// connection within `timeout`.
+    void start(uint64_t start_lsn = 0, std::chrono::milliseconds timeout = DEFAULT_CONNECT_TIMEOUT);
+
+    /// Send the queued blocks and disconnect
+    void stop();
+
+    /// Returns the end of the log sent to the standby
+    uint64_t get_shipped_lsn() const { return shipped_lsn_; }
+
+    /// Returns false once sending failed, e.g. because the standby went away.
+    /// The log written since is not shipped.
+    bool is_connected() const { return connected_; }
+
+   private:
+    struct Block {
+        uint64_t lsn;
+        uint64_t flush_time_us;
+        std::vector<char> data;
+    };
+
+    /// Queue a block, called by the log manager
+    void enqueue(uint64_t lsn, const char* data, size_t size);
+
+    void run();
+
+    LogManager& log_manager_;
+
+    std::string socket_path_;
+
+    int socket_ = -1;
+
+    std::thread thread_;
+
+    /// protects the queue
+    std::mutex mutex_;
+
+    /// wakes up the thread
+    std::condition_variable wake_up_;
+
+    /// blocks that were not sent yet, adjacent writes are merged
+    std::deque<Block> queue_;
+
+    bool stopping_ = false;
+
+    std::atomic<bool> connected_{false};
+
+    std::atomic<uint64_t> shipped_lsn_{0};
+};
+
+}  // namespace buzzdb
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/histogram.h"
+
+namespace buzzdb {
+
+/// Number of LogManager::LogRecordType values, the counters are indexed by them
+constexpr size_t LOG_RECORD_TYPE_COUNT = 9;
+
+/// Latency of a write to the log file that was not timed
+constexpr uint64_t NOT_TIMED = UINT64_MAX;
+
+/// Statistics of a log manager since it was created, reset or recovered
+struct LogStatsSnapshot {
+    /// records appended (or found by recovery) per LogRecordType
+    std::array<uint64_t, LOG_RECORD_TYPE_COUNT> records{};
+
+    /// bytes of those records per LogRecordType
+    std::array<uint64_t, LOG_RECORD_TYPE_COUNT> bytes{};
+
+    /// writes to the log file
+    uint64_t flushes = 0;
+
+    uint64_t flushed_bytes = 0;
+
+    /// nanoseconds per write to the log file, of the writes that were timed
+    Histogram flush_latency_ns;
+
+    /// commit records made durable by a write, for the writes with any
+    Histogram group_commit_size;
+
+    uint64_t total_records() const;
+
+    uint64_t total_bytes() const;
+};
+
+/// Counters of the log manager. Every thread updates its own shard, without
+/// a shared cache line or a lookup on the append path; a snapshot sums the
+/// shards. Only the owning thread writes a shard.
+class LogStats {
+   public:
+    LogStats();
+
+    ~LogStats();
+
+    /// A copy starts with the sums of `other` in one shard
+    LogStats(const LogStats& other);
+
+    LogStats& operator=(const LogStats& other);
+
+    void add_record(size_t type, uint64_t size);
+
+    /// Count a write of `bytes` to the log file that made `commits` commit
+    /// records durable, its latency is NOT_TIMED unless it was sampled
+    void add_flush(uint64_t bytes, uint64_t latency_ns, uint64_t commits);
+
+    LogStatsSnapshot snapshot() const;
+
+    /// Zero the counters. Increments of other threads running concurrently
+    /// may survive.
+    void reset();
+
+   private:
+    struct alignas(64) Shard {
+        std::thread::id owner;
+        std::array<std::atomic<uint64_t>, LOG_RECORD_TYPE_COUNT> records{};
+        std::array<std::atomic<uint64_t>, LOG_RECORD_TYPE_COUNT> bytes{};
+        std::atomic<uint64_t> flushes{0};
+        std::atomic<uint64_t> flushed_bytes{0};
+        AtomicHistogram flush_latency_ns;
+        AtomicHistogram group_commit_size;
+
+        void clear();
+    };
+
+    /// Returns the shard of the calling thread
+    Shard& local_shard();
+
+    /// Add the sums of `snapshot` to the shard of the calling thread
+    void merge(const LogStatsSnapshot& snapshot);
+
+    /// identifies this object in the thread local shard caches, never reused
+    uint64_t id_;
+
+    /// protects the list of shards
+    mutable std::mutex mutex_;
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}  // namespace buzzdb
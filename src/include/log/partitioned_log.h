@@ -0,0 +1,209 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "buffer/buffer_manager.h"
+#include "log/log_manager.h"
+#include "log/log_stats.h"
+#include "log/write_ahead_log.h"
+#include "storage/file.h"
+
+namespace buzzdb {
+
+/// A log split into partitions, one file each, that the worker threads
+/// append to without a shared latch, buffer or LSN counter. With many cores
+/// the single log buffer of a LogManager becomes a hotspot: every append
+/// takes its latch and moves its cache lines between the cores.
+///
+/// Records are ordered by a global sequence number (GSN) instead of a single
+/// LSN. Every partition has a GSN clock; a record gets a GSN above the clock
+/// of its partition and above the GSN of the page it updates, which it then
+/// becomes the page LSN of. The updates of a page thus have increasing GSNs,
+/// whatever partitions they were logged in, and recovery merges the
+/// partitions by GSN. The low byte of a GSN is the partition of the record.
+///
+/// A commit writes the buffer of its own partition. It only waits for the
+/// other partitions if the transaction updated a page whose last update was
+/// logged in one of them and is not durable yet (remote flush avoidance).
+///
+/// Each thread appends to the partition it was assigned on its first call,
+/// the threads are assigned to the partitions round robin. A transaction
+/// must log all its records from one thread. A database uses either a
+/// PartitionedLog or a LogManager; register it with
+/// `BufferManager::set_log_manager()` to keep the WAL rule.
+class PartitionedLog : public WriteAheadLog {
+   public:
+    /// The partition of a record is the low byte of its GSN
+    static constexpr size_t MAX_PARTITIONS = 256;
+
+    /// Constructor. Opens the files `partition.<i>` in `directory`, which is
+    /// created if needed. Run `recovery()` before logging to a directory
+    /// holding the partitions of a previous run.
+    PartitionedLog(const std::string& directory, size_t partition_count);
+
+    ~PartitionedLog() override;
+
+    PartitionedLog(const PartitionedLog&) = delete;
+    PartitionedLog& operator=(const PartitionedLog&) = delete;
+
+    size_t get_partition_count() const { return partitions_.size(); }
+
+    /// Returns the partition of the record with GSN `gsn`
+    static size_t get_gsn_partition(uint64_t gsn) { return gsn % MAX_PARTITIONS; }
+
+    /// Add a txn begin record
+    void log_txn_begin(uint64_t txn_id);
+
+    /// Add an update record, returns its GSN, to be set as the page LSN.
+    /// `page_lsn` is the page LSN before the update.
+    uint64_t log_update(uint64_t txn_id, uint64_t page_id, uint64_t length, uint64_t offset,
+                        std::byte* before_img, std::byte* after_img, uint64_t page_lsn);
+
+    /// Add a commit record and return its GSN once the transaction is durable
+    uint64_t log_commit(uint64_t txn_id);
+
+    /// Roll back the updates of the transaction with compensation records
+    /// and add an abort record
+    void log_abort(uint64_t txn_id, BufferManager& buffer_manager);
+
+    /// Write the buffers of the partitions holding records up to GSN `lsn`,
+    /// by default all buffers
+    void flush_log(uint64_t lsn = INVALID_LSN) override;
+
+    /// Returns the lowest GSN in the partition buffers, INVALID_LSN if they
+    /// are empty. Does not take the latches.
+    uint64_t get_durable_lsn() override;
+
+    /// Redo the partitions and roll back the transactions that did not end.
+    /// The partitions are decoded in parallel, then the update and
+    /// compensation records are replayed by `set_recovery_threads()` workers
+    /// that each own a share of the page ids and merge the records of their
+    /// pages from all partitions in GSN order.
+    void recovery(BufferManager& buffer_manager);
+
+    /// Set the number of redo workers of the recovery
+    void set_recovery_threads(size_t recovery_threads) { recovery_threads_ = recovery_threads; }
+
+    /// Write the buffer of a partition once it holds `bytes`
+    void set_max_unflushed_bytes(size_t bytes) { max_unflushed_bytes_ = bytes; }
+
+    /// Set the size of the chunks in which recovery reads the partitions
+    void set_log_reader_chunk_size(size_t chunk_size) { log_reader_chunk_size_ = chunk_size; }
+
+    /// Returns the record and byte counts per type and the writes to the
+    /// partition files, summed over the partitions
+    LogStatsSnapshot get_stats() const { return stats_.snapshot(); }
+
+   private:
+    /// A before-image kept for the rollback of a transaction
+    struct UndoEntry {
+        /// GSN of the update, the compensation record refers to it
+        uint64_t gsn;
+        uint64_t page_id;
+        uint64_t offset;
+        uint64_t length;
+        size_t image_offset;
+    };
+
+    /// A transaction running in a partition
+    struct Txn {
+        /// LSN of its last record in the partition file
+        uint64_t last_lsn = INVALID_LSN;
+        std::vector<UndoEntry> undo_entries;
+        std::vector<std::byte> undo_images;
+        /// other partitions and the GSN up to which they must be durable
+        /// before the transaction commits
+        std::vector<std::pair<size_t, uint64_t>> dependencies;
+    };
+
+    struct alignas(64) Partition {
+        /// protects the state of the partition and the appends to its file
+        std::mutex latch;
+
+        std::unique_ptr<File> file;
+
+        size_t index = 0;
+
+        /// LSN the next record gets, its offset in the partition file
+        uint64_t current_offset = 0;
+
+        /// end of the partition file, the buffer holds [durable_offset, current_offset)
+        uint64_t durable_offset = 0;
+
+        /// GSN clock, the upper bytes of the GSN of the last record
+        uint64_t clock = 0;
+
+        /// GSN of the last record in the buffer
+        uint64_t last_gsn = 0;
+
+        /// records appended since the last write
+        std::vector<char> log_buffer;
+
+        /// commit records in the log buffer
+        uint64_t unflushed_commits = 0;
+
+        /// writes to the partition file, to sample their latency
+        uint64_t flushes = 0;
+
+        /// encoding buffer of the record being appended
+        std::vector<char> record_buffer;
+
+        std::unordered_map<uint64_t, Txn> txns;
+
+        /// GSN of the first record in the buffer, INVALID_LSN if it is
+        /// empty. Read without the latch.
+        std::atomic<uint64_t> first_unflushed_gsn{INVALID_LSN};
+
+        /// GSN of the last durable record. Read without the latch.
+        std::atomic<uint64_t> durable_gsn{0};
+    };
+
+    /// Returns the partition of the calling thread
+    Partition& local_partition();
+
+    /// Returns the GSN of the next record of the partition, above the page LSN
+    uint64_t next_gsn(Partition& partition, uint64_t page_lsn);
+
+    /// Start encoding a record with GSN `gsn` into the record buffer of the partition
+    void begin_record(Partition& partition, LogManager::LogRecordType type, uint64_t txn_id, uint64_t gsn);
+
+    /// Append the record buffer to the log buffer of the partition, returns its LSN
+    uint64_t end_record(Partition& partition, uint64_t gsn);
+
+    /// Write the log buffer of the partition to its file, with its latch held
+    void flush_partition(Partition& partition);
+
+    /// Write the buffer of the partition if it holds records up to GSN `gsn`
+    void flush_partition_to(Partition& partition, uint64_t gsn);
+
+    /// Log a compensation record of the update with GSN `undo_gsn` in the
+    /// partition and write `before_img` to the page
+    void compensate(Partition& partition, uint64_t txn_id, uint64_t page_id, uint64_t length, uint64_t offset,
+                    const char* before_img, uint64_t undo_gsn, BufferManager& buffer_manager);
+
+    std::vector<std::unique_ptr<Partition>> partitions_;
+
+    /// partition assigned to the next thread that logs
+    std::atomic<size_t> next_partition_{0};
+
+    /// identifies this object in the thread local partition caches, never reused
+    uint64_t id_;
+
+    LogStats stats_;
+
+    size_t max_unflushed_bytes_ = LogManager::DEFAULT_MAX_UNFLUSHED_BYTES;
+
+    size_t recovery_threads_ = 1;
+
+    size_t log_reader_chunk_size_ = LogManager::DEFAULT_LOG_READER_CHUNK_SIZE;
+};
+
+}  // namespace buzzdb
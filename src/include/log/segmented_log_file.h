@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "storage/file.h"
+
+namespace buzzdb {
+
+/// The log as a sequence of fixed-size segment files in a directory. The
+/// segments are exposed as one file whose offsets are LSNs, segment `i`
+/// holding [i * segment_size, (i + 1) * segment_size).
+///
+/// Segments that are no longer needed are renamed to the segments that
+/// follow the end of the log and reused once the log gets there, so
+/// appending rarely has to allocate a file. A recycled segment still holds
+/// old records; they are rejected by the CRC of the records, which covers
+/// their LSN.
+///
+/// With an archive directory, segments that are no longer needed are moved
+/// there instead, so that the log an online backup needs for a restore is
+/// kept. Appending then allocates a new segment file for every segment.
+///
+/// The directory also holds the master record, the LSN recovery starts at.
+class SegmentedLogFile : public File {
+   public:
+    /// Constructor. Opens the segments found in `directory`, creating it if
+    /// needed. In `READ` mode the directory must exist and nothing in it is
+    /// created or changed: the functions that would change it throw
+    /// `std::runtime_error`, as does reading a segment that is missing.
+    /// @param[in] directory              The directory of the segment files.
+    /// @param[in] segment_size           Size of a segment file in bytes.
+    /// @param[in] mode                   `Mode` the segment files are opened with.
+    /// @param[in] max_recycled_segments  Number of segments kept for reuse, the others are deleted.
+    SegmentedLogFile(const std::string& directory, size_t segment_size, Mode mode = WRITE,
+                     size_t max_recycled_segments = DEFAULT_MAX_RECYCLED_SEGMENTS);
+
+    /// Default number of segments kept for reuse
+    static constexpr size_t DEFAULT_MAX_RECYCLED_SEGMENTS = 4;
+
+    Mode get_mode() const override { return mode_; }
+
+    /// Returns the end of the log. Until recovery cut the log at its last
+    /// record, this is the end of the last segment file.
+    size_t size() const override;
+
+    /// Moves the end of the log, creating segment files as needed. Segments
+    /// past the new end are kept for reuse.
+    void resize(size_t new_size) override;
+
+    /// Reads [offset, offset + size), which must lie in [get_start_lsn(), size())
+    void read_block(size_t offset, size_t size, char* block) override;
+
+    /// Writes [offset, offset + size), which must lie in [get_start_lsn(), size())
+    void write_block(const char* block, size_t offset, size_t size) override;
+
+    /// Returns the first LSN that is still stored
+    uint64_t get_start_lsn() const;
+
+    /// Recycle or archive the segments that only hold LSNs below `lsn`
+    void truncate_before(uint64_t lsn);
+
+    /// Move the segments that are no longer needed to `directory` instead of
+    /// recycling them, an empty directory disables archiving
+    void set_archive_directory(const std::string& directory);
+
+    /// Copy the segment files of `directory` holding LSNs in [start_lsn, end_lsn)
+    /// to `target_directory`, replacing the segments found there. Used to
+    /// assemble a log from archived and live segments.
+    static void copy_segments(const std::string& directory, const std::string& target_directory,
+                              size_t segment_size, uint64_t start_lsn, uint64_t end_lsn);
+
+    /// Returns true if `name` is the name of a segment file: the prefix
+    /// `log.` followed by the 16 hex digits of the segment index
+    static bool is_segment_name(const std::string& name);
+
+    /// Returns the LSN stored in the master record, INVALID_LSN if there is none
+    uint64_t read_master_record() const;
+
+    /// Atomically replace the master record
+    void write_master_record(uint64_t lsn);
+
+    /// Returns the number of segment files, including the ones kept for reuse
+    size_t get_segment_count() const;
+
+    /// Returns the number of segment files that were created
+    size_t get_created_segment_count() const;
+
+   private:
+    /// Returns the name of the segment file `index`
+    static std::string segment_name(uint64_t index);
+
+    std::string segment_path(uint64_t index) const;
+
+    /// Returns the segment file `index`, creating it if it does not exist
+    File& get_segment(uint64_t index);
+
+    /// Throws `std::runtime_error` in `READ` mode
+    void check_writable(const char* operation) const;
+
+    std::string directory_;
+
+    size_t segment_size_;
+
+    Mode mode_;
+
+    size_t max_recycled_segments_;
+
+    /// where truncated segments are moved, empty if they are recycled
+    std::string archive_directory_;
+
+    /// protects the segment map, reads and writes of segment files are thread-safe
+    mutable std::mutex mutex_;
+
+    /// open segment files by index
+    std::map<uint64_t, std::unique_ptr<File>> segments_;
+
+    uint64_t start_lsn_ = 0;
+
+    uint64_t size_ = 0;
+
+    uint64_t master_lsn_;
+
+    size_t created_segments_ = 0;
+};
+
+}  // namespace buzzdb
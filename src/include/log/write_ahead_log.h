@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common/macros.h"
+
+namespace buzzdb {
+
+/// The part of a log the buffer manager needs to keep the WAL rule: a page
+/// is written only once the records of its updates are durable. Pages carry
+/// the sequence number of the record of their last update in their header,
+/// a LogManager stores its LSNs there and a PartitionedLog its GSNs.
+class WriteAheadLog {
+   public:
+    virtual ~WriteAheadLog() = default;
+
+    /// Make the record with sequence number `lsn` and the ones before it
+    /// durable, by default all records
+    virtual void flush_log(uint64_t lsn = INVALID_LSN) = 0;
+
+    /// Returns the first sequence number whose record may not be durable,
+    /// the records before it survive a crash. Must not take a latch that is
+    /// held while fixing pages.
+    virtual uint64_t get_durable_lsn() = 0;
+};
+
+}  // namespace buzzdb
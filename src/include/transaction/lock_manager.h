@@ -0,0 +1,178 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common/macros.h"
+#include "storage/slotted_page.h"  // for TID
+#include "transaction/record_key.h"
+#include "transaction/txn_abort_error.h"
+
+namespace buzzdb {
+
+enum class LockMode {
+    SHARED,
+    EXCLUSIVE,
+};
+
+/// How the lock manager keeps transactions from waiting for each other in a
+/// cycle. The transaction ids give the age of the transactions, a smaller id
+/// is older.
+enum class DeadlockPolicy {
+    /// an older transaction waits for a younger one, a younger one aborts
+    /// instead of waiting for an older one
+    WAIT_DIE,
+    /// an older transaction aborts the younger ones it would wait for, a
+    /// younger one waits for an older one
+    WOUND_WAIT,
+    /// transactions wait, a background thread searches the waits-for graph
+    /// for cycles and aborts the youngest transaction of each
+    DETECTION,
+};
+
+/// Counters of a lock manager
+struct LockStats {
+    /// locks granted, upgrades included
+    uint64_t acquired = 0;
+    /// lock requests that had to wait
+    uint64_t waits = 0;
+    /// transactions told to abort by the deadlock policy
+    uint64_t aborts = 0;
+    /// cycles found by the deadlock detector
+    uint64_t deadlocks = 0;
+};
+
+/// Row-level locks for strict two-phase locking, keyed by the segment and
+/// the TID of a record. The locks are hashed into buckets, each with its
+/// own mutex, holding a FIFO queue of requests per locked record. A shared
+/// lock held alone can be upgraded to an exclusive one, the upgrade is
+/// granted before the requests waiting in the queue.
+/// A transaction keeps its locks until `unlock_all()`, which the
+/// TransactionManager calls once it committed or aborted. All functions are
+/// thread-safe, a transaction itself is used by one thread at a time.
+class LockManager {
+   public:
+    /// Constructor.
+    /// @param[in] policy       How deadlocks are avoided or resolved.
+    /// @param[in] bucket_count Number of hash buckets of the lock table.
+    explicit LockManager(DeadlockPolicy policy = DeadlockPolicy::WAIT_DIE,
+                         size_t bucket_count = DEFAULT_BUCKET_COUNT);
+
+    /// Destructor. Stops the deadlock detector.
+    ~LockManager();
+
+    LockManager(const LockManager&) = delete;
+    LockManager& operator=(const LockManager&) = delete;
+
+    static constexpr size_t DEFAULT_BUCKET_COUNT = 1024;
+
+    /// Lock the record for the transaction, waiting for conflicting locks
+    /// to be released. A transaction holding a shared lock that asks for an
+    /// exclusive one upgrades it. Throws `txn_abort_error` if the
+    /// transaction must abort, it then keeps the locks it held before.
+    void lock(uint64_t txn_id, uint16_t segment_id, TID tid, LockMode mode);
+
+    /// Release all locks of the transaction and forget it
+    void unlock_all(uint64_t txn_id);
+
+    /// Returns the mode of the lock the transaction holds on the record, false if none
+    bool holds(uint64_t txn_id, uint16_t segment_id, TID tid, LockMode& mode);
+
+    DeadlockPolicy get_policy() const { return policy_; }
+
+    /// Set how often the deadlock detector searches the waits-for graph
+    void set_detection_interval(std::chrono::microseconds interval) { detection_interval_us_ = interval.count(); }
+
+    static constexpr std::chrono::microseconds DEFAULT_DETECTION_INTERVAL{1000};
+
+    LockStats get_stats() const;
+
+   private:
+    struct LockRequest {
+        uint64_t txn_id;
+        LockMode mode;
+        bool granted;
+        /// a granted shared lock waiting to become exclusive
+        bool upgrading;
+    };
+
+    /// Requests on a record in arrival order, the granted ones first
+    struct LockQueue {
+        std::vector<LockRequest> requests;
+    };
+
+    struct alignas(64) Bucket {
+        std::mutex mutex;
+        /// waiters of the bucket, notified when a lock is released or a
+        /// waiting transaction must abort
+        std::condition_variable released;
+        std::unordered_map<RecordKey, LockQueue, RecordKeyHash> queues;
+    };
+
+    /// The locks of a transaction
+    struct TxnLocks {
+        std::vector<RecordKey> keys;
+        /// set by the deadlock policy, the transaction throws at its next lock request
+        bool aborted = false;
+        /// bucket the transaction waits in, nullptr if it does not wait
+        Bucket* waiting_in = nullptr;
+    };
+
+    struct alignas(64) TxnShard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, TxnLocks> txns;
+    };
+
+    static constexpr size_t TXN_SHARDS = 64;
+
+    Bucket& get_bucket(const RecordKey& key) { return *buckets_[RecordKeyHash()(key) % buckets_.size()]; }
+
+    TxnShard& get_txn_shard(uint64_t txn_id) { return txn_shards_[txn_id % TXN_SHARDS]; }
+
+    /// Returns whether the request at `position` can be granted
+    static bool grantable(const LockQueue& queue, size_t position);
+
+    /// Returns the transactions the request at `position` waits for
+    static std::vector<uint64_t> blockers(const LockQueue& queue, size_t position);
+
+    /// Returns whether the transaction was told to abort, sets or clears the
+    /// bucket it waits in
+    bool check_aborted(uint64_t txn_id, Bucket* waiting_in);
+
+    /// Tell a transaction to abort and wake it up if it waits
+    void abort_txn(uint64_t txn_id);
+
+    /// Body of the deadlock detector thread
+    void detect_deadlocks();
+
+    /// Search the waits-for graph once, returns the number of cycles broken
+    size_t break_cycles();
+
+    DeadlockPolicy policy_;
+
+    std::vector<std::unique_ptr<Bucket>> buckets_;
+
+    std::array<TxnShard, TXN_SHARDS> txn_shards_;
+
+    std::atomic<uint64_t> detection_interval_us_{DEFAULT_DETECTION_INTERVAL.count()};
+
+    std::atomic<bool> stop_{false};
+
+    std::thread detector_;
+
+    std::atomic<uint64_t> acquired_{0};
+    std::atomic<uint64_t> waits_{0};
+    std::atomic<uint64_t> aborts_{0};
+    std::atomic<uint64_t> deadlocks_{0};
+};
+
+}  // namespace buzzdb
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "common/macros.h"
+#include "storage/slotted_page.h"  // for TID
+#include "transaction/record_key.h"
+
+namespace buzzdb {
+
+class HeapSegment;
+
+/// Optimistic concurrency control in the style of Silo. A transaction takes
+/// no locks while it runs: it records the version of every record it reads
+/// and buffers its writes. At its commit, the TransactionManager asks the
+/// OccManager to lock the version words of the written records, in a global
+/// order to avoid deadlocks, and to check that the records read still have
+/// the versions observed. If they do, the writes are installed and logged,
+/// then the versions are bumped and unlocked; otherwise the transaction
+/// aborts without having changed a page.
+///
+/// The version words are a fixed array indexed by a hash of the record, so
+/// records that share a word conflict spuriously, which only costs aborts.
+/// A word holds a lock bit and a counter bumped by every installed write. A
+/// read copies the record between two loads of its word and retries if the
+/// word changed or was locked meanwhile.
+///
+/// Inserted records are not tracked: a transaction does not see whether
+/// another one allocated a record it scanned past.
+class OccManager {
+   public:
+    /// Constructor.
+    /// @param[in] version_words Number of version words, the records are hashed onto them.
+    explicit OccManager(size_t version_words = DEFAULT_VERSION_WORDS);
+
+    OccManager(const OccManager&) = delete;
+    OccManager& operator=(const OccManager&) = delete;
+
+    static constexpr size_t DEFAULT_VERSION_WORDS = 1 << 16;
+
+    /// Returns the version of the record once it is not locked, to be passed
+    /// to `end_read()` after copying the record
+    uint64_t begin_read(uint16_t segment_id, TID tid);
+
+    /// Returns whether the record was not changed since `begin_read()`
+    /// returned `version`, and adds it to the read set of the transaction if so
+    bool end_read(uint64_t txn_id, uint16_t segment_id, TID tid, uint64_t version);
+
+    /// Copy the last write of the transaction to the record into `record`,
+    /// returns false if it did not write the record
+    bool read_own_write(uint64_t txn_id, uint16_t segment_id, TID tid, std::byte* record, uint32_t capacity);
+
+    /// Buffer a write of the transaction until its commit
+    void buffer_write(uint64_t txn_id, HeapSegment* segment, TID tid, const std::byte* record,
+                      uint32_t record_size);
+
+    /// Lock the version words of the write set and validate the read set.
+    /// Returns false and unlocks them if a record read was changed or is
+    /// locked by another transaction.
+    bool validate(uint64_t txn_id);
+
+    /// Write the buffered records of a validated transaction to their segments.
+    /// If a write throws, the ones before it are installed and logged, the
+    /// caller rolls them back before abort().
+    void install(uint64_t txn_id);
+
+    /// Bump and unlock the version words of the write set of an installed
+    /// transaction and forget it
+    void release(uint64_t txn_id);
+
+    /// Forget the reads and the buffered writes of the transaction
+    void abort(uint64_t txn_id);
+
+    /// Returns the number of failed validations
+    uint64_t get_validation_failures() const { return validation_failures_.load(); }
+
+   private:
+    static constexpr uint64_t LOCK_BIT = uint64_t{1} << 63;
+
+    struct ReadEntry {
+        size_t word;
+        uint64_t version;
+    };
+
+    struct WriteEntry {
+        HeapSegment* segment;
+        uint16_t segment_id;
+        TID tid;
+        std::vector<std::byte> record;
+    };
+
+    /// Read and write set of a transaction
+    struct TxnState {
+        std::vector<ReadEntry> reads;
+        std::vector<WriteEntry> writes;
+        /// version words locked by the validation, sorted
+        std::vector<size_t> locked;
+    };
+
+    struct alignas(64) TxnShard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, TxnState> txns;
+    };
+
+    static constexpr size_t TXN_SHARDS = 64;
+
+    size_t get_word(uint16_t segment_id, TID tid) const {
+        return RecordKeyHash()(RecordKey{segment_id, tid.value}) % words_count_;
+    }
+
+    TxnShard& get_txn_shard(uint64_t txn_id) { return txn_shards_[txn_id % TXN_SHARDS]; }
+
+    /// Returns the state of the transaction, created if needed. Only the
+    /// thread running the transaction uses it.
+    TxnState& get_txn(uint64_t txn_id);
+
+    /// Unlock the version words, bumping their version if `bump` is set
+    void unlock(TxnState& txn, bool bump);
+
+    /// Remove the transaction
+    void remove_txn(uint64_t txn_id);
+
+    size_t words_count_;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> words_;
+
+    std::array<TxnShard, TXN_SHARDS> txn_shards_;
+
+    std::atomic<uint64_t> validation_failures_{0};
+};
+
+}  // namespace buzzdb
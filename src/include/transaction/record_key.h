@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace buzzdb {
+
+/// Identifies a record across the segments: the segment id and the TID value
+struct RecordKey {
+    uint16_t segment_id;
+    uint64_t tid;
+
+    bool operator==(const RecordKey& other) const { return segment_id == other.segment_id && tid == other.tid; }
+};
+
+struct RecordKeyHash {
+    size_t operator()(const RecordKey& key) const {
+        // the slot is in the low bits of the TID, spread the pages over the buckets
+        uint64_t hash = (key.tid ^ (uint64_t{key.segment_id} << 48)) * 0x9e3779b97f4a7c15ULL;
+        return hash >> 20;
+    }
+};
+
+}  // namespace buzzdb
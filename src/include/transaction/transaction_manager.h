@@ -1,11 +1,16 @@
 #pragma once
 
+#include <array>
 #include <atomic>
-#include <map>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include "buffer/buffer_manager.h"
 #include "log/log_manager.h"
+#include "transaction/lock_manager.h"
+#include "transaction/occ_manager.h"
+#include "transaction/version_store.h"
 #include "common/macros.h"
 
 namespace buzzdb {
@@ -25,6 +30,18 @@ public:
     uint64_t get_txn_id(){ 	return txn_id_; }
 };
 
+/// Starts, commits and aborts transactions. The public functions are
+/// thread-safe: the transaction table is split into shards by transaction id,
+/// each with its own mutex, so threads working on different transactions
+/// rarely wait for each other. A transaction itself is used by one thread at
+/// a time. Committed and aborted transactions are removed from the table;
+/// committing, aborting or adding a page to them afterwards is an error, as
+/// it is for a transaction that was never started.
+/// With a LockManager set, the transactions hold their record locks until
+/// they committed or aborted (strict two-phase locking). With a
+/// VersionStore set, every transaction reads a snapshot taken at its start.
+/// With an OccManager set, the transactions run optimistically and are
+/// validated at their commit.
 class TransactionManager {
 
 public:
@@ -41,20 +58,97 @@ public:
     /// Start the transaction
     uint64_t start_txn();
 
-    /// Commit the transaction
-    void commit_txn(uint64_t txn_id);
+    /// Commit the transaction, returns the LSN of its commit record,
+    /// INVALID_LSN for a lazily begun transaction that did not update anything.
+    /// With asynchronous commits, that record is durable once
+    /// LogManager::get_durable_lsn() is past it, LogManager::flush_log(lsn) waits for it.
+    /// With an OccManager, the transaction is aborted and
+    /// `validation_abort_error` thrown if a record it read changed since.
+    /// If installing its writes throws, e.g. `buffer_full_error`, it is
+    /// rolled back and aborted and the exception rethrown.
+    uint64_t commit_txn(uint64_t txn_id);
+
+    /// Let the commits of this session return once their commit record is in
+    /// the log buffer instead of waiting for the log to be written. A crash
+    /// may lose the commits that were not flushed yet.
+    void set_async_commit(bool async_commit) { async_commit_ = async_commit; }
+
+    /// Flush the pages a transaction modified before its commit record is
+    /// written. By default they are not: the log holds the updates and the
+    /// buffer manager writes the pages when it needs their frames.
+    void set_force_at_commit(bool force_at_commit) { force_at_commit_ = force_at_commit; }
 
     /// Abort the transaction
     void abort_txn(uint64_t txn_id);
 
-    /// add modified page to the transaction 
+    /// Begin the transactions lazily: a transaction writes its begin record
+    /// with its first update and takes its snapshot with its first read or
+    /// update. A read-only transaction then logs nothing and tracks no
+    /// pages. Set it while no transaction is running.
+    void set_lazy_begin(bool lazy_begin) {
+        lazy_begin_ = lazy_begin;
+        log_manager_.set_lazy_begin(lazy_begin);
+    }
+
+    /// Release the record locks of the transactions at their commit or
+    /// abort, nullptr to not use locks. Set it before starting transactions.
+    void set_lock_manager(LockManager* lock_manager) { lock_manager_ = lock_manager; }
+
+    /// Take a snapshot at the start of the transactions and publish or drop
+    /// their versions at their commit or abort, nullptr to not keep
+    /// versions. Set it before starting transactions.
+    void set_version_store(VersionStore* version_store) { version_store_ = version_store; }
+
+    /// Validate the transactions and install their buffered writes at their
+    /// commit, nullptr to not run them optimistically. Set it before
+    /// starting transactions.
+    void set_occ_manager(OccManager* occ_manager) { occ_manager_ = occ_manager; }
+
+    /// Returns a savepoint of the running transaction, the LSN of its last
+    /// log record, to roll back to with `rollback_to_savepoint()`. The writes
+    /// of optimistic transactions are buffered, not logged: with an
+    /// OccManager, this exits.
+    uint64_t create_savepoint(uint64_t txn_id);
+
+    /// Undo the updates the running transaction made after the savepoint.
+    /// It keeps running, with its locks, and may retry the work. Exits with
+    /// an OccManager.
+    void rollback_to_savepoint(uint64_t txn_id, uint64_t savepoint);
+
+    /// add modified page to the transaction, which must be running
     void add_modified_page(uint64_t txn_id, uint64_t page_id);
 
+    /// Returns the number of transactions that were started and did not end yet
+    size_t get_active_txn_count();
+
+    /// Number of shards of the transaction table
+    static constexpr size_t TRANSACTION_TABLE_SHARDS = 64;
+
     /// reset the state
     /// this is used to simulate crash
     void reset(LogManager &log_manager);
 private:
 
+    /// A shard of the transaction table
+    struct alignas(64) TransactionTableShard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Transaction> transactions;
+    };
+
+    /// Returns the shard holding the transaction
+    TransactionTableShard& get_shard(uint64_t txn_id) {
+        return transaction_table_[txn_id % TRANSACTION_TABLE_SHARDS];
+    }
+
+    /// Remove the transaction from the table and return it, exits if it is not running
+    Transaction remove_txn(uint64_t txn_id);
+
+    /// Exits if the transaction is not running
+    void check_txn(uint64_t txn_id);
+
+    /// Exits if the transactions are optimistic
+    void check_savepoints_supported();
+
     /// Log manager
     LogManager &log_manager_;
 
@@ -64,8 +158,23 @@ private:
     /// To obtain a new txn id for each transaction
     std::atomic<uint64_t> transaction_counter_;
 
-    /// List of transactions
-    std::map<uint64_t, Transaction> transaction_table_;
+    /// Running transactions
+    std::array<TransactionTableShard, TRANSACTION_TABLE_SHARDS> transaction_table_;
+
+    /// Lock manager, nullptr if the transactions take no locks
+    LockManager* lock_manager_ = nullptr;
+
+    /// Version store, nullptr if the transactions read the last versions
+    VersionStore* version_store_ = nullptr;
+
+    /// OCC manager, nullptr if the transactions do not run optimistically
+    OccManager* occ_manager_ = nullptr;
+
+    bool async_commit_ = false;
+
+    bool lazy_begin_ = false;
+
+    bool force_at_commit_ = false;
 
 };
 
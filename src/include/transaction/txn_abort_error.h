@@ -0,0 +1,38 @@
+#pragma once
+
+#include <exception>
+
+namespace buzzdb {
+
+/// Thrown when the transaction must abort, the caller rolls it back with
+/// `abort_txn()`. `LockManager::lock()` throws it to resolve a deadlock,
+/// the other causes throw the subclasses below.
+class txn_abort_error
+: public std::exception {
+public:
+    const char* what() const noexcept override {
+        return "transaction aborted to resolve a deadlock";
+    }
+};
+
+/// Thrown by `VersionStore::install()` when another transaction updated the
+/// record after the snapshot or did not commit yet (first updater wins)
+class write_conflict_error
+: public txn_abort_error {
+public:
+    const char* what() const noexcept override {
+        return "transaction aborted: the record was updated by a concurrent transaction";
+    }
+};
+
+/// Thrown by `TransactionManager::commit_txn()` when the validation of an
+/// optimistic transaction finds that a record it read changed since
+class validation_abort_error
+: public txn_abort_error {
+public:
+    const char* what() const noexcept override {
+        return "transaction aborted: a record it read was changed by a concurrent transaction";
+    }
+};
+
+}  // namespace buzzdb
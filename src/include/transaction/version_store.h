@@ -0,0 +1,161 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "common/macros.h"
+#include "storage/slotted_page.h"  // for TID
+#include "transaction/record_key.h"
+
+namespace buzzdb {
+
+/// Prior versions of the records for snapshot reads (multi-version
+/// concurrency control). Records are updated in place on their pages; before
+/// overwriting a record, a writer keeps its image in a version chain, newest
+/// first. Once the writer commits, the version is tagged with its commit
+/// timestamp. A transaction reads the record as of the timestamp of the last
+/// commit when it began: the page holds it if the newest version was written
+/// by a transaction that committed by then, otherwise the image of the oldest
+/// version written after it.
+///
+/// Readers take no locks and never wait for writers, nor writers for
+/// readers: the chains are hashed into buckets whose mutexes are held only
+/// to copy a record or link a version. A record has at most one uncommitted
+/// version; a transaction updating a record that another one updated after
+/// its snapshot aborts (first updater wins).
+///
+/// Garbage collection is epoch-based. A snapshot is registered with the
+/// epoch it began in and a commit tags its versions with the epoch it ended
+/// in. `collect_garbage()` starts a new epoch and frees the versions of the
+/// epochs before the oldest registered snapshot: every snapshot that could
+/// still read them has ended.
+///
+/// The allocation of records is not versioned, a snapshot sees a record
+/// inserted after it began with the content it had before the insertion.
+class VersionStore {
+   public:
+    /// Constructor.
+    /// @param[in] bucket_count Number of hash buckets of the version chains.
+    explicit VersionStore(size_t bucket_count = DEFAULT_BUCKET_COUNT);
+
+    VersionStore(const VersionStore&) = delete;
+    VersionStore& operator=(const VersionStore&) = delete;
+
+    static constexpr size_t DEFAULT_BUCKET_COUNT = 1024;
+
+    /// Take the snapshot of the transaction. A transaction that did not
+    /// begin takes its snapshot with its first read or update.
+    void begin(uint64_t txn_id);
+
+    /// Keep `image`, the record before the transaction overwrites it. Throws
+    /// `write_conflict_error` if another transaction updated the record after
+    /// the snapshot or did not commit yet.
+    void install(uint64_t txn_id, uint16_t segment_id, TID tid, const std::byte* image, uint32_t length);
+
+    /// Copy the first `length` bytes of the version of the record visible to
+    /// the snapshot of the transaction; `current` is the record on the page.
+    void read(uint64_t txn_id, uint16_t segment_id, TID tid, const std::byte* current, std::byte* record,
+              uint32_t length);
+
+    /// Make the versions of the transaction visible to the snapshots taken
+    /// afterwards and drop its snapshot, returns its commit timestamp
+    uint64_t commit(uint64_t txn_id);
+
+    /// Drop the versions and the snapshot of the transaction. Its records
+    /// must be rolled back on their pages first.
+    void abort(uint64_t txn_id);
+
+    /// Start a new epoch and free the versions no snapshot can read, returns their number
+    size_t collect_garbage();
+
+    /// Returns the number of versions kept
+    size_t get_version_count() const { return version_count_.load(); }
+
+    /// Returns the timestamp of the last commit
+    uint64_t get_commit_timestamp() const { return clock_.load(); }
+
+    uint64_t get_epoch() const { return epoch_.load(); }
+
+   private:
+    /// The record before an update
+    struct Version {
+        /// transaction that wrote the update
+        uint64_t writer;
+        /// commit timestamp of the writer, UNCOMMITTED before its commit
+        uint64_t commit_ts;
+        std::vector<std::byte> image;
+        /// version before this one
+        std::unique_ptr<Version> older;
+    };
+
+    static constexpr uint64_t UNCOMMITTED = ~uint64_t{0};
+
+    struct alignas(64) Bucket {
+        std::mutex mutex;
+        /// newest version of each record with versions
+        std::unordered_map<RecordKey, std::unique_ptr<Version>, RecordKeyHash> chains;
+    };
+
+    /// A transaction with a snapshot
+    struct TxnState {
+        /// timestamp of the last commit when it began
+        uint64_t snapshot;
+        /// epoch when it began
+        uint64_t epoch;
+        /// records it updated
+        std::vector<RecordKey> keys;
+    };
+
+    struct alignas(64) TxnShard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, TxnState> txns;
+    };
+
+    static constexpr size_t TXN_SHARDS = 64;
+
+    Bucket& get_bucket(const RecordKey& key) { return *buckets_[RecordKeyHash()(key) % buckets_.size()]; }
+
+    TxnShard& get_txn_shard(uint64_t txn_id) { return txn_shards_[txn_id % TXN_SHARDS]; }
+
+    /// Remove the transaction from its shard and return it, an empty state if it has none
+    TxnState remove_txn(uint64_t txn_id);
+
+    /// Returns the snapshot of the transaction, taken now if it has none
+    uint64_t get_snapshot(uint64_t txn_id);
+
+    std::vector<std::unique_ptr<Bucket>> buckets_;
+
+    std::array<TxnShard, TXN_SHARDS> txn_shards_;
+
+    /// timestamp of the last commit, published once its versions are tagged
+    std::atomic<uint64_t> clock_{0};
+
+    /// serializes the commits of the writers
+    std::mutex commit_mutex_;
+
+    std::atomic<uint64_t> epoch_{0};
+
+    /// The versions of a commit, freed once no snapshot of its epoch is left
+    struct Garbage {
+        uint64_t epoch;
+        uint64_t commit_ts;
+        std::vector<RecordKey> keys;
+    };
+
+    /// by epoch
+    std::deque<Garbage> garbage_;
+
+    /// protects garbage_, taken after commit_mutex_
+    std::mutex garbage_mutex_;
+
+    std::atomic<size_t> version_count_{0};
+};
+
+}  // namespace buzzdb
@@ -0,0 +1,143 @@
+#include "log/backup.h"
+
+#include <string.h>
+
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+
+#include "common/crc32c.h"
+#include "common/defer.h"
+#include "log/segmented_log_file.h"
+#include "storage/file.h"
+
+namespace buzzdb {
+
+namespace {
+
+constexpr char MANIFEST_FILE[] = "manifest";
+
+constexpr char MANIFEST_TEMP_FILE[] = "manifest.tmp";
+
+/// Subdirectory of the target directory holding the restored log
+constexpr char RESTORED_LOG_DIRECTORY[] = "log";
+
+void append_bytes(std::vector<char>& buffer, const void* data, size_t size) {
+    const char* bytes = reinterpret_cast<const char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+void write_manifest(const BackupManifest& manifest, const std::string& directory) {
+    std::vector<char> data;
+    uint64_t count = manifest.segment_ids.size();
+    append_bytes(data, &manifest.start_lsn, sizeof(uint64_t));
+    append_bytes(data, &manifest.end_lsn, sizeof(uint64_t));
+    append_bytes(data, &count, sizeof(uint64_t));
+    for (uint16_t segment_id : manifest.segment_ids) {
+        append_bytes(data, &segment_id, sizeof(uint16_t));
+    }
+    uint32_t crc = crc32c(0, data.data(), data.size());
+    append_bytes(data, &crc, sizeof(uint32_t));
+
+    std::string temp_path = directory + "/" + MANIFEST_TEMP_FILE;
+    {
+        std::filesystem::remove(temp_path);
+        auto file = File::open_file(temp_path.c_str(), File::WRITE);
+        file->resize(data.size());
+        file->write_block(data.data(), 0, data.size());
+    }
+    std::filesystem::rename(temp_path, directory + "/" + MANIFEST_FILE);
+}
+
+}  // namespace
+
+BackupManifest create_backup(LogManager& log_manager, BufferManager& buffer_manager,
+                             const std::vector<uint16_t>& segment_ids, const std::string& directory) {
+    std::filesystem::create_directories(directory);
+    BackupManifest manifest;
+    manifest.segment_ids = segment_ids;
+    manifest.start_lsn = log_manager.log_backup_begin(buffer_manager);
+    for (uint16_t segment_id : segment_ids) {
+        buffer_manager.copy_segment(segment_id, directory + "/" + std::to_string(segment_id));
+    }
+    // the copies hold no update past the durable log
+    log_manager.flush_log();
+    manifest.end_lsn = log_manager.get_durable_lsn();
+    write_manifest(manifest, directory);
+    return manifest;
+}
+
+BackupManifest read_backup_manifest(const std::string& directory) {
+    std::string path = directory + "/" + MANIFEST_FILE;
+    if (!std::filesystem::exists(path)) {
+        throw std::runtime_error("backup manifest not found in " + directory);
+    }
+    auto file = File::open_file(path.c_str(), File::READ);
+    std::vector<char> data(file->size());
+    file->read_block(0, data.size(), data.data());
+
+    constexpr size_t FIXED_SIZE = 3 * sizeof(uint64_t) + sizeof(uint32_t);
+    BackupManifest manifest;
+    uint64_t count = 0;
+    if (data.size() >= FIXED_SIZE) {
+        memcpy(&count, data.data() + 2 * sizeof(uint64_t), sizeof(uint64_t));
+    }
+    if (data.size() < FIXED_SIZE || count != (data.size() - FIXED_SIZE) / sizeof(uint16_t)) {
+        throw std::runtime_error("corrupt backup manifest in " + directory);
+    }
+    uint32_t crc;
+    memcpy(&crc, data.data() + data.size() - sizeof(uint32_t), sizeof(uint32_t));
+    if (crc != crc32c(0, data.data(), data.size() - sizeof(uint32_t))) {
+        throw std::runtime_error("corrupt backup manifest in " + directory);
+    }
+    memcpy(&manifest.start_lsn, data.data(), sizeof(uint64_t));
+    memcpy(&manifest.end_lsn, data.data() + sizeof(uint64_t), sizeof(uint64_t));
+    manifest.segment_ids.resize(count);
+    memcpy(manifest.segment_ids.data(), data.data() + 3 * sizeof(uint64_t), count * sizeof(uint16_t));
+    return manifest;
+}
+
+RestoreResult restore_backup(const RestoreOptions& options, BufferManager& buffer_manager) {
+    auto start = std::chrono::steady_clock::now();
+    BackupManifest manifest = read_backup_manifest(options.backup_directory);
+
+    std::filesystem::create_directories(options.target_directory);
+    for (uint16_t segment_id : manifest.segment_ids) {
+        std::filesystem::copy_file(options.backup_directory + "/" + std::to_string(segment_id),
+                                   options.target_directory + "/" + std::to_string(segment_id),
+                                   std::filesystem::copy_options::overwrite_existing);
+    }
+    buffer_manager.set_segment_directory(options.target_directory);
+
+    // the segments of the live log replace archived copies, the record at the target may span two segments
+    std::string log_directory = options.target_directory + "/" + RESTORED_LOG_DIRECTORY;
+    std::filesystem::remove_all(log_directory);
+    uint64_t end_lsn = options.target_lsn == INVALID_LSN ? INVALID_LSN : options.target_lsn + 2 * options.segment_size;
+    if (!options.archive_directory.empty()) {
+        SegmentedLogFile::copy_segments(options.archive_directory, log_directory, options.segment_size,
+                                        manifest.start_lsn, end_lsn);
+    }
+    SegmentedLogFile::copy_segments(options.log_directory, log_directory, options.segment_size,
+                                    manifest.start_lsn, end_lsn);
+
+    SegmentedLogFile log_file(log_directory, options.segment_size);
+    LogManager log_manager(&log_file);
+    if (log_file.get_start_lsn() > manifest.start_lsn) {
+        throw std::runtime_error("the log before the backup was not archived");
+    }
+    // pages evicted by the replay follow the restored log
+    buffer_manager.set_log_manager(&log_manager);
+    Defer unregister([&buffer_manager]() { buffer_manager.set_log_manager(nullptr); });
+    RestoreResult result;
+    result.restored_lsn = log_manager.restore(manifest.start_lsn, options.target_lsn, options.target_time, buffer_manager);
+    if (result.restored_lsn < manifest.end_lsn) {
+        throw std::runtime_error("the restored log ends before the backup");
+    }
+    result.log_bytes = result.restored_lsn - manifest.start_lsn;
+
+    log_manager.log_checkpoint(buffer_manager);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+}  // namespace buzzdb
@@ -0,0 +1,107 @@
+#include "log/checkpointer.h"
+
+#include <algorithm>
+
+namespace buzzdb {
+
+Checkpointer::Checkpointer(LogManager& log_manager, BufferManager& buffer_manager)
+    : log_manager_(log_manager), buffer_manager_(buffer_manager) {}
+
+Checkpointer::~Checkpointer() { stop(); }
+
+void Checkpointer::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thread_.joinable()) {
+        return;
+    }
+    stopping_ = false;
+    last_checkpoint_lsn_ = log_manager_.get_current_lsn();
+    last_checkpoint_time_ = std::chrono::steady_clock::now();
+    thread_ = std::thread(&Checkpointer::run, this);
+}
+
+void Checkpointer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_up_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void Checkpointer::request_checkpoint() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!thread_.joinable()) {
+        lock.unlock();
+        checkpoint();
+        lock.lock();
+        checkpoint_count_++;
+        return;
+    }
+    // a checkpoint that is running may have started before the request
+    size_t target = checkpoint_count_ + (running_ ? 2 : 1);
+    requested_ = true;
+    wake_up_.notify_all();
+    checkpoint_done_.wait(lock, [&] { return checkpoint_count_ >= target || stopping_; });
+}
+
+size_t Checkpointer::get_checkpoint_count() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return checkpoint_count_;
+}
+
+void Checkpointer::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        wake_up_.wait_for(lock, POLL_INTERVAL, [this] { return stopping_ || requested_; });
+        if (stopping_) {
+            break;
+        }
+        uint64_t log_volume = log_manager_.get_current_lsn() - last_checkpoint_lsn_;
+        bool volume_reached = log_volume_trigger_ > 0 && log_volume >= log_volume_trigger_;
+        bool interval_elapsed = interval_.count() > 0 && log_volume > 0 &&
+                                std::chrono::steady_clock::now() - last_checkpoint_time_ >= interval_;
+        if (!requested_ && !volume_reached && !interval_elapsed) {
+            continue;
+        }
+        requested_ = false;
+        running_ = true;
+        lock.unlock();
+        checkpoint();
+        lock.lock();
+        running_ = false;
+        checkpoint_count_++;
+        checkpoint_done_.notify_all();
+    }
+    checkpoint_done_.notify_all();
+}
+
+void Checkpointer::checkpoint() {
+    last_checkpoint_lsn_ = log_manager_.get_current_lsn();
+    last_checkpoint_time_ = std::chrono::steady_clock::now();
+    size_t steps = log_manager_.log_fuzzy_checkpoint_begin(buffer_manager_);
+    // each step writes at most one page
+    auto flush_time = std::chrono::nanoseconds(0);
+    if (io_budget_ > 0) {
+        uint64_t page_bytes = BufferManager::PAGE_LSN_SIZE + buffer_manager_.get_page_size();
+        flush_time = std::chrono::nanoseconds(page_bytes * 1000000000ull / io_budget_);
+    }
+    auto next_flush = std::chrono::steady_clock::now();
+    for (size_t step = 0; step < steps; step++) {
+        bool stopping;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping = stopping_;
+        }
+        if (!stopping) {
+            std::this_thread::sleep_until(next_flush);
+        }
+        next_flush = std::max(next_flush, std::chrono::steady_clock::now()) + flush_time;
+        log_manager_.log_fuzzy_checkpoint_do_step(buffer_manager_, step);
+    }
+    log_manager_.log_fuzzy_checkpoint_end();
+}
+
+}  // namespace buzzdb
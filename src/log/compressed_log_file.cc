@@ -0,0 +1,254 @@
+#include "log/compressed_log_file.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#include "common/crc32c.h"
+
+namespace buzzdb {
+
+namespace {
+
+/// Size of the reads that scan the chunks when opening the file
+constexpr size_t SCAN_CHUNK_SIZE = 1 << 20;
+
+uint32_t chunk_crc(uint64_t lsn, const char* header, const char* data, uint32_t stored_size) {
+    uint32_t crc = crc32c(0, reinterpret_cast<const char*>(&lsn), sizeof(uint64_t));
+    crc = crc32c(crc, header, 2 * sizeof(uint32_t));
+    return crc32c(crc, data, stored_size);
+}
+
+}  // namespace
+
+CompressedLogFile::CompressedLogFile(std::unique_ptr<File> file, size_t block_size, int level)
+    : file_(std::move(file)), block_size_(block_size) {
+    memset(&deflate_stream_, 0, sizeof(z_stream));
+    // chunks are small, building the decoding tables of a dynamic Huffman code
+    // for each of them would cost the reader more than the code saves
+    if (deflateInit2(&deflate_stream_, level, Z_DEFLATED, MAX_WBITS, 8, Z_FIXED) != Z_OK) {
+        throw std::runtime_error("deflateInit failed");
+    }
+    open();
+}
+
+CompressedLogFile::~CompressedLogFile() { deflateEnd(&deflate_stream_); }
+
+void CompressedLogFile::open() {
+    uint64_t file_size = file_->size();
+    std::vector<char> window;
+    uint64_t window_start = 0;
+    // make [position, position + size) available in the window
+    auto ensure = [&](uint64_t position, uint64_t size) -> const char* {
+        if (size > file_size || position > file_size - size) {
+            return nullptr;
+        }
+        if (position < window_start || position + size > window_start + window.size()) {
+            window.resize(std::min<uint64_t>(file_size - position, std::max<uint64_t>(SCAN_CHUNK_SIZE, size)));
+            file_->read_block(position, window.size(), window.data());
+            window_start = position;
+        }
+        return window.data() + (position - window_start);
+    };
+
+    uint64_t position = 0;
+    uint64_t lsn = 0;
+    while (true) {
+        const char* header = ensure(position, CHUNK_HEADER_SIZE);
+        if (header == nullptr) {
+            break;
+        }
+        uint32_t raw_size;
+        uint32_t stored_size;
+        uint32_t crc;
+        memcpy(&raw_size, header, sizeof(uint32_t));
+        memcpy(&stored_size, header + sizeof(uint32_t), sizeof(uint32_t));
+        memcpy(&crc, header + 2 * sizeof(uint32_t), sizeof(uint32_t));
+        bool block_start = raw_size & BLOCK_START_FLAG;
+        if (!block_start && blocks_.empty()) {
+            break;
+        }
+        const char* chunk = ensure(position, CHUNK_HEADER_SIZE + uint64_t{stored_size});
+        if (chunk == nullptr || crc != chunk_crc(lsn, chunk, chunk + CHUNK_HEADER_SIZE, stored_size)) {
+            break;
+        }
+        if (block_start) {
+            blocks_.push_back(Block{lsn, 0, position, 0});
+        }
+        Block& block = blocks_.back();
+        block.raw_size += raw_size & ~BLOCK_START_FLAG;
+        position += CHUNK_HEADER_SIZE + stored_size;
+        block.physical_size = position - block.physical_offset;
+        lsn += raw_size & ~BLOCK_START_FLAG;
+    }
+    written_size_ = lsn;
+    size_ = lsn;
+    physical_size_ = position;
+    // drop a torn chunk, the next one is written in its place
+    if (file_->get_mode() == WRITE && file_size > physical_size_) {
+        file_->resize(physical_size_);
+    }
+}
+
+size_t CompressedLogFile::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+size_t CompressedLogFile::get_stored_size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return physical_size_;
+}
+
+void CompressedLogFile::start_block() {
+    deflateReset(&deflate_stream_);
+    open_block_.clear();
+    block_open_ = true;
+    blocks_.push_back(Block{written_size_, 0, physical_size_, 0});
+}
+
+void CompressedLogFile::append_chunk(const char* data, size_t size) {
+    uint32_t raw_size = static_cast<uint32_t>(size);
+    if (!block_open_ || open_block_.size() >= block_size_) {
+        start_block();
+        raw_size |= BLOCK_START_FLAG;
+    }
+    deflate_stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    deflate_stream_.avail_in = static_cast<uInt>(size);
+    chunk_buffer_.resize(CHUNK_HEADER_SIZE + size + size / 8 + 64);
+    size_t stored_size = 0;
+    // a sync flush ends the chunk on a byte boundary with all of its input
+    do {
+        if (chunk_buffer_.size() - CHUNK_HEADER_SIZE - stored_size < 64) {
+            chunk_buffer_.resize(2 * chunk_buffer_.size());
+        }
+        deflate_stream_.next_out = reinterpret_cast<Bytef*>(&chunk_buffer_[CHUNK_HEADER_SIZE + stored_size]);
+        deflate_stream_.avail_out = static_cast<uInt>(chunk_buffer_.size() - CHUNK_HEADER_SIZE - stored_size);
+        uInt avail_out = deflate_stream_.avail_out;
+        deflate(&deflate_stream_, Z_SYNC_FLUSH);
+        stored_size += avail_out - deflate_stream_.avail_out;
+    } while (deflate_stream_.avail_out == 0);
+
+    uint32_t stored = static_cast<uint32_t>(stored_size);
+    char* chunk = chunk_buffer_.data();
+    memcpy(chunk, &raw_size, sizeof(uint32_t));
+    memcpy(chunk + sizeof(uint32_t), &stored, sizeof(uint32_t));
+    uint32_t crc = chunk_crc(written_size_, chunk, chunk + CHUNK_HEADER_SIZE, stored);
+    memcpy(chunk + 2 * sizeof(uint32_t), &crc, sizeof(uint32_t));
+    size_t chunk_size = CHUNK_HEADER_SIZE + stored_size;
+    file_->resize(physical_size_ + chunk_size);
+    file_->write_block(chunk, physical_size_, chunk_size);
+
+    physical_size_ += chunk_size;
+    written_size_ += size;
+    open_block_.insert(open_block_.end(), data, data + size);
+    Block& block = blocks_.back();
+    block.raw_size += size;
+    block.physical_size = physical_size_ - block.physical_offset;
+}
+
+const std::vector<char>& CompressedLogFile::get_block(size_t index) {
+    if (block_open_ && index == blocks_.size() - 1) {
+        return open_block_;
+    }
+    if (cached_block_ == index) {
+        return cached_block_data_;
+    }
+    const Block& block = blocks_[index];
+    std::vector<char> chunks(block.physical_size);
+    file_->read_block(block.physical_offset, block.physical_size, chunks.data());
+    // the deflated bytes of the chunks form one stream
+    std::vector<char> stream;
+    stream.reserve(block.physical_size);
+    for (size_t position = 0; position + CHUNK_HEADER_SIZE <= chunks.size();) {
+        uint32_t stored_size;
+        memcpy(&stored_size, &chunks[position + sizeof(uint32_t)], sizeof(uint32_t));
+        stream.insert(stream.end(), &chunks[position + CHUNK_HEADER_SIZE],
+                      &chunks[position + CHUNK_HEADER_SIZE] + stored_size);
+        position += CHUNK_HEADER_SIZE + stored_size;
+    }
+
+    cached_block_ = SIZE_MAX;
+    cached_block_data_.resize(block.raw_size);
+    z_stream inflate_stream;
+    memset(&inflate_stream, 0, sizeof(z_stream));
+    if (inflateInit(&inflate_stream) != Z_OK) {
+        throw std::runtime_error("inflateInit failed");
+    }
+    inflate_stream.next_in = reinterpret_cast<Bytef*>(stream.data());
+    inflate_stream.avail_in = static_cast<uInt>(stream.size());
+    inflate_stream.next_out = reinterpret_cast<Bytef*>(cached_block_data_.data());
+    inflate_stream.avail_out = static_cast<uInt>(cached_block_data_.size());
+    inflate(&inflate_stream, Z_SYNC_FLUSH);
+    uint64_t inflated = inflate_stream.total_out;
+    inflateEnd(&inflate_stream);
+    if (inflated != block.raw_size) {
+        throw std::runtime_error("corrupt compressed log block");
+    }
+    cached_block_ = index;
+    return cached_block_data_;
+}
+
+void CompressedLogFile::resize(size_t new_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (new_size >= written_size_) {
+        size_ = new_size;
+        return;
+    }
+    // drop the blocks past the new end, the block it cuts is written again
+    auto it = std::upper_bound(blocks_.begin(), blocks_.end(), new_size,
+                               [](uint64_t lsn, const Block& block) { return lsn < block.lsn; });
+    size_t index = (it - blocks_.begin()) - 1;
+    const Block block = blocks_[index];
+    std::vector<char> prefix;
+    if (block.lsn < new_size) {
+        const std::vector<char>& data = get_block(index);
+        prefix.assign(data.begin(), data.begin() + (new_size - block.lsn));
+    }
+    blocks_.resize(index);
+    block_open_ = false;
+    cached_block_ = SIZE_MAX;
+    written_size_ = block.lsn;
+    physical_size_ = block.physical_offset;
+    file_->resize(physical_size_);
+    if (!prefix.empty()) {
+        append_chunk(prefix.data(), prefix.size());
+    }
+    size_ = new_size;
+}
+
+void CompressedLogFile::read_block(size_t offset, size_t size, char* block) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    assert(offset + size <= size_);
+    while (size > 0) {
+        if (offset >= written_size_) {
+            // resized but not written yet
+            memset(block, 0, size);
+            return;
+        }
+        auto it = std::upper_bound(blocks_.begin(), blocks_.end(), offset,
+                                   [](uint64_t lsn, const Block& block) { return lsn < block.lsn; });
+        size_t index = (it - blocks_.begin()) - 1;
+        const std::vector<char>& data = get_block(index);
+        uint64_t block_offset = offset - blocks_[index].lsn;
+        size_t length = std::min<uint64_t>(size, blocks_[index].raw_size - block_offset);
+        memcpy(block, data.data() + block_offset, length);
+        block += length;
+        offset += length;
+        size -= length;
+    }
+}
+
+void CompressedLogFile::write_block(const char* block, size_t offset, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    assert(offset >= written_size_ && offset + size <= size_);
+    if (offset > written_size_) {
+        std::vector<char> zeros(offset - written_size_, 0);
+        append_chunk(zeros.data(), zeros.size());
+    }
+    append_chunk(block, size);
+}
+
+}  // namespace buzzdb
@@ -0,0 +1,39 @@
+#include "log/log_flusher.h"
+
+namespace buzzdb {
+
+LogFlusher::LogFlusher(LogManager& log_manager) : log_manager_(log_manager) {}
+
+LogFlusher::~LogFlusher() { stop(); }
+
+void LogFlusher::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thread_.joinable()) {
+        return;
+    }
+    stopping_ = false;
+    thread_ = std::thread(&LogFlusher::run, this);
+}
+
+void LogFlusher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_up_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void LogFlusher::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        wake_up_.wait_for(lock, interval_, [this] { return stopping_; });
+        lock.unlock();
+        log_manager_.flush_log();
+        lock.lock();
+    }
+}
+
+}  // namespace buzzdb
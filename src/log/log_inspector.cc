@@ -0,0 +1,257 @@
+#include "log/log_inspector.h"
+
+#include <string.h>
+
+#include <chrono>
+#include <iomanip>
+#include <unordered_map>
+#include <vector>
+
+namespace buzzdb {
+
+namespace {
+
+double elapsed_seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool has_page(const LogRecordView& record) {
+    return record.type == LogManager::LogRecordType::UPDATE_RECORD ||
+           record.type == LogManager::LogRecordType::COMPENSATION_RECORD;
+}
+
+/// Print the transaction of a record, redo-only records have none
+void print_txn_id(std::ostream& out, uint64_t txn_id) {
+    if (txn_id == INVALID_TXN_ID) {
+        out << "-";
+    } else {
+        out << txn_id;
+    }
+}
+
+}  // namespace
+
+const char* get_log_record_type_name(LogManager::LogRecordType type) {
+    switch (type) {
+        case LogManager::LogRecordType::ABORT_RECORD:
+            return "ABORT";
+        case LogManager::LogRecordType::COMMIT_RECORD:
+            return "COMMIT";
+        case LogManager::LogRecordType::UPDATE_RECORD:
+            return "UPDATE";
+        case LogManager::LogRecordType::BEGIN_RECORD:
+            return "BEGIN";
+        case LogManager::LogRecordType::CHECKPOINT_RECORD:
+            return "CHECKPOINT";
+        case LogManager::LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD:
+            return "BEGIN_FUZZY_CHECKPOINT";
+        case LogManager::LogRecordType::END_FUZZY_CHECKPOINT_RECORD:
+            return "END_FUZZY_CHECKPOINT";
+        case LogManager::LogRecordType::COMPENSATION_RECORD:
+            return "CLR";
+        default:
+            return "INVALID";
+    }
+}
+
+bool LogFilter::matches(const LogRecordView& record) const {
+    if (txn_id && record.txn_id != *txn_id) {
+        return false;
+    }
+    if (page_id && (!has_page(record) || record.page_id != *page_id)) {
+        return false;
+    }
+    return true;
+}
+
+uint64_t LogSummary::total_records() const {
+    uint64_t total = 0;
+    for (uint64_t count : records) {
+        total += count;
+    }
+    return total;
+}
+
+uint64_t LogSummary::total_bytes() const {
+    uint64_t total = 0;
+    for (uint64_t size : bytes) {
+        total += size;
+    }
+    return total;
+}
+
+LogInspector::LogInspector(File* log_file, uint64_t start_lsn, size_t chunk_size)
+    : log_file_(log_file), start_lsn_(start_lsn), chunk_size_(chunk_size) {}
+
+LogSummary LogInspector::scan(std::ostream* out) {
+    LogSummary summary;
+    summary.start_lsn = this->start_lsn_;
+    LogReader reader(this->log_file_, this->start_lsn_, this->log_file_->size(), this->chunk_size_);
+    LogRecordView record;
+    while (reader.next(record)) {
+        if (!this->filter_.matches(record)) {
+            continue;
+        }
+        size_t type = static_cast<size_t>(record.type);
+        summary.records[type]++;
+        summary.bytes[type] += record.size;
+        if (record.delta != nullptr && record.type == LogManager::LogRecordType::UPDATE_RECORD) {
+            summary.delta_updates++;
+        }
+        // the checkpoint records belong to no transaction
+        if (record.txn_id != INVALID_TXN_ID || has_page(record)) {
+            TxnLogSummary& txn = summary.txns[record.txn_id];
+            txn.records++;
+            txn.bytes += record.size;
+            txn.page_writes += has_page(record) ? 1 : 0;
+            if (txn.first_lsn == INVALID_LSN) {
+                txn.first_lsn = record.lsn;
+            }
+            txn.last_lsn = record.lsn;
+            txn.committed |= record.type == LogManager::LogRecordType::COMMIT_RECORD;
+            txn.aborted |= record.type == LogManager::LogRecordType::ABORT_RECORD;
+        }
+        if (out != nullptr) {
+            print_record(*out, record);
+        }
+    }
+    summary.end_lsn = reader.get_next_lsn();
+    return summary;
+}
+
+RedoTiming LogInspector::time_redo() {
+    RedoTiming timing;
+    LogRecordView record;
+    auto start = std::chrono::steady_clock::now();
+    {
+        LogReader reader(this->log_file_, this->start_lsn_, this->log_file_->size(), this->chunk_size_);
+        while (reader.next(record)) {
+            timing.records++;
+        }
+        timing.bytes = reader.get_next_lsn() - this->start_lsn_;
+    }
+    timing.decode_seconds = elapsed_seconds(start);
+
+    // the pages start out empty and grow to the largest offset written
+    std::unordered_map<uint64_t, std::vector<char>> pages;
+    start = std::chrono::steady_clock::now();
+    {
+        LogReader reader(this->log_file_, this->start_lsn_, this->log_file_->size(), this->chunk_size_);
+        while (reader.next(record)) {
+            if (!has_page(record) || !this->filter_.matches(record)) {
+                continue;
+            }
+            std::vector<char>& page = pages[record.page_id];
+            if (page.size() < record.offset + record.length) {
+                page.resize(record.offset + record.length);
+            }
+            char* data = &page[record.offset];
+            if (record.delta != nullptr) {
+                apply_delta(record.delta, record.delta_size, true, data);
+            } else {
+                memcpy(data, record.after_img, record.length);
+            }
+            timing.applied++;
+        }
+    }
+    timing.redo_seconds = elapsed_seconds(start);
+    timing.pages = pages.size();
+    return timing;
+}
+
+void LogInspector::print_record(std::ostream& out, const LogRecordView& record) {
+    out << record.lsn << " " << get_log_record_type_name(record.type);
+    switch (record.type) {
+        case LogManager::LogRecordType::UPDATE_RECORD:
+            out << (record.delta != nullptr ? " (delta) " : " ");
+            print_txn_id(out, record.txn_id);
+            out << " " << record.page_id << " " << record.length << " " << record.offset;
+            break;
+        case LogManager::LogRecordType::COMPENSATION_RECORD:
+            out << " ";
+            print_txn_id(out, record.txn_id);
+            out << " " << record.page_id << " " << record.length << " " << record.offset << " "
+                << record.undo_next_lsn;
+            break;
+        case LogManager::LogRecordType::BEGIN_RECORD:
+        case LogManager::LogRecordType::ABORT_RECORD:
+            out << " " << record.txn_id;
+            break;
+        case LogManager::LogRecordType::COMMIT_RECORD: {
+            out << " " << record.txn_id;
+            if (record.payload_size >= sizeof(uint64_t)) {
+                uint64_t commit_time;
+                memcpy(&commit_time, record.payload, sizeof(uint64_t));
+                out << " " << commit_time;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    out << "\n";
+}
+
+void LogInspector::print_summary(std::ostream& out, const LogSummary& summary, bool per_txn) {
+    out << "log [" << summary.start_lsn << ", " << summary.end_lsn << "): " << summary.total_records()
+        << " records, " << summary.total_bytes() << " bytes\n";
+    out << std::left << std::setw(24) << "type" << std::right << std::setw(12) << "records" << std::setw(14)
+        << "bytes" << std::setw(12) << "avg size" << "\n";
+    for (size_t type = 1; type < LOG_RECORD_TYPE_COUNT; type++) {
+        if (summary.records[type] == 0) {
+            continue;
+        }
+        out << std::left << std::setw(24) << get_log_record_type_name(static_cast<LogManager::LogRecordType>(type))
+            << std::right << std::setw(12) << summary.records[type] << std::setw(14) << summary.bytes[type]
+            << std::setw(12) << summary.bytes[type] / summary.records[type] << "\n";
+    }
+    if (summary.delta_updates > 0) {
+        out << summary.delta_updates << " of the updates are delta updates\n";
+    }
+
+    uint64_t committed = 0;
+    uint64_t aborted = 0;
+    uint64_t running = 0;
+    for (auto& [txn_id, txn] : summary.txns) {
+        if (txn_id == INVALID_TXN_ID) {
+            continue;
+        }
+        committed += txn.committed ? 1 : 0;
+        aborted += txn.aborted ? 1 : 0;
+        running += txn.committed || txn.aborted ? 0 : 1;
+    }
+    out << committed + aborted + running << " transactions: " << committed << " committed, " << aborted
+        << " aborted, " << running << " running at the end of the log\n";
+    if (!per_txn) {
+        return;
+    }
+    out << std::setw(20) << "txn" << std::setw(10) << "records" << std::setw(12) << "bytes" << std::setw(12)
+        << "page writes" << std::setw(14) << "first lsn" << std::setw(14) << "last lsn" << "  state\n";
+    for (auto& [txn_id, txn] : summary.txns) {
+        out << std::setw(20);
+        if (txn_id == INVALID_TXN_ID) {
+            out << "redo-only";
+        } else {
+            out << txn_id;
+        }
+        out << std::setw(10) << txn.records << std::setw(12) << txn.bytes << std::setw(12) << txn.page_writes
+            << std::setw(14) << txn.first_lsn << std::setw(14) << txn.last_lsn << "  ";
+        if (txn_id == INVALID_TXN_ID) {
+            out << "-\n";
+        } else {
+            out << (txn.committed ? "committed" : txn.aborted ? "aborted" : "running") << "\n";
+        }
+    }
+}
+
+void LogInspector::print_redo_timing(std::ostream& out, const RedoTiming& timing) {
+    out << std::fixed << std::setprecision(1);
+    out << "decoded " << timing.records << " records, " << timing.bytes << " bytes in "
+        << timing.decode_seconds * 1e3 << " ms: " << timing.get_decode_throughput() << " MB/s, "
+        << (timing.decode_seconds > 0 ? timing.records / timing.decode_seconds / 1e6 : 0) << " M records/s\n";
+    out << "redo applied " << timing.applied << " records to " << timing.pages << " pages in "
+        << timing.redo_seconds * 1e3 << " ms: " << timing.get_redo_throughput() << " MB/s\n";
+    out << std::defaultfloat << std::setprecision(6);
+}
+
+}  // namespace buzzdb
@@ -1,14 +1,23 @@
-
 #include "log/log_manager.h"
 
 #include <string.h>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
-#include <iostream>
-#include <set>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
 
 #include "common/macros.h"
+#include "common/trace.h"
+#include "log/log_reader.h"
+#include "log/segmented_log_file.h"
 #include "storage/test_file.h"
 
 namespace buzzdb {
@@ -22,6 +31,7 @@ namespace buzzdb {
  Write @data of @length at an @offset the buffer page @page_id
         BufferFrame& frame = buffer_manager.fix_page(page_id, true);
         memcpy(&frame.get_data()[offset], data, length);
+        frame.set_page_lsn(lsn);
         buffer_manager.unfix_page(frame, true);
 
  * Read and Write from/to the log_file
@@ -31,128 +41,435 @@ namespace buzzdb {
    uint64_t txn_id;
    log_file_->read_block(offset, sizeof(uint64_t), reinterpret_cast<char *>(&txn_id));
    log_file_->write_block(reinterpret_cast<char *> (&txn_id), offset, sizeof(uint64_t));
+
+ * The log is read through a LogReader, see log/log_reader.h for the record layout
  */
 
+namespace {
+
+/// Only every FLUSH_LATENCY_SAMPLE_INTERVAL-th write to the log file is timed,
+/// reading the clock twice costs as much as appending a small record
+constexpr uint64_t FLUSH_LATENCY_SAMPLE_INTERVAL = 16;
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+void append_bytes(std::vector<char>& buffer, const void* data, size_t size) {
+    const char* bytes = reinterpret_cast<const char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+/// Returns the commit time of a commit record, 0 if it has none
+uint64_t get_commit_time(const LogRecordView& record) {
+    uint64_t commit_time = 0;
+    if (record.payload_size >= sizeof(uint64_t)) {
+        memcpy(&commit_time, record.payload, sizeof(uint64_t));
+    }
+    return commit_time;
+}
+
+/// Write the after image of an update or compensation record at `data`
+void redo_image(const LogRecordView& record, char* data) {
+    if (record.delta != nullptr) {
+        apply_delta(record.delta, record.delta_size, true, data);
+    } else {
+        memcpy(data, record.after_img, record.length);
+    }
+}
+
+}  // namespace
+
 LogManager::LogManager(File* log_file) {
     log_file_ = log_file;
-    log_record_type_to_count[LogRecordType::ABORT_RECORD] = 0;
-    log_record_type_to_count[LogRecordType::COMMIT_RECORD] = 0;
-    log_record_type_to_count[LogRecordType::UPDATE_RECORD] = 0;
-    log_record_type_to_count[LogRecordType::BEGIN_RECORD] = 0;
-    log_record_type_to_count[LogRecordType::CHECKPOINT_RECORD] = 0;
-    log_record_type_to_count[LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD] = 0;
-    log_record_type_to_count[LogRecordType::END_FUZZY_CHECKPOINT_RECORD] = 0;
+    segmented_log_file_ = dynamic_cast<SegmentedLogFile*>(log_file);
 }
 
 LogManager::~LogManager() {}
 
 void LogManager::reset(File* log_file) {
+    std::lock_guard<std::mutex> lock(latch_);
     log_file_ = log_file;
+    segmented_log_file_ = dynamic_cast<SegmentedLogFile*>(log_file);
     current_offset_ = 0;
-    txn_id_to_first_log_record.clear();
-    log_record_type_to_count.clear();
+    durable_lsn_ = 0;
+    log_buffer_.clear();
+    txn_id_to_last_lsn.clear();
+    txn_id_to_first_lsn.clear();
+    stats_.reset();
+    unflushed_commits_ = 0;
+    flush_listener_ = nullptr;
     fuzzy_checkpoint_page_ids.clear();
+    fuzzy_checkpoint_begin_lsn_ = INVALID_LSN;
+    fuzzy_checkpoint_buffer_manager_ = nullptr;
+    txn_id_to_undo_buffer.clear();
 }
 
 /// Get log records
 uint64_t LogManager::get_total_log_records() {
-    return log_record_type_to_count[LogRecordType::ABORT_RECORD]
-        + log_record_type_to_count[LogRecordType::COMMIT_RECORD]
-        + log_record_type_to_count[LogRecordType::UPDATE_RECORD]
-        + log_record_type_to_count[LogRecordType::BEGIN_RECORD]
-        + log_record_type_to_count[LogRecordType::CHECKPOINT_RECORD]
-        + log_record_type_to_count[LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD]
-        + log_record_type_to_count[LogRecordType::END_FUZZY_CHECKPOINT_RECORD];
+    return this->stats_.snapshot().total_records();
 }
 
 uint64_t LogManager::get_total_log_records_of_type(LogRecordType type) {
-    return log_record_type_to_count[type];
+    return this->stats_.snapshot().records[static_cast<size_t>(type)];
+}
+
+uint64_t LogManager::get_current_lsn() {
+    std::lock_guard<std::mutex> lock(this->latch_);
+    return this->current_offset_;
+}
+
+void LogManager::begin_record(LogRecordType type, uint64_t txn_id) {
+    uint64_t prev_lsn = INVALID_LSN;
+    auto it = this->txn_id_to_last_lsn.find(txn_id);
+    if (it != this->txn_id_to_last_lsn.end()) {
+        prev_lsn = it->second;
+    }
+    const unsigned char TYPE = static_cast<unsigned char>(type);
+    // size and crc are filled in by end_record()
+    this->record_buffer_.assign(RECORD_PREFIX_SIZE, 0);
+    append_bytes(this->record_buffer_, &TYPE, sizeof(unsigned char));
+    append_bytes(this->record_buffer_, &txn_id, sizeof(uint64_t));
+    append_bytes(this->record_buffer_, &prev_lsn, sizeof(uint64_t));
+}
+
+uint64_t LogManager::end_record(bool flush) {
+    uint64_t lsn = this->current_offset_;
+    char* data = this->record_buffer_.data();
+    uint32_t size = static_cast<uint32_t>(this->record_buffer_.size());
+    memcpy(data, &size, sizeof(uint32_t));
+    // the crc lets the reader detect a torn tail, so the record is written at once
+    uint32_t crc = record_crc(lsn, data, size);
+    memcpy(data + sizeof(uint32_t), &crc, sizeof(uint32_t));
+    unsigned char type = static_cast<unsigned char>(data[RECORD_PREFIX_SIZE]) & ~DELTA_RECORD_FLAG;
+    bool is_commit = type == static_cast<unsigned char>(LogRecordType::COMMIT_RECORD);
+    this->stats_.add_record(type, size);
+    if (flush && this->log_buffer_.empty()) {
+        TraceScope scope(TracePhase::LOG_FLUSH);
+        bool timed = this->flushes_++ % FLUSH_LATENCY_SAMPLE_INTERVAL == 0;
+        auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        {
+            TraceScope resize_scope(TracePhase::LOG_RESIZE);
+            this->log_file_->resize(lsn + size);
+        }
+        this->log_file_->write_block(data, lsn, size);
+        this->durable_lsn_ = lsn + size;
+        this->stats_.add_flush(size, timed ? elapsed_ns(start) : NOT_TIMED, is_commit ? 1 : 0);
+        if (this->flush_listener_) {
+            this->flush_listener_(lsn, data, size);
+        }
+    } else {
+        this->log_buffer_.insert(this->log_buffer_.end(), data, data + size);
+        this->unflushed_commits_ += is_commit ? 1 : 0;
+        if (flush || this->log_buffer_.size() >= this->max_unflushed_bytes_) {
+            this->flush_log_buffer();
+        }
+    }
+    this->current_offset_ += size;
+    return lsn;
+}
+
+void LogManager::flush_log_buffer() {
+    if (this->log_buffer_.empty()) {
+        return;
+    }
+    TraceScope scope(TracePhase::LOG_FLUSH);
+    size_t size = this->log_buffer_.size();
+    bool timed = this->flushes_++ % FLUSH_LATENCY_SAMPLE_INTERVAL == 0;
+    auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    {
+        TraceScope resize_scope(TracePhase::LOG_RESIZE);
+        this->log_file_->resize(this->durable_lsn_ + size);
+    }
+    this->log_file_->write_block(this->log_buffer_.data(), this->durable_lsn_, size);
+    if (this->flush_listener_) {
+        this->flush_listener_(this->durable_lsn_, this->log_buffer_.data(), size);
+    }
+    this->durable_lsn_ += size;
+    this->stats_.add_flush(size, timed ? elapsed_ns(start) : NOT_TIMED, this->unflushed_commits_);
+    this->log_buffer_.clear();
+    this->unflushed_commits_ = 0;
+}
+
+void LogManager::flush_log(uint64_t lsn) {
+    std::lock_guard<std::mutex> lock(this->latch_);
+    if (lsn >= this->durable_lsn_) {
+        this->flush_log_buffer();
+    }
+}
+
+uint64_t LogManager::get_durable_lsn() {
+    // no latch: the buffer manager asks while a rollback holds it and fixes pages
+    return this->durable_lsn_;
+}
+
+void LogManager::set_flush_listener(FlushListener listener, uint64_t start_lsn) {
+    std::lock_guard<std::mutex> lock(this->latch_);
+    if (listener) {
+        std::vector<char> block;
+        for (uint64_t lsn = start_lsn; lsn < this->durable_lsn_; lsn += block.size()) {
+            block.resize(std::min<uint64_t>(this->durable_lsn_ - lsn, this->log_reader_chunk_size_));
+            this->log_file_->read_block(lsn, block.size(), block.data());
+            listener(lsn, block.data(), block.size());
+        }
+    }
+    this->flush_listener_ = std::move(listener);
 }
 
 /**
  * Increment the ABORT_RECORD count.
- * Rollback the provided transaction.
- * Add abort log record to the log file.
+ * Rollback the provided transaction, from its in-memory undo buffer unless it
+ * spilled past the budget, in which case its backward chain in the log file is followed.
+ * Every undone update is logged with a compensation record.
+ * Add abort log record to the log file once the rollback is complete.
  * Remove from the active transactions.
  */
 void LogManager::log_abort(uint64_t txn_id, BufferManager& buffer_manager) {
-    this->log_file_->resize(this->current_offset_ + sizeof(unsigned char) + sizeof(uint64_t));
-    const unsigned char TYPE = static_cast<unsigned char>(LogRecordType::ABORT_RECORD);
-    this->log_file_->write_block(reinterpret_cast<char*>(&txn_id), current_offset_ + sizeof(unsigned char), sizeof(uint64_t));
-    this->log_file_->write_block(reinterpret_cast<const char*>(&TYPE), current_offset_, sizeof(unsigned char));
-    this->current_offset_ += sizeof(unsigned char) + sizeof(uint64_t);
-    this->log_record_type_to_count[LogRecordType::ABORT_RECORD]++;
-    this->rollback_txn(txn_id, buffer_manager);
-    this->txn_id_to_first_log_record.erase(txn_id);
+    TraceScope scope(TracePhase::LOG_APPEND, txn_id);
+    std::lock_guard<std::mutex> lock(this->latch_);
+    if (this->lazy_begin_ && this->txn_id_to_last_lsn.count(txn_id) == 0) {
+        // it did not update anything, nothing was logged
+        return;
+    }
+    auto undo_buffer = this->txn_id_to_undo_buffer.find(txn_id);
+    if (undo_buffer != this->txn_id_to_undo_buffer.end() && !undo_buffer->second.spilled) {
+        this->apply_undo_buffer(txn_id, undo_buffer->second, buffer_manager);
+    } else {
+        this->rollback_txn_chain(txn_id, buffer_manager);
+    }
+    if (undo_buffer != this->txn_id_to_undo_buffer.end()) {
+        this->txn_id_to_undo_buffer.erase(undo_buffer);
+    }
+    this->begin_record(LogRecordType::ABORT_RECORD, txn_id);
+    this->end_record();
+    this->txn_id_to_last_lsn.erase(txn_id);
+    this->txn_id_to_first_lsn.erase(txn_id);
+}
+
+void LogManager::apply_undo_buffer(uint64_t txn_id, const UndoBuffer& undo_buffer, BufferManager& buffer_manager) {
+    for (auto it = undo_buffer.entries.rbegin(); it != undo_buffer.entries.rend(); ++it) {
+        this->compensate(txn_id, it->page_id, it->length, it->offset,
+                         reinterpret_cast<const char*>(&undo_buffer.images[it->image_offset]),
+                         it->prev_lsn, buffer_manager);
+    }
+}
+
+void LogManager::compensate(uint64_t txn_id, uint64_t page_id, uint64_t length, uint64_t offset,
+                            const char* before_img, uint64_t undo_next_lsn, BufferManager& buffer_manager) {
+    this->begin_record(LogRecordType::COMPENSATION_RECORD, txn_id);
+    append_bytes(this->record_buffer_, &page_id, sizeof(uint64_t));
+    append_bytes(this->record_buffer_, &length, sizeof(uint64_t));
+    append_bytes(this->record_buffer_, &offset, sizeof(uint64_t));
+    append_bytes(this->record_buffer_, &undo_next_lsn, sizeof(uint64_t));
+    append_bytes(this->record_buffer_, before_img, length);
+    uint64_t clr_lsn = this->end_record();
+    this->txn_id_to_last_lsn[txn_id] = clr_lsn;
+
+    BufferFrame& frame = buffer_manager.fix_page(page_id, true);
+    memcpy(&frame.get_data()[offset], before_img, length);
+    frame.set_page_lsn(clr_lsn);
+    buffer_manager.unfix_page(frame, true);
+}
+
+void LogManager::undo_update(const LogRecordView& record, BufferManager& buffer_manager) {
+    if (record.delta == nullptr) {
+        this->compensate(record.txn_id, record.page_id, record.length, record.offset,
+                         record.before_img, record.prev_lsn, buffer_manager);
+        return;
+    }
+    // outside of the changed ranges the images are equal, those bytes are taken from the page
+    std::vector<char> before_img(record.length);
+    BufferFrame& frame = buffer_manager.fix_page(record.page_id, false);
+    memcpy(before_img.data(), &frame.get_data()[record.offset], record.length);
+    buffer_manager.unfix_page(frame, false);
+    apply_delta(record.delta, record.delta_size, false, before_img.data());
+    this->compensate(record.txn_id, record.page_id, record.length, record.offset,
+                     before_img.data(), record.prev_lsn, buffer_manager);
 }
 
 /**
  * Increment the COMMIT_RECORD count
- * Add commit log record to the log file
+ * Add commit log record with the commit time to the log file, or only to the
+ * log buffer for an asynchronous commit
  * Remove from the active transactions
  */
-void LogManager::log_commit(uint64_t txn_id) {
-    this->log_file_->resize(this->current_offset_ + sizeof(unsigned char) + sizeof(uint64_t));
-    const unsigned char TYPE = static_cast<unsigned char>(LogRecordType::COMMIT_RECORD);
-    this->log_file_->write_block(reinterpret_cast<char*>(&txn_id), current_offset_ + sizeof(unsigned char), sizeof(uint64_t));
-    this->log_file_->write_block(reinterpret_cast<const char*>(&TYPE), current_offset_, sizeof(unsigned char));
-    this->current_offset_ += sizeof(unsigned char) + sizeof(uint64_t);
-    this->log_record_type_to_count[LogRecordType::COMMIT_RECORD]++;
-    this->txn_id_to_first_log_record.erase(txn_id);
+uint64_t LogManager::log_commit(uint64_t txn_id, bool async) {
+    TraceScope scope(TracePhase::LOG_APPEND, txn_id);
+    uint64_t commit_time = now_us();
+    std::lock_guard<std::mutex> lock(this->latch_);
+    if (this->lazy_begin_ && this->txn_id_to_last_lsn.count(txn_id) == 0) {
+        // a read-only transaction, nothing to make durable
+        return INVALID_LSN;
+    }
+    this->begin_record(LogRecordType::COMMIT_RECORD, txn_id);
+    append_bytes(this->record_buffer_, &commit_time, sizeof(uint64_t));
+    uint64_t lsn = this->end_record(!async);
+    this->txn_id_to_last_lsn.erase(txn_id);
+    this->txn_id_to_first_lsn.erase(txn_id);
+    this->txn_id_to_undo_buffer.erase(txn_id);
+    return lsn;
 }
 
 /**
  * Increment the UPDATE_RECORD count
  * Add the update log record to the log file
+ * Keep the before image in the undo buffer of the transaction
  * @param txn_id		transaction id
  * @param page_id		buffer page id
  * @param length		length of the update tuple
  * @param offset 		offset to the tuple in the buffer page
  * @param before_img	before image of the buffer page at the given offset
  * @param after_img		after image of the buffer page at the given offset
+ * @return              LSN of the record, to be set as the page LSN
  */
-void LogManager::log_update(uint64_t txn_id, uint64_t page_id, uint64_t length, uint64_t offset, std::byte* before_img, std::byte* after_img) {
-    this->log_file_->resize(this->current_offset_ + sizeof(unsigned char) + 4 * sizeof(uint64_t) + 2 * length);
-    const unsigned char TYPE = static_cast<unsigned char>(LogRecordType::UPDATE_RECORD);
-    this->log_file_->write_block(reinterpret_cast<char*>(&txn_id), current_offset_ + sizeof(unsigned char), sizeof(uint64_t));
-    this->log_file_->write_block(reinterpret_cast<char*>(&page_id), current_offset_ + sizeof(unsigned char) + sizeof(uint64_t), sizeof(uint64_t));
-    this->log_file_->write_block(reinterpret_cast<char*>(&length), current_offset_ + sizeof(unsigned char) + 2 * sizeof(uint64_t), sizeof(uint64_t));
-    this->log_file_->write_block(reinterpret_cast<char*>(&offset), current_offset_ + sizeof(unsigned char) + 3 * sizeof(uint64_t), sizeof(uint64_t));
-    this->log_file_->write_block(reinterpret_cast<char*>(before_img), current_offset_ + sizeof(unsigned char) + 4 * sizeof(uint64_t), length);
-    this->log_file_->write_block(reinterpret_cast<char*>(after_img), current_offset_ + sizeof(unsigned char) + 4 * sizeof(uint64_t) + length, length);
-    this->log_file_->write_block(reinterpret_cast<const char*>(&TYPE), current_offset_, sizeof(unsigned char));
-    this->current_offset_ += sizeof(unsigned char) + 4 * sizeof(uint64_t) + 2 * length;
-    this->log_record_type_to_count[LogRecordType::UPDATE_RECORD]++;
+uint64_t LogManager::log_update(uint64_t txn_id, uint64_t page_id, uint64_t length, uint64_t offset, std::byte* before_img, std::byte* after_img) {
+    TraceScope scope(TracePhase::LOG_APPEND, txn_id);
+    std::lock_guard<std::mutex> lock(this->latch_);
+    auto last_lsn = this->txn_id_to_last_lsn.find(txn_id);
+    if (this->lazy_begin_ && txn_id != INVALID_TXN_ID && last_lsn == this->txn_id_to_last_lsn.end()) {
+        // the first update of the transaction, the update record writes both
+        this->append_txn_begin(txn_id, false);
+        last_lsn = this->txn_id_to_last_lsn.find(txn_id);
+    }
+    uint64_t prev_lsn = last_lsn == this->txn_id_to_last_lsn.end() ? INVALID_LSN : last_lsn->second;
+    this->begin_record(LogRecordType::UPDATE_RECORD, txn_id);
+    append_bytes(this->record_buffer_, &page_id, sizeof(uint64_t));
+    append_bytes(this->record_buffer_, &length, sizeof(uint64_t));
+    append_bytes(this->record_buffer_, &offset, sizeof(uint64_t));
+    if (this->delta_updates_ && append_delta(this->record_buffer_, before_img, after_img, length)) {
+        this->record_buffer_[RECORD_PREFIX_SIZE] |= DELTA_RECORD_FLAG;
+    } else {
+        append_bytes(this->record_buffer_, before_img, length);
+        append_bytes(this->record_buffer_, after_img, length);
+    }
+    uint64_t lsn = this->end_record();
+    if (txn_id != INVALID_TXN_ID) {
+        this->txn_id_to_last_lsn[txn_id] = lsn;
+    }
+
+    auto it = this->txn_id_to_undo_buffer.find(txn_id);
+    if (it == this->txn_id_to_undo_buffer.end() || it->second.spilled) {
+        return lsn;
+    }
+    UndoBuffer& undo_buffer = it->second;
+    if (undo_buffer.images.size() + length > this->undo_buffer_budget_) {
+        // release the memory, abort falls back to the log file
+        undo_buffer.spilled = true;
+        std::vector<UndoEntry>().swap(undo_buffer.entries);
+        std::vector<std::byte>().swap(undo_buffer.images);
+        return lsn;
+    }
+    size_t image_offset = undo_buffer.images.size();
+    undo_buffer.images.insert(undo_buffer.images.end(), before_img, before_img + length);
+    undo_buffer.entries.push_back(UndoEntry{prev_lsn, page_id, offset, length, image_offset});
+    return lsn;
 }
 
 /**
  * Increment the BEGIN_RECORD count
  * Add the begin log record to the log file
  * Add to the active transactions
+ * Create the undo buffer of the transaction
+ * With lazy begins, nothing: the first update of the transaction does it
  */
 void LogManager::log_txn_begin(uint64_t txn_id) {
-    this->log_file_->resize(this->current_offset_ + sizeof(unsigned char) + sizeof(uint64_t));
-    const unsigned char TYPE = static_cast<unsigned char>(LogRecordType::BEGIN_RECORD);
-    this->log_file_->write_block(reinterpret_cast<char*>(&txn_id), current_offset_ + sizeof(unsigned char), sizeof(uint64_t));
-    this->log_file_->write_block(reinterpret_cast<const char*>(&TYPE), current_offset_, sizeof(unsigned char));
-    this->current_offset_ += sizeof(unsigned char) + sizeof(uint64_t);
-    uint64_t total_records = this->get_total_log_records();
-    this->log_record_type_to_count[LogRecordType::BEGIN_RECORD]++;
-    this->txn_id_to_first_log_record.insert({txn_id, total_records});
+    if (this->lazy_begin_) {
+        return;
+    }
+    TraceScope scope(TracePhase::LOG_APPEND, txn_id);
+    std::lock_guard<std::mutex> lock(this->latch_);
+    this->append_txn_begin(txn_id, true);
+}
+
+void LogManager::append_txn_begin(uint64_t txn_id, bool flush) {
+    this->begin_record(LogRecordType::BEGIN_RECORD, txn_id);
+    uint64_t lsn = this->end_record(flush);
+    this->txn_id_to_last_lsn[txn_id] = lsn;
+    this->txn_id_to_first_lsn[txn_id] = lsn;
+    this->txn_id_to_undo_buffer[txn_id];
+}
+
+void LogManager::append_active_txn_table() {
+    uint64_t count = this->txn_id_to_last_lsn.size();
+    append_bytes(this->record_buffer_, &count, sizeof(uint64_t));
+    for (auto& [txn_id, last_lsn] : this->txn_id_to_last_lsn) {
+        append_bytes(this->record_buffer_, &txn_id, sizeof(uint64_t));
+        append_bytes(this->record_buffer_, &last_lsn, sizeof(uint64_t));
+    }
+}
+
+uint64_t LogManager::get_log_start_lsn() const {
+    return this->segmented_log_file_ == nullptr ? 0 : this->segmented_log_file_->get_start_lsn();
+}
+
+void LogManager::load_checkpoint_tables(const LogRecordView& record, DirtyPageTable& dirty_page_table) {
+    const char* payload = record.payload;
+    const char* payload_end = record.payload + record.payload_size;
+    // both tables are a count followed by pairs
+    auto read_table = [&payload, payload_end](auto&& add_entry) {
+        uint64_t count = 0;
+        if (payload_end - payload < static_cast<ptrdiff_t>(sizeof(uint64_t))) {
+            return;
+        }
+        memcpy(&count, payload, sizeof(uint64_t));
+        payload += sizeof(uint64_t);
+        if (count > static_cast<uint64_t>(payload_end - payload) / (2 * sizeof(uint64_t))) {
+            payload = payload_end;
+            return;
+        }
+        for (uint64_t i = 0; i < count; i++, payload += 2 * sizeof(uint64_t)) {
+            uint64_t key;
+            uint64_t lsn;
+            memcpy(&key, payload, sizeof(uint64_t));
+            memcpy(&lsn, payload + sizeof(uint64_t), sizeof(uint64_t));
+            add_entry(key, lsn);
+        }
+    };
+    read_table([this](uint64_t txn_id, uint64_t last_lsn) {
+        // a transaction already seen by the analysis has newer records
+        this->txn_id_to_last_lsn.emplace(txn_id, last_lsn);
+    });
+    read_table([&dirty_page_table](uint64_t page_id, uint64_t rec_lsn) {
+        auto entry = dirty_page_table.try_emplace(page_id, DirtyPageEntry{rec_lsn, INVALID_LSN});
+        if (!entry.second) {
+            entry.first->second.rec_lsn = std::min(entry.first->second.rec_lsn, rec_lsn);
+        }
+    });
+}
+
+void LogManager::truncate_log(uint64_t checkpoint_lsn, uint64_t min_rec_lsn) {
+    if (this->segmented_log_file_ == nullptr) {
+        return;
+    }
+    this->segmented_log_file_->write_master_record(checkpoint_lsn);
+    // the loser transactions are rolled back by following their backward chains
+    uint64_t lsn = std::min(checkpoint_lsn, min_rec_lsn);
+    for (auto& entry : this->txn_id_to_first_lsn) {
+        lsn = std::min(lsn, entry.second);
+    }
+    this->segmented_log_file_->truncate_before(lsn);
 }
 
 /**
  * Increment the CHECKPOINT_RECORD count
  * Flush all dirty pages to the disk (USE: buffer_manager.flush_all_pages())
  * Add the checkpoint log record to the log file
+ * Recovery can start at the checkpoint, the log before it can be truncated
+ * No updates may run concurrently, use a fuzzy checkpoint otherwise
  */
 void LogManager::log_checkpoint(BufferManager& buffer_manager) {
     buffer_manager.flush_all_pages();
-    this->log_file_->resize(this->current_offset_ + sizeof(unsigned char));
-    const unsigned char TYPE = static_cast<unsigned char>(LogRecordType::CHECKPOINT_RECORD);
-    this->log_file_->write_block(reinterpret_cast<const char*>(&TYPE), current_offset_, sizeof(unsigned char));
-    this->current_offset_ += sizeof(unsigned char);
-    this->log_record_type_to_count[LogRecordType::CHECKPOINT_RECORD]++;
+    std::lock_guard<std::mutex> lock(this->latch_);
+    this->begin_record(LogRecordType::CHECKPOINT_RECORD, INVALID_TXN_ID);
+    this->append_active_txn_table();
+    uint64_t lsn = this->end_record();
+    this->truncate_log(lsn, INVALID_LSN);
 }
 
 /**
@@ -162,306 +479,587 @@ void LogManager::log_checkpoint(BufferManager& buffer_manager) {
  * Add the fuzzy checkpoint begin log record to the log file
  */
 size_t LogManager::log_fuzzy_checkpoint_begin(BufferManager& buffer_manager) {
-    this->fuzzy_checkpoint_page_ids = buffer_manager.get_dirty_page_ids();
-    this->log_file_->resize(this->current_offset_ + sizeof(unsigned char));
-    const unsigned char TYPE = static_cast<unsigned char>(LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD);
-    this->log_file_->write_block(reinterpret_cast<const char*>(&TYPE), current_offset_, sizeof(unsigned char));
-    this->current_offset_ += sizeof(unsigned char);
-    this->log_record_type_to_count[LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD]++;
+    std::vector<uint64_t> page_ids = buffer_manager.get_dirty_page_ids();
+    std::lock_guard<std::mutex> lock(this->latch_);
+    this->fuzzy_checkpoint_page_ids = std::move(page_ids);
+    this->fuzzy_checkpoint_buffer_manager_ = &buffer_manager;
+    this->begin_record(LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD, INVALID_TXN_ID);
+    this->fuzzy_checkpoint_begin_lsn_ = this->end_record();
     return this->fuzzy_checkpoint_page_ids.size();
 }
 
 /**
  * Flush the page at the given step of the fuzzy checkpoint (if it is not already flushed)
+ * A page that is fixed is skipped, the end record has it in its dirty page table
  */
-void LogManager::log_fuzzy_checkpoint_do_step(BufferManager& buffer_manager, size_t step) {
-    if (step >= this->fuzzy_checkpoint_page_ids.size()) {
-        return;
+bool LogManager::log_fuzzy_checkpoint_do_step(BufferManager& buffer_manager, size_t step) {
+    uint64_t page_id;
+    {
+        std::lock_guard<std::mutex> lock(this->latch_);
+        if (step >= this->fuzzy_checkpoint_page_ids.size()) {
+            return true;
+        }
+        page_id = this->fuzzy_checkpoint_page_ids[step];
     }
-    uint64_t page_id = this->fuzzy_checkpoint_page_ids[step];
-    buffer_manager.flush_page(page_id);
+    return buffer_manager.try_flush_page(page_id);
 }
 
 /**
  * Increment the END_FUZZY_CHECKPOINT_RECORD count
- * Add the fuzzy checkpoint end log record to the log file
+ * Add the fuzzy checkpoint end log record to the log file, with the active
+ * transaction table and the pages that are still dirty with their recLSN
+ * Recovery can start at the begin record, the log before it and before the
+ * recLSNs can be truncated
  */
 void LogManager::log_fuzzy_checkpoint_end() {
-    this->log_file_->resize(this->current_offset_ + sizeof(unsigned char));
-    const unsigned char TYPE = static_cast<unsigned char>(LogRecordType::END_FUZZY_CHECKPOINT_RECORD);
-    this->log_file_->write_block(reinterpret_cast<const char*>(&TYPE), current_offset_, sizeof(unsigned char));
-    this->current_offset_ += sizeof(unsigned char);
-    this->log_record_type_to_count[LogRecordType::END_FUZZY_CHECKPOINT_RECORD]++;
+    BufferManager* buffer_manager;
+    {
+        std::lock_guard<std::mutex> lock(this->latch_);
+        buffer_manager = this->fuzzy_checkpoint_buffer_manager_;
+    }
+    // pages dirtied after the snapshot are covered by the records after the begin record
+    std::vector<std::pair<uint64_t, uint64_t>> dirty_pages;
+    if (buffer_manager != nullptr) {
+        dirty_pages = buffer_manager->get_dirty_page_table();
+    }
+
+    std::lock_guard<std::mutex> lock(this->latch_);
+    this->begin_record(LogRecordType::END_FUZZY_CHECKPOINT_RECORD, INVALID_TXN_ID);
+    this->append_active_txn_table();
+    uint64_t count = dirty_pages.size();
+    uint64_t min_rec_lsn = INVALID_LSN;
+    append_bytes(this->record_buffer_, &count, sizeof(uint64_t));
+    for (auto& [page_id, rec_lsn] : dirty_pages) {
+        append_bytes(this->record_buffer_, &page_id, sizeof(uint64_t));
+        append_bytes(this->record_buffer_, &rec_lsn, sizeof(uint64_t));
+        min_rec_lsn = std::min(min_rec_lsn, rec_lsn);
+    }
+    this->end_record();
     this->fuzzy_checkpoint_page_ids.clear();
+    this->fuzzy_checkpoint_buffer_manager_ = nullptr;
+    if (this->fuzzy_checkpoint_begin_lsn_ != INVALID_LSN) {
+        this->truncate_log(this->fuzzy_checkpoint_begin_lsn_, min_rec_lsn);
+        this->fuzzy_checkpoint_begin_lsn_ = INVALID_LSN;
+    }
 }
 
-class UpdateInfo {
-public:
-    uint64_t txn_id;
-    uint64_t page_id;
-    uint64_t length;
-    uint64_t offset;
-    std::unique_ptr<char[]> before_img;
-    std::unique_ptr<char[]> after_img;
+/**
+ * @Analysis Phase:
+ * 		1. Rebuild the active transaction table (txn_id_to_last_lsn)
+ * 		2. Rebuild the dirty page table with the recLSN of each page
+ * @Redo Phase:
+ * 		1. Repeat history from the minimum recLSN
+ * 		2. Skip pages whose pageLSN shows the record is already applied
+ * 	@Undo Phase
+ * 		1. Rollback the transactions which are not commited, writing CLRs
+ * 		2. Resume from the undo next LSN of the last CLR of a transaction, so that
+ * 		   a restarted recovery does not undo an update twice
+ * 		3. Add an abort record once a transaction is fully rolled back
+ */
+void LogManager::recovery(BufferManager& buffer_manager) {
+    std::lock_guard<std::mutex> lock(this->latch_);
+    this->stats_.reset();
+    this->txn_id_to_last_lsn.clear();
+    this->txn_id_to_first_lsn.clear();
+    this->txn_id_to_undo_buffer.clear();
+    this->fuzzy_checkpoint_begin_lsn_ = INVALID_LSN;
+    this->current_offset_ = this->log_file_->size();
+    this->durable_lsn_ = this->current_offset_;
 
-    UpdateInfo(uint64_t txn_id, uint64_t page_id, uint64_t length, uint64_t offset, std::unique_ptr<char[]> before_img, std::unique_ptr<char[]> after_img)
-        : txn_id(txn_id), page_id(page_id), length(length), offset(offset), before_img(std::move(before_img)), after_img(std::move(after_img)) {}
-};
+    DirtyPageTable dirty_page_table;
+    this->recovery_analysis(dirty_page_table);
+    this->recovery_redo(dirty_page_table, buffer_manager);
+    this->recovery_undo(buffer_manager);
+}
 
-UNUSED_ATTRIBUTE
-static void printLog(buzzdb::File *f) {
-    size_t size = f->size();
-    uint64_t current_offset = 0;
-    std::vector<UpdateInfo> updates;
-    while (current_offset < size) {
-        unsigned char type;
-        f->read_block(current_offset, sizeof(unsigned char), reinterpret_cast<char*>(&type));
-        if (type == static_cast<unsigned char>(buzzdb::LogManager::LogRecordType::INVALID_RECORD_TYPE)) {
-            break;
+void LogManager::recovery_analysis(DirtyPageTable& dirty_page_table) {
+    uint64_t start_lsn = this->get_log_start_lsn();
+    if (this->segmented_log_file_ != nullptr) {
+        uint64_t checkpoint_lsn = this->segmented_log_file_->read_master_record();
+        if (checkpoint_lsn != INVALID_LSN && checkpoint_lsn > start_lsn) {
+            start_lsn = checkpoint_lsn;
         }
-        if (type == static_cast<unsigned char>(buzzdb::LogManager::LogRecordType::CHECKPOINT_RECORD)) {
-            std::cout << "CHECKPOINT" << std::endl;
-            current_offset += sizeof(unsigned char);
-            continue;
-        }
-        if (type == static_cast<unsigned char>(buzzdb::LogManager::LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD)) {
-            std::cout << "BEGIN_FUZZY_CHECKPOINT_RECORD" << std::endl;
-            current_offset += sizeof(unsigned char);
-            continue;
+    }
+    uint64_t fuzzy_checkpoint_begin_lsn = INVALID_LSN;
+    LogReader reader(this->log_file_, start_lsn, this->current_offset_, this->log_reader_chunk_size_);
+    LogRecordView record;
+    while (reader.next(record)) {
+        uint64_t lsn = record.lsn;
+        this->stats_.add_record(static_cast<size_t>(record.type), record.size);
+        switch (record.type) {
+            case LogRecordType::BEGIN_RECORD:
+                this->txn_id_to_last_lsn[record.txn_id] = lsn;
+                break;
+            // the abort record is written once the rollback is complete
+            case LogRecordType::ABORT_RECORD:
+            case LogRecordType::COMMIT_RECORD:
+                this->txn_id_to_last_lsn.erase(record.txn_id);
+                break;
+            case LogRecordType::UPDATE_RECORD:
+            case LogRecordType::COMPENSATION_RECORD: {
+                if (record.txn_id != INVALID_TXN_ID) {
+                    this->txn_id_to_last_lsn[record.txn_id] = lsn;
+                }
+                auto entry = dirty_page_table.try_emplace(record.page_id, DirtyPageEntry{lsn, INVALID_LSN});
+                if (!entry.second && fuzzy_checkpoint_begin_lsn != INVALID_LSN &&
+                    entry.first->second.first_lsn_since_fuzzy_checkpoint == INVALID_LSN) {
+                    entry.first->second.first_lsn_since_fuzzy_checkpoint = lsn;
+                }
+                break;
+            }
+            case LogRecordType::CHECKPOINT_RECORD:
+                // all pages were flushed
+                dirty_page_table.clear();
+                this->load_checkpoint_tables(record, dirty_page_table);
+                break;
+            case LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD:
+                fuzzy_checkpoint_begin_lsn = lsn;
+                for (auto& entry : dirty_page_table) {
+                    entry.second.first_lsn_since_fuzzy_checkpoint = INVALID_LSN;
+                }
+                break;
+            case LogRecordType::END_FUZZY_CHECKPOINT_RECORD:
+                if (fuzzy_checkpoint_begin_lsn != INVALID_LSN) {
+                    // the pages dirty at the begin record were flushed, only later updates may be missing
+                    for (auto it = dirty_page_table.begin(); it != dirty_page_table.end();) {
+                        if (it->second.rec_lsn >= fuzzy_checkpoint_begin_lsn) {
+                            ++it;
+                        } else if (it->second.first_lsn_since_fuzzy_checkpoint != INVALID_LSN) {
+                            it->second.rec_lsn = it->second.first_lsn_since_fuzzy_checkpoint;
+                            ++it;
+                        } else {
+                            it = dirty_page_table.erase(it);
+                        }
+                    }
+                    fuzzy_checkpoint_begin_lsn = INVALID_LSN;
+                }
+                // except for those the end record lists, e.g. because they were fixed
+                this->load_checkpoint_tables(record, dirty_page_table);
+                break;
+            default:
+                break;
         }
-        if (type == static_cast<unsigned char>(buzzdb::LogManager::LogRecordType::END_FUZZY_CHECKPOINT_RECORD)) {
-            std::cout << "END_FUZZY_CHECKPOINT_RECORD" << std::endl;
-            current_offset += sizeof(unsigned char);
-            continue;
+    }
+    // drop a torn or corrupt tail so that new records follow the last valid one
+    this->current_offset_ = reader.get_next_lsn();
+    this->durable_lsn_ = this->current_offset_;
+    this->log_file_->resize(this->current_offset_);
+}
+
+void LogManager::recovery_redo(const DirtyPageTable& dirty_page_table, BufferManager& buffer_manager) {
+    uint64_t lsn = INVALID_LSN;
+    for (auto& entry : dirty_page_table) {
+        lsn = std::min(lsn, entry.second.rec_lsn);
+    }
+    if (lsn == INVALID_LSN) {
+        return;
+    }
+    if (this->redo_threads_ > 1) {
+        // the parallel redo keeps the pages of a wave fixed
+        size_t wave_size = buffer_manager.get_fixable_frame_count();
+        if (wave_size > 0) {
+            this->recovery_parallel_redo(dirty_page_table, wave_size, buffer_manager);
+            return;
         }
-        if (type == static_cast<unsigned char>(buzzdb::LogManager::LogRecordType::BEGIN_RECORD)) {
-            uint64_t current_txn_id;
-            f->read_block(current_offset + sizeof(unsigned char), sizeof(uint64_t), reinterpret_cast<char*>(&current_txn_id));
-            current_offset += sizeof(unsigned char) + sizeof(uint64_t);
-            std::cout << "BEGIN " << current_txn_id << std::endl;
-            continue;
+    }
+    LogReader reader(this->log_file_, lsn, this->current_offset_, this->log_reader_chunk_size_);
+    LogRecordView record;
+    while (reader.next(record)) {
+        if (record.type == LogRecordType::UPDATE_RECORD || record.type == LogRecordType::COMPENSATION_RECORD) {
+            auto entry = dirty_page_table.find(record.page_id);
+            if (entry != dirty_page_table.end() && record.lsn >= entry->second.rec_lsn) {
+                BufferFrame& frame = buffer_manager.fix_page(record.page_id, true);
+                uint64_t page_lsn = frame.get_page_lsn();
+                bool apply = page_lsn == INVALID_LSN || page_lsn < record.lsn;
+                if (apply) {
+                    redo_image(record, &frame.get_data()[record.offset]);
+                    frame.set_page_lsn(record.lsn);
+                }
+                buffer_manager.unfix_page(frame, apply);
+            }
         }
-        if (type == static_cast<unsigned char>(buzzdb::LogManager::LogRecordType::COMMIT_RECORD)) {
-            uint64_t current_txn_id;
-            f->read_block(current_offset + sizeof(unsigned char), sizeof(uint64_t), reinterpret_cast<char*>(&current_txn_id));
-            current_offset += sizeof(unsigned char) + sizeof(uint64_t);
-            std::cout << "COMMIT " << current_txn_id << std::endl;
-            continue;
+    }
+}
+
+/**
+ * Apply the update and compensation records of [start_lsn, end_lsn) whose
+ * page LSN is older, without a dirty page table: the pages of a standby
+ * were all written by this redo.
+ * The records are counted as recovery counts them.
+ */
+uint64_t LogManager::redo_log(uint64_t start_lsn, uint64_t end_lsn, BufferManager& buffer_manager) {
+    std::lock_guard<std::mutex> lock(this->latch_);
+    LogReader reader(this->log_file_, start_lsn, end_lsn, this->log_reader_chunk_size_);
+    LogRecordView record;
+    while (reader.next(record)) {
+        this->stats_.add_record(static_cast<size_t>(record.type), record.size);
+        if (record.type == LogRecordType::UPDATE_RECORD || record.type == LogRecordType::COMPENSATION_RECORD) {
+            BufferFrame& frame = buffer_manager.fix_page(record.page_id, true);
+            uint64_t page_lsn = frame.get_page_lsn();
+            bool apply = page_lsn == INVALID_LSN || page_lsn < record.lsn;
+            if (apply) {
+                redo_image(record, &frame.get_data()[record.offset]);
+                frame.set_page_lsn(record.lsn);
+            }
+            buffer_manager.unfix_page(frame, apply);
         }
-        if (type == static_cast<unsigned char>(buzzdb::LogManager::LogRecordType::ABORT_RECORD)) {
-            uint64_t current_txn_id;
-            f->read_block(current_offset + sizeof(unsigned char), sizeof(uint64_t), reinterpret_cast<char*>(&current_txn_id));
-            current_offset += sizeof(unsigned char) + sizeof(uint64_t);
-            std::cout << "ABORT " << current_txn_id << std::endl;
-        } else {
-            uint64_t current_txn_id;
-            f->read_block(current_offset + sizeof(unsigned char), sizeof(uint64_t), reinterpret_cast<char*>(&current_txn_id));
-            uint64_t length;
-            uint64_t page_id;
-            uint64_t offset;
-            f->read_block(current_offset + sizeof(unsigned char) + sizeof(uint64_t), sizeof(uint64_t), reinterpret_cast<char*>(&page_id));
-            f->read_block(current_offset + sizeof(unsigned char) + 2 * sizeof(uint64_t), sizeof(uint64_t), reinterpret_cast<char*>(&length));
-            f->read_block(current_offset + sizeof(unsigned char) + 3 * sizeof(uint64_t), sizeof(uint64_t), reinterpret_cast<char*>(&offset));
-            current_offset += sizeof(unsigned char) + 4 * sizeof(uint64_t) + 2 * length;
-            std::cout << "UPDATE " << current_txn_id << " " << page_id << " " << length << " " << offset << std::endl;
+    }
+    return reader.get_next_lsn();
+}
+
+uint64_t LogManager::log_backup_begin(BufferManager& buffer_manager) {
+    uint64_t lsn;
+    {
+        std::lock_guard<std::mutex> lock(this->latch_);
+        this->flush_log_buffer();
+        lsn = this->current_offset_;
+        // their rollback follows the backward chains
+        for (auto& entry : this->txn_id_to_first_lsn) {
+            lsn = std::min(lsn, entry.second);
         }
     }
+    // pages dirtied after the snapshot are covered by the records after `lsn`
+    for (auto& [page_id, rec_lsn] : buffer_manager.get_dirty_page_table()) {
+        lsn = std::min(lsn, rec_lsn);
+    }
+    return lsn;
 }
 
 /**
- * @Analysis Phase:
- * 		1. Get the active transactions and commited transactions
- * 		2. Restore the txn_id_to_first_log_record
- * @Redo Phase:
- * 		1. Redo the entire log tape to restore the buffer page
- * 		2. For UPDATE logs: write the after_img to the buffer page
- * 		3. For ABORT logs: rollback the transactions
- * 	@Undo Phase
- * 		1. Rollback the transactions which are active and not commited
+ * Analysis and redo in one pass: the copied pages are fuzzy, so every
+ * update and compensation record from the begin of the backup on is
+ * checked against its page LSN, there is no dirty page table to build.
+ * The log after the cut is zeroed, a record left there would otherwise be
+ * taken for one that follows the records appended by the rollbacks.
  */
-void LogManager::recovery(BufferManager& buffer_manager) {
-    this->log_record_type_to_count[LogRecordType::ABORT_RECORD] = 0;
-    this->log_record_type_to_count[LogRecordType::COMMIT_RECORD] = 0;
-    this->log_record_type_to_count[LogRecordType::UPDATE_RECORD] = 0;
-    this->log_record_type_to_count[LogRecordType::BEGIN_RECORD] = 0;
-    this->log_record_type_to_count[LogRecordType::CHECKPOINT_RECORD] = 0;
-    this->log_record_type_to_count[LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD] = 0;
-    this->log_record_type_to_count[LogRecordType::END_FUZZY_CHECKPOINT_RECORD] = 0;
+uint64_t LogManager::restore(uint64_t start_lsn, uint64_t target_lsn, uint64_t target_time,
+                             BufferManager& buffer_manager) {
+    std::lock_guard<std::mutex> lock(this->latch_);
+    this->stats_.reset();
+    this->txn_id_to_last_lsn.clear();
+    this->txn_id_to_first_lsn.clear();
+    this->txn_id_to_undo_buffer.clear();
+    this->fuzzy_checkpoint_begin_lsn_ = INVALID_LSN;
+    // the buffer manager does not flush the log for the pages written during the pass
     this->current_offset_ = this->log_file_->size();
-    uint64_t current_offset = 0;
-    std::vector<UpdateInfo> updatesPending;
-    std::vector<UpdateInfo> updatesSinceLastCheckpoint;
-    std::set<uint64_t> aborted_txns;
-
-    while (current_offset < this->current_offset_) {
-        unsigned char type;
-        this->log_file_->read_block(current_offset, sizeof(unsigned char), reinterpret_cast<char*>(&type));
-        if (type == static_cast<unsigned char>(LogRecordType::INVALID_RECORD_TYPE)) {
+    this->durable_lsn_ = this->current_offset_;
+
+    uint64_t end_lsn = start_lsn;
+    LogReader reader(this->log_file_, start_lsn, this->current_offset_, this->log_reader_chunk_size_);
+    LogRecordView record;
+    while (reader.next(record) && record.lsn <= target_lsn) {
+        if (record.type == LogRecordType::COMMIT_RECORD && get_commit_time(record) > target_time) {
             break;
         }
-        if (type == static_cast<unsigned char>(LogRecordType::CHECKPOINT_RECORD)) {
-            current_offset += sizeof(unsigned char);
-            this->log_record_type_to_count[LogRecordType::CHECKPOINT_RECORD]++;
-            updatesPending.clear();
-            updatesSinceLastCheckpoint.clear();
-            continue;
-        }
-        if (type == static_cast<unsigned char>(LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD)) {
-            current_offset += sizeof(unsigned char);
-            this->log_record_type_to_count[LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD]++;
-            updatesPending.clear();
-            updatesPending.reserve(updatesSinceLastCheckpoint.size());
-            for (auto& update : updatesSinceLastCheckpoint) {
-                updatesPending.push_back(std::move(update));
+        this->stats_.add_record(static_cast<size_t>(record.type), record.size);
+        switch (record.type) {
+            case LogRecordType::BEGIN_RECORD:
+                this->txn_id_to_last_lsn[record.txn_id] = record.lsn;
+                break;
+            case LogRecordType::ABORT_RECORD:
+            case LogRecordType::COMMIT_RECORD:
+                this->txn_id_to_last_lsn.erase(record.txn_id);
+                break;
+            case LogRecordType::UPDATE_RECORD:
+            case LogRecordType::COMPENSATION_RECORD: {
+                if (record.txn_id != INVALID_TXN_ID) {
+                    this->txn_id_to_last_lsn[record.txn_id] = record.lsn;
+                }
+                BufferFrame& frame = buffer_manager.fix_page(record.page_id, true);
+                uint64_t page_lsn = frame.get_page_lsn();
+                bool apply = page_lsn == INVALID_LSN || page_lsn < record.lsn;
+                if (apply) {
+                    redo_image(record, &frame.get_data()[record.offset]);
+                    frame.set_page_lsn(record.lsn);
+                }
+                buffer_manager.unfix_page(frame, apply);
+                break;
             }
-            updatesSinceLastCheckpoint.clear();
-            continue;
-        }
-        if (type == static_cast<unsigned char>(LogRecordType::END_FUZZY_CHECKPOINT_RECORD)) {
-            current_offset += sizeof(unsigned char);
-            this->log_record_type_to_count[LogRecordType::END_FUZZY_CHECKPOINT_RECORD]++;
-            updatesPending.clear();
-            continue;
-        }
-        if (type == static_cast<unsigned char>(LogRecordType::BEGIN_RECORD)) {
-            uint64_t txn_id;
-            this->log_file_->read_block(current_offset + sizeof(unsigned char), sizeof(uint64_t), reinterpret_cast<char*>(&txn_id));
-            uint64_t total_records = this->get_total_log_records();
-            this->txn_id_to_first_log_record.insert({txn_id, total_records});
-            current_offset += sizeof(unsigned char) + sizeof(uint64_t);
-            this->log_record_type_to_count[LogRecordType::BEGIN_RECORD]++;
-        } else if (type == static_cast<unsigned char>(LogRecordType::COMMIT_RECORD)) {
-            uint64_t txn_id;
-            this->log_file_->read_block(current_offset + sizeof(unsigned char), sizeof(uint64_t), reinterpret_cast<char*>(&txn_id));
-            txn_id_to_first_log_record.erase(txn_id);
-            current_offset += sizeof(unsigned char) + sizeof(uint64_t);
-            this->log_record_type_to_count[LogRecordType::COMMIT_RECORD]++;
-        } else if (type == static_cast<unsigned char>(LogRecordType::ABORT_RECORD)) {
-            uint64_t txn_id;
-            this->log_file_->read_block(current_offset + sizeof(unsigned char), sizeof(uint64_t), reinterpret_cast<char*>(&txn_id));
-            aborted_txns.insert(txn_id);
-            current_offset += sizeof(unsigned char) + sizeof(uint64_t);
-            this->log_record_type_to_count[LogRecordType::ABORT_RECORD]++;
-        } else {
-            uint64_t current_txn_id;
-            uint64_t length;
-            uint64_t page_id;
-            uint64_t offset;
-            this->log_file_->read_block(current_offset + sizeof(unsigned char), sizeof(uint64_t), reinterpret_cast<char*>(&current_txn_id));
-            this->log_file_->read_block(current_offset + sizeof(unsigned char) + sizeof(uint64_t), sizeof(uint64_t), reinterpret_cast<char*>(&page_id));
-            this->log_file_->read_block(current_offset + sizeof(unsigned char) + 2 * sizeof(uint64_t), sizeof(uint64_t), reinterpret_cast<char*>(&length));
-            this->log_file_->read_block(current_offset + sizeof(unsigned char) + 3 * sizeof(uint64_t), sizeof(uint64_t), reinterpret_cast<char*>(&offset));
-            std::unique_ptr<char[]> before_img = std::make_unique<char[]>(length);
-            std::unique_ptr<char[]> after_img = std::make_unique<char[]>(length);
-            this->log_file_->read_block(current_offset + sizeof(unsigned char) + 4 * sizeof(uint64_t), length, before_img.get());
-            this->log_file_->read_block(current_offset + sizeof(unsigned char) + 4 * sizeof(uint64_t) + length, length, after_img.get());
-            updatesSinceLastCheckpoint.push_back(UpdateInfo(current_txn_id, page_id, length, offset, std::move(before_img), std::move(after_img)));
-            current_offset += sizeof(unsigned char) + 4 * sizeof(uint64_t) + 2 * length;
-            this->log_record_type_to_count[LogRecordType::UPDATE_RECORD]++;
+            default:
+                break;
         }
+        end_lsn = record.lsn + record.size;
     }
 
-    if (!updatesPending.empty()) {
-        for (auto& update : updatesSinceLastCheckpoint) {
-            updatesPending.push_back(std::move(update));
-        }
-        updatesSinceLastCheckpoint.clear();
-        updatesSinceLastCheckpoint.reserve(updatesPending.size());
-        for (auto& update : updatesPending) {
-            updatesSinceLastCheckpoint.push_back(std::move(update));
-        }
-        updatesPending.clear();
+    std::vector<char> zeros(std::min<uint64_t>(this->log_file_->size() - end_lsn, this->log_reader_chunk_size_));
+    for (uint64_t lsn = end_lsn; lsn < this->log_file_->size(); lsn += zeros.size()) {
+        this->log_file_->write_block(zeros.data(), lsn, std::min<uint64_t>(zeros.size(), this->log_file_->size() - lsn));
+    }
+    this->log_file_->resize(end_lsn);
+    this->current_offset_ = end_lsn;
+    this->durable_lsn_ = end_lsn;
+    this->recovery_undo(buffer_manager);
+    return end_lsn;
+}
+
+namespace {
+
+/// An update of the parallel redo, its image is stored in the arena of its partition
+struct RedoItem {
+    size_t frame_index;
+    uint64_t lsn;
+    uint64_t offset;
+    uint64_t length;
+    size_t image_offset;
+    /// size of the changed byte ranges of a delta update, 0 for a full image
+    uint64_t delta_size;
+};
+
+struct RedoPartition {
+    std::vector<RedoItem> items;
+    std::vector<char> images;
+};
+
+}  // namespace
+
+/**
+ * The pages are taken in the order of their recLSN, so the log read by a
+ * wave starts at the first update of its pages: the later waves read less
+ * of it.
+ */
+void LogManager::recovery_parallel_redo(const DirtyPageTable& dirty_page_table, size_t wave_size,
+                                        BufferManager& buffer_manager) {
+    std::vector<std::pair<uint64_t, uint64_t>> pages;
+    pages.reserve(dirty_page_table.size());
+    for (auto& entry : dirty_page_table) {
+        pages.emplace_back(entry.first, entry.second.rec_lsn);
+    }
+    std::sort(pages.begin(), pages.end(), [](auto& a, auto& b) { return a.second < b.second; });
+    for (size_t begin = 0; begin < pages.size(); begin += wave_size) {
+        size_t end = std::min(pages.size(), begin + wave_size);
+        this->recovery_redo_wave(std::vector<std::pair<uint64_t, uint64_t>>(pages.begin() + begin,
+                                                                             pages.begin() + end),
+                                 buffer_manager);
+    }
+}
+
+/**
+ * The reader thread decodes the log into one of two sets of per-worker
+ * queues while the workers apply the other set. Each worker fixes the pages
+ * of its partition when the wave starts, their reads overlap with the
+ * decoding of the first batch, and keeps them fixed until the wave ends: the
+ * workers do not contend on the buffer manager for each record.
+ */
+void LogManager::recovery_redo_wave(const std::vector<std::pair<uint64_t, uint64_t>>& pages,
+                                    BufferManager& buffer_manager) {
+    size_t num_workers = this->redo_threads_;
+    auto worker_of = [&](uint64_t page_id) { return std::hash<uint64_t>{}(page_id) % num_workers; };
+    std::unordered_map<uint64_t, size_t> page_id_to_frame_index;
+    uint64_t start_lsn = INVALID_LSN;
+    for (size_t frame_index = 0; frame_index < pages.size(); frame_index++) {
+        page_id_to_frame_index[pages[frame_index].first] = frame_index;
+        start_lsn = std::min(start_lsn, pages[frame_index].second);
     }
+    std::vector<BufferFrame*> frames(pages.size(), nullptr);
+    std::vector<char> frame_applied(pages.size(), 0);
+
+    std::array<std::vector<RedoPartition>, 2> queues{std::vector<RedoPartition>(num_workers),
+                                                     std::vector<RedoPartition>(num_workers)};
+    std::mutex latch;
+    std::condition_variable batch_ready;
+    std::condition_variable batch_done;
+    uint64_t batch = 0;
+    /// the set of queues of the last batch handed to the workers
+    size_t applying = 0;
+    size_t pending_workers = 0;
+    bool finished = false;
 
-    for (auto& update : updatesSinceLastCheckpoint) {
-        if (aborted_txns.find(update.txn_id) == aborted_txns.end()) {
-            continue;
+    auto apply_partition = [&](RedoPartition& partition) {
+        for (auto& item : partition.items) {
+            BufferFrame& frame = *frames[item.frame_index];
+            uint64_t page_lsn = frame.get_page_lsn();
+            if (page_lsn == INVALID_LSN || page_lsn < item.lsn) {
+                char* data = &frame.get_data()[item.offset];
+                if (item.delta_size > 0) {
+                    apply_delta(&partition.images[item.image_offset], item.delta_size, true, data);
+                } else {
+                    memcpy(data, &partition.images[item.image_offset], item.length);
+                }
+                frame.set_page_lsn(item.lsn);
+                frame_applied[item.frame_index] = 1;
+            }
         }
-        BufferFrame& frame = buffer_manager.fix_page(update.page_id, true);
-        memcpy(&frame.get_data()[update.offset], update.after_img.get(), update.length);
-        buffer_manager.unfix_page(frame, true);
+        partition.items.clear();
+        partition.images.clear();
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t worker = 0; worker < num_workers; worker++) {
+        workers.emplace_back([&, worker]() {
+            for (size_t frame_index = 0; frame_index < pages.size(); frame_index++) {
+                if (worker_of(pages[frame_index].first) == worker) {
+                    frames[frame_index] = &buffer_manager.fix_page(pages[frame_index].first, true);
+                }
+            }
+            uint64_t seen_batch = 0;
+            while (true) {
+                size_t set;
+                {
+                    std::unique_lock<std::mutex> lock(latch);
+                    batch_ready.wait(lock, [&]() { return finished || batch != seen_batch; });
+                    if (batch == seen_batch) {
+                        break;
+                    }
+                    seen_batch = batch;
+                    set = applying;
+                }
+                apply_partition(queues[set][worker]);
+                std::lock_guard<std::mutex> lock(latch);
+                if (--pending_workers == 0) {
+                    batch_done.notify_one();
+                }
+            }
+            for (size_t frame_index = 0; frame_index < pages.size(); frame_index++) {
+                if (frames[frame_index] != nullptr && worker_of(pages[frame_index].first) == worker) {
+                    buffer_manager.unfix_page(*frames[frame_index], frame_applied[frame_index]);
+                }
+            }
+        });
     }
 
-    for (auto& txn_id : aborted_txns) {
-        this->rollback_txn(txn_id, buffer_manager);
+    // hand the filled queues to the workers once they applied the others,
+    // which are filled next
+    size_t filling = 0;
+    auto dispatch = [&]() {
+        std::unique_lock<std::mutex> lock(latch);
+        batch_done.wait(lock, [&]() { return pending_workers == 0; });
+        applying = filling;
+        pending_workers = num_workers;
+        batch++;
+        batch_ready.notify_all();
+        filling ^= 1;
+    };
+
+    size_t batch_size = 0;
+    LogReader reader(this->log_file_, start_lsn, this->current_offset_, this->log_reader_chunk_size_);
+    LogRecordView record;
+    while (reader.next(record)) {
+        if (record.type == LogRecordType::UPDATE_RECORD || record.type == LogRecordType::COMPENSATION_RECORD) {
+            auto entry = page_id_to_frame_index.find(record.page_id);
+            if (entry != page_id_to_frame_index.end() && record.lsn >= pages[entry->second].second) {
+                // a page always goes to the same worker, which keeps the order of its updates
+                RedoPartition& partition = queues[filling][worker_of(record.page_id)];
+                partition.items.push_back(RedoItem{entry->second, record.lsn, record.offset, record.length,
+                                                   partition.images.size(), record.delta_size});
+                if (record.delta != nullptr) {
+                    partition.images.insert(partition.images.end(), record.delta, record.delta + record.delta_size);
+                } else {
+                    partition.images.insert(partition.images.end(), record.after_img, record.after_img + record.length);
+                }
+                if (++batch_size == REDO_BATCH_SIZE) {
+                    dispatch();
+                    batch_size = 0;
+                }
+            }
+        }
+    }
+    if (batch_size > 0) {
+        dispatch();
+    }
+    {
+        std::unique_lock<std::mutex> lock(latch);
+        batch_done.wait(lock, [&]() { return pending_workers == 0; });
+        finished = true;
+        batch_ready.notify_all();
     }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
 
-    for (auto& txn_id : txn_id_to_first_log_record) {
-        if (aborted_txns.find(txn_id.first) == aborted_txns.end()) {
-            this->rollback_txn(txn_id.first, buffer_manager);
+void LogManager::recovery_undo(BufferManager& buffer_manager) {
+    std::priority_queue<uint64_t> lsns_to_undo;
+    for (auto& txn : this->txn_id_to_last_lsn) {
+        lsns_to_undo.push(txn.second);
+    }
+    LogReader reader(this->log_file_, this->get_log_start_lsn(), this->current_offset_, this->log_reader_chunk_size_);
+    LogRecordView record;
+    while (!lsns_to_undo.empty()) {
+        uint64_t lsn = lsns_to_undo.top();
+        lsns_to_undo.pop();
+        if (!reader.read(lsn, record)) {
+            // the loser would be left half rolled back
+            throw std::runtime_error("cannot read back the record at LSN " + std::to_string(lsn) +
+                                     " of a transaction to undo");
+        }
+        uint64_t next_lsn = record.prev_lsn;
+        if (record.type == LogRecordType::UPDATE_RECORD) {
+            this->undo_update(record, buffer_manager);
+        } else if (record.type == LogRecordType::COMPENSATION_RECORD) {
+            // skip the updates that were already compensated
+            next_lsn = record.undo_next_lsn;
+        }
+        if (next_lsn != INVALID_LSN) {
+            lsns_to_undo.push(next_lsn);
+        } else {
+            this->begin_record(LogRecordType::ABORT_RECORD, record.txn_id);
+            this->end_record();
+            this->txn_id_to_last_lsn.erase(record.txn_id);
         }
     }
 }
 
 /**
- * Use txn_id_to_first_log_record to get the begin of the current transaction
- * Walk through the log tape and rollback the changes by writing the before
- * image of the tuple on the buffer page.
- * Note: There might be other transactions' log records interleaved, so be careful to
- * only undo the changes corresponding to current transactions.
+ * Follow the backward chain of the transaction from its last record and
+ * rollback the changes by writing the before image of the tuple on the
+ * buffer page, each one logged with a compensation record.
  */
 void LogManager::rollback_txn(uint64_t txn_id, BufferManager& buffer_manager) {
-    auto it = this->txn_id_to_first_log_record.find(txn_id);
-    if (it == this->txn_id_to_first_log_record.end()) {
+    std::lock_guard<std::mutex> lock(this->latch_);
+    this->rollback_txn_chain(txn_id, buffer_manager);
+}
+
+void LogManager::rollback_txn_chain(uint64_t txn_id, BufferManager& buffer_manager, uint64_t savepoint_lsn) {
+    auto it = this->txn_id_to_last_lsn.find(txn_id);
+    if (it == this->txn_id_to_last_lsn.end()) {
         return;
     }
-    uint64_t current_offset = 0;
-    std::vector<UpdateInfo> updates;
-    while (current_offset < this->current_offset_) {
-        unsigned char type;
-        this->log_file_->read_block(current_offset, sizeof(unsigned char), reinterpret_cast<char*>(&type));
-        if (type == static_cast<unsigned char>(LogRecordType::INVALID_RECORD_TYPE)) {
-            break;
-        }
-        if (type == static_cast<unsigned char>(LogRecordType::CHECKPOINT_RECORD)) {
-            current_offset += sizeof(unsigned char);
-            continue;
+    uint64_t lsn = it->second;
+    // the reader only sees the log file
+    this->flush_log_buffer();
+    LogReader reader(this->log_file_, this->get_log_start_lsn(), this->current_offset_, this->log_reader_chunk_size_);
+    LogRecordView record;
+    while (lsn != INVALID_LSN && (savepoint_lsn == INVALID_LSN || lsn > savepoint_lsn)) {
+        if (!reader.read(lsn, record)) {
+            throw std::runtime_error("cannot read back the record at LSN " + std::to_string(lsn) + " of transaction " +
+                                     std::to_string(txn_id) + " to roll back");
         }
-        if (type == static_cast<unsigned char>(LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD)) {
-            current_offset += sizeof(unsigned char);
-            continue;
-        }
-        if (type == static_cast<unsigned char>(LogRecordType::END_FUZZY_CHECKPOINT_RECORD)) {
-            current_offset += sizeof(unsigned char);
-            continue;
-        }
-        if (type == static_cast<unsigned char>(LogRecordType::BEGIN_RECORD) || type == static_cast<unsigned char>(LogRecordType::COMMIT_RECORD)) {
-            current_offset += sizeof(unsigned char) + sizeof(uint64_t);
-            continue;
-        }
-        if (type == static_cast<unsigned char>(LogRecordType::ABORT_RECORD)) {
-            uint64_t current_txn_id;
-            this->log_file_->read_block(current_offset + sizeof(unsigned char), sizeof(uint64_t), reinterpret_cast<char*>(&current_txn_id));
-            current_offset += sizeof(unsigned char) + sizeof(uint64_t);
-            if (current_txn_id == txn_id) {
-                break;
-            }
-        } else {
-            uint64_t current_txn_id;
-            this->log_file_->read_block(current_offset + sizeof(unsigned char), sizeof(uint64_t), reinterpret_cast<char*>(&current_txn_id));
-            uint64_t length;
-            if (current_txn_id == txn_id) {
-                uint64_t page_id;
-                uint64_t offset;
-                this->log_file_->read_block(current_offset + sizeof(unsigned char) + sizeof(uint64_t), sizeof(uint64_t), reinterpret_cast<char*>(&page_id));
-                this->log_file_->read_block(current_offset + sizeof(unsigned char) + 2 * sizeof(uint64_t), sizeof(uint64_t), reinterpret_cast<char*>(&length));
-                this->log_file_->read_block(current_offset + sizeof(unsigned char) + 3 * sizeof(uint64_t), sizeof(uint64_t), reinterpret_cast<char*>(&offset));
-                std::unique_ptr<char[]> before_img = std::make_unique<char[]>(length);
-                std::unique_ptr<char[]> after_img = std::make_unique<char[]>(length);
-                this->log_file_->read_block(current_offset + sizeof(unsigned char) + 4 * sizeof(uint64_t), length, before_img.get());
-                this->log_file_->read_block(current_offset + sizeof(unsigned char) + 4 * sizeof(uint64_t) + length, length, after_img.get());
-                updates.push_back(UpdateInfo(current_txn_id, page_id, length, offset, std::move(before_img), std::move(after_img)));
-            } else {
-                this->log_file_->read_block(current_offset + sizeof(unsigned char) + 2 * sizeof(uint64_t), sizeof(uint64_t), reinterpret_cast<char*>(&length));
-            }
-            current_offset += sizeof(unsigned char) + 4 * sizeof(uint64_t) + 2 * length;
+        if (record.type == LogRecordType::UPDATE_RECORD) {
+            this->undo_update(record, buffer_manager);
         }
+        lsn = record.type == LogRecordType::COMPENSATION_RECORD ? record.undo_next_lsn : record.prev_lsn;
     }
+}
 
-    for (auto it = updates.rbegin(); it != updates.rend(); ++it) {
-        BufferFrame& frame = buffer_manager.fix_page(it->page_id, true);
-        memcpy(&frame.get_data()[it->offset], it->before_img.get(), it->length);
-        buffer_manager.unfix_page(frame, true);
+uint64_t LogManager::create_savepoint(uint64_t txn_id) {
+    std::lock_guard<std::mutex> lock(this->latch_);
+    auto last_lsn = this->txn_id_to_last_lsn.find(txn_id);
+    return last_lsn == this->txn_id_to_last_lsn.end() ? INVALID_LSN : last_lsn->second;
+}
+
+/**
+ * Undo the updates after the savepoint from the undo buffer, or from the
+ * backward chain in the log file if the buffer spilled. The entries undone
+ * leave the undo buffer: an entry was logged after the savepoint if the
+ * record before it was not.
+ */
+void LogManager::rollback_to_savepoint(uint64_t txn_id, uint64_t savepoint_lsn, BufferManager& buffer_manager) {
+    TraceScope scope(TracePhase::LOG_APPEND, txn_id);
+    std::lock_guard<std::mutex> lock(this->latch_);
+    auto undo_buffer = this->txn_id_to_undo_buffer.find(txn_id);
+    if (undo_buffer == this->txn_id_to_undo_buffer.end() || undo_buffer->second.spilled) {
+        this->rollback_txn_chain(txn_id, buffer_manager, savepoint_lsn);
+        return;
+    }
+    auto& entries = undo_buffer->second.entries;
+    auto& images = undo_buffer->second.images;
+    while (!entries.empty() && (savepoint_lsn == INVALID_LSN || entries.back().prev_lsn >= savepoint_lsn)) {
+        const UndoEntry& entry = entries.back();
+        this->compensate(txn_id, entry.page_id, entry.length, entry.offset,
+                         reinterpret_cast<const char*>(&images[entry.image_offset]), entry.prev_lsn,
+                         buffer_manager);
+        images.resize(entry.image_offset);
+        entries.pop_back();
     }
 }
 
@@ -0,0 +1,274 @@
+#include "log/log_reader.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/macros.h"
+
+namespace buzzdb {
+
+namespace {
+
+/// Check that the changed byte ranges of a delta update fill `delta_size` bytes
+/// and stay within the `length` bytes of the update
+bool is_valid_delta(const char* delta, uint64_t delta_size, uint64_t length) {
+    if (delta_size < sizeof(uint16_t)) {
+        return false;
+    }
+    uint16_t count;
+    memcpy(&count, delta, sizeof(uint16_t));
+    uint64_t position = sizeof(uint16_t);
+    for (uint16_t range = 0; range < count; range++) {
+        if (delta_size - position < DELTA_RANGE_HEADER_SIZE) {
+            return false;
+        }
+        uint16_t range_offset;
+        uint16_t range_length;
+        memcpy(&range_offset, delta + position, sizeof(uint16_t));
+        memcpy(&range_length, delta + position + sizeof(uint16_t), sizeof(uint16_t));
+        position += DELTA_RANGE_HEADER_SIZE;
+        if (range_offset + range_length > length || delta_size - position < 2 * uint64_t{range_length}) {
+            return false;
+        }
+        position += 2 * uint64_t{range_length};
+    }
+    return position == delta_size;
+}
+
+void append_bytes(std::vector<char>& buffer, const void* data, size_t size) {
+    const char* bytes = reinterpret_cast<const char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+}  // namespace
+
+// Ranges separated by a few equal bytes are merged, as their header would
+// cost more than the bytes in between.
+bool append_delta(std::vector<char>& buffer, const std::byte* before_img, const std::byte* after_img, uint64_t length) {
+    if (length > UINT16_MAX) {
+        return false;
+    }
+    std::vector<std::pair<uint16_t, uint16_t>> ranges;
+    uint64_t delta_size = sizeof(uint16_t);
+    uint64_t position = 0;
+    while (position < length) {
+        if (before_img[position] == after_img[position]) {
+            position++;
+            continue;
+        }
+        uint64_t end = position + 1;
+        while (end < length && before_img[end] != after_img[end]) {
+            end++;
+        }
+        if (!ranges.empty() && 2 * (position - ranges.back().first - ranges.back().second) <= DELTA_RANGE_HEADER_SIZE) {
+            delta_size += 2 * (end - ranges.back().first - ranges.back().second);
+            ranges.back().second = end - ranges.back().first;
+        } else {
+            delta_size += DELTA_RANGE_HEADER_SIZE + 2 * (end - position);
+            ranges.emplace_back(position, end - position);
+        }
+        if (delta_size >= 2 * length) {
+            return false;
+        }
+        position = end;
+    }
+    uint16_t count = ranges.size();
+    append_bytes(buffer, &count, sizeof(uint16_t));
+    for (auto& range : ranges) {
+        append_bytes(buffer, &range.first, sizeof(uint16_t));
+        append_bytes(buffer, &range.second, sizeof(uint16_t));
+        append_bytes(buffer, before_img + range.first, range.second);
+        append_bytes(buffer, after_img + range.first, range.second);
+    }
+    return true;
+}
+
+void apply_delta(const char* delta, uint64_t delta_size, bool after, char* data) {
+    uint16_t count;
+    memcpy(&count, delta, sizeof(uint16_t));
+    uint64_t position = sizeof(uint16_t);
+    for (uint16_t range = 0; range < count && position < delta_size; range++) {
+        uint16_t range_offset;
+        uint16_t range_length;
+        memcpy(&range_offset, delta + position, sizeof(uint16_t));
+        memcpy(&range_length, delta + position + sizeof(uint16_t), sizeof(uint16_t));
+        position += DELTA_RANGE_HEADER_SIZE;
+        memcpy(data + range_offset, delta + position + (after ? range_length : 0), range_length);
+        position += 2 * uint64_t{range_length};
+    }
+}
+
+LogReader::LogReader(File* log_file, uint64_t start_lsn, uint64_t end_lsn, size_t chunk_size)
+    : log_file_(log_file),
+      start_lsn_(start_lsn),
+      end_lsn_(end_lsn),
+      chunk_size_(chunk_size),
+      next_lsn_(start_lsn) {}
+
+LogReader::~LogReader() {
+    if (prefetch_.valid()) {
+        prefetch_.wait();
+    }
+}
+
+void LogReader::finish_prefetch() {
+    if (prefetch_.valid()) {
+        prefetch_.get();
+    }
+}
+
+void LogReader::load(uint64_t start, uint64_t end) {
+    finish_prefetch();
+    if (buffer_.size() < end - start) {
+        buffer_.resize(end - start);
+    }
+    log_file_->read_block(start, end - start, buffer_.data());
+    window_ = buffer_.data();
+    window_start_ = start;
+    window_end_ = end;
+}
+
+void LogReader::start_prefetch() {
+    if (window_end_ >= end_lsn_) {
+        return;
+    }
+    prefetch_start_ = window_end_;
+    prefetch_end_ = std::min<uint64_t>(end_lsn_, prefetch_start_ + chunk_size_);
+    if (prefetch_buffer_.size() < 2 * chunk_size_) {
+        prefetch_buffer_.resize(2 * chunk_size_);
+    }
+    File* log_file = log_file_;
+    char* block = prefetch_buffer_.data() + chunk_size_;
+    size_t size = prefetch_end_ - prefetch_start_;
+    uint64_t offset = prefetch_start_;
+    prefetch_ = std::async(std::launch::async, [log_file, offset, size, block]() {
+        log_file->read_block(offset, size, block);
+    });
+}
+
+bool LogReader::ensure(uint64_t lsn, uint64_t size) {
+    if (lsn < start_lsn_ || size > end_lsn_ || lsn > end_lsn_ - size) {
+        return false;
+    }
+    if (lsn >= window_start_ && lsn + size <= window_end_) {
+        return true;
+    }
+    // continue into the prefetched chunk, the tail of the window is copied in front of it
+    if (prefetch_.valid() && prefetch_start_ == window_end_ && lsn >= window_start_ && lsn <= window_end_ &&
+        window_end_ - lsn <= chunk_size_ && lsn + size <= prefetch_end_) {
+        prefetch_.get();
+        uint64_t tail = window_end_ - lsn;
+        char* data = prefetch_buffer_.data() + chunk_size_ - tail;
+        memcpy(data, window_ + (lsn - window_start_), tail);
+        std::swap(buffer_, prefetch_buffer_);
+        window_ = data;
+        window_start_ = lsn;
+        window_end_ = prefetch_end_;
+        start_prefetch();
+        return true;
+    }
+    if (lsn < window_start_) {
+        // following a backward chain, keep most of the chunk before `lsn`
+        uint64_t start = lsn - std::min<uint64_t>(lsn - start_lsn_, chunk_size_ - chunk_size_ / 4);
+        load(start, std::min<uint64_t>(end_lsn_, std::max<uint64_t>(start + chunk_size_, lsn + size)));
+        return true;
+    }
+    load(lsn, std::min<uint64_t>(end_lsn_, std::max<uint64_t>(lsn + chunk_size_, lsn + size)));
+    if (sequential_) {
+        start_prefetch();
+    }
+    return true;
+}
+
+bool LogReader::next(LogRecordView& record) {
+    sequential_ = true;
+    return decode(next_lsn_, record);
+}
+
+bool LogReader::read(uint64_t lsn, LogRecordView& record) {
+    sequential_ = false;
+    return decode(lsn, record);
+}
+
+bool LogReader::decode(uint64_t lsn, LogRecordView& record) {
+    if (!ensure(lsn, RECORD_HEADER_SIZE)) {
+        return false;
+    }
+    uint32_t size;
+    memcpy(&size, window_ + (lsn - window_start_), sizeof(uint32_t));
+    // a torn record has a zero or garbage size, it must not make us read past the log
+    if (size < RECORD_HEADER_SIZE || !ensure(lsn, size)) {
+        return false;
+    }
+    const char* data = window_ + (lsn - window_start_);
+    uint32_t crc;
+    memcpy(&crc, data + sizeof(uint32_t), sizeof(uint32_t));
+    if (crc != record_crc(lsn, data, size)) {
+        return false;
+    }
+    unsigned char type = static_cast<unsigned char>(data[RECORD_PREFIX_SIZE]);
+    bool is_delta = type & DELTA_RECORD_FLAG;
+    bool has_gsn = type & GSN_RECORD_FLAG;
+    type &= ~(DELTA_RECORD_FLAG | GSN_RECORD_FLAG);
+    if (type == static_cast<unsigned char>(LogManager::LogRecordType::INVALID_RECORD_TYPE) ||
+        type > static_cast<unsigned char>(LogManager::LogRecordType::COMPENSATION_RECORD) ||
+        (is_delta && type != static_cast<unsigned char>(LogManager::LogRecordType::UPDATE_RECORD))) {
+        return false;
+    }
+    size_t header_size = RECORD_HEADER_SIZE + (has_gsn ? sizeof(uint64_t) : 0);
+    if (size < header_size) {
+        return false;
+    }
+    record.type = static_cast<LogManager::LogRecordType>(type);
+    record.lsn = lsn;
+    record.size = size;
+    memcpy(&record.txn_id, data + RECORD_PREFIX_SIZE + sizeof(unsigned char), sizeof(uint64_t));
+    memcpy(&record.prev_lsn, data + RECORD_PREFIX_SIZE + sizeof(unsigned char) + sizeof(uint64_t), sizeof(uint64_t));
+    record.gsn = INVALID_LSN;
+    if (has_gsn) {
+        memcpy(&record.gsn, data + RECORD_HEADER_SIZE, sizeof(uint64_t));
+    }
+
+    bool is_update = record.type == LogManager::LogRecordType::UPDATE_RECORD;
+    if (is_update || record.type == LogManager::LogRecordType::COMPENSATION_RECORD) {
+        size_t fields_size = is_update ? UPDATE_FIELDS_SIZE : COMPENSATION_FIELDS_SIZE;
+        if (size < header_size + fields_size) {
+            return false;
+        }
+        const char* fields = data + header_size;
+        memcpy(&record.page_id, fields, sizeof(uint64_t));
+        memcpy(&record.length, fields + sizeof(uint64_t), sizeof(uint64_t));
+        memcpy(&record.offset, fields + 2 * sizeof(uint64_t), sizeof(uint64_t));
+        record.undo_next_lsn = INVALID_LSN;
+        if (!is_update) {
+            memcpy(&record.undo_next_lsn, fields + 3 * sizeof(uint64_t), sizeof(uint64_t));
+        }
+        const char* images = fields + fields_size;
+        if (is_delta) {
+            record.delta = images;
+            record.delta_size = size - header_size - fields_size;
+            if (!is_valid_delta(record.delta, record.delta_size, record.length)) {
+                return false;
+            }
+            record.before_img = nullptr;
+            record.after_img = nullptr;
+        } else {
+            uint64_t images_size = is_update ? 2 * record.length : record.length;
+            if (record.length > size || header_size + fields_size + images_size != size) {
+                return false;
+            }
+            record.before_img = is_update ? images : nullptr;
+            record.after_img = is_update ? images + record.length : images;
+            record.delta = nullptr;
+            record.delta_size = 0;
+        }
+    } else {
+        record.payload = data + header_size;
+        record.payload_size = size - header_size;
+    }
+    next_lsn_ = lsn + size;
+    return true;
+}
+
+}  // namespace buzzdb
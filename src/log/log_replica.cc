@@ -0,0 +1,187 @@
+#include "log/log_replica.h"
+
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+#include <vector>
+
+#include "log/log_shipper.h"
+
+namespace buzzdb {
+
+namespace {
+
+[[noreturn]] void throw_errno() { throw std::system_error{errno, std::system_category()}; }
+
+/// How long a blocked receive waits before checking for a stop
+constexpr int POLL_TIMEOUT_MS = 50;
+
+/// Wait until `socket` is readable, returns false if the standby is stopped
+bool wait_readable(int socket, const std::atomic<bool>& stopping) {
+    pollfd descriptor{socket, POLLIN, 0};
+    while (!stopping) {
+        int ready = ::poll(&descriptor, 1, POLL_TIMEOUT_MS);
+        if (ready > 0) {
+            return true;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+    return false;
+}
+
+/// Receive `size` bytes, returns false if the primary disconnected or the
+/// standby is stopped
+bool receive_all(int socket, char* data, size_t size, const std::atomic<bool>& stopping) {
+    while (size > 0) {
+        if (!wait_readable(socket, stopping)) {
+            return false;
+        }
+        ssize_t received = ::recv(socket, data, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+}  // namespace
+
+LogReplica::LogReplica(File* log_file, BufferManager& buffer_manager, std::string socket_path)
+    : log_file_(log_file),
+      buffer_manager_(buffer_manager),
+      log_manager_(log_file),
+      socket_path_(std::move(socket_path)) {}
+
+LogReplica::~LogReplica() { stop(); }
+
+void LogReplica::start() {
+    if (thread_.joinable()) {
+        return;
+    }
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path_.c_str(), sizeof(address.sun_path) - 1);
+    ::unlink(socket_path_.c_str());
+    listen_socket_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_socket_ < 0) {
+        throw_errno();
+    }
+    if (::bind(listen_socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        ::listen(listen_socket_, 1) < 0) {
+        int error = errno;
+        ::close(listen_socket_);
+        listen_socket_ = -1;
+        throw std::system_error{error, std::system_category()};
+    }
+    stopping_ = false;
+    thread_ = std::thread(&LogReplica::run, this);
+}
+
+void LogReplica::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    stopping_ = true;
+    thread_.join();
+    ::close(listen_socket_);
+    listen_socket_ = -1;
+    ::unlink(socket_path_.c_str());
+}
+
+void LogReplica::promote() {
+    stop();
+    log_manager_.recovery(buffer_manager_);
+}
+
+void LogReplica::run() {
+    while (wait_readable(listen_socket_, stopping_)) {
+        int connection = ::accept(listen_socket_, nullptr, nullptr);
+        if (connection < 0) {
+            continue;
+        }
+        receive(connection);
+        ::close(connection);
+    }
+}
+
+void LogReplica::receive(int connection) {
+    char header[LogShipper::FRAME_HEADER_SIZE];
+    std::vector<char> block;
+    while (receive_all(connection, header, LogShipper::FRAME_HEADER_SIZE, stopping_)) {
+        uint64_t lsn;
+        uint32_t size;
+        uint64_t flush_time_us;
+        memcpy(&lsn, header, sizeof(uint64_t));
+        memcpy(&size, header + sizeof(uint64_t), sizeof(uint32_t));
+        memcpy(&flush_time_us, header + sizeof(uint64_t) + sizeof(uint32_t), sizeof(uint64_t));
+        block.resize(size);
+        if (!receive_all(connection, block.data(), size, stopping_)) {
+            return;
+        }
+
+        if (lsn + size > log_file_->size()) {
+            log_file_->resize(lsn + size);
+        }
+        log_file_->write_block(block.data(), lsn, size);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            // shipping started past the replayed log
+            if (applied_lsn_ == received_lsn_ && applied_lsn_ < lsn) {
+                applied_lsn_ = lsn;
+            }
+            received_lsn_ = lsn + size;
+            pending_blocks_.emplace_back(lsn + size, flush_time_us);
+        }
+
+        uint64_t applied_lsn = log_manager_.redo_log(applied_lsn_, received_lsn_, buffer_manager_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            applied_lsn_ = applied_lsn;
+            while (!pending_blocks_.empty() && pending_blocks_.front().first <= applied_lsn) {
+                pending_blocks_.pop_front();
+            }
+        }
+        replayed_.notify_all();
+    }
+}
+
+uint64_t LogReplica::get_lag_lsn() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return received_lsn_ - applied_lsn_;
+}
+
+double LogReplica::get_lag_seconds() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_blocks_.empty()) {
+        return 0;
+    }
+    uint64_t now = now_us();
+    uint64_t flush_time_us = pending_blocks_.front().second;
+    return now > flush_time_us ? (now - flush_time_us) / 1e6 : 0;
+}
+
+bool LogReplica::wait_for_lsn(uint64_t lsn, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return replayed_.wait_for(lock, timeout, [this, lsn] { return applied_lsn_ >= lsn; });
+}
+
+}  // namespace buzzdb
@@ -0,0 +1,140 @@
+#include "log/log_shipper.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+
+namespace buzzdb {
+
+namespace {
+
+[[noreturn]] void throw_errno() { throw std::system_error{errno, std::system_category()}; }
+
+bool send_all(int socket, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = ::send(socket, data, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+}  // namespace
+
+LogShipper::LogShipper(LogManager& log_manager, std::string socket_path)
+    : log_manager_(log_manager), socket_path_(std::move(socket_path)) {}
+
+LogShipper::~LogShipper() { stop(); }
+
+void LogShipper::start(uint64_t start_lsn, std::chrono::milliseconds timeout) {
+    if (thread_.joinable()) {
+        return;
+    }
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path_.c_str(), sizeof(address.sun_path) - 1);
+
+    // the standby may still be starting
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        socket_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (socket_ < 0) {
+            throw_errno();
+        }
+        if (::connect(socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+            break;
+        }
+        int error = errno;
+        ::close(socket_);
+        socket_ = -1;
+        if ((error != ENOENT && error != ECONNREFUSED) || std::chrono::steady_clock::now() >= deadline) {
+            throw std::system_error{error, std::system_category()};
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    stopping_ = false;
+    connected_ = true;
+    shipped_lsn_ = start_lsn;
+    thread_ = std::thread(&LogShipper::run, this);
+    log_manager_.set_flush_listener(
+        [this](uint64_t lsn, const char* data, size_t size) { this->enqueue(lsn, data, size); }, start_lsn);
+}
+
+void LogShipper::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    log_manager_.set_flush_listener(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_up_.notify_all();
+    thread_.join();
+    ::close(socket_);
+    socket_ = -1;
+}
+
+void LogShipper::enqueue(uint64_t lsn, const char* data, size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!connected_) {
+            return;
+        }
+        // the sender fell behind, one frame carries both writes
+        if (!queue_.empty() && queue_.back().lsn + queue_.back().data.size() == lsn) {
+            queue_.back().data.insert(queue_.back().data.end(), data, data + size);
+            return;
+        }
+        queue_.push_back(Block{lsn, now_us(), std::vector<char>(data, data + size)});
+    }
+    wake_up_.notify_one();
+}
+
+void LogShipper::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_up_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        Block block = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+
+        char header[FRAME_HEADER_SIZE];
+        uint32_t size = static_cast<uint32_t>(block.data.size());
+        memcpy(header, &block.lsn, sizeof(uint64_t));
+        memcpy(header + sizeof(uint64_t), &size, sizeof(uint32_t));
+        memcpy(header + sizeof(uint64_t) + sizeof(uint32_t), &block.flush_time_us, sizeof(uint64_t));
+        bool sent = send_all(socket_, header, FRAME_HEADER_SIZE) && send_all(socket_, block.data.data(), size);
+
+        lock.lock();
+        if (!sent) {
+            connected_ = false;
+            queue_.clear();
+            return;
+        }
+        shipped_lsn_ = block.lsn + size;
+    }
+}
+
+}  // namespace buzzdb
@@ -0,0 +1,139 @@
+#include "log/log_stats.h"
+
+#include <algorithm>
+
+namespace buzzdb {
+
+namespace {
+
+std::atomic<uint64_t> next_stats_id{1};
+
+/// The shard the calling thread used last
+struct LocalShard {
+    uint64_t stats_id = 0;
+    void* shard = nullptr;
+};
+
+thread_local LocalShard local_shard_cache;
+
+}  // namespace
+
+uint64_t LogStatsSnapshot::total_records() const {
+    uint64_t total = 0;
+    for (uint64_t count : records) {
+        total += count;
+    }
+    return total;
+}
+
+uint64_t LogStatsSnapshot::total_bytes() const {
+    uint64_t total = 0;
+    for (uint64_t size : bytes) {
+        total += size;
+    }
+    return total;
+}
+
+void LogStats::Shard::clear() {
+    for (size_t type = 0; type < LOG_RECORD_TYPE_COUNT; type++) {
+        records[type].store(0, std::memory_order_relaxed);
+        bytes[type].store(0, std::memory_order_relaxed);
+    }
+    flushes.store(0, std::memory_order_relaxed);
+    flushed_bytes.store(0, std::memory_order_relaxed);
+    flush_latency_ns.clear();
+    group_commit_size.clear();
+}
+
+LogStats::LogStats() : id_(next_stats_id++) {}
+
+LogStats::~LogStats() {}
+
+LogStats::LogStats(const LogStats& other) : id_(next_stats_id++) { merge(other.snapshot()); }
+
+LogStats& LogStats::operator=(const LogStats& other) {
+    if (this != &other) {
+        LogStatsSnapshot snapshot = other.snapshot();
+        reset();
+        merge(snapshot);
+    }
+    return *this;
+}
+
+LogStats::Shard& LogStats::local_shard() {
+    if (local_shard_cache.stats_id == id_) {
+        return *static_cast<Shard*>(local_shard_cache.shard);
+    }
+    std::thread::id owner = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(mutex_);
+    Shard* shard = nullptr;
+    for (auto& candidate : shards_) {
+        if (candidate->owner == owner) {
+            shard = candidate.get();
+            break;
+        }
+    }
+    if (shard == nullptr) {
+        shards_.push_back(std::make_unique<Shard>());
+        shard = shards_.back().get();
+        shard->owner = owner;
+    }
+    local_shard_cache.stats_id = id_;
+    local_shard_cache.shard = shard;
+    return *shard;
+}
+
+void LogStats::add_record(size_t type, uint64_t size) {
+    Shard& shard = local_shard();
+    bump(shard.records[type], 1);
+    bump(shard.bytes[type], size);
+}
+
+void LogStats::add_flush(uint64_t bytes, uint64_t latency_ns, uint64_t commits) {
+    Shard& shard = local_shard();
+    bump(shard.flushes, 1);
+    bump(shard.flushed_bytes, bytes);
+    if (latency_ns != NOT_TIMED) {
+        shard.flush_latency_ns.add(latency_ns);
+    }
+    if (commits > 0) {
+        shard.group_commit_size.add(commits);
+    }
+}
+
+LogStatsSnapshot LogStats::snapshot() const {
+    LogStatsSnapshot snapshot;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& shard : shards_) {
+        for (size_t type = 0; type < LOG_RECORD_TYPE_COUNT; type++) {
+            snapshot.records[type] += shard->records[type].load(std::memory_order_relaxed);
+            snapshot.bytes[type] += shard->bytes[type].load(std::memory_order_relaxed);
+        }
+        snapshot.flushes += shard->flushes.load(std::memory_order_relaxed);
+        snapshot.flushed_bytes += shard->flushed_bytes.load(std::memory_order_relaxed);
+        shard->flush_latency_ns.read(snapshot.flush_latency_ns);
+        shard->group_commit_size.read(snapshot.group_commit_size);
+    }
+    return snapshot;
+}
+
+void LogStats::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& shard : shards_) {
+        shard->clear();
+    }
+}
+
+void LogStats::merge(const LogStatsSnapshot& snapshot) {
+    Shard& shard = local_shard();
+    for (size_t type = 0; type < LOG_RECORD_TYPE_COUNT; type++) {
+        bump(shard.records[type], snapshot.records[type]);
+        bump(shard.bytes[type], snapshot.bytes[type]);
+    }
+    bump(shard.flushes, snapshot.flushes);
+    bump(shard.flushed_bytes, snapshot.flushed_bytes);
+    shard.flush_latency_ns.merge(snapshot.flush_latency_ns);
+    shard.group_commit_size.merge(snapshot.group_commit_size);
+}
+
+}  // namespace buzzdb
@@ -0,0 +1,525 @@
+#include "log/partitioned_log.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+
+#include "common/trace.h"
+#include "log/log_reader.h"
+
+namespace buzzdb {
+
+namespace {
+
+/// Only every FLUSH_LATENCY_SAMPLE_INTERVAL-th write to a partition file is timed
+constexpr uint64_t FLUSH_LATENCY_SAMPLE_INTERVAL = 16;
+
+std::atomic<uint64_t> next_log_id{1};
+
+/// The partition the calling thread was assigned by the log it used last
+struct LocalPartition {
+    uint64_t log_id = 0;
+    size_t index = 0;
+};
+
+thread_local LocalPartition local_partition_cache;
+
+/// Partitions the calling thread was assigned, by log
+thread_local std::unordered_map<uint64_t, size_t> local_partitions;
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+void append_bytes(std::vector<char>& buffer, const void* data, size_t size) {
+    const char* bytes = reinterpret_cast<const char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+/// An update or compensation record to replay, its image is kept by the partition scan
+struct RedoItem {
+    uint64_t gsn;
+    uint64_t page_id;
+    uint64_t offset;
+    uint64_t length;
+    /// size of the changed byte ranges of a delta update, 0 if the after image is kept
+    uint64_t delta_size;
+    size_t image_offset;
+};
+
+/// An update of a transaction that may have to be undone
+struct UndoItem {
+    uint64_t gsn;
+    uint64_t lsn;
+    uint64_t txn_id;
+    size_t partition;
+};
+
+/// What recovery decoded from a partition
+struct PartitionScan {
+    /// records per redo worker, in GSN order
+    std::vector<std::vector<RedoItem>> redo_items;
+    std::vector<char> images;
+    std::vector<UndoItem> updates;
+    /// GSNs of the updates undone by compensation records
+    std::vector<uint64_t> compensated;
+    /// transactions with records in the partition and whether they ended
+    std::unordered_map<uint64_t, bool> txns;
+    /// end of the last valid record
+    uint64_t end_lsn = 0;
+    uint64_t max_gsn = 0;
+};
+
+/// Run `work(i)` for i in [0, count) on up to `threads` threads
+template <typename Work>
+void parallel_for(size_t count, size_t threads, Work work) {
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    for (size_t worker = 0; worker < std::min(count, std::max<size_t>(threads, 1)); worker++) {
+        workers.emplace_back([&]() {
+            for (size_t i = next++; i < count; i = next++) {
+                work(i);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+}  // namespace
+
+PartitionedLog::PartitionedLog(const std::string& directory, size_t partition_count) : id_(next_log_id++) {
+    if (partition_count == 0 || partition_count > MAX_PARTITIONS) {
+        throw std::runtime_error("a partitioned log has 1 to 256 partitions");
+    }
+    std::filesystem::create_directories(directory);
+    for (size_t index = 0; index < partition_count; index++) {
+        auto partition = std::make_unique<Partition>();
+        std::string path = directory + "/partition." + std::to_string(index);
+        partition->file = File::open_file(path.c_str(), File::WRITE);
+        partition->index = index;
+        partition->current_offset = partition->file->size();
+        partition->durable_offset = partition->current_offset;
+        this->partitions_.push_back(std::move(partition));
+    }
+}
+
+PartitionedLog::~PartitionedLog() {}
+
+PartitionedLog::Partition& PartitionedLog::local_partition() {
+    LocalPartition& cache = local_partition_cache;
+    if (cache.log_id != this->id_) {
+        auto it = local_partitions.find(this->id_);
+        if (it == local_partitions.end()) {
+            it = local_partitions.emplace(this->id_, this->next_partition_++ % this->partitions_.size()).first;
+        }
+        cache.log_id = this->id_;
+        cache.index = it->second;
+    }
+    return *this->partitions_[cache.index];
+}
+
+uint64_t PartitionedLog::next_gsn(Partition& partition, uint64_t page_lsn) {
+    uint64_t clock = partition.clock;
+    if (page_lsn != INVALID_LSN) {
+        clock = std::max(clock, page_lsn / MAX_PARTITIONS);
+    }
+    partition.clock = clock + 1;
+    return partition.clock * MAX_PARTITIONS + partition.index;
+}
+
+void PartitionedLog::begin_record(Partition& partition, LogManager::LogRecordType type, uint64_t txn_id,
+                                  uint64_t gsn) {
+    uint64_t prev_lsn = INVALID_LSN;
+    auto it = partition.txns.find(txn_id);
+    if (it != partition.txns.end()) {
+        prev_lsn = it->second.last_lsn;
+    }
+    const unsigned char TYPE = static_cast<unsigned char>(type) | GSN_RECORD_FLAG;
+    // size and crc are filled in by end_record()
+    partition.record_buffer.assign(RECORD_PREFIX_SIZE, 0);
+    append_bytes(partition.record_buffer, &TYPE, sizeof(unsigned char));
+    append_bytes(partition.record_buffer, &txn_id, sizeof(uint64_t));
+    append_bytes(partition.record_buffer, &prev_lsn, sizeof(uint64_t));
+    append_bytes(partition.record_buffer, &gsn, sizeof(uint64_t));
+}
+
+uint64_t PartitionedLog::end_record(Partition& partition, uint64_t gsn) {
+    uint64_t lsn = partition.current_offset;
+    char* data = partition.record_buffer.data();
+    uint32_t size = static_cast<uint32_t>(partition.record_buffer.size());
+    memcpy(data, &size, sizeof(uint32_t));
+    uint32_t crc = record_crc(lsn, data, size);
+    memcpy(data + sizeof(uint32_t), &crc, sizeof(uint32_t));
+    unsigned char type = static_cast<unsigned char>(data[RECORD_PREFIX_SIZE]) & ~(DELTA_RECORD_FLAG | GSN_RECORD_FLAG);
+    this->stats_.add_record(type, size);
+    if (partition.log_buffer.empty()) {
+        partition.first_unflushed_gsn = gsn;
+    }
+    partition.log_buffer.insert(partition.log_buffer.end(), data, data + size);
+    partition.last_gsn = gsn;
+    partition.unflushed_commits += type == static_cast<unsigned char>(LogManager::LogRecordType::COMMIT_RECORD);
+    partition.current_offset += size;
+    if (partition.log_buffer.size() >= this->max_unflushed_bytes_) {
+        this->flush_partition(partition);
+    }
+    return lsn;
+}
+
+void PartitionedLog::flush_partition(Partition& partition) {
+    if (partition.log_buffer.empty()) {
+        return;
+    }
+    TraceScope scope(TracePhase::LOG_FLUSH);
+    size_t size = partition.log_buffer.size();
+    bool timed = partition.flushes++ % FLUSH_LATENCY_SAMPLE_INTERVAL == 0;
+    auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    {
+        TraceScope resize_scope(TracePhase::LOG_RESIZE);
+        partition.file->resize(partition.durable_offset + size);
+    }
+    partition.file->write_block(partition.log_buffer.data(), partition.durable_offset, size);
+    partition.durable_offset += size;
+    this->stats_.add_flush(size, timed ? elapsed_ns(start) : NOT_TIMED, partition.unflushed_commits);
+    partition.log_buffer.clear();
+    partition.unflushed_commits = 0;
+    partition.durable_gsn = partition.last_gsn;
+    partition.first_unflushed_gsn = INVALID_LSN;
+}
+
+void PartitionedLog::flush_partition_to(Partition& partition, uint64_t gsn) {
+    if (partition.first_unflushed_gsn > gsn) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(partition.latch);
+    if (partition.first_unflushed_gsn <= gsn) {
+        this->flush_partition(partition);
+    }
+}
+
+void PartitionedLog::flush_log(uint64_t lsn) {
+    for (auto& partition : this->partitions_) {
+        this->flush_partition_to(*partition, lsn);
+    }
+}
+
+uint64_t PartitionedLog::get_durable_lsn() {
+    uint64_t durable_lsn = INVALID_LSN;
+    for (auto& partition : this->partitions_) {
+        durable_lsn = std::min<uint64_t>(durable_lsn, partition->first_unflushed_gsn);
+    }
+    return durable_lsn;
+}
+
+void PartitionedLog::log_txn_begin(uint64_t txn_id) {
+    TraceScope scope(TracePhase::LOG_APPEND, txn_id);
+    Partition& partition = this->local_partition();
+    std::lock_guard<std::mutex> lock(partition.latch);
+    uint64_t gsn = this->next_gsn(partition, INVALID_LSN);
+    partition.txns.erase(txn_id);
+    this->begin_record(partition, LogManager::LogRecordType::BEGIN_RECORD, txn_id, gsn);
+    partition.txns[txn_id].last_lsn = this->end_record(partition, gsn);
+}
+
+/**
+ * Add the update record to the buffer of the partition
+ * Keep the before image for a rollback
+ * Remember the partition of the last update of the page if it is not durable,
+ * the commit waits for it
+ */
+uint64_t PartitionedLog::log_update(uint64_t txn_id, uint64_t page_id, uint64_t length, uint64_t offset,
+                                    std::byte* before_img, std::byte* after_img, uint64_t page_lsn) {
+    TraceScope scope(TracePhase::LOG_APPEND, txn_id);
+    Partition& partition = this->local_partition();
+    std::lock_guard<std::mutex> lock(partition.latch);
+    uint64_t gsn = this->next_gsn(partition, page_lsn);
+    this->begin_record(partition, LogManager::LogRecordType::UPDATE_RECORD, txn_id, gsn);
+    append_bytes(partition.record_buffer, &page_id, sizeof(uint64_t));
+    append_bytes(partition.record_buffer, &length, sizeof(uint64_t));
+    append_bytes(partition.record_buffer, &offset, sizeof(uint64_t));
+    if (append_delta(partition.record_buffer, before_img, after_img, length)) {
+        partition.record_buffer[RECORD_PREFIX_SIZE] |= DELTA_RECORD_FLAG;
+    } else {
+        append_bytes(partition.record_buffer, before_img, length);
+        append_bytes(partition.record_buffer, after_img, length);
+    }
+    uint64_t lsn = this->end_record(partition, gsn);
+    if (txn_id == INVALID_TXN_ID) {
+        return gsn;
+    }
+
+    Txn& txn = partition.txns[txn_id];
+    txn.last_lsn = lsn;
+    txn.undo_entries.push_back(UndoEntry{gsn, page_id, offset, length, txn.undo_images.size()});
+    txn.undo_images.insert(txn.undo_images.end(), before_img, before_img + length);
+    size_t page_partition = get_gsn_partition(page_lsn);
+    if (page_lsn != INVALID_LSN && page_partition != partition.index && page_partition < this->partitions_.size() &&
+        page_lsn > this->partitions_[page_partition]->durable_gsn) {
+        auto dependency = std::find_if(txn.dependencies.begin(), txn.dependencies.end(),
+                                       [&](auto& entry) { return entry.first == page_partition; });
+        if (dependency == txn.dependencies.end()) {
+            txn.dependencies.emplace_back(page_partition, page_lsn);
+        } else {
+            dependency->second = std::max(dependency->second, page_lsn);
+        }
+    }
+    return gsn;
+}
+
+/**
+ * Make the last updates of the pages the transaction depends on durable
+ * Add the commit record with the commit time and write the buffer of the partition
+ * Remove from the active transactions
+ */
+uint64_t PartitionedLog::log_commit(uint64_t txn_id) {
+    TraceScope scope(TracePhase::LOG_APPEND, txn_id);
+    Partition& partition = this->local_partition();
+    std::vector<std::pair<size_t, uint64_t>> dependencies;
+    {
+        std::lock_guard<std::mutex> lock(partition.latch);
+        auto it = partition.txns.find(txn_id);
+        if (it != partition.txns.end()) {
+            dependencies = std::move(it->second.dependencies);
+        }
+    }
+    for (auto& [index, gsn] : dependencies) {
+        this->flush_partition_to(*this->partitions_[index], gsn);
+    }
+
+    uint64_t commit_time = now_us();
+    std::lock_guard<std::mutex> lock(partition.latch);
+    uint64_t gsn = this->next_gsn(partition, INVALID_LSN);
+    this->begin_record(partition, LogManager::LogRecordType::COMMIT_RECORD, txn_id, gsn);
+    append_bytes(partition.record_buffer, &commit_time, sizeof(uint64_t));
+    this->end_record(partition, gsn);
+    this->flush_partition(partition);
+    partition.txns.erase(txn_id);
+    return gsn;
+}
+
+/**
+ * Apply the before images of the transaction in reverse order, each with a
+ * compensation record referring to the GSN of the update it undoes
+ * Add the abort record
+ * Remove from the active transactions
+ */
+void PartitionedLog::log_abort(uint64_t txn_id, BufferManager& buffer_manager) {
+    TraceScope scope(TracePhase::LOG_APPEND, txn_id);
+    Partition& partition = this->local_partition();
+    std::vector<UndoEntry> undo_entries;
+    std::vector<std::byte> undo_images;
+    {
+        std::lock_guard<std::mutex> lock(partition.latch);
+        auto it = partition.txns.find(txn_id);
+        if (it != partition.txns.end()) {
+            undo_entries = std::move(it->second.undo_entries);
+            undo_images = std::move(it->second.undo_images);
+        }
+    }
+    // the pages are fixed without the latch, an eviction may flush the partition
+    for (auto it = undo_entries.rbegin(); it != undo_entries.rend(); ++it) {
+        this->compensate(partition, txn_id, it->page_id, it->length, it->offset,
+                         reinterpret_cast<const char*>(&undo_images[it->image_offset]), it->gsn, buffer_manager);
+    }
+    std::lock_guard<std::mutex> lock(partition.latch);
+    uint64_t gsn = this->next_gsn(partition, INVALID_LSN);
+    this->begin_record(partition, LogManager::LogRecordType::ABORT_RECORD, txn_id, gsn);
+    this->end_record(partition, gsn);
+    partition.txns.erase(txn_id);
+}
+
+void PartitionedLog::compensate(Partition& partition, uint64_t txn_id, uint64_t page_id, uint64_t length,
+                                uint64_t offset, const char* before_img, uint64_t undo_gsn,
+                                BufferManager& buffer_manager) {
+    BufferFrame& frame = buffer_manager.fix_page(page_id, true);
+    uint64_t gsn;
+    {
+        std::lock_guard<std::mutex> lock(partition.latch);
+        gsn = this->next_gsn(partition, frame.get_page_lsn());
+        this->begin_record(partition, LogManager::LogRecordType::COMPENSATION_RECORD, txn_id, gsn);
+        append_bytes(partition.record_buffer, &page_id, sizeof(uint64_t));
+        append_bytes(partition.record_buffer, &length, sizeof(uint64_t));
+        append_bytes(partition.record_buffer, &offset, sizeof(uint64_t));
+        append_bytes(partition.record_buffer, &undo_gsn, sizeof(uint64_t));
+        append_bytes(partition.record_buffer, before_img, length);
+        uint64_t lsn = this->end_record(partition, gsn);
+        auto it = partition.txns.find(txn_id);
+        if (it != partition.txns.end()) {
+            it->second.last_lsn = lsn;
+        }
+    }
+    memcpy(&frame.get_data()[offset], before_img, length);
+    frame.set_page_lsn(gsn);
+    buffer_manager.unfix_page(frame, true);
+}
+
+/**
+ * Decode the partitions in parallel, each into per-worker lists of the
+ * update and compensation records and the outcome of its transactions
+ * Replay the records, each worker merging the lists of its pages by GSN
+ * Cut the torn tails and move the GSN clocks past the highest GSN
+ * Roll back the updates of the transactions that did not end and that were
+ * not compensated yet, in reverse GSN order, and add their abort records
+ */
+void PartitionedLog::recovery(BufferManager& buffer_manager) {
+    size_t workers = std::max<size_t>(this->recovery_threads_, 1);
+    std::vector<PartitionScan> scans(this->partitions_.size());
+    parallel_for(this->partitions_.size(), workers, [&](size_t index) {
+        Partition& partition = *this->partitions_[index];
+        PartitionScan& scan = scans[index];
+        scan.redo_items.resize(workers);
+        LogReader reader(partition.file.get(), 0, partition.file->size(), this->log_reader_chunk_size_);
+        LogRecordView record;
+        while (reader.next(record)) {
+            this->stats_.add_record(static_cast<size_t>(record.type), record.size);
+            if (record.gsn == INVALID_LSN) {
+                continue;
+            }
+            scan.max_gsn = std::max(scan.max_gsn, record.gsn);
+            if (record.txn_id != INVALID_TXN_ID) {
+                bool& ended = scan.txns[record.txn_id];
+                ended |= record.type == LogManager::LogRecordType::COMMIT_RECORD ||
+                         record.type == LogManager::LogRecordType::ABORT_RECORD;
+            }
+            bool is_update = record.type == LogManager::LogRecordType::UPDATE_RECORD;
+            if (!is_update && record.type != LogManager::LogRecordType::COMPENSATION_RECORD) {
+                continue;
+            }
+            if (is_update && record.txn_id != INVALID_TXN_ID) {
+                scan.updates.push_back(UndoItem{record.gsn, record.lsn, record.txn_id, index});
+            } else if (!is_update) {
+                scan.compensated.push_back(record.undo_next_lsn);
+            }
+            RedoItem item{record.gsn, record.page_id, record.offset, record.length, record.delta_size,
+                          scan.images.size()};
+            if (record.delta != nullptr) {
+                scan.images.insert(scan.images.end(), record.delta, record.delta + record.delta_size);
+            } else {
+                scan.images.insert(scan.images.end(), record.after_img, record.after_img + record.length);
+            }
+            scan.redo_items[record.page_id % workers].push_back(item);
+        }
+        scan.end_lsn = reader.get_next_lsn();
+    });
+
+    // a worker owns the pages with page_id % workers == worker
+    parallel_for(workers, workers, [&](size_t worker) {
+        // (gsn, partition, position) of the next record of each partition
+        using Cursor = std::tuple<uint64_t, size_t, size_t>;
+        std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heads;
+        for (size_t index = 0; index < scans.size(); index++) {
+            if (!scans[index].redo_items[worker].empty()) {
+                heads.emplace(scans[index].redo_items[worker][0].gsn, index, 0);
+            }
+        }
+        while (!heads.empty()) {
+            auto [gsn, index, position] = heads.top();
+            heads.pop();
+            const std::vector<RedoItem>& items = scans[index].redo_items[worker];
+            const RedoItem& item = items[position];
+            if (position + 1 < items.size()) {
+                heads.emplace(items[position + 1].gsn, index, position + 1);
+            }
+            BufferFrame& frame = buffer_manager.fix_page(item.page_id, true);
+            uint64_t page_lsn = frame.get_page_lsn();
+            bool apply = page_lsn == INVALID_LSN || page_lsn < gsn;
+            if (apply) {
+                const char* image = &scans[index].images[item.image_offset];
+                char* data = &frame.get_data()[item.offset];
+                if (item.delta_size != 0) {
+                    apply_delta(image, item.delta_size, true, data);
+                } else {
+                    memcpy(data, image, item.length);
+                }
+                frame.set_page_lsn(gsn);
+            }
+            buffer_manager.unfix_page(frame, apply);
+        }
+    });
+
+    uint64_t max_gsn = 0;
+    std::unordered_set<uint64_t> compensated;
+    std::unordered_map<uint64_t, size_t> losers;
+    std::vector<UndoItem> undo_items;
+    for (auto& scan : scans) {
+        max_gsn = std::max(max_gsn, scan.max_gsn);
+        compensated.insert(scan.compensated.begin(), scan.compensated.end());
+    }
+    for (size_t index = 0; index < scans.size(); index++) {
+        for (auto& [txn_id, ended] : scans[index].txns) {
+            if (!ended) {
+                losers.emplace(txn_id, index);
+            }
+        }
+        for (auto& update : scans[index].updates) {
+            if (!scans[index].txns[update.txn_id] && compensated.count(update.gsn) == 0) {
+                undo_items.push_back(update);
+            }
+        }
+    }
+    for (size_t index = 0; index < this->partitions_.size(); index++) {
+        Partition& partition = *this->partitions_[index];
+        std::lock_guard<std::mutex> lock(partition.latch);
+        partition.file->resize(scans[index].end_lsn);
+        partition.current_offset = scans[index].end_lsn;
+        partition.durable_offset = scans[index].end_lsn;
+        partition.clock = max_gsn / MAX_PARTITIONS;
+        partition.last_gsn = scans[index].max_gsn;
+        partition.durable_gsn = scans[index].max_gsn;
+        partition.first_unflushed_gsn = INVALID_LSN;
+        partition.log_buffer.clear();
+        partition.unflushed_commits = 0;
+        partition.txns.clear();
+    }
+
+    std::sort(undo_items.begin(), undo_items.end(),
+              [](const UndoItem& a, const UndoItem& b) { return a.gsn > b.gsn; });
+    std::vector<std::unique_ptr<LogReader>> readers;
+    for (size_t index = 0; index < this->partitions_.size(); index++) {
+        readers.push_back(std::make_unique<LogReader>(this->partitions_[index]->file.get(), 0,
+                                                      scans[index].end_lsn, this->log_reader_chunk_size_));
+    }
+    LogRecordView record;
+    for (auto& item : undo_items) {
+        if (!readers[item.partition]->read(item.lsn, record)) {
+            throw std::runtime_error("cannot read back an update of partition " + std::to_string(item.partition));
+        }
+        std::vector<char> before_img(record.length);
+        if (record.delta != nullptr) {
+            // outside of the changed ranges the images are equal, those bytes are taken from the page
+            BufferFrame& frame = buffer_manager.fix_page(record.page_id, false);
+            memcpy(before_img.data(), &frame.get_data()[record.offset], record.length);
+            buffer_manager.unfix_page(frame, false);
+            apply_delta(record.delta, record.delta_size, false, before_img.data());
+        } else {
+            memcpy(before_img.data(), record.before_img, record.length);
+        }
+        this->compensate(*this->partitions_[item.partition], record.txn_id, record.page_id, record.length,
+                         record.offset, before_img.data(), record.gsn, buffer_manager);
+    }
+    for (auto& [txn_id, index] : losers) {
+        Partition& partition = *this->partitions_[index];
+        std::lock_guard<std::mutex> lock(partition.latch);
+        uint64_t gsn = this->next_gsn(partition, INVALID_LSN);
+        this->begin_record(partition, LogManager::LogRecordType::ABORT_RECORD, txn_id, gsn);
+        this->end_record(partition, gsn);
+    }
+    this->flush_log();
+}
+
+}  // namespace buzzdb
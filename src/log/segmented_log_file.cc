@@ -0,0 +1,274 @@
+#include "log/segmented_log_file.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+
+#include "common/crc32c.h"
+#include "common/macros.h"
+
+namespace buzzdb {
+
+namespace {
+
+constexpr char SEGMENT_PREFIX[] = "log.";
+
+constexpr char MASTER_RECORD_FILE[] = "master";
+
+constexpr char MASTER_RECORD_TEMP_FILE[] = "master.tmp";
+
+/// master record: lsn | crc of the lsn
+constexpr size_t MASTER_RECORD_SIZE = sizeof(uint64_t) + sizeof(uint32_t);
+
+/// number of hex digits of the index in a segment file name
+constexpr size_t SEGMENT_INDEX_DIGITS = 16;
+
+/// Returns true if `name` is the name of a segment file, as written by
+/// `segment_name()`, setting its index. Other files in the directory, e.g.
+/// `log.tmp` or a copy with a suffix, are not segments.
+bool parse_segment_name(const std::string& name, uint64_t& index) {
+    size_t prefix_length = strlen(SEGMENT_PREFIX);
+    if (name.size() != prefix_length + SEGMENT_INDEX_DIGITS || name.compare(0, prefix_length, SEGMENT_PREFIX) != 0) {
+        return false;
+    }
+    index = 0;
+    for (size_t i = prefix_length; i < name.size(); i++) {
+        char digit = name[i];
+        uint64_t value;
+        if (digit >= '0' && digit <= '9') {
+            value = digit - '0';
+        } else if (digit >= 'a' && digit <= 'f') {
+            value = digit - 'a' + 10;
+        } else if (digit >= 'A' && digit <= 'F') {
+            value = digit - 'A' + 10;
+        } else {
+            return false;
+        }
+        index = (index << 4) | value;
+    }
+    return true;
+}
+
+}  // namespace
+
+SegmentedLogFile::SegmentedLogFile(const std::string& directory, size_t segment_size, Mode mode,
+                                   size_t max_recycled_segments)
+    : directory_(directory),
+      segment_size_(segment_size),
+      mode_(mode),
+      max_recycled_segments_(max_recycled_segments),
+      master_lsn_(INVALID_LSN) {
+    if (mode_ == WRITE) {
+        std::filesystem::create_directories(directory_);
+    }
+    for (auto& entry : std::filesystem::directory_iterator(directory_)) {
+        uint64_t index;
+        if (!parse_segment_name(entry.path().filename().string(), index)) {
+            continue;
+        }
+        segments_[index] = File::open_file(entry.path().c_str(), mode_);
+    }
+    if (!segments_.empty()) {
+        start_lsn_ = segments_.begin()->first * segment_size_;
+        size_ = (segments_.rbegin()->first + 1) * segment_size_;
+    }
+
+    std::string master_path = directory_ + "/" + MASTER_RECORD_FILE;
+    if (std::filesystem::exists(master_path)) {
+        auto master = File::open_file(master_path.c_str(), File::READ);
+        if (master->size() == MASTER_RECORD_SIZE) {
+            char record[MASTER_RECORD_SIZE];
+            master->read_block(0, MASTER_RECORD_SIZE, record);
+            uint32_t crc;
+            memcpy(&crc, record + sizeof(uint64_t), sizeof(uint32_t));
+            if (crc == crc32c(0, record, sizeof(uint64_t))) {
+                memcpy(&master_lsn_, record, sizeof(uint64_t));
+            }
+        }
+    }
+}
+
+bool SegmentedLogFile::is_segment_name(const std::string& name) {
+    uint64_t index;
+    return parse_segment_name(name, index);
+}
+
+std::string SegmentedLogFile::segment_name(uint64_t index) {
+    char name[32];
+    snprintf(name, sizeof(name), "%s%016llx", SEGMENT_PREFIX, static_cast<unsigned long long>(index));
+    return name;
+}
+
+std::string SegmentedLogFile::segment_path(uint64_t index) const { return directory_ + "/" + segment_name(index); }
+
+File& SegmentedLogFile::get_segment(uint64_t index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (mode_ == READ) {
+        auto segment = segments_.find(index);
+        if (segment == segments_.end()) {
+            throw std::runtime_error("log segment " + segment_path(index) + " is missing");
+        }
+        return *segment->second;
+    }
+    auto& segment = segments_[index];
+    if (!segment) {
+        segment = File::open_file(segment_path(index).c_str(), File::WRITE);
+        segment->resize(segment_size_);
+        created_segments_++;
+    }
+    return *segment;
+}
+
+void SegmentedLogFile::check_writable(const char* operation) const {
+    if (mode_ == READ) {
+        throw std::runtime_error(std::string("cannot ") + operation + " the read-only log in " + directory_);
+    }
+}
+
+size_t SegmentedLogFile::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+void SegmentedLogFile::resize(size_t new_size) {
+    check_writable("resize");
+    uint64_t start_lsn = get_start_lsn();
+    assert(new_size >= start_lsn);
+    for (uint64_t index = start_lsn / segment_size_; index * segment_size_ < new_size; index++) {
+        get_segment(index);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_ = new_size;
+}
+
+void SegmentedLogFile::read_block(size_t offset, size_t size, char* block) {
+    assert(offset >= get_start_lsn() && offset + size <= this->size());
+    while (size > 0) {
+        uint64_t index = offset / segment_size_;
+        size_t segment_offset = offset % segment_size_;
+        size_t chunk = std::min(size, segment_size_ - segment_offset);
+        get_segment(index).read_block(segment_offset, chunk, block);
+        offset += chunk;
+        block += chunk;
+        size -= chunk;
+    }
+}
+
+void SegmentedLogFile::write_block(const char* block, size_t offset, size_t size) {
+    check_writable("write");
+    assert(offset >= get_start_lsn() && offset + size <= this->size());
+    while (size > 0) {
+        uint64_t index = offset / segment_size_;
+        size_t segment_offset = offset % segment_size_;
+        size_t chunk = std::min(size, segment_size_ - segment_offset);
+        get_segment(index).write_block(block, segment_offset, chunk);
+        offset += chunk;
+        block += chunk;
+        size -= chunk;
+    }
+}
+
+uint64_t SegmentedLogFile::get_start_lsn() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return start_lsn_;
+}
+
+void SegmentedLogFile::truncate_before(uint64_t lsn) {
+    check_writable("truncate");
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t end_index = std::min(lsn, size_) / segment_size_;
+    for (uint64_t index = start_lsn_ / segment_size_; index < end_index; index++) {
+        auto segment = segments_.find(index);
+        if (segment == segments_.end()) {
+            continue;
+        }
+        uint64_t next_index = segments_.rbegin()->first + 1;
+        uint64_t recycled = next_index - (size_ + segment_size_ - 1) / segment_size_;
+        if (!archive_directory_.empty()) {
+            std::string archive_path = archive_directory_ + "/" + segment_name(index);
+            std::error_code error;
+            std::filesystem::rename(segment_path(index), archive_path, error);
+            if (error) {
+                // the archive is on another file system
+                std::filesystem::copy_file(segment_path(index), archive_path,
+                                           std::filesystem::copy_options::overwrite_existing);
+                std::filesystem::remove(segment_path(index));
+            }
+        } else if (recycled < max_recycled_segments_) {
+            // the file keeps its blocks, the open handle stays valid across the rename
+            std::filesystem::rename(segment_path(index), segment_path(next_index));
+            segments_[next_index] = std::move(segment->second);
+        } else {
+            std::filesystem::remove(segment_path(index));
+        }
+        segments_.erase(segment);
+    }
+    start_lsn_ = std::max(start_lsn_, end_index * segment_size_);
+}
+
+void SegmentedLogFile::set_archive_directory(const std::string& directory) {
+    check_writable("archive");
+    if (!directory.empty()) {
+        std::filesystem::create_directories(directory);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    archive_directory_ = directory;
+}
+
+void SegmentedLogFile::copy_segments(const std::string& directory, const std::string& target_directory,
+                                     size_t segment_size, uint64_t start_lsn, uint64_t end_lsn) {
+    if (!std::filesystem::exists(directory)) {
+        return;
+    }
+    std::filesystem::create_directories(target_directory);
+    for (auto& entry : std::filesystem::directory_iterator(directory)) {
+        uint64_t index;
+        if (!parse_segment_name(entry.path().filename().string(), index)) {
+            continue;
+        }
+        if ((index + 1) * segment_size <= start_lsn || index * segment_size >= end_lsn) {
+            continue;
+        }
+        std::filesystem::copy_file(entry.path(), target_directory + "/" + segment_name(index),
+                                   std::filesystem::copy_options::overwrite_existing);
+    }
+}
+
+uint64_t SegmentedLogFile::read_master_record() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return master_lsn_;
+}
+
+void SegmentedLogFile::write_master_record(uint64_t lsn) {
+    check_writable("write the master record of");
+    char record[MASTER_RECORD_SIZE];
+    memcpy(record, &lsn, sizeof(uint64_t));
+    uint32_t crc = crc32c(0, record, sizeof(uint64_t));
+    memcpy(record + sizeof(uint64_t), &crc, sizeof(uint32_t));
+    std::string temp_path = directory_ + "/" + MASTER_RECORD_TEMP_FILE;
+    {
+        std::filesystem::remove(temp_path);
+        auto master = File::open_file(temp_path.c_str(), File::WRITE);
+        master->resize(MASTER_RECORD_SIZE);
+        master->write_block(record, 0, MASTER_RECORD_SIZE);
+    }
+    std::filesystem::rename(temp_path, directory_ + "/" + MASTER_RECORD_FILE);
+    std::lock_guard<std::mutex> lock(mutex_);
+    master_lsn_ = lsn;
+}
+
+size_t SegmentedLogFile::get_segment_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return segments_.size();
+}
+
+size_t SegmentedLogFile::get_created_segment_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return created_segments_;
+}
+
+}  // namespace buzzdb
@@ -0,0 +1,337 @@
+#include "transaction/lock_manager.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace buzzdb {
+
+namespace {
+
+bool compatible(LockMode a, LockMode b) { return a == LockMode::SHARED && b == LockMode::SHARED; }
+
+}  // namespace
+
+LockManager::LockManager(DeadlockPolicy policy, size_t bucket_count) : policy_(policy) {
+    buckets_.reserve(bucket_count);
+    for (size_t i = 0; i < bucket_count; i++) {
+        buckets_.push_back(std::make_unique<Bucket>());
+    }
+    if (policy_ == DeadlockPolicy::DETECTION) {
+        detector_ = std::thread(&LockManager::detect_deadlocks, this);
+    }
+}
+
+LockManager::~LockManager() {
+    stop_ = true;
+    if (detector_.joinable()) {
+        detector_.join();
+    }
+}
+
+bool LockManager::grantable(const LockQueue& queue, size_t position) {
+    const LockRequest& request = queue.requests[position];
+    if (request.granted && !request.upgrading) {
+        return true;
+    }
+    LockMode mode = request.upgrading ? LockMode::EXCLUSIVE : request.mode;
+    for (size_t i = 0; i < queue.requests.size(); i++) {
+        const LockRequest& other = queue.requests[i];
+        if (i == position) {
+            continue;
+        }
+        if (other.granted) {
+            if (!compatible(mode, other.mode)) {
+                return false;
+            }
+        } else if (i < position && !request.upgrading) {
+            // first come, first served, an upgrade goes ahead of the waiters
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<uint64_t> LockManager::blockers(const LockQueue& queue, size_t position) {
+    std::vector<uint64_t> txns;
+    const LockRequest& request = queue.requests[position];
+    LockMode mode = request.upgrading ? LockMode::EXCLUSIVE : request.mode;
+    for (size_t i = 0; i < queue.requests.size(); i++) {
+        const LockRequest& other = queue.requests[i];
+        if (i == position || compatible(mode, other.mode)) {
+            continue;
+        }
+        if (other.granted || (i < position && !request.upgrading)) {
+            txns.push_back(other.txn_id);
+        }
+    }
+    return txns;
+}
+
+bool LockManager::check_aborted(uint64_t txn_id, Bucket* waiting_in) {
+    auto& shard = get_txn_shard(txn_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto txn = shard.txns.find(txn_id);
+    if (txn == shard.txns.end()) {
+        if (waiting_in == nullptr) {
+            return false;
+        }
+        txn = shard.txns.emplace(txn_id, TxnLocks()).first;
+    }
+    txn->second.waiting_in = waiting_in;
+    return txn->second.aborted;
+}
+
+void LockManager::abort_txn(uint64_t txn_id) {
+    Bucket* waiting_in;
+    {
+        auto& shard = get_txn_shard(txn_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // a transaction with a request has an entry, a missing one ended meanwhile
+        auto txn = shard.txns.find(txn_id);
+        if (txn == shard.txns.end() || txn->second.aborted) {
+            return;
+        }
+        txn->second.aborted = true;
+        waiting_in = txn->second.waiting_in;
+    }
+    aborts_++;
+    // without the mutex of the bucket, which the caller may not take: a
+    // waiter that misses the notification sees the flag after its timeout
+    if (waiting_in != nullptr) {
+        waiting_in->released.notify_all();
+    }
+}
+
+void LockManager::lock(uint64_t txn_id, uint16_t segment_id, TID tid, LockMode mode) {
+    RecordKey key{segment_id, tid.value};
+    Bucket& bucket = get_bucket(key);
+    std::unique_lock<std::mutex> latch(bucket.mutex);
+    LockQueue& queue = bucket.queues[key];
+
+    auto find_request = [&]() {
+        for (size_t i = 0; i < queue.requests.size(); i++) {
+            if (queue.requests[i].txn_id == txn_id) {
+                return i;
+            }
+        }
+        return queue.requests.size();
+    };
+
+    size_t position = find_request();
+    bool upgrade = position < queue.requests.size();
+    if (upgrade) {
+        LockRequest& held = queue.requests[position];
+        if (mode == LockMode::SHARED || held.mode == LockMode::EXCLUSIVE) {
+            return;
+        }
+        held.upgrading = true;
+    } else {
+        queue.requests.push_back(LockRequest{txn_id, mode, false, false});
+    }
+
+    bool waited = false;
+    while (true) {
+        // requests ahead may have left while waiting
+        position = find_request();
+        bool aborted = policy_ != DeadlockPolicy::WAIT_DIE && check_aborted(txn_id, &bucket);
+        if (!aborted && grantable(queue, position)) {
+            break;
+        }
+        if (!aborted && policy_ != DeadlockPolicy::DETECTION) {
+            for (uint64_t blocker : blockers(queue, position)) {
+                if (policy_ == DeadlockPolicy::WAIT_DIE && blocker < txn_id) {
+                    // younger than a holder, die
+                    aborted = true;
+                    aborts_++;
+                    break;
+                }
+                if (policy_ == DeadlockPolicy::WOUND_WAIT && blocker > txn_id) {
+                    abort_txn(blocker);
+                }
+            }
+        }
+        if (aborted) {
+            if (upgrade) {
+                queue.requests[position].upgrading = false;
+            } else {
+                queue.requests.erase(queue.requests.begin() + position);
+                if (queue.requests.empty()) {
+                    bucket.queues.erase(key);
+                }
+            }
+            latch.unlock();
+            // the requests behind may be grantable now
+            bucket.released.notify_all();
+            if (policy_ != DeadlockPolicy::WAIT_DIE) {
+                check_aborted(txn_id, nullptr);
+            }
+            throw txn_abort_error();
+        }
+        if (!waited) {
+            waits_++;
+            waited = true;
+        }
+        bucket.released.wait_for(latch, std::chrono::microseconds(detection_interval_us_.load()));
+    }
+
+    LockRequest& request = queue.requests[position];
+    request.granted = true;
+    if (upgrade) {
+        request.mode = LockMode::EXCLUSIVE;
+        request.upgrading = false;
+    }
+    latch.unlock();
+    acquired_++;
+
+    auto& shard = get_txn_shard(txn_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    TxnLocks& txn = shard.txns[txn_id];
+    txn.waiting_in = nullptr;
+    if (!upgrade) {
+        txn.keys.push_back(key);
+    }
+}
+
+void LockManager::unlock_all(uint64_t txn_id) {
+    auto& shard = get_txn_shard(txn_id);
+    std::vector<RecordKey> keys;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto txn = shard.txns.find(txn_id);
+        if (txn == shard.txns.end()) {
+            return;
+        }
+        keys = txn->second.keys;
+    }
+
+    for (auto& key : keys) {
+        Bucket& bucket = get_bucket(key);
+        {
+            std::lock_guard<std::mutex> latch(bucket.mutex);
+            auto queue = bucket.queues.find(key);
+            auto& requests = queue->second.requests;
+            requests.erase(std::find_if(requests.begin(), requests.end(),
+                                        [&](const LockRequest& request) { return request.txn_id == txn_id; }));
+            if (requests.empty()) {
+                bucket.queues.erase(queue);
+            }
+        }
+        bucket.released.notify_all();
+    }
+
+    // forgotten once it holds no request, nobody aborts it afterwards
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.txns.erase(txn_id);
+}
+
+bool LockManager::holds(uint64_t txn_id, uint16_t segment_id, TID tid, LockMode& mode) {
+    RecordKey key{segment_id, tid.value};
+    Bucket& bucket = get_bucket(key);
+    std::lock_guard<std::mutex> latch(bucket.mutex);
+    auto queue = bucket.queues.find(key);
+    if (queue == bucket.queues.end()) {
+        return false;
+    }
+    for (auto& request : queue->second.requests) {
+        if (request.txn_id == txn_id && request.granted) {
+            mode = request.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+LockStats LockManager::get_stats() const {
+    LockStats stats;
+    stats.acquired = acquired_.load();
+    stats.waits = waits_.load();
+    stats.aborts = aborts_.load();
+    stats.deadlocks = deadlocks_.load();
+    return stats;
+}
+
+void LockManager::detect_deadlocks() {
+    while (!stop_) {
+        std::this_thread::sleep_for(std::chrono::microseconds(detection_interval_us_.load()));
+        break_cycles();
+    }
+}
+
+size_t LockManager::break_cycles() {
+    // the waits-for graph, collected bucket by bucket: the edges of a bucket
+    // may be gone when the next one is read, a cycle found is then broken
+    // needlessly, which is rare and costs an abort
+    std::unordered_map<uint64_t, std::vector<uint64_t>> waits_for;
+    for (auto& bucket : buckets_) {
+        std::lock_guard<std::mutex> latch(bucket->mutex);
+        for (auto& [key, queue] : bucket->queues) {
+            for (size_t i = 0; i < queue.requests.size(); i++) {
+                const LockRequest& request = queue.requests[i];
+                if (request.granted && !request.upgrading) {
+                    continue;
+                }
+                auto txns = blockers(queue, i);
+                auto& edges = waits_for[request.txn_id];
+                edges.insert(edges.end(), txns.begin(), txns.end());
+            }
+        }
+    }
+    // waiters that were told to abort already leave the graph
+    for (auto it = waits_for.begin(); it != waits_for.end();) {
+        auto& shard = get_txn_shard(it->first);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto txn = shard.txns.find(it->first);
+        if (txn != shard.txns.end() && txn->second.aborted) {
+            it = waits_for.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    size_t cycles = 0;
+    std::unordered_set<uint64_t> done;
+    for (auto& [start, unused] : waits_for) {
+        if (done.count(start) != 0) {
+            continue;
+        }
+        // depth first search, the path holds the transactions on the stack
+        std::vector<uint64_t> path{start};
+        std::vector<size_t> next_edge{0};
+        std::unordered_set<uint64_t> on_path{start};
+        while (!path.empty()) {
+            auto node = waits_for.find(path.back());
+            if (node == waits_for.end() || next_edge.back() >= node->second.size()) {
+                done.insert(path.back());
+                on_path.erase(path.back());
+                path.pop_back();
+                next_edge.pop_back();
+                continue;
+            }
+            uint64_t target = node->second[next_edge.back()++];
+            if (on_path.count(target) != 0) {
+                // a cycle, abort its youngest transaction and drop it from the graph
+                auto begin = std::find(path.begin(), path.end(), target);
+                uint64_t victim = *std::max_element(begin, path.end());
+                abort_txn(victim);
+                waits_for.at(victim).clear();
+                deadlocks_++;
+                cycles++;
+                // unwind to the victim, its edges are gone
+                while (path.back() != victim) {
+                    on_path.erase(path.back());
+                    path.pop_back();
+                    next_edge.pop_back();
+                }
+                continue;
+            }
+            if (done.count(target) == 0) {
+                path.push_back(target);
+                next_edge.push_back(0);
+                on_path.insert(target);
+            }
+        }
+    }
+    return cycles;
+}
+
+}  // namespace buzzdb
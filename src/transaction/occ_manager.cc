@@ -0,0 +1,126 @@
+#include "transaction/occ_manager.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "heap/heap_file.h"
+
+namespace buzzdb {
+
+OccManager::OccManager(size_t version_words)
+    : words_count_(version_words), words_(new std::atomic<uint64_t>[version_words]) {
+    for (size_t i = 0; i < words_count_; i++) {
+        words_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+OccManager::TxnState& OccManager::get_txn(uint64_t txn_id) {
+    auto& shard = get_txn_shard(txn_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // the node stays in place while other transactions of the shard come and go
+    return shard.txns[txn_id];
+}
+
+void OccManager::remove_txn(uint64_t txn_id) {
+    auto& shard = get_txn_shard(txn_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.txns.erase(txn_id);
+}
+
+uint64_t OccManager::begin_read(uint16_t segment_id, TID tid) {
+    auto& word = words_[get_word(segment_id, tid)];
+    uint64_t version = word.load(std::memory_order_acquire);
+    while (version & LOCK_BIT) {
+        // a commit installs the record
+        std::this_thread::yield();
+        version = word.load(std::memory_order_acquire);
+    }
+    return version;
+}
+
+bool OccManager::end_read(uint64_t txn_id, uint16_t segment_id, TID tid, uint64_t version) {
+    size_t word = get_word(segment_id, tid);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (words_[word].load(std::memory_order_relaxed) != version) {
+        return false;
+    }
+    get_txn(txn_id).reads.push_back(ReadEntry{word, version});
+    return true;
+}
+
+bool OccManager::read_own_write(uint64_t txn_id, uint16_t segment_id, TID tid, std::byte* record,
+                                uint32_t capacity) {
+    TxnState& txn = get_txn(txn_id);
+    for (auto write = txn.writes.rbegin(); write != txn.writes.rend(); ++write) {
+        if (write->segment_id == segment_id && write->tid.value == tid.value) {
+            memcpy(record, write->record.data(), std::min<size_t>(capacity, write->record.size()));
+            return true;
+        }
+    }
+    return false;
+}
+
+void OccManager::buffer_write(uint64_t txn_id, HeapSegment* segment, TID tid, const std::byte* record,
+                              uint32_t record_size) {
+    get_txn(txn_id).writes.push_back(
+        WriteEntry{segment, segment->segment_id_, tid, std::vector<std::byte>(record, record + record_size)});
+}
+
+void OccManager::unlock(TxnState& txn, bool bump) {
+    for (size_t word : txn.locked) {
+        uint64_t version = words_[word].load(std::memory_order_relaxed) & ~LOCK_BIT;
+        words_[word].store(bump ? version + 1 : version, std::memory_order_release);
+    }
+    txn.locked.clear();
+}
+
+bool OccManager::validate(uint64_t txn_id) {
+    TxnState& txn = get_txn(txn_id);
+
+    // lock the write set in the order of the words, the commits do not deadlock
+    for (auto& write : txn.writes) {
+        txn.locked.push_back(get_word(write.segment_id, write.tid));
+    }
+    std::sort(txn.locked.begin(), txn.locked.end());
+    txn.locked.erase(std::unique(txn.locked.begin(), txn.locked.end()), txn.locked.end());
+    for (size_t word : txn.locked) {
+        uint64_t version = words_[word].load(std::memory_order_relaxed);
+        while ((version & LOCK_BIT) ||
+               !words_[word].compare_exchange_weak(version, version | LOCK_BIT, std::memory_order_acquire)) {
+            std::this_thread::yield();
+            version = words_[word].load(std::memory_order_relaxed);
+        }
+    }
+
+    for (auto& read : txn.reads) {
+        uint64_t version = words_[read.word].load(std::memory_order_acquire);
+        bool locked_by_other = (version & LOCK_BIT) && !std::binary_search(txn.locked.begin(), txn.locked.end(), read.word);
+        if ((version & ~LOCK_BIT) != read.version || locked_by_other) {
+            unlock(txn, false);
+            validation_failures_++;
+            return false;
+        }
+    }
+    return true;
+}
+
+void OccManager::install(uint64_t txn_id) {
+    TxnState& txn = get_txn(txn_id);
+    for (auto& write : txn.writes) {
+        write.segment->write_in_place(write.tid, write.record.data(), write.record.size(), txn_id);
+    }
+}
+
+void OccManager::release(uint64_t txn_id) {
+    unlock(get_txn(txn_id), true);
+    remove_txn(txn_id);
+}
+
+void OccManager::abort(uint64_t txn_id) {
+    unlock(get_txn(txn_id), false);
+    remove_txn(txn_id);
+}
+
+}  // namespace buzzdb
@@ -1,8 +1,10 @@
 
 #include <iostream>
+#include <utility>
 
 #include "transaction/transaction_manager.h"
 #include "common/macros.h"
+#include "common/trace.h"
 
 namespace buzzdb {
 
@@ -21,26 +23,62 @@ TransactionManager::TransactionManager(LogManager &log_manager,
 				log_manager_(log_manager),
 				buffer_manager_(buffer_manager),
 				transaction_counter_(0){
+	buffer_manager_.set_log_manager(&log_manager_);
 }
 
 TransactionManager::~TransactionManager(){
+	buffer_manager_.set_log_manager(nullptr);
 }
 
 void TransactionManager::reset(LogManager &log_manager){
 	log_manager_ = log_manager;
 	buffer_manager_.discard_all_pages();
 	transaction_counter_ = 0;
-	transaction_table_.clear();
+	for (auto& shard : transaction_table_) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		// the ids are given out again, the locks of the lost transactions go
+		for (auto& entry : shard.transactions) {
+			if (lock_manager_ != nullptr) {
+				lock_manager_->unlock_all(entry.first);
+			}
+			if (version_store_ != nullptr) {
+				version_store_->abort(entry.first);
+			}
+			if (occ_manager_ != nullptr) {
+				occ_manager_->abort(entry.first);
+			}
+		}
+		shard.transactions.clear();
+	}
+}
+
+Transaction TransactionManager::remove_txn(uint64_t txn_id){
+	auto& shard = get_shard(txn_id);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto node = shard.transactions.extract(txn_id);
+	if (node.empty()) {
+		std::cout << "Txn does not exist \n";
+		exit(-1);
+	}
+	return std::move(node.mapped());
 }
 
 /// Start the transaction
 uint64_t TransactionManager::start_txn(){
 
 	uint64_t txn_id = ++transaction_counter_;
+	TraceScope scope(TracePhase::START_TXN, txn_id);
 
 	/// Create a transaction
-	Transaction txn(txn_id, true);
-	transaction_table_[txn_id] = txn;
+	{
+		auto& shard = get_shard(txn_id);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.transactions.emplace(txn_id, Transaction(txn_id, true));
+	}
+
+	if (version_store_ != nullptr && !lazy_begin_) {
+		version_store_->begin(txn_id);
+	}
 
 	/// Add a txn begin log record
 	log_manager_.log_txn_begin(txn_id);
@@ -49,56 +87,146 @@ uint64_t TransactionManager::start_txn(){
 }
 
 /// Commit the transaction
-void TransactionManager::commit_txn(uint64_t txn_id){
-
-	if(transaction_table_.count(txn_id) == 0){
-		std::cout << "Txn does not exist \n";
-		exit(-1);
+uint64_t TransactionManager::commit_txn(uint64_t txn_id){
+	TraceScope scope(TracePhase::COMMIT_TXN, txn_id);
+
+	// the transaction leaves the table first, its pages are then only used by this thread
+	Transaction txn = remove_txn(txn_id);
+
+	// an optimistic transaction whose reads changed rolls back nothing, its
+	// writes were only buffered
+	if (occ_manager_ != nullptr) {
+		if (!occ_manager_->validate(txn_id)) {
+			occ_manager_->abort(txn_id);
+			log_manager_.log_abort(txn_id, buffer_manager_);
+			for(auto page_id : txn.modified_pages_){
+				buffer_manager_.release_uncommitted_page(page_id);
+			}
+			throw validation_abort_error();
+		}
+		try {
+			occ_manager_->install(txn_id);
+		} catch (...) {
+			// the writes installed so far are rolled back before the version
+			// words are unlocked, readers never validate against them
+			log_manager_.log_abort(txn_id, buffer_manager_);
+			occ_manager_->abort(txn_id);
+			for(auto page_id : txn.modified_pages_){
+				buffer_manager_.release_uncommitted_page(page_id);
+			}
+			throw;
+		}
 	}
 
-	auto& txn = transaction_table_[txn_id];
-
-	if (txn.started_) {
-
-		// flush all the dirty pages associated with this transaction out
+	// flush all the dirty pages associated with this transaction out,
+	// without forcing them the redo pass applies the updates after a crash
+	if (force_at_commit_) {
 		for(auto page_id : txn.modified_pages_){
 			buffer_manager_.flush_page(page_id);
 		}
+	}
 
-		log_manager_.log_commit(txn_id);
+	uint64_t commit_lsn = log_manager_.log_commit(txn_id, async_commit_);
+
+	for(auto page_id : txn.modified_pages_){
+		buffer_manager_.release_uncommitted_page(page_id);
+	}
+
+	// the validated writes become visible once the commit record is logged
+	if (occ_manager_ != nullptr) {
+		occ_manager_->release(txn_id);
+	}
+
+	// the versions become visible once the commit record is logged
+	if (version_store_ != nullptr) {
+		version_store_->commit(txn_id);
+	}
 
-	    txn.started_ = false;
+	// strict 2PL, the locks go once the commit record is logged
+	if (lock_manager_ != nullptr) {
+		lock_manager_->unlock_all(txn_id);
 	}
 
+	return commit_lsn;
 }
 
 /// Abort the transaction
-void TransactionManager::abort_txn(UNUSED_ATTRIBUTE uint64_t txn_id){
+void TransactionManager::abort_txn(uint64_t txn_id){
+	TraceScope scope(TracePhase::ABORT_TXN, txn_id);
 
-	if(transaction_table_.count(txn_id) == 0){
-		std::cout << "Txn does not exist \n";
-		exit(-1);
-	}
+	Transaction txn = remove_txn(txn_id);
 
-	auto& txn = transaction_table_[txn_id];
+	// the rollback restores the before images in the buffer, the pages
+	// are written like any other
+	log_manager_.log_abort(txn_id, buffer_manager_);
 
-	if (txn.started_) {
+	for(auto page_id : txn.modified_pages_){
+		buffer_manager_.release_uncommitted_page(page_id);
+	}
 
-		// discard all the dirty pages associated with this transaction
-		for(auto page_id : txn.modified_pages_){
-			buffer_manager_.discard_page(page_id);
-		}
+	// the before images are back, the versions and locks can go
+	if (occ_manager_ != nullptr) {
+		occ_manager_->abort(txn_id);
+	}
+	if (version_store_ != nullptr) {
+		version_store_->abort(txn_id);
+	}
+	if (lock_manager_ != nullptr) {
+		lock_manager_->unlock_all(txn_id);
+	}
+}
 
-		log_manager_.log_abort(txn_id, buffer_manager_);
+void TransactionManager::check_txn(uint64_t txn_id){
+	auto& shard = get_shard(txn_id);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	if (shard.transactions.count(txn_id) == 0) {
+		std::cout << "Txn does not exist \n";
+		exit(-1);
+	}
+}
 
-	    txn.started_ = false;
+void TransactionManager::check_savepoints_supported(){
+	// the buffered writes of optimistic transactions would still be installed at the commit
+	if (occ_manager_ != nullptr) {
+		std::cout << "Savepoints are not supported with optimistic transactions \n";
+		exit(-1);
 	}
+}
+
+uint64_t TransactionManager::create_savepoint(uint64_t txn_id){
+	check_txn(txn_id);
+	check_savepoints_supported();
+	return log_manager_.create_savepoint(txn_id);
+}
 
+void TransactionManager::rollback_to_savepoint(uint64_t txn_id, uint64_t savepoint){
+	check_txn(txn_id);
+	check_savepoints_supported();
+	// the pages stay in modified_pages_, they are released at the end of the transaction
+	log_manager_.rollback_to_savepoint(txn_id, savepoint, buffer_manager_);
 }
 
 void TransactionManager::add_modified_page(uint64_t txn_id, uint64_t page_id){
-	auto &txn = transaction_table_[txn_id];
-	txn.modified_pages_.push_back(page_id);
+	{
+		auto& shard = get_shard(txn_id);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto txn = shard.transactions.find(txn_id);
+		if (txn == shard.transactions.end()) {
+			std::cout << "Txn does not exist \n";
+			exit(-1);
+		}
+		txn->second.modified_pages_.push_back(page_id);
+	}
+	buffer_manager_.add_uncommitted_page(page_id);
+}
+
+size_t TransactionManager::get_active_txn_count(){
+	size_t count = 0;
+	for (auto& shard : transaction_table_) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		count += shard.transactions.size();
+	}
+	return count;
 }
 
 }  // namespace buzzdb
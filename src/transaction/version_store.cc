@@ -0,0 +1,183 @@
+#include "transaction/version_store.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "transaction/txn_abort_error.h"
+
+namespace buzzdb {
+
+VersionStore::VersionStore(size_t bucket_count) {
+    buckets_.reserve(bucket_count);
+    for (size_t i = 0; i < bucket_count; i++) {
+        buckets_.push_back(std::make_unique<Bucket>());
+    }
+}
+
+void VersionStore::begin(uint64_t txn_id) {
+    get_snapshot(txn_id);
+}
+
+uint64_t VersionStore::get_snapshot(uint64_t txn_id) {
+    auto& shard = get_txn_shard(txn_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto txn = shard.txns.find(txn_id);
+    if (txn == shard.txns.end()) {
+        // the epoch is read with the shard mutex held: a garbage collection
+        // either sees the snapshot or started its epoch before it
+        uint64_t epoch = epoch_.load();
+        txn = shard.txns.emplace(txn_id, TxnState{clock_.load(), epoch, {}}).first;
+    }
+    return txn->second.snapshot;
+}
+
+VersionStore::TxnState VersionStore::remove_txn(uint64_t txn_id) {
+    auto& shard = get_txn_shard(txn_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto node = shard.txns.extract(txn_id);
+    if (node.empty()) {
+        return TxnState{0, 0, {}};
+    }
+    return std::move(node.mapped());
+}
+
+void VersionStore::install(uint64_t txn_id, uint16_t segment_id, TID tid, const std::byte* image, uint32_t length) {
+    uint64_t snapshot = get_snapshot(txn_id);
+
+    RecordKey key{segment_id, tid.value};
+    Bucket& bucket = get_bucket(key);
+    {
+        std::lock_guard<std::mutex> latch(bucket.mutex);
+        auto& head = bucket.chains[key];
+        if (head) {
+            if (head->writer == txn_id && head->commit_ts == UNCOMMITTED) {
+                // the image before the first update of the transaction is kept
+                return;
+            }
+            if (head->commit_ts == UNCOMMITTED || head->commit_ts > snapshot) {
+                throw write_conflict_error();
+            }
+        }
+        auto version = std::make_unique<Version>();
+        version->writer = txn_id;
+        version->commit_ts = UNCOMMITTED;
+        version->image.assign(image, image + length);
+        version->older = std::move(head);
+        head = std::move(version);
+    }
+    version_count_++;
+
+    auto& shard = get_txn_shard(txn_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.txns.at(txn_id).keys.push_back(key);
+}
+
+void VersionStore::read(uint64_t txn_id, uint16_t segment_id, TID tid, const std::byte* current, std::byte* record,
+                        uint32_t length) {
+    uint64_t snapshot = get_snapshot(txn_id);
+
+    RecordKey key{segment_id, tid.value};
+    Bucket& bucket = get_bucket(key);
+    std::lock_guard<std::mutex> latch(bucket.mutex);
+    // the page is only read if its record is visible, a writer updates it
+    // after linking the version that hides it
+    const std::byte* source = current;
+    auto chain = bucket.chains.find(key);
+    if (chain != bucket.chains.end()) {
+        for (Version* version = chain->second.get(); version != nullptr; version = version->older.get()) {
+            bool own = version->writer == txn_id && version->commit_ts == UNCOMMITTED;
+            if (own || version->commit_ts <= snapshot) {
+                break;
+            }
+            source = version->image.data();
+        }
+    }
+    memcpy(record, source, length);
+}
+
+uint64_t VersionStore::commit(uint64_t txn_id) {
+    TxnState txn = remove_txn(txn_id);
+    if (txn.keys.empty()) {
+        return clock_.load();
+    }
+
+    std::lock_guard<std::mutex> lock(commit_mutex_);
+    // the timestamp is published once all versions carry it, a snapshot
+    // taken meanwhile sees none of them as committed
+    uint64_t commit_ts = clock_.load() + 1;
+    for (auto& key : txn.keys) {
+        Bucket& bucket = get_bucket(key);
+        std::lock_guard<std::mutex> latch(bucket.mutex);
+        bucket.chains[key]->commit_ts = commit_ts;
+    }
+    clock_.store(commit_ts);
+    uint64_t epoch = epoch_.load();
+
+    std::lock_guard<std::mutex> garbage_lock(garbage_mutex_);
+    garbage_.push_back(Garbage{epoch, commit_ts, std::move(txn.keys)});
+    return commit_ts;
+}
+
+void VersionStore::abort(uint64_t txn_id) {
+    TxnState txn = remove_txn(txn_id);
+    for (auto& key : txn.keys) {
+        Bucket& bucket = get_bucket(key);
+        std::lock_guard<std::mutex> latch(bucket.mutex);
+        auto chain = bucket.chains.find(key);
+        std::unique_ptr<Version> older = std::move(chain->second->older);
+        if (older) {
+            chain->second = std::move(older);
+        } else {
+            bucket.chains.erase(chain);
+        }
+        version_count_--;
+    }
+}
+
+size_t VersionStore::collect_garbage() {
+    uint64_t min_epoch = ++epoch_;
+    for (auto& shard : txn_shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto& [txn_id, txn] : shard.txns) {
+            min_epoch = std::min(min_epoch, txn.epoch);
+        }
+    }
+
+    std::vector<Garbage> garbage;
+    {
+        std::lock_guard<std::mutex> garbage_lock(garbage_mutex_);
+        while (!garbage_.empty() && garbage_.front().epoch < min_epoch) {
+            garbage.push_back(std::move(garbage_.front()));
+            garbage_.pop_front();
+        }
+    }
+
+    size_t freed = 0;
+    for (auto& commit : garbage) {
+        for (auto& key : commit.keys) {
+            Bucket& bucket = get_bucket(key);
+            std::lock_guard<std::mutex> latch(bucket.mutex);
+            auto chain = bucket.chains.find(key);
+            if (chain == bucket.chains.end()) {
+                continue;
+            }
+            // the versions up to this commit are older than every snapshot
+            std::unique_ptr<Version>* link = &chain->second;
+            while (*link && ((*link)->commit_ts == UNCOMMITTED || (*link)->commit_ts > commit.commit_ts)) {
+                link = &(*link)->older;
+            }
+            for (Version* version = link->get(); version != nullptr; version = version->older.get()) {
+                freed++;
+            }
+            link->reset();
+            if (!chain->second) {
+                bucket.chains.erase(chain);
+            }
+        }
+    }
+    version_count_ -= freed;
+    return freed;
+}
+
+}  // namespace buzzdb
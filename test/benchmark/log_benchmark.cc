@@ -0,0 +1,794 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_manager.h"
+#include "common/crc32c.h"
+#include "heap/heap_file.h"
+#include "log/backup.h"
+#include "log/compressed_log_file.h"
+#include "log/log_manager.h"
+#include "log/log_reader.h"
+#include "log/partitioned_log.h"
+#include "log/segmented_log_file.h"
+#include "storage/test_file.h"
+#include "transaction/lock_manager.h"
+#include "transaction/occ_manager.h"
+#include "transaction/transaction_manager.h"
+
+using buzzdb::BufferManager;
+using buzzdb::CompressedLogFile;
+using buzzdb::DeadlockPolicy;
+using buzzdb::File;
+using buzzdb::HeapSegment;
+using buzzdb::LockManager;
+using buzzdb::LockMode;
+using buzzdb::LogManager;
+using buzzdb::OccManager;
+using buzzdb::PartitionedLog;
+using buzzdb::SegmentedLogFile;
+using buzzdb::TestFile;
+using buzzdb::TID;
+using buzzdb::TransactionManager;
+using buzzdb::txn_abort_error;
+
+namespace {
+
+/// the in-memory log is cut off once it reaches this size
+constexpr size_t MAX_LOG_SIZE = 64 << 20;
+
+constexpr uint64_t UPDATES_PER_TXN = 16;
+
+/// Append path: update records with images of state.range(0) bytes, committed
+/// every UPDATES_PER_TXN updates. Each record is checksummed.
+void BM_LogUpdate(benchmark::State& state) {
+    size_t length = state.range(0);
+    std::vector<std::byte> before_img(length, std::byte{1});
+    std::vector<std::byte> after_img(length, std::byte{2});
+    TestFile log_file;
+    LogManager log_manager(&log_file);
+    uint64_t txn_id = 0;
+    uint64_t updates = 0;
+    for (auto _ : state) {
+        if (updates % UPDATES_PER_TXN == 0) {
+            if (txn_id != 0) {
+                log_manager.log_commit(txn_id);
+            }
+            if (log_file.size() > MAX_LOG_SIZE) {
+                state.PauseTiming();
+                log_file.resize(0);
+                log_manager.reset(&log_file);
+                state.ResumeTiming();
+            }
+            log_manager.log_txn_begin(++txn_id);
+        }
+        log_manager.log_update(txn_id, 0, length, 0, before_img.data(), after_img.data());
+        updates++;
+    }
+    state.SetBytesProcessed(state.iterations() * 2 * length);
+}
+
+/// Updates of our typical workloads, as written by HeapSegment::write
+enum Workload {
+    /// a table_id | field tuple written into a free slot
+    INSERT_TUPLE,
+    /// an 8 byte counter incremented in a 128 byte tuple
+    INCREMENT_COUNTER,
+    /// one of the ten 100 byte fields of a 1000 byte YCSB row overwritten
+    YCSB_FIELD_UPDATE,
+};
+
+/// Generates the before and after images of the updates of a workload
+class WorkloadUpdates {
+   public:
+    explicit WorkloadUpdates(Workload workload)
+        : workload_(workload),
+          length_(workload == INSERT_TUPLE ? 16 : workload == INCREMENT_COUNTER ? 128 : 1000),
+          before_img_(length_),
+          after_img_(length_) {}
+
+    void next() {
+        uint64_t value = random_();
+        switch (workload_) {
+            case INSERT_TUPLE:
+                // a free slot is zeroed, the table id and the field are small integers
+                std::fill(before_img_.begin(), before_img_.end(), std::byte{0});
+                after_img_ = before_img_;
+                after_img_[0] = std::byte{101};
+                memcpy(&after_img_[8], &updates_, sizeof(uint32_t));
+                break;
+            case INCREMENT_COUNTER:
+                before_img_ = after_img_;
+                memcpy(&value, &after_img_[16], sizeof(uint64_t));
+                value++;
+                memcpy(&after_img_[16], &value, sizeof(uint64_t));
+                break;
+            case YCSB_FIELD_UPDATE:
+                // YCSB fields are random letters
+                before_img_ = after_img_;
+                for (size_t i = 0; i < 100; i++) {
+                    after_img_[(value % 10) * 100 + i] = static_cast<std::byte>('a' + random_() % 26);
+                }
+                break;
+        }
+        updates_++;
+    }
+
+    size_t length() const { return length_; }
+
+    std::byte* before_img() { return before_img_.data(); }
+
+    std::byte* after_img() { return after_img_.data(); }
+
+   private:
+    Workload workload_;
+    size_t length_;
+    std::vector<std::byte> before_img_;
+    std::vector<std::byte> after_img_;
+    std::mt19937_64 random_{42};
+    uint64_t updates_ = 0;
+};
+
+/// Size of the log per update with full images (state.range(1) == 0) or
+/// delta update records (state.range(1) == 1), reported as log_bytes_per_update
+void BM_LogBytesPerUpdate(benchmark::State& state) {
+    WorkloadUpdates workload(static_cast<Workload>(state.range(0)));
+    TestFile log_file;
+    LogManager log_manager(&log_file);
+    log_manager.set_delta_updates(state.range(1) == 1);
+    uint64_t txn_id = 0;
+    uint64_t updates = 0;
+    uint64_t log_bytes = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        if (updates % UPDATES_PER_TXN == 0) {
+            if (txn_id != 0) {
+                log_manager.log_commit(txn_id);
+            }
+            if (log_file.size() > MAX_LOG_SIZE) {
+                log_file.resize(0);
+                log_manager.reset(&log_file);
+            }
+            log_manager.log_txn_begin(++txn_id);
+        }
+        workload.next();
+        uint64_t lsn = log_manager.get_current_lsn();
+        state.ResumeTiming();
+        log_manager.log_update(txn_id, 0, workload.length(), 0, workload.before_img(), workload.after_img());
+        state.PauseTiming();
+        log_bytes += log_manager.get_current_lsn() - lsn;
+        updates++;
+        state.ResumeTiming();
+    }
+    state.counters["log_bytes_per_update"] = benchmark::Counter(log_bytes, benchmark::Counter::kAvgIterations);
+    state.SetLabel(state.range(1) == 1 ? "delta" : "full images");
+}
+
+/// Number of updates appended and read back by BM_CompressedLog
+constexpr uint64_t COMPRESSED_LOG_UPDATES = 1 << 16;
+
+/// Append path and recovery scan of the log of a workload (state.range(0)),
+/// written to a plain file (state.range(1) == 0) or through a CompressedLogFile
+/// (state.range(1) == 1), with full images (state.range(2) == 0) or delta
+/// update records (state.range(2) == 1). bytes_per_second counts the raw log,
+/// compression_ratio is its size over the stored size.
+void BM_CompressedLog(benchmark::State& state) {
+    bool compressed = state.range(1) == 1;
+    uint64_t raw_size = 0;
+    uint64_t stored_size = 0;
+    double read_seconds = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        WorkloadUpdates workload(static_cast<Workload>(state.range(0)));
+        auto file = std::make_unique<TestFile>();
+        TestFile* plain_file = file.get();
+        std::unique_ptr<CompressedLogFile> compressed_file;
+        File* log_file = plain_file;
+        if (compressed) {
+            compressed_file = std::make_unique<CompressedLogFile>(std::move(file));
+            log_file = compressed_file.get();
+        }
+        LogManager log_manager(log_file);
+        log_manager.set_delta_updates(state.range(2) == 1);
+        state.ResumeTiming();
+        for (uint64_t update = 0; update < COMPRESSED_LOG_UPDATES; update++) {
+            uint64_t txn_id = update / UPDATES_PER_TXN + 1;
+            if (update % UPDATES_PER_TXN == 0) {
+                log_manager.log_txn_begin(txn_id);
+            }
+            state.PauseTiming();
+            workload.next();
+            state.ResumeTiming();
+            log_manager.log_update(txn_id, 0, workload.length(), 0, workload.before_img(), workload.after_img());
+            if (update % UPDATES_PER_TXN == UPDATES_PER_TXN - 1) {
+                log_manager.log_commit(txn_id);
+            }
+        }
+        state.PauseTiming();
+        raw_size += log_file->size();
+        stored_size += compressed ? compressed_file->get_stored_size() : plain_file->size();
+        auto start = std::chrono::steady_clock::now();
+        buzzdb::LogReader reader(log_file, 0, log_file->size(), LogManager::DEFAULT_LOG_READER_CHUNK_SIZE);
+        buzzdb::LogRecordView record;
+        while (reader.next(record)) {
+        }
+        read_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        state.ResumeTiming();
+    }
+    state.SetBytesProcessed(raw_size);
+    state.counters["compression_ratio"] = static_cast<double>(raw_size) / stored_size;
+    state.counters["read_bytes_per_second"] = raw_size / read_seconds;
+    state.SetLabel(std::string(compressed ? "zlib" : "plain") + (state.range(2) == 1 ? ", delta" : ", full images"));
+}
+
+/// Segment and log file of BM_CommitLatency
+constexpr uint16_t COMMIT_LATENCY_SEGMENT = 900;
+constexpr const char* COMMIT_LATENCY_LOG = "commit_latency.log";
+
+/// Latency of commit_txn for transactions that update a 128 byte tuple on
+/// each of state.range(1) pages, forcing the pages at commit (state.range(0)
+/// == 1) or leaving them to the buffer manager (state.range(0) == 0). Only
+/// the commits are timed.
+void BM_CommitLatency(benchmark::State& state) {
+    constexpr uint32_t TUPLE_SIZE = 128;
+    constexpr uint64_t PAGE_SIZE = 4096;
+    constexpr uint64_t PAGE_COUNT = 64;
+    bool force = state.range(0) == 1;
+    uint64_t pages_per_txn = state.range(1);
+    File::open_file(std::to_string(COMMIT_LATENCY_SEGMENT).c_str(), File::WRITE)->resize(0);
+    auto log_file = File::open_file(COMMIT_LATENCY_LOG, File::WRITE);
+    log_file->resize(0);
+    {
+        BufferManager buffer_manager(PAGE_SIZE, 2 * PAGE_COUNT);
+        LogManager log_manager(log_file.get());
+        HeapSegment heap_segment(COMMIT_LATENCY_SEGMENT, log_manager, buffer_manager);
+        TransactionManager transaction_manager(log_manager, buffer_manager);
+        transaction_manager.set_force_at_commit(force);
+
+        // one tuple at the start of each page
+        std::vector<std::byte> tuple(TUPLE_SIZE);
+        std::vector<TID> tids;
+        uint64_t txn_id = transaction_manager.start_txn();
+        while (tids.size() < PAGE_COUNT) {
+            TID tid = heap_segment.allocate(TUPLE_SIZE);
+            if (tids.empty() || (tid.value >> 16) != (tids.back().value >> 16)) {
+                tids.push_back(tid);
+            }
+            heap_segment.write(tid, tuple.data(), TUPLE_SIZE, txn_id);
+        }
+        transaction_manager.commit_txn(txn_id);
+        buffer_manager.flush_all_pages();
+
+        uint64_t next_page = 0;
+        for (auto _ : state) {
+            state.PauseTiming();
+            txn_id = transaction_manager.start_txn();
+            for (uint64_t page = 0; page < pages_per_txn; page++) {
+                TID tid = tids[next_page++ % tids.size()];
+                tuple[0] = static_cast<std::byte>(next_page);
+                heap_segment.write(tid, tuple.data(), TUPLE_SIZE, txn_id);
+                transaction_manager.add_modified_page(
+                    txn_id, BufferManager::get_overall_page_id(COMMIT_LATENCY_SEGMENT, tid.value >> 16));
+            }
+            state.ResumeTiming();
+            transaction_manager.commit_txn(txn_id);
+        }
+    }
+    log_file.reset();
+    std::remove(COMMIT_LATENCY_LOG);
+    std::remove(std::to_string(COMMIT_LATENCY_SEGMENT).c_str());
+    state.SetLabel(force ? "force" : "no-force");
+}
+
+constexpr const char* COMMIT_THROUGHPUT_LOG = "commit_throughput.log";
+constexpr const char* COMMIT_THROUGHPUT_DIRECTORY = "commit_throughput.d";
+
+/// Commit throughput of state.range(1) threads that each run transactions of
+/// 4 updates of a 64 byte tuple on a page of their own, logged to a single
+/// LogManager (state.range(0) == 0), a PartitionedLog with one partition (1)
+/// or with a partition per thread (2). The single partition separates the
+/// effect of the partitioning from buffering the records of a transaction
+/// until its commit. Reports the commits per second.
+void BM_CommitThroughput(benchmark::State& state) {
+    constexpr uint64_t TUPLE_SIZE = 64;
+    constexpr uint64_t UPDATES = 4;
+    constexpr uint64_t TXNS_PER_THREAD = 64;
+    int mode = state.range(0);
+    size_t threads = state.range(1);
+    uint64_t commits = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::unique_ptr<File> log_file;
+        std::unique_ptr<LogManager> log_manager;
+        std::unique_ptr<PartitionedLog> partitioned_log;
+        std::filesystem::remove_all(COMMIT_THROUGHPUT_DIRECTORY);
+        if (mode == 0) {
+            log_file = File::open_file(COMMIT_THROUGHPUT_LOG, File::WRITE);
+            log_file->resize(0);
+            log_manager = std::make_unique<LogManager>(log_file.get());
+        } else {
+            partitioned_log = std::make_unique<PartitionedLog>(COMMIT_THROUGHPUT_DIRECTORY, mode == 1 ? 1 : threads);
+        }
+        state.ResumeTiming();
+
+        std::vector<std::thread> workers;
+        for (size_t thread = 0; thread < threads; thread++) {
+            workers.emplace_back([&, thread]() {
+                std::vector<std::byte> before_img(TUPLE_SIZE, std::byte{1});
+                std::vector<std::byte> after_img(TUPLE_SIZE, std::byte{2});
+                uint64_t page_lsn = buzzdb::INVALID_LSN;
+                for (uint64_t txn = 0; txn < TXNS_PER_THREAD; txn++) {
+                    uint64_t txn_id = thread * TXNS_PER_THREAD + txn + 1;
+                    if (log_manager) {
+                        log_manager->log_txn_begin(txn_id);
+                    } else {
+                        partitioned_log->log_txn_begin(txn_id);
+                    }
+                    for (uint64_t update = 0; update < UPDATES; update++) {
+                        after_img[0] = static_cast<std::byte>(txn + update);
+                        if (log_manager) {
+                            log_manager->log_update(txn_id, thread, TUPLE_SIZE, update * TUPLE_SIZE,
+                                                    before_img.data(), after_img.data());
+                        } else {
+                            page_lsn = partitioned_log->log_update(txn_id, thread, TUPLE_SIZE, update * TUPLE_SIZE,
+                                                                   before_img.data(), after_img.data(), page_lsn);
+                        }
+                    }
+                    if (log_manager) {
+                        log_manager->log_commit(txn_id);
+                    } else {
+                        partitioned_log->log_commit(txn_id);
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        commits += threads * TXNS_PER_THREAD;
+
+        state.PauseTiming();
+        log_manager.reset();
+        partitioned_log.reset();
+        log_file.reset();
+        state.ResumeTiming();
+    }
+    std::remove(COMMIT_THROUGHPUT_LOG);
+    std::filesystem::remove_all(COMMIT_THROUGHPUT_DIRECTORY);
+    state.counters["commits_per_s"] = benchmark::Counter(commits, benchmark::Counter::kIsRate);
+    const char* labels[] = {"log manager", "1 partition", "partition per thread"};
+    state.SetLabel(labels[mode]);
+}
+
+/// Lock throughput of 8 threads running transactions that lock 4 of 4096
+/// records, half of them shared, with the deadlock policy state.range(0)
+/// (0 wait-die, 1 wound-wait, 2 detection). state.range(1) percent of the
+/// accesses go to a hot spot of 16 records. An aborted transaction releases
+/// its locks and retries with its id, which keeps its age. Reports the
+/// commits per second and the aborts per commit.
+void BM_LockContention(benchmark::State& state) {
+    constexpr size_t THREADS = 8;
+    constexpr uint64_t RECORDS = 4096;
+    constexpr uint64_t HOT_RECORDS = 16;
+    constexpr uint64_t LOCKS = 4;
+    constexpr uint64_t TXNS_PER_THREAD = 256;
+    constexpr uint16_t SEGMENT = 1;
+    auto policy = static_cast<DeadlockPolicy>(state.range(0));
+    uint64_t hot_percent = state.range(1);
+    uint64_t commits = 0;
+    uint64_t aborts = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto lock_manager = std::make_unique<LockManager>(policy);
+        std::atomic<uint64_t> next_txn_id{1};
+        state.ResumeTiming();
+
+        std::vector<std::thread> workers;
+        for (size_t thread = 0; thread < THREADS; thread++) {
+            workers.emplace_back([&, thread]() {
+                std::mt19937_64 rng(thread);
+                std::uniform_int_distribution<uint64_t> percent(0, 99);
+                for (uint64_t txn = 0; txn < TXNS_PER_THREAD; txn++) {
+                    uint64_t txn_id = next_txn_id++;
+                    while (true) {
+                        try {
+                            for (uint64_t i = 0; i < LOCKS; i++) {
+                                uint64_t record = percent(rng) < hot_percent ? rng() % HOT_RECORDS
+                                                                             : HOT_RECORDS + rng() % (RECORDS - HOT_RECORDS);
+                                LockMode mode = rng() % 2 == 0 ? LockMode::SHARED : LockMode::EXCLUSIVE;
+                                lock_manager->lock(txn_id, SEGMENT, TID(record / 64, record % 64), mode);
+                            }
+                            lock_manager->unlock_all(txn_id);
+                            break;
+                        } catch (const txn_abort_error&) {
+                            lock_manager->unlock_all(txn_id);
+                        }
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        commits += THREADS * TXNS_PER_THREAD;
+
+        state.PauseTiming();
+        aborts += lock_manager->get_stats().aborts;
+        lock_manager.reset();
+        state.ResumeTiming();
+    }
+    state.counters["commits_per_s"] = benchmark::Counter(commits, benchmark::Counter::kIsRate);
+    state.counters["aborts_per_commit"] = static_cast<double>(aborts) / commits;
+    const char* labels[] = {"wait-die", "wound-wait", "detection"};
+    state.SetLabel(labels[state.range(0)]);
+}
+
+/// Segment of BM_Ycsb
+constexpr uint16_t YCSB_SEGMENT = 902;
+
+/// Throughput of 8 threads running YCSB-A like transactions of 4 operations
+/// on 1024 rows of 16 bytes, half reads and half read-modify-writes, under
+/// strict 2PL with wait-die (state.range(0) == 0) or OCC (1).
+/// state.range(1) percent of the operations go to a hot spot of 16 rows.
+/// Aborted transactions are retried. The log is kept in memory, so the
+/// concurrency control dominates. Reports the commits per second and the
+/// aborts per commit.
+void BM_Ycsb(benchmark::State& state) {
+    constexpr size_t THREADS = 8;
+    constexpr uint64_t ROWS = 1024;
+    constexpr uint64_t HOT_ROWS = 16;
+    constexpr uint64_t OPERATIONS = 4;
+    constexpr uint64_t TXNS_PER_THREAD = 256;
+    bool occ = state.range(0) == 1;
+    uint64_t hot_percent = state.range(1);
+    uint64_t commits = 0;
+    uint64_t aborts = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        File::open_file(std::to_string(YCSB_SEGMENT).c_str(), File::WRITE)->resize(0);
+        TestFile log_file;
+        BufferManager buffer_manager(4096, 64);
+        LogManager log_manager(&log_file);
+        HeapSegment heap_segment(YCSB_SEGMENT, log_manager, buffer_manager);
+        TransactionManager transaction_manager(log_manager, buffer_manager);
+        LockManager lock_manager(DeadlockPolicy::WAIT_DIE);
+        OccManager occ_manager;
+        std::vector<TID> rows;
+        uint64_t load_txn = transaction_manager.start_txn();
+        for (uint64_t row = 0; row < ROWS; row++) {
+            uint64_t record[2] = {row, 0};
+            rows.push_back(heap_segment.allocate(sizeof(record)));
+            heap_segment.write(rows.back(), reinterpret_cast<std::byte*>(record), sizeof(record), load_txn);
+        }
+        transaction_manager.commit_txn(load_txn);
+        if (occ) {
+            transaction_manager.set_occ_manager(&occ_manager);
+            heap_segment.occ_manager_ = &occ_manager;
+        } else {
+            transaction_manager.set_lock_manager(&lock_manager);
+            heap_segment.lock_manager_ = &lock_manager;
+        }
+        std::atomic<uint64_t> retries{0};
+        state.ResumeTiming();
+
+        std::vector<std::thread> workers;
+        for (size_t thread = 0; thread < THREADS; thread++) {
+            workers.emplace_back([&, thread]() {
+                std::mt19937_64 rng(thread);
+                std::uniform_int_distribution<uint64_t> percent(0, 99);
+                for (uint64_t txn = 0; txn < TXNS_PER_THREAD; txn++) {
+                    while (true) {
+                        uint64_t txn_id = transaction_manager.start_txn();
+                        try {
+                            for (uint64_t operation = 0; operation < OPERATIONS; operation++) {
+                                uint64_t row = percent(rng) < hot_percent ? rng() % HOT_ROWS
+                                                                          : HOT_ROWS + rng() % (ROWS - HOT_ROWS);
+                                TID tid = rows[row];
+                                uint64_t record[2];
+                                heap_segment.read(tid, reinterpret_cast<std::byte*>(record), sizeof(record), txn_id);
+                                if (rng() % 2 == 0) {
+                                    record[1]++;
+                                    heap_segment.write(tid, reinterpret_cast<std::byte*>(record), sizeof(record),
+                                                       txn_id);
+                                    transaction_manager.add_modified_page(
+                                        txn_id, BufferManager::get_overall_page_id(YCSB_SEGMENT, tid.value >> 16));
+                                }
+                            }
+                        } catch (const txn_abort_error&) {
+                            transaction_manager.abort_txn(txn_id);
+                            retries++;
+                            continue;
+                        }
+                        try {
+                            transaction_manager.commit_txn(txn_id);
+                            break;
+                        } catch (const txn_abort_error&) {
+                            // the failed validation aborted the transaction
+                            retries++;
+                        }
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        commits += THREADS * TXNS_PER_THREAD;
+        aborts += retries;
+
+        state.PauseTiming();
+        transaction_manager.set_occ_manager(nullptr);
+        transaction_manager.set_lock_manager(nullptr);
+        state.ResumeTiming();
+    }
+    std::remove(std::to_string(YCSB_SEGMENT).c_str());
+    state.counters["commits_per_s"] = benchmark::Counter(commits, benchmark::Counter::kIsRate);
+    state.counters["aborts_per_commit"] = static_cast<double>(aborts) / commits;
+    state.SetLabel(occ ? "occ" : "2pl");
+}
+
+/// Segment and log of BM_ReadMostly
+constexpr uint16_t READ_MOSTLY_SEGMENT = 903;
+constexpr const char* READ_MOSTLY_LOG = "read_mostly.log";
+
+/// Transactions on 1024 rows of 16 bytes, 90% of them read 4 rows and 10%
+/// update one, with eager (state.range(0) == 0) or lazy begins (1), logged
+/// to a file. Reports the transactions per second.
+void BM_ReadMostly(benchmark::State& state) {
+    constexpr uint64_t ROWS = 1024;
+    constexpr uint64_t READS = 4;
+    bool lazy = state.range(0) == 1;
+    File::open_file(std::to_string(READ_MOSTLY_SEGMENT).c_str(), File::WRITE)->resize(0);
+    auto log_file = File::open_file(READ_MOSTLY_LOG, File::WRITE);
+    log_file->resize(0);
+    uint64_t txns = 0;
+    {
+        BufferManager buffer_manager(4096, 64);
+        LogManager log_manager(log_file.get());
+        HeapSegment heap_segment(READ_MOSTLY_SEGMENT, log_manager, buffer_manager);
+        TransactionManager transaction_manager(log_manager, buffer_manager);
+        std::vector<TID> rows;
+        uint64_t load_txn = transaction_manager.start_txn();
+        for (uint64_t row = 0; row < ROWS; row++) {
+            uint64_t record[2] = {row, 0};
+            rows.push_back(heap_segment.allocate(sizeof(record)));
+            heap_segment.write(rows.back(), reinterpret_cast<std::byte*>(record), sizeof(record), load_txn);
+        }
+        transaction_manager.commit_txn(load_txn);
+        transaction_manager.set_lazy_begin(lazy);
+
+        std::mt19937_64 rng(42);
+        for (auto _ : state) {
+            uint64_t txn_id = transaction_manager.start_txn();
+            uint64_t record[2];
+            if (rng() % 10 != 0) {
+                for (uint64_t read = 0; read < READS; read++) {
+                    heap_segment.read(rows[rng() % ROWS], reinterpret_cast<std::byte*>(record), sizeof(record),
+                                      txn_id);
+                }
+            } else {
+                TID tid = rows[rng() % ROWS];
+                heap_segment.read(tid, reinterpret_cast<std::byte*>(record), sizeof(record), txn_id);
+                record[1]++;
+                heap_segment.write(tid, reinterpret_cast<std::byte*>(record), sizeof(record), txn_id);
+                transaction_manager.add_modified_page(
+                    txn_id, BufferManager::get_overall_page_id(READ_MOSTLY_SEGMENT, tid.value >> 16));
+            }
+            transaction_manager.commit_txn(txn_id);
+            txns++;
+        }
+    }
+    log_file.reset();
+    std::remove(READ_MOSTLY_LOG);
+    std::remove(std::to_string(READ_MOSTLY_SEGMENT).c_str());
+    state.counters["txns_per_s"] = benchmark::Counter(txns, benchmark::Counter::kIsRate);
+    state.SetLabel(lazy ? "lazy begin" : "eager begin");
+}
+
+/// Segment of BM_ParallelRedo
+constexpr uint16_t REDO_SEGMENT = 902;
+
+/// Redo pass of a recovery over 32 MB of log with state.range(0) threads:
+/// transactions of UPDATES_PER_TXN updates that overwrite 1 KB tuples on 256
+/// pages, none of which were written. The buffer holds all pages, or a
+/// quarter of them if state.range(1) is set and the redo goes in waves.
+/// Reports the replayed log in MB/s.
+void BM_ParallelRedo(benchmark::State& state) {
+    constexpr uint32_t TUPLE_SIZE = 1024;
+    constexpr uint64_t PAGE_SIZE = 4096;
+    constexpr uint64_t PAGE_COUNT = 256;
+    constexpr uint64_t LOG_SIZE = 32 << 20;
+    size_t threads = state.range(0);
+    size_t frames = state.range(1) ? PAGE_COUNT / 4 : 2 * PAGE_COUNT;
+    File::open_file(std::to_string(REDO_SEGMENT).c_str(), File::WRITE)->resize(0);
+    TestFile log_file;
+    {
+        BufferManager buffer_manager(PAGE_SIZE, 2 * PAGE_COUNT);
+        LogManager log_manager(&log_file);
+        HeapSegment heap_segment(REDO_SEGMENT, log_manager, buffer_manager);
+        TransactionManager transaction_manager(log_manager, buffer_manager);
+
+        std::vector<std::byte> tuple(TUPLE_SIZE);
+        std::vector<TID> tids;
+        uint64_t txn_id = transaction_manager.start_txn();
+        while (tids.size() < PAGE_COUNT) {
+            TID tid = heap_segment.allocate(TUPLE_SIZE);
+            if (tids.empty() || (tid.value >> 16) != (tids.back().value >> 16)) {
+                tids.push_back(tid);
+            }
+            heap_segment.write(tid, tuple.data(), TUPLE_SIZE, txn_id);
+        }
+        transaction_manager.commit_txn(txn_id);
+
+        for (uint64_t update = 0; log_file.size() < LOG_SIZE;) {
+            txn_id = transaction_manager.start_txn();
+            for (uint64_t i = 0; i < UPDATES_PER_TXN; i++, update++) {
+                // a full image, not a delta record
+                std::fill(tuple.begin(), tuple.end(), static_cast<std::byte>(update));
+                heap_segment.write(tids[update % tids.size()], tuple.data(), TUPLE_SIZE, txn_id);
+            }
+            transaction_manager.commit_txn(txn_id);
+        }
+        log_manager.flush_log();
+        buffer_manager.discard_all_pages();
+    }
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        BufferManager buffer_manager(PAGE_SIZE, frames);
+        LogManager log_manager(&log_file);
+        log_manager.set_redo_threads(threads);
+        state.ResumeTiming();
+        log_manager.recovery(buffer_manager);
+        state.PauseTiming();
+        buffer_manager.discard_all_pages();
+        state.ResumeTiming();
+    }
+    state.SetBytesProcessed(state.iterations() * log_file.size());
+    state.counters["redo_MBps"] =
+        benchmark::Counter(state.iterations() * log_file.size() / 1e6, benchmark::Counter::kIsRate);
+    std::remove(std::to_string(REDO_SEGMENT).c_str());
+}
+
+/// Segment and directories of BM_PointInTimeRestore
+constexpr uint16_t RESTORE_SEGMENT = 901;
+constexpr const char* RESTORE_LOG_DIRECTORY = "restore_bench.log.d";
+constexpr const char* RESTORE_ARCHIVE_DIRECTORY = "restore_bench.archive";
+constexpr const char* RESTORE_BACKUP_DIRECTORY = "restore_bench.backup";
+constexpr const char* RESTORE_TARGET_DIRECTORY = "restore_bench.target";
+
+/// Restore of an online backup followed by state.range(0) MB of log, most
+/// of it archived by checkpoints: transactions of UPDATES_PER_TXN updates of
+/// a 128 byte tuple on 64 pages. Reports the replayed log in MB/s.
+void BM_PointInTimeRestore(benchmark::State& state) {
+    constexpr uint32_t TUPLE_SIZE = 128;
+    constexpr uint64_t PAGE_SIZE = 4096;
+    constexpr uint64_t PAGE_COUNT = 64;
+    constexpr size_t SEGMENT_SIZE = 1 << 20;
+    uint64_t log_size = static_cast<uint64_t>(state.range(0)) << 20;
+    for (auto directory : {RESTORE_LOG_DIRECTORY, RESTORE_ARCHIVE_DIRECTORY, RESTORE_BACKUP_DIRECTORY,
+                           RESTORE_TARGET_DIRECTORY}) {
+        std::filesystem::remove_all(directory);
+    }
+    File::open_file(std::to_string(RESTORE_SEGMENT).c_str(), File::WRITE)->resize(0);
+    {
+        BufferManager buffer_manager(PAGE_SIZE, 2 * PAGE_COUNT);
+        SegmentedLogFile log_file(RESTORE_LOG_DIRECTORY, SEGMENT_SIZE);
+        log_file.set_archive_directory(RESTORE_ARCHIVE_DIRECTORY);
+        LogManager log_manager(&log_file);
+        HeapSegment heap_segment(RESTORE_SEGMENT, log_manager, buffer_manager);
+        TransactionManager transaction_manager(log_manager, buffer_manager);
+
+        std::vector<std::byte> tuple(TUPLE_SIZE);
+        std::vector<TID> tids;
+        uint64_t txn_id = transaction_manager.start_txn();
+        while (tids.size() < PAGE_COUNT) {
+            TID tid = heap_segment.allocate(TUPLE_SIZE);
+            if (tids.empty() || (tid.value >> 16) != (tids.back().value >> 16)) {
+                tids.push_back(tid);
+            }
+            heap_segment.write(tid, tuple.data(), TUPLE_SIZE, txn_id);
+        }
+        transaction_manager.commit_txn(txn_id);
+        buzzdb::create_backup(log_manager, buffer_manager, {RESTORE_SEGMENT}, RESTORE_BACKUP_DIRECTORY);
+
+        uint64_t start_lsn = log_manager.get_current_lsn();
+        uint64_t checkpoint_lsn = start_lsn;
+        for (uint64_t update = 0; log_manager.get_current_lsn() - start_lsn < log_size;) {
+            txn_id = transaction_manager.start_txn();
+            for (uint64_t i = 0; i < UPDATES_PER_TXN; i++, update++) {
+                tuple[update % TUPLE_SIZE] = static_cast<std::byte>(update);
+                heap_segment.write(tids[update % tids.size()], tuple.data(), TUPLE_SIZE, txn_id);
+            }
+            transaction_manager.commit_txn(txn_id);
+            if (log_manager.get_current_lsn() - checkpoint_lsn > 4 * SEGMENT_SIZE) {
+                log_manager.log_checkpoint(buffer_manager);
+                checkpoint_lsn = log_manager.get_current_lsn();
+            }
+        }
+        buffer_manager.flush_all_pages();
+    }
+
+    buzzdb::RestoreOptions options;
+    options.backup_directory = RESTORE_BACKUP_DIRECTORY;
+    options.archive_directory = RESTORE_ARCHIVE_DIRECTORY;
+    options.log_directory = RESTORE_LOG_DIRECTORY;
+    options.segment_size = SEGMENT_SIZE;
+    options.target_directory = RESTORE_TARGET_DIRECTORY;
+    uint64_t log_bytes = 0;
+    double seconds = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::filesystem::remove_all(RESTORE_TARGET_DIRECTORY);
+        BufferManager buffer_manager(PAGE_SIZE, 2 * PAGE_COUNT);
+        state.ResumeTiming();
+        buzzdb::RestoreResult result = buzzdb::restore_backup(options, buffer_manager);
+        log_bytes += result.log_bytes;
+        seconds += result.seconds;
+        state.PauseTiming();
+        buffer_manager.discard_all_pages();
+        state.ResumeTiming();
+    }
+    state.SetBytesProcessed(log_bytes);
+    state.counters["restore_MBps"] = seconds > 0 ? log_bytes / seconds / 1e6 : 0;
+
+    for (auto directory : {RESTORE_LOG_DIRECTORY, RESTORE_ARCHIVE_DIRECTORY, RESTORE_BACKUP_DIRECTORY,
+                           RESTORE_TARGET_DIRECTORY}) {
+        std::filesystem::remove_all(directory);
+    }
+    std::remove(std::to_string(RESTORE_SEGMENT).c_str());
+}
+
+/// CRC of an update record of the same size as in BM_LogUpdate, i.e. the
+/// checksum share of the append path
+template <uint32_t (*CRC32C)(uint32_t, const char*, size_t)>
+void BM_Crc32cRecord(benchmark::State& state) {
+    // header and update fields, followed by the two images
+    std::vector<char> record(41 + 2 * state.range(0), 1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(CRC32C(0, record.data(), record.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * record.size());
+    state.SetLabel(CRC32C == buzzdb::crc32c && buzzdb::crc32c_is_hardware() ? "hardware" : "software");
+}
+
+}  // namespace
+
+BENCHMARK(BM_LogUpdate)->RangeMultiplier(4)->Range(16, 4096);
+BENCHMARK(BM_LogBytesPerUpdate)->ArgsProduct({{INSERT_TUPLE, INCREMENT_COUNTER, YCSB_FIELD_UPDATE}, {0, 1}});
+BENCHMARK(BM_CompressedLog)
+    ->ArgsProduct({{INSERT_TUPLE, INCREMENT_COUNTER, YCSB_FIELD_UPDATE}, {0, 1}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_CommitLatency)->ArgsProduct({{0, 1}, {1, 4, 16}})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_CommitThroughput)
+    ->ArgsProduct({{0, 1, 2}, {8, 16, 32, 64}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LockContention)
+    ->ArgsProduct({{0, 1, 2}, {0, 50, 90}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Ycsb)->ArgsProduct({{0, 1}, {0, 50, 90}})->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ReadMostly)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+// without waves, the serial redo of the small buffer evicts a page for most records
+BENCHMARK(BM_ParallelRedo)
+    ->ArgsProduct({{1, 2, 4, 8}, {0}})
+    ->ArgsProduct({{2, 4, 8}, {1}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PointInTimeRestore)->Arg(4)->Arg(16)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Crc32cRecord, buzzdb::crc32c)->RangeMultiplier(4)->Range(16, 4096);
+BENCHMARK_TEMPLATE(BM_Crc32cRecord, buzzdb::crc32c_software)->RangeMultiplier(4)->Range(16, 4096);
+
+BENCHMARK_MAIN();
@@ -1,22 +1,64 @@
 #include <gtest/gtest.h>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
 #include <string>
+#include <thread>
 
 #include "heap/heap_file.h"
+#include "log/backup.h"
+#include "log/checkpointer.h"
+#include "log/compressed_log_file.h"
+#include "log/log_flusher.h"
+#include "log/log_inspector.h"
 #include "log/log_manager.h"
+#include "log/log_reader.h"
+#include "log/log_replica.h"
+#include "log/log_shipper.h"
+#include "log/partitioned_log.h"
+#include "log/segmented_log_file.h"
 #include "transaction/transaction_manager.h"
 #include "common/macros.h"
+#include "common/trace.h"
 #include "buffer/buffer_manager.h"
 #include "storage/test_file.h"
 
 
+using buzzdb::BackupManifest;
 using buzzdb::BufferManager;
+using buzzdb::Checkpointer;
+using buzzdb::CompressedLogFile;
+using buzzdb::LogFilter;
+using buzzdb::LogFlusher;
+using buzzdb::LogInspector;
+using buzzdb::LockManager;
+using buzzdb::LockMode;
+using buzzdb::DeadlockPolicy;
 using buzzdb::LogManager;
+using buzzdb::LogReader;
+using buzzdb::LogReplica;
+using buzzdb::LogShipper;
+using buzzdb::OccManager;
+using buzzdb::PartitionedLog;
+using buzzdb::RestoreOptions;
+using buzzdb::RestoreResult;
+using buzzdb::LogRecordView;
+using buzzdb::SegmentedLogFile;
 using buzzdb::HeapSegment;
 using buzzdb::TransactionManager;
 using buzzdb::TID;
 using buzzdb::BufferFrame;
 using buzzdb::SlottedPage;
 using buzzdb::File;
+using buzzdb::TestFile;
+using buzzdb::TracePhase;
+using buzzdb::TraceSpan;
+using buzzdb::Tracer;
+using buzzdb::txn_abort_error;
+using buzzdb::validation_abort_error;
+using buzzdb::VersionStore;
+using buzzdb::write_conflict_error;
 
 using buzzdb::INVALID_FIELD;
 
@@ -27,9 +69,13 @@ namespace {
 
 class LogManagerTest: public ::testing::Test{
 	void SetUp() { 
-		auto file_handle = File::open_file(std::to_string(HEAP_SEGMENT).c_str(), 
-	   										File::WRITE);
-		file_handle->resize(0);
+		// segments are not forced at commit, stale pages of an earlier run
+		// must not be found by redo
+		for (uint64_t segment_id : {HEAP_SEGMENT, HEAP_SEGMENT + 1}) {
+			auto file_handle = File::open_file(std::to_string(segment_id).c_str(),
+											   File::WRITE);
+			file_handle->resize(0);
+		}
        	auto log_handle = File::open_file(LOG_FILE, File::WRITE);
 		log_handle->resize(0);
    }
@@ -178,6 +224,24 @@ void dont_insert(HeapSegment& heap_segment,
 	abort(transaction_manager, buffer_manager, txn_id);
 }
 
+/* Log file that simulates a crash by throwing once a given number of
+ * writes went through
+*/
+class SimulatedCrash : public std::exception {};
+
+class CrashingTestFile : public TestFile {
+ public:
+	size_t writes_until_crash = std::numeric_limits<size_t>::max();
+
+	void write_block(const char* block, size_t offset, size_t size) override {
+		if (writes_until_crash == 0) {
+			throw SimulatedCrash();
+		}
+		writes_until_crash--;
+		TestFile::write_block(block, offset, size);
+	}
+};
+
 /* Simulate crash
  * Reset DB
  * recovery
@@ -190,7 +254,11 @@ void crash(TransactionManager& transaction_manager,
 	auto log_file = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
 	log_manager.reset(log_file.get());
 	transaction_manager.reset(log_manager);
+	// pages evicted during recovery are covered by the recovered log, the
+	// copy is gone once we return
+	buffer_manager.set_log_manager(&log_manager);
 	log_manager.recovery(buffer_manager);
+	buffer_manager.set_log_manager(nullptr);
 }
 
 
@@ -206,11 +274,11 @@ TEST_F(LogManagerTest, LogRecordTest) {
 			table_id, 5, 10);
 	
 	// check number of log records
-    EXPECT_EQ(log_manager.get_total_log_records(), 4);
+    EXPECT_EQ(log_manager.get_total_log_records(), 6);
 
-	// check number of update log records
+	// check number of update log records, each insert logs its slot allocation
     EXPECT_EQ(log_manager.get_total_log_records_of_type(
-    		LogManager::LogRecordType::UPDATE_RECORD), 2);
+    		LogManager::LogRecordType::UPDATE_RECORD), 4);
 }
 
 TEST_F(LogManagerTest, FlushAllTest) {
@@ -233,7 +301,7 @@ TEST_F(LogManagerTest, FlushAllTest) {
 
 	auto txn_id = transaction_manager.start_txn();
 
-	insert_row(heap_segment, transaction_manager, table_id, txn_id, 3);
+	insert_row(heap_segment, transaction_manager, txn_id, table_id, 3);
 
 	buffer_manager.flush_all_pages();
 
@@ -270,6 +338,97 @@ TEST_F(LogManagerTest, TestCommitCrash){
 } 
 
 
+/* T1 inserts and commits without any page reaching the heap file
+ * crash
+ * redo rebuilds the slots and the tuples from the log
+*/
+TEST_F(LogManagerTest, TestNoForceCommitCrash){
+	BufferManager buffer_manager(128, 10);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment1(HEAP_SEGMENT, log_manager, buffer_manager);
+	HeapSegment heap_segment2(HEAP_SEGMENT + 1, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	uint64_t t1 = transaction_manager.start_txn();
+	insert_row(heap_segment1, transaction_manager, t1, table_id, 5);
+	insert_row(heap_segment1, transaction_manager, t1, table_id, 10);
+	transaction_manager.commit_txn(t1);
+	EXPECT_EQ(File::open_file(std::to_string(HEAP_SEGMENT).c_str(), File::READ)->size(), 0);
+
+	// forcing the pages at commit writes them before the commit record
+	transaction_manager.set_force_at_commit(true);
+	uint64_t t2 = transaction_manager.start_txn();
+	insert_row(heap_segment2, transaction_manager, t2, table_id, 15);
+	transaction_manager.commit_txn(t2);
+	EXPECT_GT(File::open_file(std::to_string(HEAP_SEGMENT + 1).c_str(), File::READ)->size(), 0);
+
+	crash(transaction_manager, buffer_manager, log_manager);
+
+	EXPECT_TRUE(look(heap_segment1, transaction_manager, buffer_manager,
+			table_id, 5, true));
+	EXPECT_TRUE(look(heap_segment1, transaction_manager, buffer_manager,
+			table_id, 10, true));
+	EXPECT_TRUE(look(heap_segment2, transaction_manager, buffer_manager,
+			table_id, 15, true));
+}
+
+
+/* T1 inserts and commits
+ * T2 inserts into more pages than the buffer holds, they are stolen
+ * every page written is covered by the durable log
+ * crash
+ * Only T1 data should be there
+ * Without steal, T3 runs out of frames
+*/
+TEST_F(LogManagerTest, TestStealEviction){
+	BufferManager buffer_manager(128, 4);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 1, 2);
+	uint64_t t2 = transaction_manager.start_txn();
+	for (uint64_t field = 10; field < 40; field++) {
+		insert_row(heap_segment, transaction_manager, t2, table_id, field);
+	}
+	EXPECT_GT(heap_segment.page_count_, 3);
+
+	size_t page_size = BufferManager::PAGE_LSN_SIZE + buffer_manager.get_page_size();
+	auto segment_file = File::open_file(std::to_string(HEAP_SEGMENT).c_str(), File::READ);
+	EXPECT_GE(segment_file->size(), 3 * page_size);
+	for (size_t offset = 0; offset + page_size <= segment_file->size(); offset += page_size) {
+		uint64_t page_lsn;
+		segment_file->read_block(offset, sizeof(uint64_t), reinterpret_cast<char*>(&page_lsn));
+		if (page_lsn != buzzdb::INVALID_LSN) {
+			EXPECT_LT(page_lsn, log_manager.get_durable_lsn());
+		}
+	}
+
+	buffer_manager.set_steal(false);
+	uint64_t t3 = transaction_manager.start_txn();
+	EXPECT_THROW({
+		for (uint64_t field = 50; field < 80; field++) {
+			insert_row(heap_segment, transaction_manager, t3, table_id, field);
+		}
+	}, buzzdb::buffer_full_error);
+
+	crash(transaction_manager, buffer_manager, log_manager);
+
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 1, true));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 2, true));
+	for (uint64_t field = 10; field < 40; field++) {
+		EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+				table_id, field, false));
+	}
+}
+
+
 /* insert, abort: data should not be there
  * flush pages directly to the heap file to defeat NO-STEAL policy	
 */
@@ -300,6 +459,37 @@ TEST_F(LogManagerTest, TestAbort){
 }
 
 
+/* insert, abort after the undo buffer spilled: the rollback falls back
+ * to the log file
+*/
+TEST_F(LogManagerTest, TestAbortSpilledUndoBuffer){
+	BufferManager buffer_manager(128, 10);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	// room for the before image of a single tuple
+	log_manager.set_undo_buffer_budget(sizeof(uint64_t)*2);
+
+	uint64_t table_id = 101;
+
+	do_insert(heap_segment, transaction_manager, buffer_manager,
+			table_id, 5, 10);
+
+	dont_insert(heap_segment, transaction_manager, buffer_manager, table_id, 3, 4);
+
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 5, true));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 10, true));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 3, false));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 4, false));
+
+}
+
 /** T1 start, T2 start and commit, T1
 */
 TEST_F(LogManagerTest, TestAbortCommitInterleaved){
@@ -463,6 +653,1809 @@ TEST_F(LogManagerTest, TestOpenCrash){
 
 }
 
+/**
+ * T1 inserts but does not commit
+ * crash, recovery undoes T1 with compensation records
+ * crash again: T1 is already compensated, nothing is undone twice
+*/
+TEST_F(LogManagerTest, TestRecoveryCompensationRecords){
+	BufferManager buffer_manager(128, 10);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 1, 2);
+
+	uint64_t txn_id = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, txn_id, table_id, 5);
+	insert_row(heap_segment, transaction_manager, txn_id, table_id, 10);
+	buffer_manager.flush_all_pages(); // requires undo
+
+	buffer_manager.discard_all_pages();
+	LogManager recovered_log_manager(logfile.get());
+	recovered_log_manager.recovery(buffer_manager);
+	EXPECT_EQ(recovered_log_manager.get_total_log_records_of_type(
+			LogManager::LogRecordType::COMPENSATION_RECORD), 2);
+
+	buffer_manager.discard_all_pages();
+	LogManager twice_recovered_log_manager(logfile.get());
+	twice_recovered_log_manager.recovery(buffer_manager);
+	EXPECT_EQ(twice_recovered_log_manager.get_total_log_records_of_type(
+			LogManager::LogRecordType::COMPENSATION_RECORD), 2);
+
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 1, true));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 2, true));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 5, false));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 10, false));
+}
+
+/**
+ * T1 inserts and commits
+ * T2 inserts but does not commit
+ * crash, then crash again after every write of the recovery until it completes
+ * Each restarted recovery resumes the undo of T2 where the last one stopped
+*/
+TEST_F(LogManagerTest, TestCrashDuringRecovery){
+	BufferManager buffer_manager(128, 10);
+	CrashingTestFile logfile;
+	LogManager log_manager(&logfile);
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 1, 2);
+
+	uint64_t txn_id = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, txn_id, table_id, 5);
+	insert_row(heap_segment, transaction_manager, txn_id, table_id, 10);
+	insert_row(heap_segment, transaction_manager, txn_id, table_id, 15);
+	buffer_manager.flush_all_pages(); // requires undo
+
+	size_t crashes = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t writes = 0; ; writes++) {
+		buffer_manager.discard_all_pages();
+		logfile.writes_until_crash = writes;
+		LogManager recovering_log_manager(&logfile);
+		try {
+			recovering_log_manager.recovery(buffer_manager);
+			break;
+		} catch (const SimulatedCrash&) {
+			crashes++;
+		}
+	}
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start);
+	std::cout << "recovered after " << crashes << " crashes during recovery in "
+			<< elapsed.count() << " us\n";
+	EXPECT_GT(crashes, 0);
+
+	// every update of T2 was compensated exactly once
+	buffer_manager.discard_all_pages();
+	LogManager recovered_log_manager(&logfile);
+	recovered_log_manager.recovery(buffer_manager);
+	EXPECT_EQ(recovered_log_manager.get_total_log_records_of_type(
+			LogManager::LogRecordType::COMPENSATION_RECORD), 3);
+	EXPECT_EQ(recovered_log_manager.get_total_log_records_of_type(
+			LogManager::LogRecordType::ABORT_RECORD), 1);
+
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 1, true));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 2, true));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 5, false));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 10, false));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 15, false));
+}
+
+/**
+ * T1 inserts over two segments and commits
+ * T2 overwrites the tuples and commits without flushing the pages
+ * crash, the parallel redo repeats the updates of T2
+*/
+TEST_F(LogManagerTest, TestParallelRedo){
+	BufferManager buffer_manager(128, 10);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment1(123, log_manager, buffer_manager);
+	HeapSegment heap_segment2(124, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id1 = 101;
+	uint64_t table_id2 = 102;
+	uint64_t t1 = transaction_manager.start_txn();
+	std::vector<TID> tids1;
+	std::vector<TID> tids2;
+	for (uint64_t field = 1; field <= 6; field++) {
+		tids1.push_back(insert_row(heap_segment1, transaction_manager, t1, table_id1, field));
+		tids2.push_back(insert_row(heap_segment2, transaction_manager, t1, table_id2, field));
+	}
+	transaction_manager.commit_txn(t1);
+
+	uint64_t t2 = transaction_manager.start_txn();
+	for (size_t i = 0; i < tids1.size(); i++) {
+		uint64_t tuple[2] = {table_id1, 100 + i};
+		heap_segment1.write(tids1[i], reinterpret_cast<std::byte *>(tuple), sizeof(tuple), t2);
+		tuple[0] = table_id2;
+		heap_segment2.write(tids2[i], reinterpret_cast<std::byte *>(tuple), sizeof(tuple), t2);
+	}
+	transaction_manager.commit_txn(t2);
+
+	buffer_manager.discard_all_pages();
+	LogManager recovered_log_manager(logfile.get());
+	recovered_log_manager.set_redo_threads(3);
+	recovered_log_manager.recovery(buffer_manager);
+
+	for (uint64_t i = 0; i < tids1.size(); i++) {
+		EXPECT_TRUE(look(heap_segment1, transaction_manager, buffer_manager,
+				table_id1, i + 1, false));
+		EXPECT_TRUE(look(heap_segment1, transaction_manager, buffer_manager,
+				table_id1, 100 + i, true));
+		EXPECT_TRUE(look(heap_segment2, transaction_manager, buffer_manager,
+				table_id2, 100 + i, true));
+	}
+}
+
+/**
+ * T1 inserts on more pages than the buffer holds and commits
+ * T2 overwrites the tuples and commits without flushing the pages
+ * crash, the parallel redo repeats the updates in waves of the pages that fit into the buffer
+*/
+TEST_F(LogManagerTest, TestParallelRedoWaves){
+	BufferManager buffer_manager(128, 4);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	uint64_t t1 = transaction_manager.start_txn();
+	std::vector<TID> tids;
+	for (uint64_t field = 1; field <= 40; field++) {
+		tids.push_back(insert_row(heap_segment, transaction_manager, t1, table_id, field));
+	}
+	transaction_manager.commit_txn(t1);
+	EXPECT_GT(tids.back().value >> 16, 4);
+
+	uint64_t t2 = transaction_manager.start_txn();
+	for (size_t i = 0; i < tids.size(); i++) {
+		uint64_t tuple[2] = {table_id, 100 + i};
+		heap_segment.write(tids[i], reinterpret_cast<std::byte *>(tuple), sizeof(tuple), t2);
+	}
+	transaction_manager.commit_txn(t2);
+
+	buffer_manager.discard_all_pages();
+	LogManager recovered_log_manager(logfile.get());
+	recovered_log_manager.set_redo_threads(3);
+	recovered_log_manager.recovery(buffer_manager);
+
+	for (uint64_t i = 0; i < tids.size(); i++) {
+		EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+				table_id, i + 1, false));
+		EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+				table_id, 100 + i, true));
+	}
+}
+
+/**
+ * T1 inserts and commits
+ * T2 inserts twice but does not commits
+ * crash while the second update of T2 is written
+ * The torn record is cut off, only T1 data should be there
+*/
+TEST_F(LogManagerTest, TestTornTail){
+	BufferManager buffer_manager(128, 10);
+	TestFile logfile;
+	LogManager log_manager(&logfile);
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 1, 2);
+	uint64_t t2 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t2, table_id, 5);
+	buffer_manager.flush_all_pages(); // requires undo
+	insert_row(heap_segment, transaction_manager, t2, table_id, 10);
+	logfile.resize(logfile.size() - 7);
+
+	// the log is valid up to the torn record
+	LogReader torn_reader(&logfile, 0, logfile.size(), LogManager::DEFAULT_LOG_READER_CHUNK_SIZE);
+	LogRecordView record;
+	while (torn_reader.next(record)) {
+	}
+	size_t valid_size = torn_reader.get_next_lsn();
+
+	buffer_manager.discard_all_pages();
+	LogManager recovered_log_manager(&logfile);
+	recovered_log_manager.recovery(buffer_manager);
+	EXPECT_EQ(recovered_log_manager.get_total_log_records_of_type(
+			LogManager::LogRecordType::UPDATE_RECORD), 7);
+	EXPECT_EQ(recovered_log_manager.get_total_log_records_of_type(
+			LogManager::LogRecordType::COMPENSATION_RECORD), 1);
+
+	// the compensation record of T2 replaced the torn record
+	LogReader reader(&logfile, 0, logfile.size(), LogManager::DEFAULT_LOG_READER_CHUNK_SIZE);
+	EXPECT_TRUE(reader.read(valid_size, record));
+	EXPECT_EQ(record.type, LogManager::LogRecordType::COMPENSATION_RECORD);
+
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 1, true));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 2, true));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 5, false));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 10, false));
+
+	// a flipped bit in the image of the compensation record is detected as well
+	logfile.get_content()[valid_size + record.size - 1] ^= 1;
+	LogReader corrupt_reader(&logfile, 0, logfile.size(), LogManager::DEFAULT_LOG_READER_CHUNK_SIZE);
+	while (corrupt_reader.next(record)) {
+	}
+	EXPECT_EQ(corrupt_reader.get_next_lsn(), valid_size);
+}
+
+/**
+ * T1 inserts and commits, T2 inserts through a compressed log of small blocks
+ * the last chunk is torn
+ * crash
+ * Reopening the log drops the torn chunk, only T1 data should be there
+*/
+TEST_F(LogManagerTest, TestCompressedLog){
+	BufferManager buffer_manager(128, 10);
+	auto file = std::make_unique<TestFile>();
+	TestFile* compressed = file.get();
+	auto logfile = std::make_unique<CompressedLogFile>(std::move(file), 256);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 1, 2);
+	uint64_t t2 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t2, table_id, 5);
+	buffer_manager.flush_all_pages(); // requires undo
+	insert_row(heap_segment, transaction_manager, t2, table_id, 10);
+	EXPECT_LT(logfile->get_stored_size(), logfile->size());
+
+	// the records read back through the compressed blocks
+	uint64_t total = log_manager.get_total_log_records();
+	LogReader reader(logfile.get(), 0, logfile->size(), 64);
+	LogRecordView record;
+	uint64_t count = 0;
+	size_t valid_size = 0;
+	while (reader.next(record)) {
+		valid_size = record.lsn;
+		count++;
+	}
+	EXPECT_EQ(count, total);
+
+	std::vector<char> content = compressed->get_content();
+	content.resize(content.size() - 3);
+	buffer_manager.discard_all_pages();
+	file = std::make_unique<TestFile>(std::move(content), File::WRITE);
+	compressed = file.get();
+	logfile = std::make_unique<CompressedLogFile>(std::move(file), 256);
+	EXPECT_EQ(logfile->size(), valid_size);
+	LogManager recovered_log_manager(logfile.get());
+	recovered_log_manager.recovery(buffer_manager);
+	EXPECT_EQ(recovered_log_manager.get_total_log_records_of_type(
+			LogManager::LogRecordType::COMPENSATION_RECORD), 1);
+
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 1, true));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 2, true));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 5, false));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 10, false));
+
+	// the compensation record and the abort record follow the valid records
+	std::vector<char> recovered = compressed->get_content();
+	logfile = std::make_unique<CompressedLogFile>(std::make_unique<TestFile>(std::move(recovered), File::WRITE), 256);
+	EXPECT_EQ(logfile->size(), recovered_log_manager.get_current_lsn());
+	EXPECT_GT(logfile->size(), valid_size);
+}
+
+/**
+ * T1 inserts and commits
+ * T2 inserts and commits asynchronously, the log is flushed up to its commit record
+ * T3 inserts and commits asynchronously, the flusher writes its commit record
+ * T4 inserts and commits asynchronously with a log buffer of a single byte
+ * T5 inserts and commits asynchronously
+ * crash
+ * The commit record of T5 is lost, only T5 data should be missing
+*/
+TEST_F(LogManagerTest, TestAsyncCommit){
+	BufferManager buffer_manager(128, 10);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 1, INVALID_FIELD);
+	transaction_manager.set_async_commit(true);
+
+	uint64_t t2 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t2, table_id, 2);
+	uint64_t t2_commit_lsn = transaction_manager.commit_txn(t2);
+	EXPECT_LE(log_manager.get_durable_lsn(), t2_commit_lsn);
+	log_manager.flush_log(t2_commit_lsn);
+	EXPECT_GT(log_manager.get_durable_lsn(), t2_commit_lsn);
+
+	LogFlusher log_flusher(log_manager);
+	log_flusher.set_interval(std::chrono::milliseconds(1));
+	log_flusher.start();
+	uint64_t t3 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t3, table_id, 3);
+	uint64_t t3_commit_lsn = transaction_manager.commit_txn(t3);
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (log_manager.get_durable_lsn() <= t3_commit_lsn && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	EXPECT_GT(log_manager.get_durable_lsn(), t3_commit_lsn);
+	log_flusher.stop();
+
+	log_manager.set_max_unflushed_bytes(1);
+	uint64_t t4 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t4, table_id, 4);
+	EXPECT_GT(transaction_manager.commit_txn(t4), 0);
+	EXPECT_EQ(log_manager.get_durable_lsn(), log_manager.get_current_lsn());
+	log_manager.set_max_unflushed_bytes(LogManager::DEFAULT_MAX_UNFLUSHED_BYTES);
+
+	uint64_t t5 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t5, table_id, 5);
+	transaction_manager.commit_txn(t5);
+	EXPECT_LT(log_manager.get_durable_lsn(), log_manager.get_current_lsn());
+
+	crash(transaction_manager, buffer_manager, log_manager);
+
+	for (uint64_t field = 1; field <= 5; field++) {
+		EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+				table_id, field, field < 5));
+	}
+}
+
+/**
+ * T1 commits, T2 .. T4 commit asynchronously and are flushed together
+ * four threads append updates
+ * The snapshot counts every record, byte, write and commit group
+*/
+TEST_F(LogManagerTest, TestLogStats){
+	TestFile logfile;
+	LogManager log_manager(&logfile);
+	std::vector<std::byte> before_img(16, std::byte{1});
+	std::vector<std::byte> after_img(16, std::byte{2});
+
+	log_manager.log_txn_begin(1);
+	log_manager.log_update(1, 0, 16, 0, before_img.data(), after_img.data());
+	log_manager.log_commit(1);
+	for (uint64_t txn_id = 2; txn_id <= 4; txn_id++) {
+		log_manager.log_txn_begin(txn_id);
+	}
+	for (uint64_t txn_id = 2; txn_id <= 4; txn_id++) {
+		log_manager.log_commit(txn_id, true);
+	}
+	log_manager.flush_log();
+
+	auto stats = log_manager.get_stats();
+	EXPECT_EQ(stats.total_records(), 9);
+	EXPECT_EQ(stats.records[static_cast<size_t>(LogManager::LogRecordType::BEGIN_RECORD)], 4);
+	EXPECT_EQ(stats.records[static_cast<size_t>(LogManager::LogRecordType::COMMIT_RECORD)], 4);
+	EXPECT_EQ(stats.total_bytes(), log_manager.get_current_lsn());
+	EXPECT_EQ(stats.flushed_bytes, log_manager.get_current_lsn());
+	// every record but the asynchronous commits was written on its own
+	EXPECT_EQ(stats.flushes, 7);
+	EXPECT_EQ(stats.flush_latency_ns.count, 1);
+	EXPECT_EQ(stats.group_commit_size.count, 2);
+	EXPECT_EQ(stats.group_commit_size.sum, 4);
+	EXPECT_EQ(stats.group_commit_size.percentile(1.0), 3);
+
+	std::vector<std::thread> threads;
+	for (size_t thread = 0; thread < 4; thread++) {
+		threads.emplace_back([&]() {
+			for (size_t update = 0; update < 1000; update++) {
+				log_manager.log_update(buzzdb::INVALID_TXN_ID, 0, 16, 0, before_img.data(), after_img.data());
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	stats = log_manager.get_stats();
+	EXPECT_EQ(log_manager.get_total_log_records_of_type(LogManager::LogRecordType::UPDATE_RECORD), 4001);
+	EXPECT_EQ(stats.total_bytes(), log_manager.get_current_lsn());
+
+	// a copy starts with the counts
+	LogManager copy = log_manager;
+	EXPECT_EQ(copy.get_total_log_records(), 4009);
+	log_manager.reset(&logfile);
+	EXPECT_EQ(log_manager.get_stats().total_records(), 0);
+	EXPECT_EQ(copy.get_total_log_records(), 4009);
+}
+
+/**
+ * T1 updates page 7 and commits, T2 updates pages 7 and 8 and is still running,
+ * a redo-only update of page 8 in between
+ * the inspector summarizes the log per type and per transaction, with and
+ * without filters, and replays it in memory
+*/
+TEST_F(LogManagerTest, TestLogInspector){
+	TestFile logfile;
+	LogManager log_manager(&logfile);
+	std::vector<std::byte> before_img(16, std::byte{1});
+	std::vector<std::byte> after_img(16, std::byte{2});
+	log_manager.log_txn_begin(1);
+	log_manager.log_update(1, 7, 16, 0, before_img.data(), after_img.data());
+	log_manager.log_commit(1);
+	log_manager.log_txn_begin(2);
+	log_manager.log_update(buzzdb::INVALID_TXN_ID, 8, 16, 32, before_img.data(), after_img.data());
+	log_manager.log_update(2, 7, 16, 16, before_img.data(), after_img.data());
+	log_manager.log_update(2, 8, 16, 0, before_img.data(), after_img.data());
+
+	LogInspector inspector(&logfile);
+	std::ostringstream records;
+	auto summary = inspector.scan(&records);
+	EXPECT_EQ(summary.total_records(), 7);
+	EXPECT_EQ(summary.total_bytes(), log_manager.get_current_lsn());
+	EXPECT_EQ(summary.end_lsn, log_manager.get_current_lsn());
+	EXPECT_EQ(summary.records[static_cast<size_t>(LogManager::LogRecordType::UPDATE_RECORD)], 4);
+	EXPECT_EQ(summary.txns.size(), 3);
+	EXPECT_TRUE(summary.txns[1].committed);
+	EXPECT_EQ(summary.txns[1].records, 3);
+	EXPECT_FALSE(summary.txns[2].committed || summary.txns[2].aborted);
+	EXPECT_EQ(summary.txns[2].page_writes, 2);
+	EXPECT_EQ(summary.txns[buzzdb::INVALID_TXN_ID].page_writes, 1);
+	std::string lines = records.str();
+	EXPECT_NE(lines.find(" COMMIT 1 "), std::string::npos);
+	EXPECT_EQ(std::count(lines.begin(), lines.end(), '\n'), 7);
+
+	std::ostringstream output;
+	LogInspector::print_summary(output, summary, true);
+	EXPECT_NE(output.str().find("2 transactions: 1 committed, 0 aborted, 1 running"), std::string::npos);
+
+	LogFilter txn_filter;
+	txn_filter.txn_id = 2;
+	inspector.set_filter(txn_filter);
+	summary = inspector.scan();
+	EXPECT_EQ(summary.total_records(), 3);
+	EXPECT_EQ(summary.txns.size(), 1);
+
+	LogFilter page_filter;
+	page_filter.page_id = 8;
+	inspector.set_filter(page_filter);
+	summary = inspector.scan();
+	EXPECT_EQ(summary.total_records(), 2);
+	auto timing = inspector.time_redo();
+	EXPECT_EQ(timing.records, 7);
+	EXPECT_EQ(timing.bytes, log_manager.get_current_lsn());
+	EXPECT_EQ(timing.applied, 2);
+	EXPECT_EQ(timing.pages, 1);
+}
+
+/**
+ * Eight threads start transactions and add pages to them concurrently,
+ * committing every other one and aborting the others
+ * The finished transactions leave the table, every record is logged once
+ * Adding a page to a finished transaction does not bring it back
+*/
+TEST_F(LogManagerTest, TestConcurrentTransactions){
+	constexpr uint64_t THREADS = 8;
+	constexpr uint64_t TXNS_PER_THREAD = 50;
+	BufferManager buffer_manager(128, 10);
+	TestFile logfile;
+	LogManager log_manager(&logfile);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	std::vector<std::thread> threads;
+	for (uint64_t thread = 0; thread < THREADS; thread++) {
+		threads.emplace_back([&, thread]() {
+			for (uint64_t i = 0; i < TXNS_PER_THREAD; i++) {
+				uint64_t txn_id = transaction_manager.start_txn();
+				transaction_manager.add_modified_page(txn_id,
+						BufferManager::get_overall_page_id(HEAP_SEGMENT, thread));
+				if (i % 2 == 0) {
+					transaction_manager.commit_txn(txn_id);
+				} else {
+					transaction_manager.abort_txn(txn_id);
+				}
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	EXPECT_EQ(transaction_manager.get_active_txn_count(), 0);
+	auto stats = log_manager.get_stats();
+	EXPECT_EQ(stats.records[static_cast<size_t>(LogManager::LogRecordType::BEGIN_RECORD)], THREADS * TXNS_PER_THREAD);
+	EXPECT_EQ(stats.records[static_cast<size_t>(LogManager::LogRecordType::COMMIT_RECORD)], THREADS * TXNS_PER_THREAD / 2);
+	EXPECT_EQ(stats.records[static_cast<size_t>(LogManager::LogRecordType::ABORT_RECORD)], THREADS * TXNS_PER_THREAD / 2);
+
+	uint64_t t1 = transaction_manager.start_txn();
+	EXPECT_EQ(transaction_manager.get_active_txn_count(), 1);
+	transaction_manager.commit_txn(t1);
+	EXPECT_EXIT(transaction_manager.add_modified_page(t1, BufferManager::get_overall_page_id(HEAP_SEGMENT, 0)),
+			::testing::ExitedWithCode(255), "");
+	EXPECT_EQ(transaction_manager.get_active_txn_count(), 0);
+}
+
+/**
+ * Four threads insert rows into the same heap segment concurrently, each
+ * in its own transaction, allocating slots on the same pages
+ * Every row gets its own slot and survives a crash
+*/
+TEST_F(LogManagerTest, TestConcurrentInserts){
+	constexpr uint64_t THREADS = 4;
+	constexpr uint64_t ROWS_PER_THREAD = 25;
+	BufferManager buffer_manager(128, 64);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	std::vector<std::vector<TID>> tids(THREADS);
+	std::vector<std::thread> threads;
+	for (uint64_t thread = 0; thread < THREADS; thread++) {
+		threads.emplace_back([&, thread]() {
+			for (uint64_t i = 0; i < ROWS_PER_THREAD; i++) {
+				uint64_t txn_id = transaction_manager.start_txn();
+				tids[thread].push_back(insert_row(heap_segment, transaction_manager,
+						txn_id, table_id, thread * ROWS_PER_THREAD + i));
+				transaction_manager.commit_txn(txn_id);
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	std::vector<uint64_t> slots;
+	for (auto& thread_tids : tids) {
+		for (auto tid : thread_tids) {
+			slots.push_back(tid.value);
+		}
+	}
+	std::sort(slots.begin(), slots.end());
+	EXPECT_EQ(std::unique(slots.begin(), slots.end()), slots.end());
+
+	crash(transaction_manager, buffer_manager, log_manager);
+
+	for (uint64_t field = 0; field < THREADS * ROWS_PER_THREAD; field++) {
+		EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+				table_id, field, true));
+	}
+}
+
+/**
+ * with wait-die, T1 and T2 share a lock, T1 upgrades it and waits for T2
+ * T2 releases its locks and T1 gets the exclusive lock, T2 dies asking again
+ * with wound-wait, T1 wounds T2 holding its lock and waits, T2 aborts at its next request
+ * with the detector, T1 and T2 wait for each other and T2 is aborted
+ * T1 writes a record through the heap segment, T2 reading it waits for T1 to commit
+*/
+TEST_F(LogManagerTest, TestLockManager){
+	const TID r1(0, 1);
+	const TID r2(0, 2);
+	LockMode mode;
+
+	// runs the lock request on a thread, returns once it waits
+	auto lock_async = [](LockManager& lock_manager, uint64_t txn_id, TID tid, LockMode mode,
+			std::atomic<int>& outcome) {
+		std::thread thread([&lock_manager, txn_id, tid, mode, &outcome]() {
+			try {
+				lock_manager.lock(txn_id, HEAP_SEGMENT, tid, mode);
+				outcome = 1;
+			} catch (const txn_abort_error&) {
+				outcome = 2;
+			}
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		return thread;
+	};
+
+	{
+		LockManager lock_manager(DeadlockPolicy::WAIT_DIE);
+		lock_manager.lock(1, HEAP_SEGMENT, r1, LockMode::SHARED);
+		lock_manager.lock(2, HEAP_SEGMENT, r1, LockMode::SHARED);
+		EXPECT_TRUE(lock_manager.holds(2, HEAP_SEGMENT, r1, mode));
+		EXPECT_EQ(mode, LockMode::SHARED);
+
+		std::atomic<int> outcome{0};
+		auto thread = lock_async(lock_manager, 1, r1, LockMode::EXCLUSIVE, outcome);
+		EXPECT_EQ(outcome, 0);
+		lock_manager.unlock_all(2);
+		thread.join();
+		EXPECT_EQ(outcome, 1);
+		EXPECT_TRUE(lock_manager.holds(1, HEAP_SEGMENT, r1, mode));
+		EXPECT_EQ(mode, LockMode::EXCLUSIVE);
+		EXPECT_FALSE(lock_manager.holds(2, HEAP_SEGMENT, r1, mode));
+
+		EXPECT_THROW(lock_manager.lock(2, HEAP_SEGMENT, r1, LockMode::SHARED), txn_abort_error);
+		lock_manager.unlock_all(2);
+		lock_manager.unlock_all(1);
+		lock_manager.lock(2, HEAP_SEGMENT, r1, LockMode::EXCLUSIVE);
+		lock_manager.unlock_all(2);
+		EXPECT_EQ(lock_manager.get_stats().waits, 1);
+		EXPECT_EQ(lock_manager.get_stats().aborts, 1);
+	}
+
+	{
+		LockManager lock_manager(DeadlockPolicy::WOUND_WAIT);
+		lock_manager.lock(2, HEAP_SEGMENT, r1, LockMode::EXCLUSIVE);
+		std::atomic<int> outcome{0};
+		auto thread = lock_async(lock_manager, 1, r1, LockMode::SHARED, outcome);
+		EXPECT_EQ(outcome, 0);
+		EXPECT_THROW(lock_manager.lock(2, HEAP_SEGMENT, r2, LockMode::SHARED), txn_abort_error);
+		EXPECT_FALSE(lock_manager.holds(2, HEAP_SEGMENT, r2, mode));
+		lock_manager.unlock_all(2);
+		thread.join();
+		EXPECT_EQ(outcome, 1);
+		lock_manager.unlock_all(1);
+		EXPECT_EQ(lock_manager.get_stats().aborts, 1);
+	}
+
+	{
+		LockManager lock_manager(DeadlockPolicy::DETECTION);
+		lock_manager.lock(1, HEAP_SEGMENT, r1, LockMode::EXCLUSIVE);
+		lock_manager.lock(2, HEAP_SEGMENT, r2, LockMode::EXCLUSIVE);
+		std::atomic<int> outcome_1{0};
+		std::atomic<int> outcome_2{0};
+		auto thread_1 = lock_async(lock_manager, 1, r2, LockMode::EXCLUSIVE, outcome_1);
+		auto thread_2 = lock_async(lock_manager, 2, r1, LockMode::SHARED, outcome_2);
+		thread_2.join();
+		EXPECT_EQ(outcome_2, 2);
+		EXPECT_EQ(outcome_1, 0);
+		lock_manager.unlock_all(2);
+		thread_1.join();
+		EXPECT_EQ(outcome_1, 1);
+		lock_manager.unlock_all(1);
+		EXPECT_EQ(lock_manager.get_stats().deadlocks, 1);
+	}
+
+	BufferManager buffer_manager(128, 10);
+	TestFile logfile;
+	LogManager log_manager(&logfile);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+	HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+	LockManager lock_manager(DeadlockPolicy::WOUND_WAIT);
+	transaction_manager.set_lock_manager(&lock_manager);
+	heap_segment.lock_manager_ = &lock_manager;
+
+	uint64_t t1 = transaction_manager.start_txn();
+	uint64_t t2 = transaction_manager.start_txn();
+	TID tid = insert_row(heap_segment, transaction_manager, t1, 17, 1);
+	EXPECT_TRUE(lock_manager.holds(t1, HEAP_SEGMENT, tid, mode));
+	EXPECT_EQ(mode, LockMode::EXCLUSIVE);
+
+	std::atomic<uint64_t> field{0};
+	std::thread reader([&]() {
+		uint64_t record[2];
+		heap_segment.read(tid, reinterpret_cast<std::byte*>(record), sizeof(record), t2);
+		field = record[1];
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	EXPECT_EQ(field, 0);
+	uint64_t update[2] = {17, 2};
+	heap_segment.write(tid, reinterpret_cast<std::byte*>(update), sizeof(update), t1);
+	transaction_manager.commit_txn(t1);
+	reader.join();
+	EXPECT_EQ(field, 2);
+	EXPECT_FALSE(lock_manager.holds(t1, HEAP_SEGMENT, tid, mode));
+	transaction_manager.commit_txn(t2);
+	EXPECT_FALSE(lock_manager.holds(t2, HEAP_SEGMENT, tid, mode));
+}
+
+/**
+ * with a version store, T1 inserts a row and commits
+ * T2 and T3 start, T3 updates the row, T2 reads the committed version without waiting
+ * T3 commits, T2 still reads its snapshot, T4 started afterwards reads the update
+ * T2 updating the row aborts, T5 updates it and aborts
+ * The versions are freed once the snapshots that can read them ended
+ * A writer moves an amount between two rows while readers check the sum of their snapshots
+*/
+TEST_F(LogManagerTest, TestSnapshotReads){
+	BufferManager buffer_manager(128, 10);
+	TestFile logfile;
+	LogManager log_manager(&logfile);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+	HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+	VersionStore version_store;
+	transaction_manager.set_version_store(&version_store);
+	heap_segment.version_store_ = &version_store;
+
+	auto read_field = [&](TID tid, uint64_t txn_id) {
+		uint64_t record[2];
+		heap_segment.read(tid, reinterpret_cast<std::byte*>(record), sizeof(record), txn_id);
+		return record[1];
+	};
+	auto write_field = [&](TID tid, uint64_t txn_id, uint64_t field) {
+		uint64_t record[2] = {17, field};
+		heap_segment.write(tid, reinterpret_cast<std::byte*>(record), sizeof(record), txn_id);
+	};
+
+	uint64_t t1 = transaction_manager.start_txn();
+	TID tid = insert_row(heap_segment, transaction_manager, t1, 17, 1);
+	transaction_manager.commit_txn(t1);
+
+	uint64_t t2 = transaction_manager.start_txn();
+	uint64_t t3 = transaction_manager.start_txn();
+	write_field(tid, t3, 2);
+	EXPECT_EQ(read_field(tid, t2), 1);
+	EXPECT_EQ(read_field(tid, t3), 2);
+	transaction_manager.commit_txn(t3);
+	EXPECT_EQ(read_field(tid, t2), 1);
+	uint64_t t4 = transaction_manager.start_txn();
+	EXPECT_EQ(read_field(tid, t4), 2);
+
+	EXPECT_THROW(write_field(tid, t2, 3), write_conflict_error);
+	transaction_manager.abort_txn(t2);
+	uint64_t t5 = transaction_manager.start_txn();
+	write_field(tid, t5, 4);
+	EXPECT_EQ(read_field(tid, t4), 2);
+	transaction_manager.abort_txn(t5);
+	EXPECT_EQ(read_field(tid, t4), 2);
+
+	EXPECT_EQ(version_store.get_version_count(), 2);
+	EXPECT_EQ(version_store.collect_garbage(), 0);
+	transaction_manager.commit_txn(t4);
+	EXPECT_EQ(version_store.collect_garbage(), 2);
+	EXPECT_EQ(version_store.get_version_count(), 0);
+
+	uint64_t t6 = transaction_manager.start_txn();
+	TID other = insert_row(heap_segment, transaction_manager, t6, 17, 0);
+	write_field(tid, t6, 100);
+	transaction_manager.commit_txn(t6);
+
+	constexpr uint64_t TRANSFERS = 200;
+	std::atomic<bool> done{false};
+	std::vector<std::thread> readers;
+	for (int reader = 0; reader < 2; reader++) {
+		readers.emplace_back([&]() {
+			while (!done) {
+				uint64_t txn_id = transaction_manager.start_txn();
+				EXPECT_EQ(read_field(tid, txn_id) + read_field(other, txn_id), 100);
+				transaction_manager.commit_txn(txn_id);
+			}
+		});
+	}
+	for (uint64_t transfer = 0; transfer < TRANSFERS; transfer++) {
+		uint64_t txn_id = transaction_manager.start_txn();
+		write_field(tid, txn_id, read_field(tid, txn_id) - 1);
+		write_field(other, txn_id, read_field(other, txn_id) + 1);
+		transaction_manager.commit_txn(txn_id);
+		if (transfer % 16 == 0) {
+			version_store.collect_garbage();
+		}
+	}
+	done = true;
+	for (auto& reader : readers) {
+		reader.join();
+	}
+	EXPECT_EQ(read_field(tid, buzzdb::INVALID_TXN_ID), 100 - TRANSFERS);
+	EXPECT_EQ(read_field(other, buzzdb::INVALID_TXN_ID), TRANSFERS);
+}
+
+/**
+ * with an OCC manager, T1 inserts a row, which is only written at its commit
+ * T2 reads the row, T3 updates it and commits, T2 updates another row and
+ * fails its validation, the other row is unchanged
+ * T4 reads its own update, T5 reads the row and commits after T4
+*/
+TEST_F(LogManagerTest, TestOptimisticTransactions){
+	BufferManager buffer_manager(128, 10);
+	TestFile logfile;
+	LogManager log_manager(&logfile);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+	HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+	OccManager occ_manager;
+	transaction_manager.set_occ_manager(&occ_manager);
+	heap_segment.occ_manager_ = &occ_manager;
+
+	auto read_field = [&](TID tid, uint64_t txn_id) {
+		uint64_t record[2];
+		heap_segment.read(tid, reinterpret_cast<std::byte*>(record), sizeof(record), txn_id);
+		return record[1];
+	};
+	auto write_field = [&](TID tid, uint64_t txn_id, uint64_t field) {
+		uint64_t record[2] = {17, field};
+		heap_segment.write(tid, reinterpret_cast<std::byte*>(record), sizeof(record), txn_id);
+	};
+
+	uint64_t t1 = transaction_manager.start_txn();
+	TID tid = insert_row(heap_segment, transaction_manager, t1, 17, 1);
+	TID other = insert_row(heap_segment, transaction_manager, t1, 17, 10);
+	EXPECT_EQ(read_field(tid, buzzdb::INVALID_TXN_ID), 0);
+	EXPECT_EQ(read_field(tid, t1), 1);
+	transaction_manager.commit_txn(t1);
+	EXPECT_EQ(read_field(tid, buzzdb::INVALID_TXN_ID), 1);
+
+	uint64_t t2 = transaction_manager.start_txn();
+	uint64_t t3 = transaction_manager.start_txn();
+	EXPECT_EQ(read_field(tid, t2), 1);
+	write_field(tid, t3, 2);
+	transaction_manager.commit_txn(t3);
+	write_field(other, t2, 11);
+	EXPECT_THROW(transaction_manager.commit_txn(t2), validation_abort_error);
+	EXPECT_EQ(read_field(other, buzzdb::INVALID_TXN_ID), 10);
+	EXPECT_EQ(occ_manager.get_validation_failures(), 1);
+	EXPECT_EQ(transaction_manager.get_active_txn_count(), 0);
+
+	uint64_t t4 = transaction_manager.start_txn();
+	uint64_t t5 = transaction_manager.start_txn();
+	write_field(tid, t4, 3);
+	EXPECT_EQ(read_field(tid, t4), 3);
+	EXPECT_EQ(read_field(tid, t5), 2);
+	transaction_manager.commit_txn(t4);
+	write_field(other, t5, 12);
+	EXPECT_THROW(transaction_manager.commit_txn(t5), validation_abort_error);
+	EXPECT_EQ(read_field(tid, buzzdb::INVALID_TXN_ID), 3);
+	EXPECT_EQ(read_field(other, buzzdb::INVALID_TXN_ID), 10);
+
+	auto stats = log_manager.get_stats();
+	EXPECT_EQ(stats.records[static_cast<size_t>(LogManager::LogRecordType::COMMIT_RECORD)], 3);
+	EXPECT_EQ(stats.records[static_cast<size_t>(LogManager::LogRecordType::ABORT_RECORD)], 2);
+}
+
+/**
+ * with an OCC manager, T1 inserts rows until they fill two pages
+ * the buffer is full of fixed pages but the first one, T2 updates a row on
+ * each page, its commit installs the first update and cannot fix the other page
+ * T2 is rolled back and aborted, its version words are unlocked and T3
+ * updates both rows
+*/
+TEST_F(LogManagerTest, TestOptimisticInstallFailure){
+	BufferManager buffer_manager(128, 4);
+	TestFile logfile;
+	LogManager log_manager(&logfile);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+	HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+	OccManager occ_manager;
+	transaction_manager.set_occ_manager(&occ_manager);
+	heap_segment.occ_manager_ = &occ_manager;
+
+	auto read_field = [&](TID tid) {
+		uint64_t record[2];
+		heap_segment.read(tid, reinterpret_cast<std::byte*>(record), sizeof(record));
+		return record[1];
+	};
+	auto write_field = [&](TID tid, uint64_t txn_id, uint64_t field) {
+		uint64_t record[2] = {17, field};
+		heap_segment.write(tid, reinterpret_cast<std::byte*>(record), sizeof(record), txn_id);
+	};
+
+	uint64_t t1 = transaction_manager.start_txn();
+	TID first = insert_row(heap_segment, transaction_manager, t1, 17, 1);
+	TID second = first;
+	for (uint64_t field = 2; (second.value >> 16) == (first.value >> 16); field++) {
+		second = insert_row(heap_segment, transaction_manager, t1, 17, field);
+	}
+	transaction_manager.commit_txn(t1);
+
+	uint64_t t2 = transaction_manager.start_txn();
+	write_field(first, t2, 100);
+	write_field(second, t2, 200);
+	std::vector<BufferFrame*> fixed;
+	fixed.push_back(&buffer_manager.fix_page(
+			BufferManager::get_overall_page_id(HEAP_SEGMENT, first.value >> 16), false));
+	fixed.push_back(&buffer_manager.fix_page(BufferManager::get_overall_page_id(124, 0), false));
+	fixed.push_back(&buffer_manager.fix_page(BufferManager::get_overall_page_id(124, 1), false));
+	EXPECT_THROW(transaction_manager.commit_txn(t2), buzzdb::buffer_full_error);
+	// T3 would wait for the version words of T2 otherwise
+	ASSERT_EQ(read_field(first), 1);
+	for (auto* frame : fixed) {
+		buffer_manager.unfix_page(*frame, false);
+	}
+	EXPECT_EQ(transaction_manager.get_active_txn_count(), 0);
+
+	uint64_t t3 = transaction_manager.start_txn();
+	write_field(first, t3, 101);
+	write_field(second, t3, 201);
+	transaction_manager.commit_txn(t3);
+	EXPECT_EQ(read_field(first), 101);
+	EXPECT_EQ(read_field(second), 201);
+
+	auto stats = log_manager.get_stats();
+	EXPECT_EQ(stats.records[static_cast<size_t>(LogManager::LogRecordType::COMMIT_RECORD)], 2);
+	EXPECT_EQ(stats.records[static_cast<size_t>(LogManager::LogRecordType::ABORT_RECORD)], 1);
+}
+
+/**
+ * with lazy begins and a version store, read-only transactions commit and abort without log records
+ * T1 inserts a row, its begin record comes with its first update
+ * T2 starts, T3 updates the row and commits, T2 takes its snapshot with its first read and sees the update
+ * T4 updates the row and aborts, the row is rolled back from its undo buffer
+*/
+TEST_F(LogManagerTest, TestLazyBegin){
+	BufferManager buffer_manager(128, 10);
+	TestFile logfile;
+	LogManager log_manager(&logfile);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+	HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+	VersionStore version_store;
+	transaction_manager.set_version_store(&version_store);
+	heap_segment.version_store_ = &version_store;
+	transaction_manager.set_lazy_begin(true);
+
+	auto read_field = [&](TID tid, uint64_t txn_id) {
+		uint64_t record[2];
+		heap_segment.read(tid, reinterpret_cast<std::byte*>(record), sizeof(record), txn_id);
+		return record[1];
+	};
+	auto write_field = [&](TID tid, uint64_t txn_id, uint64_t field) {
+		uint64_t record[2] = {17, field};
+		heap_segment.write(tid, reinterpret_cast<std::byte*>(record), sizeof(record), txn_id);
+	};
+	auto count = [&](LogManager::LogRecordType type) {
+		return log_manager.get_stats().records[static_cast<size_t>(type)];
+	};
+
+	for (int i = 0; i < 10; i++) {
+		uint64_t txn_id = transaction_manager.start_txn();
+		if (i % 2 == 0) {
+			EXPECT_EQ(transaction_manager.commit_txn(txn_id), buzzdb::INVALID_LSN);
+		} else {
+			transaction_manager.abort_txn(txn_id);
+		}
+	}
+	EXPECT_EQ(log_manager.get_total_log_records(), 0);
+
+	uint64_t t1 = transaction_manager.start_txn();
+	TID tid = insert_row(heap_segment, transaction_manager, t1, 17, 1);
+	transaction_manager.commit_txn(t1);
+	EXPECT_EQ(count(LogManager::LogRecordType::BEGIN_RECORD), 1);
+	// the allocation is logged outside of the transaction
+	EXPECT_EQ(count(LogManager::LogRecordType::UPDATE_RECORD), 2);
+	EXPECT_EQ(count(LogManager::LogRecordType::COMMIT_RECORD), 1);
+
+	uint64_t t2 = transaction_manager.start_txn();
+	uint64_t t3 = transaction_manager.start_txn();
+	write_field(tid, t3, 2);
+	transaction_manager.commit_txn(t3);
+	EXPECT_EQ(read_field(tid, t2), 2);
+	uint64_t t4 = transaction_manager.start_txn();
+	write_field(tid, t4, 3);
+	EXPECT_EQ(read_field(tid, t2), 2);
+	transaction_manager.abort_txn(t4);
+	EXPECT_EQ(read_field(tid, t2), 2);
+	EXPECT_EQ(read_field(tid, buzzdb::INVALID_TXN_ID), 2);
+	EXPECT_EQ(transaction_manager.commit_txn(t2), buzzdb::INVALID_LSN);
+
+	EXPECT_EQ(count(LogManager::LogRecordType::BEGIN_RECORD), 3);
+	EXPECT_EQ(count(LogManager::LogRecordType::COMMIT_RECORD), 2);
+	EXPECT_EQ(count(LogManager::LogRecordType::COMPENSATION_RECORD), 1);
+	EXPECT_EQ(count(LogManager::LogRecordType::ABORT_RECORD), 1);
+}
+
+/**
+ * T1 inserts a row and commits
+ * T2 updates it, takes a savepoint, inserts a row and updates the first one again, rolls back to the
+ * savepoint, retries and commits: only the updates after the savepoint are undone
+ * T3 rolls back to a savepoint, then aborts
+ * T4 rolls back to a savepoint, crash: its update before the savepoint is undone by the recovery
+*/
+void check_savepoints(size_t undo_buffer_budget){
+	BufferManager buffer_manager(128, 10);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+	HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+	log_manager.set_undo_buffer_budget(undo_buffer_budget);
+
+	auto read_field = [&](TID tid) {
+		uint64_t record[2];
+		heap_segment.read(tid, reinterpret_cast<std::byte*>(record), sizeof(record));
+		return record[1];
+	};
+	auto write_field = [&](TID tid, uint64_t txn_id, uint64_t field) {
+		uint64_t record[2] = {17, field};
+		heap_segment.write(tid, reinterpret_cast<std::byte*>(record), sizeof(record), txn_id);
+	};
+
+	uint64_t t1 = transaction_manager.start_txn();
+	TID a = insert_row(heap_segment, transaction_manager, t1, 17, 1);
+	transaction_manager.commit_txn(t1);
+
+	uint64_t t2 = transaction_manager.start_txn();
+	write_field(a, t2, 2);
+	uint64_t savepoint = transaction_manager.create_savepoint(t2);
+	TID b = insert_row(heap_segment, transaction_manager, t2, 17, 5);
+	write_field(a, t2, 3);
+	transaction_manager.rollback_to_savepoint(t2, savepoint);
+	EXPECT_EQ(read_field(a), 2);
+	EXPECT_NE(read_field(b), 5);
+	// a rollback to the same savepoint again has nothing left to undo
+	uint64_t lsn = log_manager.get_current_lsn();
+	transaction_manager.rollback_to_savepoint(t2, savepoint);
+	EXPECT_EQ(log_manager.get_current_lsn(), lsn);
+	write_field(a, t2, 4);
+	transaction_manager.commit_txn(t2);
+	EXPECT_EQ(read_field(a), 4);
+
+	uint64_t t3 = transaction_manager.start_txn();
+	write_field(a, t3, 6);
+	savepoint = transaction_manager.create_savepoint(t3);
+	write_field(a, t3, 7);
+	transaction_manager.rollback_to_savepoint(t3, savepoint);
+	EXPECT_EQ(read_field(a), 6);
+	write_field(a, t3, 8);
+	transaction_manager.abort_txn(t3);
+	EXPECT_EQ(read_field(a), 4);
+
+	uint64_t t4 = transaction_manager.start_txn();
+	write_field(a, t4, 9);
+	savepoint = transaction_manager.create_savepoint(t4);
+	write_field(a, t4, 10);
+	transaction_manager.rollback_to_savepoint(t4, savepoint);
+	EXPECT_EQ(read_field(a), 9);
+
+	crash(transaction_manager, buffer_manager, log_manager);
+
+	EXPECT_EQ(read_field(a), 4);
+}
+
+/** savepoints rolled back from the undo buffer */
+TEST_F(LogManagerTest, TestSavepoints){
+	check_savepoints(LogManager::DEFAULT_UNDO_BUFFER_BUDGET);
+}
+
+/** savepoints rolled back from the log */
+TEST_F(LogManagerTest, TestSavepointsFromLog){
+	check_savepoints(0);
+}
+
+/**
+ * with an OCC manager, T1 writes a row: its write is only buffered, taking a savepoint or rolling back
+ * to one exits instead of leaving the write to be installed at the commit
+*/
+TEST_F(LogManagerTest, TestSavepointsOptimistic){
+	BufferManager buffer_manager(128, 10);
+	TestFile logfile;
+	LogManager log_manager(&logfile);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+	HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+	OccManager occ_manager;
+	transaction_manager.set_occ_manager(&occ_manager);
+	heap_segment.occ_manager_ = &occ_manager;
+
+	uint64_t t1 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t1, 17, 1);
+	EXPECT_EXIT(transaction_manager.create_savepoint(t1), ::testing::ExitedWithCode(255), "");
+	EXPECT_EXIT(transaction_manager.rollback_to_savepoint(t1, log_manager.get_current_lsn()),
+			::testing::ExitedWithCode(255), "");
+	transaction_manager.abort_txn(t1);
+}
+
+/**
+ * with tracing enabled
+ * T1 inserts on three pages of a two page buffer and commits, forcing its pages
+ * T2 inserts and aborts
+ * The spans of the three layers are dumped, nested in the transaction spans
+*/
+TEST_F(LogManagerTest, TestTracing){
+	BufferManager buffer_manager(128, 3);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+	transaction_manager.set_force_at_commit(true);
+	Tracer::reset();
+	Tracer::set_enabled(true);
+
+	uint64_t table_id = 101;
+	uint64_t t1 = transaction_manager.start_txn();
+	for (uint64_t field = 1; field <= 12; field++) {
+		insert_row(heap_segment, transaction_manager, t1, table_id, field);
+	}
+	transaction_manager.commit_txn(t1);
+	uint64_t t2 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t2, table_id, 13);
+	transaction_manager.abort_txn(t2);
+	Tracer::set_enabled(false);
+
+	auto spans = Tracer::dump();
+	auto histograms = Tracer::histograms();
+	EXPECT_EQ(histograms[static_cast<size_t>(TracePhase::START_TXN)].count, 2);
+	EXPECT_EQ(histograms[static_cast<size_t>(TracePhase::COMMIT_TXN)].count, 1);
+	EXPECT_EQ(histograms[static_cast<size_t>(TracePhase::ABORT_TXN)].count, 1);
+	for (size_t phase = 0; phase < buzzdb::TRACE_PHASE_COUNT; phase++) {
+		EXPECT_GT(histograms[phase].count, 0) << buzzdb::get_trace_phase_name(static_cast<TracePhase>(phase));
+	}
+	EXPECT_EQ(spans.size(), histograms[static_cast<size_t>(TracePhase::LOG_APPEND)].count +
+			histograms[static_cast<size_t>(TracePhase::LOG_FLUSH)].count +
+			histograms[static_cast<size_t>(TracePhase::LOG_RESIZE)].count +
+			histograms[static_cast<size_t>(TracePhase::FIX_PAGE_MISS)].count +
+			histograms[static_cast<size_t>(TracePhase::WRITE_FRAME)].count + 4);
+
+	// the pages forced by the commit are written within its span and tagged with T1
+	auto commit = std::find_if(spans.begin(), spans.end(),
+			[](const TraceSpan& span) { return span.phase == TracePhase::COMMIT_TXN; });
+	ASSERT_NE(commit, spans.end());
+	EXPECT_EQ(commit->txn_id, t1);
+	EXPECT_EQ(commit->depth, 0);
+	size_t forced_pages = 0;
+	for (auto& span : spans) {
+		if (span.phase == TracePhase::WRITE_FRAME && span.start_ns >= commit->start_ns &&
+				span.start_ns + span.duration_ns <= commit->start_ns + commit->duration_ns) {
+			EXPECT_EQ(span.txn_id, t1);
+			EXPECT_EQ(span.depth, 1);
+			forced_pages++;
+		}
+		// the flushes of the log happen within an append
+		if (span.phase == TracePhase::LOG_FLUSH) {
+			EXPECT_GE(span.depth, 1);
+		}
+	}
+	EXPECT_GT(forced_pages, 0);
+
+	std::ostringstream output;
+	Tracer::print_spans(output, spans);
+	Tracer::print_histograms(output, histograms);
+	EXPECT_NE(output.str().find("  write_frame txn " + std::to_string(t1)), std::string::npos);
+	EXPECT_NE(output.str().find("commit_txn"), std::string::npos);
+
+	Tracer::reset();
+	EXPECT_TRUE(Tracer::dump().empty());
+}
+
+/**
+ * T1 inserts and commits
+ * the standby connects, the log so far is shipped
+ * T2 inserts and commits, T3 inserts but does not commit
+ * the standby replays the log as it arrives and catches up
+ * the standby takes over, only T1 and T2 data should be there
+*/
+TEST_F(LogManagerTest, TestLogShipping){
+	const std::string standby_directory = "standby";
+	const std::string socket_path = "standby.sock";
+	std::filesystem::remove_all(standby_directory);
+	std::filesystem::create_directories(standby_directory);
+
+	BufferManager buffer_manager(128, 10);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	BufferManager standby_buffer_manager(128, 10);
+	standby_buffer_manager.set_segment_directory(standby_directory);
+	auto standby_logfile = File::open_file((standby_directory + "/" + LOG_FILE).c_str(), File::WRITE);
+	LogReplica replica(standby_logfile.get(), standby_buffer_manager, socket_path);
+	replica.start();
+
+	uint64_t table_id = 101;
+	do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 1, INVALID_FIELD);
+
+	LogShipper shipper(log_manager, socket_path);
+	shipper.start();
+	EXPECT_TRUE(replica.wait_for_lsn(log_manager.get_durable_lsn(), std::chrono::seconds(10)));
+
+	do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 2, INVALID_FIELD);
+	uint64_t t3 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t3, table_id, 3);
+	EXPECT_TRUE(replica.wait_for_lsn(log_manager.get_durable_lsn(), std::chrono::seconds(10)));
+	EXPECT_TRUE(shipper.is_connected());
+	EXPECT_EQ(shipper.get_shipped_lsn(), log_manager.get_durable_lsn());
+	EXPECT_EQ(replica.get_received_lsn(), log_manager.get_durable_lsn());
+	EXPECT_EQ(replica.get_lag_lsn(), 0);
+	EXPECT_EQ(replica.get_lag_seconds(), 0);
+	EXPECT_EQ(replica.get_log_manager().get_total_log_records(), log_manager.get_total_log_records());
+
+	shipper.stop();
+	replica.promote();
+	HeapSegment standby_segment(HEAP_SEGMENT, replica.get_log_manager(), standby_buffer_manager);
+	standby_segment.page_count_ = heap_segment.page_count_;
+	for (uint64_t field = 1; field <= 3; field++) {
+		EXPECT_TRUE(look(standby_segment, transaction_manager, standby_buffer_manager,
+				table_id, field, field < 3));
+	}
+	standby_buffer_manager.discard_all_pages();
+	std::filesystem::remove_all(standby_directory);
+}
+
+/**
+ * T1 .. T20 insert and commit, checkpoint after every fifth
+ * T21 inserts but does not commits
+ * T22 .. T31 insert and commit, checkpoint after every fifth
+ * crash
+ * Segments before the checkpoints are recycled, except for those T21 needs.
+ * Recovery starts at the last checkpoint, only T21 data should be missing
+*/
+TEST_F(LogManagerTest, TestSegmentedLog){
+	const std::string log_directory = "BuzzDB.log.d";
+	std::filesystem::remove_all(log_directory);
+	BufferManager buffer_manager(1024, 10);
+	auto logfile = std::make_unique<SegmentedLogFile>(log_directory, 1024);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	for (uint64_t i = 0; i < 20; i++) {
+		do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 100 + 2 * i, 101 + 2 * i);
+		if (i % 5 == 4) {
+			log_manager.log_checkpoint(buffer_manager);
+		}
+	}
+	EXPECT_GT(logfile->get_start_lsn(), 0);
+	// the log went through more segments than were created
+	EXPECT_LT(logfile->get_created_segment_count(), logfile->size() / 1024);
+
+	uint64_t t21 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t21, table_id, 5);
+	buffer_manager.flush_all_pages(); // requires undo
+	uint64_t t21_segment_start = logfile->size() / 1024 * 1024;
+	for (uint64_t i = 20; i < 30; i++) {
+		do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 100 + 2 * i, 101 + 2 * i);
+		if (i % 5 == 4) {
+			log_manager.log_checkpoint(buffer_manager);
+		}
+	}
+	EXPECT_LE(logfile->get_start_lsn(), t21_segment_start);
+
+	buffer_manager.discard_all_pages();
+	logfile = std::make_unique<SegmentedLogFile>(log_directory, 1024);
+	LogManager recovered_log_manager(logfile.get());
+	recovered_log_manager.recovery(buffer_manager);
+	// only the records after the last checkpoint were analyzed
+	EXPECT_EQ(recovered_log_manager.get_total_log_records_of_type(
+			LogManager::LogRecordType::CHECKPOINT_RECORD), 1);
+	EXPECT_EQ(recovered_log_manager.get_total_log_records_of_type(
+			LogManager::LogRecordType::BEGIN_RECORD), 0);
+	EXPECT_EQ(recovered_log_manager.get_total_log_records_of_type(
+			LogManager::LogRecordType::COMPENSATION_RECORD), 1);
+
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 5, false));
+	for (uint64_t field = 100; field < 160; field++) {
+		EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+				table_id, field, true));
+	}
+	std::filesystem::remove_all(log_directory);
+}
+
+/**
+ * T1 .. T5 insert and commit on a segmented log
+ * stray files named like segments are left in its directory
+ * crash, the log is opened without them and recovery finds all data
+*/
+TEST_F(LogManagerTest, TestSegmentedLogStrayFiles){
+	const std::string log_directory = "BuzzDB.log.d";
+	std::filesystem::remove_all(log_directory);
+	BufferManager buffer_manager(1024, 10);
+	auto logfile = std::make_unique<SegmentedLogFile>(log_directory, 1024);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	for (uint64_t i = 0; i < 5; i++) {
+		do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 100 + 2 * i, 101 + 2 * i);
+	}
+	uint64_t start_lsn = logfile->get_start_lsn();
+	uint64_t size = logfile->size();
+	for (auto name : {"log.tmp", "log.00000000000000ff.bak", "log.000000000000000g"}) {
+		File::open_file((log_directory + "/" + name).c_str(), File::WRITE)->resize(1024);
+	}
+
+	buffer_manager.discard_all_pages();
+	logfile = std::make_unique<SegmentedLogFile>(log_directory, 1024);
+	EXPECT_EQ(logfile->get_start_lsn(), start_lsn);
+	// up to the end of the last segment until recovery cuts it
+	EXPECT_EQ(logfile->size(), (size + 1023) / 1024 * 1024);
+	LogManager recovered_log_manager(logfile.get());
+	recovered_log_manager.recovery(buffer_manager);
+	for (uint64_t field = 100; field < 110; field++) {
+		EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+				table_id, field, true));
+	}
+	std::filesystem::remove_all(log_directory);
+}
+
+/**
+ * T1 .. T5 insert and commit on a segmented log
+ * the log is opened read-only: its records are read, writes throw and no file is created
+*/
+TEST_F(LogManagerTest, TestReadOnlySegmentedLog){
+	const std::string log_directory = "BuzzDB.log.d";
+	std::filesystem::remove_all(log_directory);
+	uint64_t log_size;
+	{
+		BufferManager buffer_manager(1024, 10);
+		SegmentedLogFile logfile(log_directory, 1024);
+		LogManager log_manager(&logfile);
+		HeapSegment heap_segment(123, log_manager, buffer_manager);
+		TransactionManager transaction_manager(log_manager, buffer_manager);
+		for (uint64_t i = 0; i < 5; i++) {
+			do_insert(heap_segment, transaction_manager, buffer_manager, 101, 100 + 2 * i, 101 + 2 * i);
+		}
+		log_size = log_manager.get_current_lsn();
+	}
+	auto count_files = [&]() {
+		size_t count = 0;
+		for (auto& entry : std::filesystem::directory_iterator(log_directory)) {
+			(void) entry;
+			count++;
+		}
+		return count;
+	};
+	size_t files = count_files();
+
+	SegmentedLogFile logfile(log_directory, 1024, File::READ);
+	EXPECT_EQ(logfile.get_mode(), File::READ);
+	buzzdb::LogInspector inspector(&logfile, logfile.get_start_lsn(), 256);
+	buzzdb::LogSummary summary = inspector.scan(nullptr);
+	EXPECT_EQ(summary.records[static_cast<size_t>(LogManager::LogRecordType::COMMIT_RECORD)], 5);
+	EXPECT_EQ(summary.end_lsn, log_size);
+	char block[8] = {};
+	EXPECT_THROW(logfile.write_block(block, 0, sizeof(block)), std::runtime_error);
+	EXPECT_THROW(logfile.resize(logfile.size() + 1024), std::runtime_error);
+	EXPECT_THROW(logfile.write_master_record(0), std::runtime_error);
+	EXPECT_EQ(count_files(), files);
+
+	EXPECT_ANY_THROW(SegmentedLogFile("BuzzDB.missing.log.d", 1024, File::READ));
+	EXPECT_FALSE(std::filesystem::exists("BuzzDB.missing.log.d"));
+	std::filesystem::remove_all(log_directory);
+}
+
+/**
+ * T1 inserts with its undo buffer spilled, its begin record is corrupted: its rollback throws
+ * T2 inserts, checkpoint, crash, its begin record before the checkpoint is corrupted: recovery throws
+ * instead of leaving T1 and T2 half rolled back
+*/
+TEST_F(LogManagerTest, TestUnreadableUndoChain){
+	auto corrupt = [](File& file, uint64_t lsn) {
+		char byte;
+		file.read_block(lsn + 12, 1, &byte);
+		byte = static_cast<char>(~byte);
+		file.write_block(&byte, lsn + 12, 1);
+	};
+	{
+		BufferManager buffer_manager(128, 10);
+		TestFile logfile;
+		LogManager log_manager(&logfile);
+		TransactionManager transaction_manager(log_manager, buffer_manager);
+		HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+		log_manager.set_undo_buffer_budget(0);
+
+		uint64_t begin_lsn = log_manager.get_current_lsn();
+		uint64_t t1 = transaction_manager.start_txn();
+		insert_row(heap_segment, transaction_manager, t1, 17, 1);
+		log_manager.flush_log();
+		corrupt(logfile, begin_lsn);
+		EXPECT_THROW(log_manager.rollback_txn(t1, buffer_manager), std::runtime_error);
+	}
+
+	const std::string log_directory = "BuzzDB.log.d";
+	std::filesystem::remove_all(log_directory);
+	BufferManager buffer_manager(128, 10);
+	auto logfile = std::make_unique<SegmentedLogFile>(log_directory, 1024);
+	LogManager log_manager(logfile.get());
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+	HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+
+	uint64_t begin_lsn = log_manager.get_current_lsn();
+	uint64_t t2 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t2, 17, 2);
+	log_manager.log_checkpoint(buffer_manager);
+	log_manager.flush_log();
+	corrupt(*logfile, begin_lsn);
+
+	buffer_manager.discard_all_pages();
+	logfile = std::make_unique<SegmentedLogFile>(log_directory, 1024);
+	LogManager recovered_log_manager(logfile.get());
+	EXPECT_THROW(recovered_log_manager.recovery(buffer_manager), std::runtime_error);
+	std::filesystem::remove_all(log_directory);
+}
+
+/**
+ * T1 .. T10 insert and commit, checkpoint after every fifth
+ * T11 inserts, an online backup is taken while it runs
+ * T12 .. T21 insert and commit, checkpoint after every fifth, T11 commits
+ * after T18; the segments that are no longer needed are archived
+ * restore to the commit of T16: T1 .. T10 and T12 .. T16 data should be there
+ * restore to a time after T14: T1 .. T10 and T12 .. T14 data should be there
+*/
+TEST_F(LogManagerTest, TestPointInTimeRestore){
+	const std::string log_directory = "BuzzDB.log.d";
+	const std::string archive_directory = "BuzzDB.archive";
+	const std::string backup_directory = "backup";
+	const std::string restore_directory = "restore";
+	for (auto& directory : {log_directory, archive_directory, backup_directory, restore_directory}) {
+		std::filesystem::remove_all(directory);
+	}
+	BufferManager buffer_manager(1024, 10);
+	auto logfile = std::make_unique<SegmentedLogFile>(log_directory, 1024);
+	logfile->set_archive_directory(archive_directory);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(HEAP_SEGMENT, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	for (uint64_t i = 0; i < 10; i++) {
+		do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 100 + i, INVALID_FIELD);
+		if (i % 5 == 4) {
+			log_manager.log_checkpoint(buffer_manager);
+		}
+	}
+	uint64_t t11 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t11, table_id, 5);
+	BackupManifest manifest = buzzdb::create_backup(log_manager, buffer_manager, {HEAP_SEGMENT}, backup_directory);
+	EXPECT_LE(manifest.start_lsn, manifest.end_lsn);
+
+	uint64_t target_lsn = 0;
+	uint64_t target_time = 0;
+	for (uint64_t i = 10; i < 20; i++) {
+		do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 100 + i, INVALID_FIELD);
+		if (i == 12) {
+			target_time = std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::system_clock::now().time_since_epoch()).count();
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+		if (i == 14) {
+			// the last record is the commit of T16
+			target_lsn = log_manager.get_current_lsn() - 1;
+		}
+		if (i == 16) {
+			transaction_manager.commit_txn(t11);
+		}
+		if (i % 5 == 4) {
+			log_manager.log_checkpoint(buffer_manager);
+		}
+	}
+	// the log the restore needs was archived
+	EXPECT_GT(logfile->get_start_lsn(), manifest.start_lsn);
+	EXPECT_FALSE(std::filesystem::is_empty(archive_directory));
+
+	RestoreOptions options;
+	options.backup_directory = backup_directory;
+	options.archive_directory = archive_directory;
+	options.log_directory = log_directory;
+	options.segment_size = 1024;
+	options.target_directory = restore_directory;
+	options.target_lsn = target_lsn;
+	BufferManager restored_buffer_manager(1024, 10);
+	RestoreResult result = buzzdb::restore_backup(options, restored_buffer_manager);
+	EXPECT_GT(result.restored_lsn, target_lsn);
+	EXPECT_EQ(result.log_bytes, result.restored_lsn - manifest.start_lsn);
+	EXPECT_GT(result.get_throughput(), 0);
+	HeapSegment restored_segment(HEAP_SEGMENT, log_manager, restored_buffer_manager);
+	restored_segment.page_count_ = heap_segment.page_count_;
+	EXPECT_TRUE(look(restored_segment, transaction_manager, restored_buffer_manager, table_id, 5, false));
+	for (uint64_t field = 100; field < 120; field++) {
+		EXPECT_TRUE(look(restored_segment, transaction_manager, restored_buffer_manager,
+				table_id, field, field < 115));
+	}
+	restored_buffer_manager.discard_all_pages();
+
+	std::filesystem::remove_all(restore_directory);
+	options.target_lsn = buzzdb::INVALID_LSN;
+	options.target_time = target_time;
+	BufferManager timed_buffer_manager(1024, 10);
+	buzzdb::restore_backup(options, timed_buffer_manager);
+	HeapSegment timed_segment(HEAP_SEGMENT, log_manager, timed_buffer_manager);
+	timed_segment.page_count_ = heap_segment.page_count_;
+	EXPECT_TRUE(look(timed_segment, transaction_manager, timed_buffer_manager, table_id, 5, false));
+	for (uint64_t field = 100; field < 120; field++) {
+		EXPECT_TRUE(look(timed_segment, transaction_manager, timed_buffer_manager,
+				table_id, field, field < 113));
+	}
+	timed_buffer_manager.discard_all_pages();
+
+	for (auto& directory : {log_directory, archive_directory, backup_directory, restore_directory}) {
+		std::filesystem::remove_all(directory);
+	}
+}
+
+/**
+ * Four threads log to their own partitions:
+ * T1 writes the shared page but does not commit
+ * T2 writes the shared page after T1 and commits, which writes the partition of T1
+ * T3 writes its own page and aborts
+ * T4 writes the shared page and commits
+ * flush the log, crash
+ * Recovery merges the partitions, T1 is undone and T2, T4 survive
+ * crash after recovery, a second recovery changes nothing
+*/
+TEST_F(LogManagerTest, TestPartitionedLog){
+	const std::string log_directory = "BuzzDB.partitions";
+	std::filesystem::remove_all(log_directory);
+	BufferManager buffer_manager(128, 10);
+	PartitionedLog log(log_directory, 4);
+	buffer_manager.set_log_manager(&log);
+	uint64_t shared_page = BufferManager::get_overall_page_id(HEAP_SEGMENT, 0);
+	uint64_t own_page = BufferManager::get_overall_page_id(HEAP_SEGMENT, 1);
+
+	auto write = [&](uint64_t txn_id, uint64_t page_id, uint64_t offset, uint64_t value) {
+		BufferFrame& frame = buffer_manager.fix_page(page_id, true);
+		char* data = &frame.get_data()[offset];
+		uint64_t lsn = log.log_update(txn_id, page_id, sizeof(uint64_t), offset,
+				reinterpret_cast<std::byte*>(data), reinterpret_cast<std::byte*>(&value), frame.get_page_lsn());
+		memcpy(data, &value, sizeof(uint64_t));
+		frame.set_page_lsn(lsn);
+		buffer_manager.unfix_page(frame, true);
+	};
+	auto read = [&](uint64_t page_id, uint64_t offset) {
+		BufferFrame& frame = buffer_manager.fix_page(page_id, false);
+		uint64_t value;
+		memcpy(&value, &frame.get_data()[offset], sizeof(uint64_t));
+		buffer_manager.unfix_page(frame, false);
+		return value;
+	};
+	// a new thread per transaction, each gets its own partition
+	auto run = [](auto work) { std::thread(work).join(); };
+
+	run([&]() {
+		log.log_txn_begin(1);
+		write(1, shared_page, 0, 1);
+	});
+	EXPECT_EQ(log.get_stats().flushes, 0);
+	run([&]() {
+		log.log_txn_begin(2);
+		write(2, shared_page, 8, 2);
+		log.log_commit(2);
+	});
+	// the commit of T2 waited for the update of T1 it follows
+	EXPECT_EQ(log.get_stats().flushes, 2);
+	run([&]() {
+		log.log_txn_begin(3);
+		write(3, own_page, 0, 3);
+		log.log_abort(3, buffer_manager);
+	});
+	run([&]() {
+		log.log_txn_begin(4);
+		write(4, shared_page, 16, 4);
+		log.log_commit(4);
+	});
+	EXPECT_EQ(read(own_page, 0), 0);
+	// the abort of T3 is not written by itself
+	EXPECT_NE(log.get_durable_lsn(), buzzdb::INVALID_LSN);
+	log.flush_log();
+	EXPECT_EQ(log.get_durable_lsn(), buzzdb::INVALID_LSN);
+
+	for (int crash = 0; crash < 2; crash++) {
+		buffer_manager.set_log_manager(nullptr);
+		buffer_manager.discard_all_pages();
+		PartitionedLog recovered_log(log_directory, 4);
+		buffer_manager.set_log_manager(&recovered_log);
+		recovered_log.set_recovery_threads(3);
+		recovered_log.recovery(buffer_manager);
+		EXPECT_EQ(read(shared_page, 0), 0);
+		EXPECT_EQ(read(shared_page, 8), 2);
+		EXPECT_EQ(read(shared_page, 16), 4);
+		EXPECT_EQ(read(own_page, 0), 0);
+		// the compensation records of T3 and T1, the second recovery finds T1 aborted
+		EXPECT_EQ(recovered_log.get_stats().records[static_cast<size_t>(LogManager::LogRecordType::COMPENSATION_RECORD)], 2);
+	}
+	buffer_manager.set_log_manager(nullptr);
+	buffer_manager.discard_all_pages();
+	std::filesystem::remove_all(log_directory);
+}
+
+/**
+ * T1 .. T6 insert and commit while the checkpointer thread runs
+ * T7 inserts into another segment but does not commits
+ * checkpoint while the page of T7 is fixed
+ * crash
+ * The end record lists T2 and its page, only T2 data should be missing
+*/
+TEST_F(LogManagerTest, TestCheckpointerThread){
+	const std::string log_directory = "BuzzDB.log.d";
+	std::filesystem::remove_all(log_directory);
+	BufferManager buffer_manager(128, 10);
+	auto logfile = std::make_unique<SegmentedLogFile>(log_directory, 1024);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	HeapSegment heap_segment2(124, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+	Checkpointer checkpointer(log_manager, buffer_manager);
+	checkpointer.set_log_volume_trigger(512);
+	checkpointer.set_interval(std::chrono::milliseconds(0));
+	checkpointer.start();
+
+	uint64_t table_id = 101;
+	for (uint64_t field = 10; field < 22; field += 2) {
+		do_insert(heap_segment, transaction_manager, buffer_manager, table_id, field, field + 1);
+	}
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (checkpointer.get_checkpoint_count() == 0 && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	EXPECT_GT(checkpointer.get_checkpoint_count(), 0);
+
+	uint64_t t7 = transaction_manager.start_txn();
+	TID tid = insert_row(heap_segment2, transaction_manager, t7, table_id, 5);
+	uint64_t page_id = BufferManager::get_overall_page_id(heap_segment2.segment_id_, tid.value >> 16);
+	BufferFrame& frame = buffer_manager.fix_page(page_id, false);
+	uint64_t rec_lsn = frame.get_rec_lsn();
+	checkpointer.request_checkpoint();
+	buffer_manager.unfix_page(frame, false);
+	checkpointer.stop();
+
+	// the last checkpoint starts at the master record
+	LogReader reader(logfile.get(), logfile->read_master_record(), logfile->size(),
+			LogManager::DEFAULT_LOG_READER_CHUNK_SIZE);
+	LogRecordView record;
+	bool found_end = false;
+	while (!found_end && reader.next(record)) {
+		found_end = record.type == LogManager::LogRecordType::END_FUZZY_CHECKPOINT_RECORD;
+	}
+	ASSERT_TRUE(found_end);
+	std::vector<uint64_t> tables(record.payload_size / sizeof(uint64_t));
+	memcpy(tables.data(), record.payload, record.payload_size);
+	ASSERT_EQ(tables[0], 1);
+	EXPECT_EQ(tables[1], t7);
+	ASSERT_EQ(tables[3], 1);
+	EXPECT_EQ(tables[4], page_id);
+	EXPECT_EQ(tables[5], rec_lsn);
+
+	buffer_manager.discard_all_pages();
+	logfile = std::make_unique<SegmentedLogFile>(log_directory, 1024);
+	LogManager recovered_log_manager(logfile.get());
+	recovered_log_manager.recovery(buffer_manager);
+	EXPECT_EQ(recovered_log_manager.get_total_log_records_of_type(
+			LogManager::LogRecordType::BEGIN_RECORD), 0);
+
+	EXPECT_TRUE(look(heap_segment2, transaction_manager, buffer_manager,
+			table_id, 5, false));
+	for (uint64_t field = 10; field < 22; field++) {
+		EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+				table_id, field, true));
+	}
+	std::filesystem::remove_all(log_directory);
+}
+
+/**
+ * T1 inserts into several pages but does not commits
+ * checkpoint with an I/O budget of 20 pages per second
+ * The pages are flushed at least 50ms apart
+*/
+TEST_F(LogManagerTest, TestCheckpointerIoBudget){
+	BufferManager buffer_manager(128, 10);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	uint64_t t1 = transaction_manager.start_txn();
+	for (uint64_t field = 1; field <= 12; field++) {
+		insert_row(heap_segment, transaction_manager, t1, table_id, field);
+	}
+	size_t dirty_pages = buffer_manager.get_dirty_page_ids().size();
+	EXPECT_GT(dirty_pages, 2);
+
+	Checkpointer checkpointer(log_manager, buffer_manager);
+	checkpointer.set_io_budget(20 * (BufferManager::PAGE_LSN_SIZE + buffer_manager.get_page_size()));
+	auto start = std::chrono::steady_clock::now();
+	checkpointer.request_checkpoint();
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	EXPECT_GE(elapsed, (dirty_pages - 1) * std::chrono::milliseconds(50));
+	EXPECT_EQ(log_manager.get_total_log_records_of_type(
+			LogManager::LogRecordType::END_FUZZY_CHECKPOINT_RECORD), 1);
+	EXPECT_TRUE(buffer_manager.get_dirty_page_table().empty());
+}
+
+/**
+ * T1 inserts and commits
+ * T2 inserts and commits
+ * T3 inserts but does not commits
+ * crash, the log is read in chunks smaller than a record
+ * Only T1,T2 data should be there
+*/
+TEST_F(LogManagerTest, TestSmallLogReaderChunks){
+	BufferManager buffer_manager(128, 10);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	log_manager.set_log_reader_chunk_size(32);
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	do_insert(heap_segment, transaction_manager, buffer_manager, table_id, 1, 2);
+	uint64_t t2 = transaction_manager.start_txn();
+	for (uint64_t field = 10; field < 20; field++) {
+		insert_row(heap_segment, transaction_manager, t2, table_id, field);
+	}
+	transaction_manager.commit_txn(t2);
+	uint64_t t3 = transaction_manager.start_txn();
+	for (uint64_t field = 20; field < 30; field++) {
+		insert_row(heap_segment, transaction_manager, t3, table_id, field);
+	}
+	buffer_manager.flush_all_pages(); // defeat no steal
+
+	uint64_t total = log_manager.get_total_log_records();
+	LogReader reader(logfile.get(), 0, logfile->size(), 32);
+	LogRecordView record;
+	uint64_t count = 0;
+	while (reader.next(record)) {
+		count++;
+	}
+	EXPECT_EQ(count, total);
+	EXPECT_EQ(reader.get_next_lsn(), logfile->size());
+
+	crash(transaction_manager, buffer_manager, log_manager);
+
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 1, true));
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 2, true));
+	for (uint64_t field = 10; field < 30; field++) {
+		EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+				table_id, field, field < 20));
+	}
+}
+
+/* Updates that change a few bytes of a wide tuple are logged as delta
+ * records, which are redone, rolled back from the log and undone after a crash
+*/
+TEST_F(LogManagerTest, TestDeltaUpdateRecords){
+	BufferManager buffer_manager(1024, 10);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+	// rollbacks follow the log
+	log_manager.set_undo_buffer_budget(0);
+
+	constexpr uint32_t tuple_size = 256;
+	std::vector<char> tuple(tuple_size, 'a');
+	auto write = [&](uint64_t txn_id, TID tid) {
+		heap_segment.write(tid, reinterpret_cast<std::byte *>(tuple.data()), tuple_size, txn_id);
+	};
+	auto read = [&](TID tid) {
+		std::vector<char> buf(tuple_size);
+		heap_segment.read(tid, reinterpret_cast<std::byte *>(buf.data()), tuple_size);
+		return buf;
+	};
+
+	uint64_t t1 = transaction_manager.start_txn();
+	TID tid = heap_segment.allocate(tuple_size);
+	write(t1, tid);
+	transaction_manager.add_modified_page(t1, BufferManager::get_overall_page_id(123, tid.value >> 16));
+	transaction_manager.commit_txn(t1);
+
+	// the page is not forced at commit, the update is redone after the crash
+	uint64_t t2 = transaction_manager.start_txn();
+	tuple[10] = 'b';
+	tuple[200] = 'b';
+	uint64_t lsn = log_manager.get_current_lsn();
+	write(t2, tid);
+	EXPECT_LT(log_manager.get_current_lsn() - lsn, tuple_size);
+	transaction_manager.commit_txn(t2);
+	std::vector<char> committed = tuple;
+
+	uint64_t t3 = transaction_manager.start_txn();
+	tuple[20] = 'c';
+	write(t3, tid);
+	tuple[21] = 'c';
+	write(t3, tid);
+	transaction_manager.abort_txn(t3);
+	EXPECT_EQ(read(tid), committed);
+
+	uint64_t t4 = transaction_manager.start_txn();
+	tuple[100] = 'd';
+	write(t4, tid);
+	tuple[150] = 'd';
+	write(t4, tid);
+	EXPECT_NE(read(tid), committed);
+
+	crash(transaction_manager, buffer_manager, log_manager);
+
+	EXPECT_EQ(read(tid), committed);
+}
+
 /** 
  * T1 inserts but does not commits
  * T2 inserts and commits
@@ -609,9 +2602,9 @@ TEST_F(LogManagerTest, TestFuzzyCheckpointCompletesThenCrash){
 
 	transaction_manager.commit_txn(t2);
 
-	EXPECT_EQ(log_manager.get_total_log_records(), 16);
+	EXPECT_EQ(log_manager.get_total_log_records(), 23);
 	EXPECT_EQ(log_manager.get_total_log_records_of_type(LogManager::LogRecordType::BEGIN_RECORD), 4);
-	EXPECT_EQ(log_manager.get_total_log_records_of_type(LogManager::LogRecordType::UPDATE_RECORD), 7);
+	EXPECT_EQ(log_manager.get_total_log_records_of_type(LogManager::LogRecordType::UPDATE_RECORD), 14);
 	EXPECT_EQ(log_manager.get_total_log_records_of_type(LogManager::LogRecordType::COMMIT_RECORD), 3);
 	EXPECT_EQ(log_manager.get_total_log_records_of_type(LogManager::LogRecordType::BEGIN_FUZZY_CHECKPOINT_RECORD), 1);
 	EXPECT_EQ(log_manager.get_total_log_records_of_type(LogManager::LogRecordType::END_FUZZY_CHECKPOINT_RECORD), 1);
@@ -0,0 +1,135 @@
+// Inspect a BuzzDB log: print its records, summarize them per type and per
+// transaction, and time a dry-run redo to measure the decode and replay
+// throughput of a log capture.
+//
+//   log_tool [options] <log file | segmented log directory>
+//
+// Built from this file linked with the sources under src/.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cerrno>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "log/compressed_log_file.h"
+#include "log/log_inspector.h"
+#include "log/segmented_log_file.h"
+#include "storage/file.h"
+
+namespace {
+
+void print_usage(const char* program) {
+    std::cerr << "usage: " << program << " [options] <log file | segmented log directory>\n"
+              << "  --records              print every matching record\n"
+              << "  --txns                 print a line per transaction\n"
+              << "  --txn <id>             only look at the records of a transaction\n"
+              << "  --page <id>            only look at the update and compensation records of a page\n"
+              << "  --redo                 time decoding the log and a dry-run redo\n"
+              << "  --compressed           the log file is a CompressedLogFile\n"
+              << "  --segment-size <bytes> segment size of a segmented log, by default the size\n"
+              << "                         of its first segment file\n"
+              << "  --chunk-size <bytes>   size of the reads issued to the log file\n";
+}
+
+bool parse_number(const char* text, uint64_t& value) {
+    char* end;
+    errno = 0;
+    value = strtoull(text, &end, 0);
+    return errno == 0 && end != text && *end == '\0';
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    bool print_records = false;
+    bool print_txns = false;
+    bool redo = false;
+    bool compressed = false;
+    uint64_t segment_size = 0;
+    uint64_t chunk_size = buzzdb::LogManager::DEFAULT_LOG_READER_CHUNK_SIZE;
+    buzzdb::LogFilter filter;
+    std::string path;
+
+    for (int arg = 1; arg < argc; arg++) {
+        uint64_t value = 0;
+        bool has_value = arg + 1 < argc;
+        if (strcmp(argv[arg], "--records") == 0) {
+            print_records = true;
+        } else if (strcmp(argv[arg], "--txns") == 0) {
+            print_txns = true;
+        } else if (strcmp(argv[arg], "--redo") == 0) {
+            redo = true;
+        } else if (strcmp(argv[arg], "--compressed") == 0) {
+            compressed = true;
+        } else if (strcmp(argv[arg], "--txn") == 0 && has_value && parse_number(argv[arg + 1], value)) {
+            filter.txn_id = value;
+            arg++;
+        } else if (strcmp(argv[arg], "--page") == 0 && has_value && parse_number(argv[arg + 1], value)) {
+            filter.page_id = value;
+            arg++;
+        } else if (strcmp(argv[arg], "--segment-size") == 0 && has_value && parse_number(argv[arg + 1], value) &&
+                   value > 0) {
+            segment_size = value;
+            arg++;
+        } else if (strcmp(argv[arg], "--chunk-size") == 0 && has_value && parse_number(argv[arg + 1], value) &&
+                   value > 0) {
+            chunk_size = value;
+            arg++;
+        } else if (argv[arg][0] != '-' && path.empty()) {
+            path = argv[arg];
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (path.empty() || !std::filesystem::exists(path)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    // the log is opened read-only, a missing segment is reported instead of created
+    try {
+        std::unique_ptr<buzzdb::File> log_file;
+        uint64_t start_lsn = 0;
+        if (std::filesystem::is_directory(path)) {
+            if (segment_size == 0) {
+                for (auto& entry : std::filesystem::directory_iterator(path)) {
+                    if (buzzdb::SegmentedLogFile::is_segment_name(entry.path().filename().string())) {
+                        segment_size = entry.file_size();
+                        break;
+                    }
+                }
+            }
+            if (segment_size == 0) {
+                std::cerr << path << " holds no log segments\n";
+                return 1;
+            }
+            auto segmented_log_file =
+                std::make_unique<buzzdb::SegmentedLogFile>(path, segment_size, buzzdb::File::READ);
+            start_lsn = segmented_log_file->get_start_lsn();
+            log_file = std::move(segmented_log_file);
+        } else {
+            log_file = buzzdb::File::open_file(path.c_str(), buzzdb::File::READ);
+            if (compressed) {
+                log_file = std::make_unique<buzzdb::CompressedLogFile>(std::move(log_file));
+            }
+        }
+
+        buzzdb::LogInspector inspector(log_file.get(), start_lsn, chunk_size);
+        inspector.set_filter(filter);
+        buzzdb::LogSummary summary = inspector.scan(print_records ? &std::cout : nullptr);
+        buzzdb::LogInspector::print_summary(std::cout, summary, print_txns);
+        if (redo) {
+            buzzdb::LogInspector::print_redo_timing(std::cout, inspector.time_redo());
+        }
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+    return 0;
+}